@@ -25,14 +25,71 @@ No usage or redistribution is allowed without explicit permission.
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 
 #include "ViseMessageQueue.h"
+#include "latency.h"
 #include "timing.h"
 
+bool
+absAPI::getDatasetReply( boost::property_tree::ptree &pt, std::string &reply ) const {
+
+    ASSERT(dataset_!=NULL);
+
+    if ( pt.count("dsetGetNumDocs") ){
+
+        reply= ( boost::format("%d") % dataset_->getNumDoc() ).str();
+
+    } else if ( pt.count("dsetGetFn") ){
+
+        uint32_t docID= pt.get<uint32_t>("dsetGetFn.docID");
+        reply= ( boost::format("%d") % dataset_->getFn(docID) ).str();
+
+    } else if ( pt.count("dsetGetDocID") ){
+
+        std::string fn= pt.get<std::string>("dsetGetDocID.fn");
+        reply= ( boost::format("%d") % dataset_->getDocIDFromAbsFn(fn) ).str();;
+
+    } else if ( pt.count("dsetGetWidthHeight") ){
+
+        uint32_t docID= pt.get<uint32_t>("dsetGetWidthHeight.docID");
+        std::pair<uint32_t, uint32_t> wh= dataset_->getWidthHeight(docID);
+        reply= ( boost::format("%d %d") % wh.first % wh.second ).str();
+
+    } else if ( pt.count("containsFn") ){
+
+        std::string fn= pt.get<std::string>("containsFn.fn");
+        reply= ( boost::format("%d") % dataset_->containsFn(fn) ).str();
+
+    } else
+        return false;
+
+    return true;
+}
+
+bool
+absAPI::isDatasetRequest( boost::property_tree::ptree const &pt ){
+    return pt.count("dsetGetNumDocs") || pt.count("dsetGetFn") || pt.count("dsetGetDocID") ||
+           pt.count("dsetGetWidthHeight") || pt.count("containsFn");
+}
+
+bool
+absAPI::isAdminRequest( boost::property_tree::ptree const &pt ){
+    return pt.count("reload") || pt.count("reloadStatus") ||
+           pt.count("engines") || pt.count("addEngine") || pt.count("removeEngine");
+}
+
+void
+absAPI::setAdmission( uint32_t maxRunning, uint32_t maxQueued, double requestTimeout ){
+    ASSERT(scheduler_==NULL);
+    scheduler_= new requestScheduler(maxRunning, maxQueued);
+    requestTimeout_= requestTimeout;
+}
+
 void
 absAPI::session( socket_ptr sock ){
 
@@ -64,6 +121,7 @@ absAPI::session( socket_ptr sock ){
     request= request.substr(0, request.length()-6); // remove end
 
     double t0= timing::tic();
+    double const arrival= latency::now();
 
     // parse the request
     std::stringstream ss( request );
@@ -73,41 +131,35 @@ absAPI::session( socket_ptr sock ){
 
     std::string reply;
 
-    if ( pt.count("dsetGetNumDocs") ){
-
-        reply= ( boost::format("%d") % dataset_->getNumDoc() ).str();
-
-    } else if ( pt.count("dsetGetFn") ){
-
-        uint32_t docID= pt.get<uint32_t>("dsetGetFn.docID");
-        reply= ( boost::format("%d") % dataset_->getFn(docID) ).str();
-
-    } else if ( pt.count("dsetGetDocID") ){
-
-        std::string fn= pt.get<std::string>("dsetGetDocID.fn");
-        reply= ( boost::format("%d") % dataset_->getDocIDFromAbsFn(fn) ).str();;
-
-    } else if ( pt.count("dsetGetWidthHeight") ){
-
-        uint32_t docID= pt.get<uint32_t>("dsetGetWidthHeight.docID");
-        std::pair<uint32_t, uint32_t> wh= dataset_->getWidthHeight(docID);
-        reply= ( boost::format("%d %d") % wh.first % wh.second ).str();
-
-    } else if ( pt.count("containsFn") ){
-
-        std::string fn= pt.get<std::string>("containsFn.fn");
-        reply= ( boost::format("%d") % dataset_->containsFn(fn) ).str();
-
-    } else {
+    if ( !getDatasetReply(pt, reply) ){
 
 //         std::cout<< timing::getTimeString() <<" Request= "<<request<<"\n";
 //        std::cout<< timing::getTimeString() <<" Request= "<< request.substr(0,300) << ( request.length()>300 ? " (...) \n" : "\n" ) ;
 
-        reply= getReply(pt, request);
+        // the time spent waiting for admission counts towards the timeout
+        double const timeout= pt.empty() ? requestTimeout_ : pt.front().second.get<double>("timeout", requestTimeout_);
+        double const deadline= (timeout>0) ? arrival + timeout/1000.0 : 0;
+
+        requestScheduler::admission admission= requestScheduler::admitted;
+        boost::scoped_ptr<requestScheduler::slot> slot;
+        if (scheduler_!=NULL && !isAdminRequest(pt)){
+            slot.reset( new requestScheduler::slot(*scheduler_, deadline) );
+            admission= slot->getAdmission();
+        }
 
-//         std::cout<<"Response= "<<reply<<"\n";
-//        std::cout<<"Response= "<< reply.substr(0,300) << ( reply.length()>300 ? " (...) \n" : "\n" ) ;
-        std::cout<<timing::getTimeString()<<" Request - DONE ("<< timing::toc(t0) <<" ms)\n";
+        if (admission==requestScheduler::admitted){
+            latency::deadline deadlineScope(deadline);
+            reply= getReply(pt, request);
+
+//             std::cout<<"Response= "<<reply<<"\n";
+//            std::cout<<"Response= "<< reply.substr(0,300) << ( reply.length()>300 ? " (...) \n" : "\n" ) ;
+            std::cout<<timing::getTimeString()<<" Request - DONE ("<< timing::toc(t0) <<" ms)\n";
+        } else {
+            // fast reply so that the client can back off or retry elsewhere
+            char const *reason= (admission==requestScheduler::overloaded) ? "queueFull" : "deadline";
+            reply= ( boost::format("<overloaded reason=\"%s\"/>") % reason ).str();
+            std::cout<<timing::getTimeString()<<" Request - REJECTED ("<< reason <<", "<< timing::toc(t0) <<" ms)\n";
+        }
     }
 
     boost::asio::write(*sock, boost::asio::buffer(reply));
@@ -34,6 +34,8 @@ If these 2 are not included here, before boost/asio.hpp: Arthur has some problem
 #include <boost/property_tree/ptree.hpp>
 
 #include "dataset_abs.h"
+#include "macros.h"
+#include "request_scheduler.h"
 
 using boost::asio::ip::tcp;
 typedef boost::shared_ptr<tcp::socket> socket_ptr;
@@ -43,9 +45,22 @@ class absAPI {
     
     public:
         
-        absAPI( datasetAbs const &datasetObj ) : dataset_(&datasetObj) {}
+        absAPI( datasetAbs const &datasetObj ) : dataset_(&datasetObj), scheduler_(NULL), requestTimeout_(0) {}
         
-        virtual ~absAPI() {}
+        // for APIs which don't have a fixed dataset, they have to override getDatasetReply
+        absAPI() : dataset_(NULL), scheduler_(NULL), requestTimeout_(0) {}
+        
+        virtual ~absAPI() {
+            if (scheduler_!=NULL)
+                delete scheduler_;
+        }
+        
+        // limits the number of requests processed at the same time and waiting (see requestScheduler), and
+        // sets the default timeout of requests in ms (0: none), which a request can override with its timeout
+        // field; call before server(). Dataset requests are cheap so they are never queued nor rejected, and neither
+        // are the administrative ones, so that an overloaded server can still be inspected and reloaded.
+        void
+            setAdmission( uint32_t maxRunning, uint32_t maxQueued, double requestTimeout= 0 );
         
         virtual void
             server(boost::asio::io_service& io_service, unsigned int port, std::string dsetname, std::string configFn, std::string vise_src_code_dir);
@@ -53,13 +68,31 @@ class absAPI {
         virtual std::string
             getReply( boost::property_tree::ptree &pt, std::string const &request ) const =0;
         
+        // replies to the dataset requests (dsetGetNumDocs etc.), returns false if pt isn't one of them
+        virtual bool
+            getDatasetReply( boost::property_tree::ptree &pt, std::string &reply ) const;
+        
+        // whether pt is one of the dataset requests
+        static bool
+            isDatasetRequest( boost::property_tree::ptree const &pt );
+        
+        // whether pt is one of the administrative requests (reload, reloadStatus, engines, addEngine, removeEngine)
+        static bool
+            isAdminRequest( boost::property_tree::ptree const &pt );
+        
     protected:
         
         void
             session( socket_ptr sock );
         
         datasetAbs const *dataset_;
-    
+        
+    private:
+        
+        requestScheduler *scheduler_;
+        double requestTimeout_;
+        
+        DISALLOW_COPY_AND_ASSIGN(absAPI)
 };
 
 #endif
@@ -0,0 +1,111 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "request_scheduler.h"
+
+#include <algorithm>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "latency.h"
+
+
+
+requestScheduler::requestScheduler( uint32_t maxRunning, uint32_t maxQueued )
+        : maxRunning_(std::max(maxRunning, static_cast<uint32_t>(1))),
+          maxQueued_(maxQueued),
+          numRunning_(0),
+          nextTicket_(0),
+          numOverloaded_(0),
+          numExpired_(0) {
+}
+
+
+
+requestScheduler::admission
+requestScheduler::admit( double deadline ){
+
+    boost::mutex::scoped_lock lock(lock_);
+
+    if (numRunning_ < maxRunning_ && queue_.empty()){
+        ++numRunning_;
+        return admitted;
+    }
+
+    if (queue_.size() >= maxQueued_){
+        ++numOverloaded_;
+        return overloaded;
+    }
+
+    uint64_t const ticket= nextTicket_++;
+    queue_.push_back(ticket);
+
+    while (queue_.front()!=ticket || numRunning_ >= maxRunning_){
+
+        if (deadline<=0){
+            changed_.wait(lock);
+            continue;
+        }
+
+        double const timeLeft= deadline - latency::now();
+        if (timeLeft<=0){
+            queue_.erase( std::find(queue_.begin(), queue_.end(), ticket) );
+            ++numExpired_;
+            // the next one could be at the front now
+            changed_.notify_all();
+            return expired;
+        }
+        changed_.timed_wait( lock, boost::posix_time::microseconds( static_cast<int64_t>(timeLeft*1e6) + 1 ) );
+    }
+
+    queue_.pop_front();
+    ++numRunning_;
+    // there could be more free slots
+    changed_.notify_all();
+    return admitted;
+}
+
+
+
+void
+requestScheduler::release(){
+    boost::mutex::scoped_lock lock(lock_);
+    ASSERT(numRunning_>0);
+    --numRunning_;
+    changed_.notify_all();
+}
+
+
+
+uint32_t
+requestScheduler::numRunning() const {
+    boost::mutex::scoped_lock lock(lock_);
+    return numRunning_;
+}
+
+
+
+uint32_t
+requestScheduler::numQueued() const {
+    boost::mutex::scoped_lock lock(lock_);
+    return queue_.size();
+}
+
+
+
+uint64_t
+requestScheduler::numRejected( admission reason ) const {
+    boost::mutex::scoped_lock lock(lock_);
+    return (reason==overloaded) ? numOverloaded_ : (reason==expired ? numExpired_ : 0);
+}
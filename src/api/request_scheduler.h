@@ -0,0 +1,94 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _REQUEST_SCHEDULER_H_
+#define _REQUEST_SCHEDULER_H_
+
+#include <deque>
+#include <stdint.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "macros.h"
+
+
+
+// Admission control of API requests: at most maxRunning are processed at the same time, at most maxQueued
+// more wait for a free slot (in arrival order), and the ones beyond that are rejected straight away.
+// Under a burst the server thus sheds load with fast replies instead of thrashing, as every query fans out
+// into several threads itself. A queued request also gives up once its deadline (latency::now() seconds,
+// 0: none) has passed, as the client won't wait for the reply anyway.
+class requestScheduler {
+
+    public:
+
+        enum admission { admitted, overloaded, expired };
+
+        requestScheduler( uint32_t maxRunning, uint32_t maxQueued );
+
+        // blocks until admitted (then release has to be called when done) or rejected
+        admission
+            admit( double deadline= 0 );
+
+        void
+            release();
+
+        // statistics
+        uint32_t
+            numRunning() const;
+
+        uint32_t
+            numQueued() const;
+
+        uint64_t
+            numRejected( admission reason ) const;
+
+        // admitted while it exists (if getAdmission()==admitted)
+        class slot {
+
+            public:
+
+                slot( requestScheduler &scheduler, double deadline= 0 ) :
+                    scheduler_(&scheduler), admission_(scheduler.admit(deadline)) {}
+
+                ~slot(){
+                    if (admission_==admitted)
+                        scheduler_->release();
+                }
+
+                inline admission
+                    getAdmission() const { return admission_; }
+
+            private:
+                requestScheduler *scheduler_;
+                admission const admission_;
+                DISALLOW_COPY_AND_ASSIGN(slot)
+        };
+
+    private:
+
+        uint32_t const maxRunning_, maxQueued_;
+
+        mutable boost::mutex lock_;
+        boost::condition_variable changed_;
+        uint32_t numRunning_;
+        std::deque<uint64_t> queue_; // tickets of the waiting requests, in arrival order
+        uint64_t nextTicket_;
+        uint64_t numOverloaded_, numExpired_;
+
+        DISALLOW_COPY_AND_ASSIGN(requestScheduler)
+};
+
+#endif
@@ -26,6 +26,7 @@
 
 #include "homography.h"
 #include "ellipse.h"
+#include "latency.h"
 
 #ifdef RR_REGISTER
 #include "register_images.h"
@@ -35,9 +36,14 @@
 
 
 void
-API::returnResults( std::vector<indScorePair> const &queryRes, std::map<uint32_t,homography> const *Hs, uint32_t startFrom, uint32_t numberToReturn, std::string &output ){
+API::returnResults( std::vector<indScorePair> const &queryRes, std::map<uint32_t,homography> const *Hs, uint32_t startFrom, uint32_t numberToReturn, std::string &output, uint32_t const *spatialDepth ){
 
-  output+= ( boost::format("<results size=\"%d\">") % queryRes.size() ).str();
+  latency::span span(latency::serialize);
+
+  if (spatialDepth!=NULL)
+    output+= ( boost::format("<results size=\"%d\" spatialDepth=\"%d\">") % queryRes.size() % *spatialDepth ).str();
+  else
+    output+= ( boost::format("<results size=\"%d\">") % queryRes.size() ).str();
 
   double h[9];
   uint32_t docID;
@@ -76,8 +82,9 @@ API::queryExecute( query &query_obj, uint32_t startFrom, uint32_t numberToReturn
 
   std::vector<indScorePair> queryRes;
   std::map<uint32_t,homography> Hs;
-  spatialRetriever_obj->spatialQuery( query_obj, queryRes, Hs, startFrom+numberToReturn );
-  API::returnResults(queryRes, &Hs, startFrom, numberToReturn, output);
+  uint32_t spatialDepth;
+  spatialRetriever_obj->spatialQuery( query_obj, queryRes, Hs, startFrom+numberToReturn, &spatialDepth );
+  API::returnResults(queryRes, &Hs, startFrom, numberToReturn, output, &spatialDepth);
 
 }
 
@@ -102,6 +109,55 @@ API::multipleQueries( std::vector<query> const &query_objs, uint32_t startFrom,
 
 
 
+void
+API::batchQueries( std::vector<query> const &query_objs, uint32_t startFrom, uint32_t numberToReturn, std::string &output ) const {
+
+  std::vector< std::vector<indScorePair> > queryRes;
+  std::vector< std::map<uint32_t,homography> > Hs;
+  spatialRetriever_obj->spatialQueryBatch( query_objs, queryRes, Hs, startFrom+numberToReturn );
+
+  output+= ( boost::format("<batchResults size=\"%d\">") % query_objs.size() ).str();
+  for (uint32_t i= 0; i<query_objs.size(); ++i)
+    API::returnResults(queryRes[i], &Hs[i], startFrom, numberToReturn, output);
+  output+= "</batchResults>";
+
+}
+
+
+
+// reads numQ queries given as <name>.docID%d (internal) or <name>.wordFn%d (external) and optional ROIs <name>.xl%d etc.
+static void
+getQueries( boost::property_tree::ptree &pt, std::string const &name, std::vector<query> &query_objs ){
+
+  uint32_t numQ= pt.get<uint32_t>(name+".numQ");
+
+  query_objs.clear();
+  query_objs.reserve(numQ);
+
+  for (uint32_t i=0; i<numQ; ++i){
+
+    double xl= pt.get<double>( (boost::format("%s.xl%d") % name % i).str(), -inf);
+    double xu= pt.get<double>( (boost::format("%s.xu%d") % name % i).str(),  inf);
+    double yl= pt.get<double>( (boost::format("%s.yl%d") % name % i).str(), -inf);
+    double yu= pt.get<double>( (boost::format("%s.yu%d") % name % i).str(),  inf);
+
+    boost::optional<uint32_t> docID_opt= pt.get_optional<uint32_t>( ( boost::format("%s.docID%d") % name % i).str() );
+
+    if (docID_opt.is_initialized()) {
+      // adding internal query
+      query_objs.push_back( query(*docID_opt, true, "", xl, xu, yl, yu) );
+    } else {
+      // adding external query
+      std::string wordFn= pt.get<std::string>( ( boost::format("%s.wordFn%d") % name % i).str() );
+      query_objs.push_back( query(0, false, wordFn, xl, xu, yl, yu) );
+    }
+
+  }
+
+}
+
+
+
 void
 API::processImage( std::string imageFn, std::string compDataFn, std::string &output ) const {
 
@@ -142,6 +198,8 @@ API::getPutativeMatches( query &query_obj, uint32_t docID2, std::string &output
 void
 API::returnMatches( std::vector< std::pair<ellipse,ellipse> > &matches, std::string &output ){
 
+  latency::span span(latency::serialize);
+
   uint32_t numInliers= matches.size();
   std::string el1, el2;
   ellipse el;
@@ -171,9 +229,74 @@ API::returnMatches( std::vector< std::pair<ellipse,ellipse> > &matches, std::str
 
 
 
+void
+API::nearDuplicatesQuery( query const *query_obj, bool confirm, uint32_t startFrom, uint32_t numberToReturn, std::string &output ) const {
+
+  if (nearDup_obj==NULL){
+    std::cerr << "API doesn't have nearDup_obj, so cannot execute request\n";
+    return;
+  }
+
+  nearDupConfirmer const *confirmer= confirm ? nearDupConfirmer_obj : NULL;
+
+  if (query_obj!=NULL){
+
+    std::vector<nearDupPair> dups;
+    nearDup_obj->getDuplicates( *query_obj, dups, confirmer );
+
+    latency::span span(latency::serialize);
+
+    output+= ( boost::format("<nearDuplicates size=\"%d\">") % dups.size() ).str();
+    for (uint32_t i= startFrom; i<dups.size() && i<startFrom+numberToReturn; ++i)
+      output+= ( boost::format("<nearDuplicate rank=\"%d\" docID=\"%d\" jaccard=\"%.4f\" numMatches=\"%d\"/>")
+                 % i % dups[i].docID2 % dups[i].jaccard % dups[i].numMatches ).str();
+    output+= "</nearDuplicates>";
+
+  } else {
+
+    std::vector< std::vector<uint32_t> > const &clusters= nearDupClusters(confirmer);
+
+    latency::span span(latency::serialize);
+
+    output+= ( boost::format("<clusters size=\"%d\">") % clusters.size() ).str();
+    for (uint32_t iCl= startFrom; iCl<clusters.size() && iCl<startFrom+numberToReturn; ++iCl){
+      output+= ( boost::format("<cluster rank=\"%d\" size=\"%d\">") % iCl % clusters[iCl].size() ).str();
+      for (uint32_t i= 0; i<clusters[iCl].size(); ++i)
+        output+= ( boost::format("<doc docID=\"%d\"/>") % clusters[iCl][i] ).str();
+      output+= "</cluster>";
+    }
+    output+= "</clusters>";
+
+  }
+
+}
+
+
+
+std::vector< std::vector<uint32_t> > const &
+API::nearDupClusters( nearDupConfirmer const *confirmer ) const {
+
+  uint32_t const confirmed= (confirmer!=NULL);
+  boost::mutex::scoped_lock lock(nearDupClustersLock_);
+
+  if (!nearDupClustersDone_[confirmed]){
+    std::vector<nearDupPair> pairs;
+    nearDup_obj->getAllPairs( pairs, confirmer );
+    nearDuplicates::getClusters( pairs, nearDupClusters_[confirmed] );
+    nearDupClustersDone_[confirmed]= true;
+  }
+  // never modified once computed, so safe to use without the lock
+  return nearDupClusters_[confirmed];
+}
+
+
+
 std::string
 API::getReply( boost::property_tree::ptree &pt, std::string const &request ) const {
 
+  // named after the request type, e.g. internalQuery
+  latency::queryTrace trace( pt.empty() ? "unknown" : pt.front().first );
+
   std::string reply;
 
   if ( pt.count("internalQuery") ){
@@ -220,34 +343,21 @@ API::getReply( boost::property_tree::ptree &pt, std::string const &request ) con
 
     uint32_t startFrom= pt.get("multiQuery.startFrom",0);
     uint32_t numberToReturn= pt.get("multiQuery.numberToReturn",20);
-    uint32_t numQ= pt.get<uint32_t>("multiQuery.numQ");
-
-    // queries
 
     std::vector<query> query_objs;
-    query_objs.reserve(numQ);
+    getQueries( pt, "multiQuery", query_objs );
 
-    for (uint32_t i=0; i<numQ; ++i){
-
-      double xl= pt.get<double>( (boost::format("multiQuery.xl%d") % i).str(), -inf);
-      double xu= pt.get<double>( (boost::format("multiQuery.xu%d") % i).str(),  inf);
-      double yl= pt.get<double>( (boost::format("multiQuery.yl%d") % i).str(), -inf);
-      double yu= pt.get<double>( (boost::format("multiQuery.yu%d") % i).str(),  inf);
+    multipleQueries( query_objs, startFrom, numberToReturn, reply );
 
-      boost::optional<uint32_t> docID_opt= pt.get_optional<uint32_t>( ( boost::format("multiQuery.docID%d") % i).str() );
+  } else if ( pt.count("batchQuery") ) {
 
-      if (docID_opt.is_initialized()) {
-        // adding internal query
-        query_objs.push_back( query(*docID_opt, true, "", xl, xu, yl, yu) );
-      } else {
-        // adding external query
-        std::string wordFn= pt.get<std::string>( ( boost::format("multiQuery.wordFn%d") % i).str() );
-        query_objs.push_back( query(0, false, wordFn, xl, xu, yl, yu) );
-      }
+    uint32_t startFrom= pt.get("batchQuery.startFrom",0);
+    uint32_t numberToReturn= pt.get("batchQuery.numberToReturn",20);
 
-    }
+    std::vector<query> query_objs;
+    getQueries( pt, "batchQuery", query_objs );
 
-    multipleQueries( query_objs, startFrom, numberToReturn, reply );
+    batchQueries( query_objs, startFrom, numberToReturn, reply );
 
   } else if ( pt.count("getPutativeInternalMatches") ) {
 
@@ -321,6 +431,29 @@ API::getReply( boost::property_tree::ptree &pt, std::string const &request ) con
 
 
 
+  } else if ( pt.count("nearDuplicates") ) {
+
+    // near duplicates of docID or of the image with precomputed features wordFn, or all clusters if neither is given
+    boost::optional<uint32_t> docID_opt= pt.get_optional<uint32_t>("nearDuplicates.docID");
+    boost::optional<std::string> wordFn_opt= pt.get_optional<std::string>("nearDuplicates.wordFn");
+
+    query *query_obj= NULL;
+    if (docID_opt.is_initialized())
+      query_obj= new query(*docID_opt, true);
+    else if (wordFn_opt.is_initialized())
+      query_obj= new query(0, false, *wordFn_opt);
+
+    nearDuplicatesQuery( query_obj,
+                         pt.get("nearDuplicates.confirm", true),
+                         pt.get("nearDuplicates.startFrom", 0),
+                         pt.get("nearDuplicates.numberToReturn", 20),
+                         reply );
+
+    if (query_obj!=NULL)
+      delete query_obj;
+
+
+
   } else if ( pt.count("processImage") ) {
 
     std::string imageFn= pt.get<std::string>("processImage.imageFn");
@@ -17,6 +17,9 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <string>
 #include <stdint.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
 
 #include "abs_api.h"
 #include "dataset_abs.h"
@@ -25,6 +28,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "spatial_retriever.h"
 #include "macros.h"
 #include "multi_query.h"
+#include "near_dup.h"
 
 
 
@@ -32,14 +36,22 @@ class API : public absAPI {
     
     public:
         
+        // aNearDup_obj (optional) enables the nearDuplicates request, aNearDupConfirmer_obj (optional) is
+        // used for its confirmation
         API(spatialRetriever const &aSpatialRetriever_obj,
             multiQuery const  *aMultiQuery_obj,
-            datasetAbs const &datasetObj ) :
+            datasetAbs const &datasetObj,
+            nearDuplicates const *aNearDup_obj= NULL,
+            nearDupConfirmer const *aNearDupConfirmer_obj= NULL ) :
             absAPI(datasetObj),
             spatialRetriever_obj(&aSpatialRetriever_obj),
             multiQuery_obj(aMultiQuery_obj),
-            dataset_(&datasetObj)
-                {}
+            dataset_(&datasetObj),
+            nearDup_obj(aNearDup_obj),
+            nearDupConfirmer_obj(aNearDupConfirmer_obj)
+                {
+                    nearDupClustersDone_[0]= nearDupClustersDone_[1]= false;
+                }
         
         std::string
             getReply( boost::property_tree::ptree &pt, std::string const &request ) const;
@@ -52,11 +64,16 @@ class API : public absAPI {
         void
             multipleQueries( std::vector<query> const &query_objs, uint32_t startFrom, uint32_t numberToReturn, std::string &output ) const;
         
+        // independent queries executed together, results of each are returned as in queryExecute
+        void
+            batchQueries( std::vector<query> const &query_objs, uint32_t startFrom, uint32_t numberToReturn, std::string &output ) const;
+        
         void
             processImage( std::string imageFn, std::string compDataFn, std::string &output ) const;
         
+        // spatialDepth (optional): number of spatially verified results, reported as an attribute of <results>
         static void
-            returnResults( std::vector<indScorePair> const &queryRes, std::map<uint32_t,homography> const *Hs, uint32_t startFrom, uint32_t numberToReturn, std::string &output );
+            returnResults( std::vector<indScorePair> const &queryRes, std::map<uint32_t,homography> const *Hs, uint32_t startFrom, uint32_t numberToReturn, std::string &output, uint32_t const *spatialDepth= NULL );
         
         void
             getMatches( query &query_obj, uint32_t docID2, std::string &output ) const;
@@ -67,10 +84,26 @@ class API : public absAPI {
         static void
             returnMatches( std::vector< std::pair<ellipse,ellipse> > &matches, std::string &output );
         
+        // query==NULL: clusters of all near duplicates, otherwise the near duplicates of the query
+        void
+            nearDuplicatesQuery( query const *query_obj, bool confirm, uint32_t startFrom, uint32_t numberToReturn, std::string &output ) const;
+        
+        // clusters of all near duplicates, computed on the first request as the data doesn't change
+        // (a reload constructs a new API), further requests only page through them
+        std::vector< std::vector<uint32_t> > const &
+            nearDupClusters( nearDupConfirmer const *confirmer ) const;
+        
         
         spatialRetriever const *spatialRetriever_obj;
         multiQuery const *multiQuery_obj;
         datasetAbs const *dataset_;
+        nearDuplicates const *nearDup_obj;
+        nearDupConfirmer const *nearDupConfirmer_obj;
+        
+        // [confirmed], guarded by nearDupClustersLock_ (held while computing so that it is done once)
+        mutable boost::mutex nearDupClustersLock_;
+        mutable bool nearDupClustersDone_[2];
+        mutable std::vector< std::vector<uint32_t> > nearDupClusters_[2];
         
         DISALLOW_COPY_AND_ASSIGN(API)
     
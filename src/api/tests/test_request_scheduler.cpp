@@ -0,0 +1,201 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "latency.h"
+#include "macros.h"
+#include "request_scheduler.h"
+
+
+
+// a request: waits for admission, records the order in which requests got in, and holds the slot for a bit
+void
+request( requestScheduler &scheduler, uint32_t ID, double deadline,
+         boost::mutex &lock, std::vector<uint32_t> &order, std::vector<requestScheduler::admission> &admissions ){
+    requestScheduler::slot slot(scheduler, deadline);
+    {
+        boost::mutex::scoped_lock lk(lock);
+        admissions[ID]= slot.getAdmission();
+        if (slot.getAdmission()==requestScheduler::admitted)
+            order.push_back(ID);
+    }
+    if (slot.getAdmission()==requestScheduler::admitted)
+        boost::this_thread::sleep( boost::posix_time::milliseconds(2) );
+}
+
+
+
+void
+waitForQueued( requestScheduler const &scheduler, uint32_t n ){
+    while (scheduler.numQueued()!=n)
+        boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+}
+
+
+
+// requests which had to wait are admitted in arrival order, also with several slots
+void
+testFIFO( uint32_t maxRunning ){
+
+    std::cout<<"FIFO, maxRunning= "<<maxRunning<<": \t"; std::cout.flush();
+
+    uint32_t const n= 12;
+    requestScheduler scheduler(maxRunning, n);
+    boost::mutex lock;
+    std::vector<uint32_t> order;
+    std::vector<requestScheduler::admission> admissions(n);
+
+    // take all slots so that everyone has to queue
+    std::vector<requestScheduler::slot*> held;
+    for (uint32_t i= 0; i<maxRunning; ++i){
+        held.push_back( new requestScheduler::slot(scheduler) );
+        ASSERT( held.back()->getAdmission()==requestScheduler::admitted );
+    }
+    ASSERT( scheduler.numRunning()==maxRunning );
+
+    boost::thread_group threads;
+    for (uint32_t i= 0; i<n; ++i){
+        threads.create_thread( boost::bind(request, boost::ref(scheduler), i, 0.0, boost::ref(lock), boost::ref(order), boost::ref(admissions)) );
+        // so that the arrival order is known
+        waitForQueued(scheduler, i+1);
+    }
+
+    for (uint32_t i= 0; i<maxRunning; ++i)
+        delete held[i];
+    threads.join_all();
+
+    ASSERT( order.size()==n );
+    // admitted in order, though with several slots the recording can be reordered a bit
+    for (uint32_t i= 0; i<n; ++i)
+        ASSERT( order[i] + maxRunning > i && order[i] < i + maxRunning );
+    ASSERT( scheduler.numRunning()==0 && scheduler.numQueued()==0 );
+    ASSERT( scheduler.numRejected(requestScheduler::overloaded)==0 );
+    ASSERT( scheduler.numRejected(requestScheduler::expired)==0 );
+
+    std::cout<<"OK\n";
+}
+
+
+
+// beyond maxQueued waiting requests the new ones are rejected straight away
+void
+testQueueFull(){
+
+    std::cout<<"queueFull: \t"; std::cout.flush();
+
+    uint32_t const maxQueued= 3;
+    requestScheduler scheduler(1, maxQueued);
+    boost::mutex lock;
+    std::vector<uint32_t> order;
+    std::vector<requestScheduler::admission> admissions(maxQueued);
+
+    requestScheduler::slot *held= new requestScheduler::slot(scheduler);
+    ASSERT( held->getAdmission()==requestScheduler::admitted );
+
+    boost::thread_group threads;
+    for (uint32_t i= 0; i<maxQueued; ++i){
+        threads.create_thread( boost::bind(request, boost::ref(scheduler), i, 0.0, boost::ref(lock), boost::ref(order), boost::ref(admissions)) );
+        waitForQueued(scheduler, i+1);
+    }
+
+    // fast rejection, whatever the deadline
+    double const t0= latency::now();
+    ASSERT( scheduler.admit()==requestScheduler::overloaded );
+    ASSERT( scheduler.admit(latency::now()+10)==requestScheduler::overloaded );
+    ASSERT( latency::now()-t0 < 1.0 );
+    ASSERT( scheduler.numRejected(requestScheduler::overloaded)==2 );
+    ASSERT( scheduler.numQueued()==maxQueued );
+
+    delete held;
+    threads.join_all();
+
+    ASSERT( order.size()==maxQueued );
+    for (uint32_t i= 0; i<maxQueued; ++i)
+        ASSERT( admissions[i]==requestScheduler::admitted );
+
+    // there is room again
+    ASSERT( scheduler.admit()==requestScheduler::admitted );
+    scheduler.release();
+
+    std::cout<<"OK\n";
+}
+
+
+
+// a queued request gives up at its deadline, and the ones behind it move up
+void
+testDeadline(){
+
+    std::cout<<"deadline: \t"; std::cout.flush();
+
+    requestScheduler scheduler(1, 5);
+    boost::mutex lock;
+    std::vector<uint32_t> order;
+    std::vector<requestScheduler::admission> admissions(3);
+
+    requestScheduler::slot *held= new requestScheduler::slot(scheduler);
+    ASSERT( held->getAdmission()==requestScheduler::admitted );
+
+    double const t0= latency::now(), wait= 0.2;
+    boost::thread_group threads;
+    // 0: expires while at the front of the queue, 1: no deadline, 2: long deadline
+    threads.create_thread( boost::bind(request, boost::ref(scheduler), 0, t0+wait, boost::ref(lock), boost::ref(order), boost::ref(admissions)) );
+    waitForQueued(scheduler, 1);
+    threads.create_thread( boost::bind(request, boost::ref(scheduler), 1, 0.0, boost::ref(lock), boost::ref(order), boost::ref(admissions)) );
+    waitForQueued(scheduler, 2);
+    threads.create_thread( boost::bind(request, boost::ref(scheduler), 2, t0+60, boost::ref(lock), boost::ref(order), boost::ref(admissions)) );
+    waitForQueued(scheduler, 3);
+
+    while (scheduler.numRejected(requestScheduler::expired)==0)
+        boost::this_thread::sleep( boost::posix_time::milliseconds(1) );
+    ASSERT( latency::now()-t0 >= wait );
+    ASSERT( scheduler.numQueued()==2 );
+    ASSERT( scheduler.numRunning()==1 );
+
+    // already passed
+    ASSERT( scheduler.admit(latency::now()-1)==requestScheduler::expired );
+    ASSERT( scheduler.numRejected(requestScheduler::expired)==2 );
+
+    delete held;
+    threads.join_all();
+
+    ASSERT( admissions[0]==requestScheduler::expired );
+    ASSERT( admissions[1]==requestScheduler::admitted );
+    ASSERT( admissions[2]==requestScheduler::admitted );
+    ASSERT( order.size()==2 && order[0]==1 && order[1]==2 );
+    ASSERT( scheduler.numRunning()==0 && scheduler.numQueued()==0 );
+    ASSERT( scheduler.numRejected(requestScheduler::overloaded)==0 );
+
+    std::cout<<"OK\n";
+}
+
+
+
+int main(){
+
+    testFIFO(1);
+    testFIFO(3);
+    testQueueFull();
+    testDeadline();
+
+    std::cout<<"\nAll OK\n";
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _CHAR_STREAM_CODECS_H_
+#define _CHAR_STREAM_CODECS_H_
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RR_CHAR_STREAM_CODECS_SSE2
+#endif
+
+
+
+// Compile-time specialized bulk decoders for the bit-packed charStreams (charStream4/6/10/12),
+// bit-compatible with their getNextUnsafe. payload is the serialized data without the first (size) byte,
+// values [start, start+n) are written to out. Values are decoded a whole group (of bytes and values) at a time,
+// only a partial group at the start or end of the range is decoded one by one.
+
+template <int bits>
+struct charStreamCodec;
+
+
+
+template <>
+struct charStreamCodec<4> {
+    
+    // byte= [val1 val2]
+    static uint32_t const groupVals= 2, groupBytes= 1;
+    
+    static inline uint32_t
+        get( uint8_t const *payload, uint32_t i ){
+            uint8_t const b= payload[i/2];
+            return (i%2==0) ? (b >> 4) : (b & 0x0F);
+        }
+    
+    template <class outT>
+    static inline void
+        decodeGroups( uint8_t const *bytes, uint32_t nGroups, outT *out ){
+            for (uint32_t iG= 0; iG<nGroups; ++iG, ++bytes, out+= 2){
+                out[0]= *bytes >> 4;
+                out[1]= *bytes & 0x0F;
+            }
+        }
+    
+};
+
+
+
+#ifdef RR_CHAR_STREAM_CODECS_SSE2
+
+// 16 bytes -> 32 values, high nibble first
+
+template <>
+inline void
+charStreamCodec<4>::decodeGroups<uint8_t>( uint8_t const *bytes, uint32_t nGroups, uint8_t *out ){
+    __m128i const mask= _mm_set1_epi8(0x0F);
+    uint32_t iG= 0;
+    for (; iG+16<=nGroups; iG+= 16, bytes+= 16, out+= 32){
+        __m128i const b = _mm_loadu_si128( reinterpret_cast<__m128i const*>(bytes) );
+        __m128i const hi= _mm_and_si128( _mm_srli_epi16(b, 4), mask );
+        __m128i const lo= _mm_and_si128( b, mask );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out)   , _mm_unpacklo_epi8(hi, lo) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out+16), _mm_unpackhi_epi8(hi, lo) );
+    }
+    for (; iG<nGroups; ++iG, ++bytes, out+= 2){
+        out[0]= *bytes >> 4;
+        out[1]= *bytes & 0x0F;
+    }
+}
+
+template <>
+inline void
+charStreamCodec<4>::decodeGroups<uint16_t>( uint8_t const *bytes, uint32_t nGroups, uint16_t *out ){
+    __m128i const mask= _mm_set1_epi8(0x0F);
+    __m128i const zero= _mm_setzero_si128();
+    uint32_t iG= 0;
+    for (; iG+16<=nGroups; iG+= 16, bytes+= 16, out+= 32){
+        __m128i const b = _mm_loadu_si128( reinterpret_cast<__m128i const*>(bytes) );
+        __m128i const hi= _mm_and_si128( _mm_srli_epi16(b, 4), mask );
+        __m128i const lo= _mm_and_si128( b, mask );
+        __m128i const v0= _mm_unpacklo_epi8(hi, lo), v1= _mm_unpackhi_epi8(hi, lo);
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out)   , _mm_unpacklo_epi8(v0, zero) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out+8) , _mm_unpackhi_epi8(v0, zero) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out+16), _mm_unpacklo_epi8(v1, zero) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(out+24), _mm_unpackhi_epi8(v1, zero) );
+    }
+    for (; iG<nGroups; ++iG, ++bytes, out+= 2){
+        out[0]= *bytes >> 4;
+        out[1]= *bytes & 0x0F;
+    }
+}
+
+#endif
+
+
+
+template <>
+struct charStreamCodec<6> {
+    
+    // bytes= [val1 val2(1:2)] [val2(3:6) val3(1:4)] [val3(5:6) val4]
+    static uint32_t const groupVals= 4, groupBytes= 3;
+    
+    static inline uint32_t
+        get( uint8_t const *payload, uint32_t i ){
+            uint8_t const *b= payload + (i/4)*3;
+            switch (i%4){
+                case 0:  return b[0] >> 2;
+                case 1:  return ((b[0] & 0x03) << 4) | (b[1] >> 4);
+                case 2:  return ((b[1] & 0x0F) << 2) | (b[2] >> 6);
+                default: return b[2] & 0x3F;
+            }
+        }
+    
+    template <class outT>
+    static inline void
+        decodeGroups( uint8_t const *b, uint32_t nGroups, outT *out ){
+            for (uint32_t iG= 0; iG<nGroups; ++iG, b+= 3, out+= 4){
+                out[0]= b[0] >> 2;
+                out[1]= ((b[0] & 0x03) << 4) | (b[1] >> 4);
+                out[2]= ((b[1] & 0x0F) << 2) | (b[2] >> 6);
+                out[3]= b[2] & 0x3F;
+            }
+        }
+    
+};
+
+
+
+template <>
+struct charStreamCodec<10> {
+    
+    // bytes= [val1(1:8)] [val1(9:10) val2(1:6)] [val2(7:10) val3(1:4)] [val3(5:10) val4(1:2)] [val4(3:10)]
+    static uint32_t const groupVals= 4, groupBytes= 5;
+    
+    static inline uint32_t
+        get( uint8_t const *payload, uint32_t i ){
+            uint8_t const *b= payload + (i/4)*5;
+            switch (i%4){
+                case 0:  return (static_cast<uint32_t>(b[0]) << 2) | (b[1] >> 6);
+                case 1:  return (static_cast<uint32_t>(b[1] & 0x3F) << 4) | (b[2] >> 4);
+                case 2:  return (static_cast<uint32_t>(b[2] & 0x0F) << 6) | (b[3] >> 2);
+                default: return (static_cast<uint32_t>(b[3] & 0x03) << 8) | b[4];
+            }
+        }
+    
+    template <class outT>
+    static inline void
+        decodeGroups( uint8_t const *b, uint32_t nGroups, outT *out ){
+            for (uint32_t iG= 0; iG<nGroups; ++iG, b+= 5, out+= 4){
+                out[0]= (static_cast<uint32_t>(b[0]) << 2) | (b[1] >> 6);
+                out[1]= (static_cast<uint32_t>(b[1] & 0x3F) << 4) | (b[2] >> 4);
+                out[2]= (static_cast<uint32_t>(b[2] & 0x0F) << 6) | (b[3] >> 2);
+                out[3]= (static_cast<uint32_t>(b[3] & 0x03) << 8) | b[4];
+            }
+        }
+    
+};
+
+
+
+template <>
+struct charStreamCodec<12> {
+    
+    // bytes= [val1(1:8)] [val1(9:12) val2(1:4)] [val2(5:12)]
+    static uint32_t const groupVals= 2, groupBytes= 3;
+    
+    static inline uint32_t
+        get( uint8_t const *payload, uint32_t i ){
+            uint8_t const *b= payload + (i/2)*3;
+            return (i%2==0) ?
+                (static_cast<uint32_t>(b[0]) << 4) | (b[1] >> 4) :
+                (static_cast<uint32_t>(b[1] & 0x0F) << 8) | b[2];
+        }
+    
+    template <class outT>
+    static inline void
+        decodeGroups( uint8_t const *b, uint32_t nGroups, outT *out ){
+            for (uint32_t iG= 0; iG<nGroups; ++iG, b+= 3, out+= 2){
+                out[0]= (static_cast<uint32_t>(b[0]) << 4) | (b[1] >> 4);
+                out[1]= (static_cast<uint32_t>(b[1] & 0x0F) << 8) | b[2];
+            }
+        }
+    
+};
+
+
+
+template <int bits, class outT>
+inline void
+charStreamDecode( uint8_t const *payload, uint32_t start, uint32_t n, outT *out ){
+    
+    typedef charStreamCodec<bits> codec;
+    uint32_t i= start, end= start+n;
+    
+    for (; i<end && i%codec::groupVals!=0; ++i, ++out)
+        *out= codec::get(payload, i);
+    
+    uint32_t const nGroups= (end-i)/codec::groupVals;
+    codec::decodeGroups( payload + (i/codec::groupVals)*codec::groupBytes, nGroups, out );
+    i+= nGroups*codec::groupVals;
+    out+= nGroups*codec::groupVals;
+    
+    for (; i<end; ++i, ++out)
+        *out= codec::get(payload, i);
+    
+}
+
+#endif
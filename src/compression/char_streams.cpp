@@ -81,12 +81,19 @@ charStream12::resetIter() {
 
 void
 charStream12::setIter(uint32_t index) {
-    iter_= &data_[1+(index*3)/2];
+    iter_= &data_[0] + 1+(index*3)/2;
     isFirst_= (index%2==0);
 }
 
 
 
+uint32_t
+charStream12::getIterInd() const {
+    return ( (iter_ - &data_[0] - 1)*2 )/3 + !isFirst_;
+}
+
+
+
 uint64_t
 charStream12::getNextUnsafe() {
     uint64_t value= 0;
@@ -175,12 +182,19 @@ charStream10::resetIter() {
 
 void
 charStream10::setIter(uint32_t index) {
-    iter_= &data_[1+(index*5)/4];
+    iter_= &data_[0] + 1+(index*5)/4;
     pos_= index%4;
 }
 
 
 
+uint32_t
+charStream10::getIterInd() const {
+    return ( (iter_ - &data_[0] - 1)/5 )*4 + pos_;
+}
+
+
+
 uint64_t
 charStream10::getNextUnsafe() {
     uint64_t value= static_cast<uint16_t>(*iter_ & mask1_[pos_]) << lshift1_[pos_];
@@ -266,12 +280,19 @@ charStream6::resetIter() {
 
 void
 charStream6::setIter(uint32_t index) {
-    iter_= &data_[1+(index*3)/4];
+    iter_= &data_[0] + 1+(index*3)/4;
     pos_= index%4;
 }
 
 
 
+uint32_t
+charStream6::getIterInd() const {
+    return ( (iter_ - &data_[0] - 1)/3 )*4 + pos_;
+}
+
+
+
 uint64_t
 charStream6::getNextUnsafe() {
     uint64_t value= 0;
@@ -363,12 +384,19 @@ charStream4::resetIter() {
 
 void
 charStream4::setIter(uint32_t index) {
-    iter_= &data_[1+index/2];
+    iter_= &data_[0] + 1+index/2;
     isFirstHalf_= (index%2==0);
 }
 
 
 
+uint32_t
+charStream4::getIterInd() const {
+    return (iter_ - &data_[0] - 1)*2 + !isFirstHalf_;
+}
+
+
+
 uint64_t
 charStream4::getNextUnsafe() {
     uint64_t value= *iter_;
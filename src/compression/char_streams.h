@@ -16,6 +16,7 @@ No usage or redistribution is allowed without explicit permission.
 #define _CHAR_STREAMS_H_
 
 
+#include <algorithm>
 #include <iostream>
 #include <cstring> // for memset and memcpy
 #include <math.h>
@@ -23,6 +24,7 @@ No usage or redistribution is allowed without explicit permission.
 #include <stdint.h>
 #include <vector>
 
+#include "char_stream_codecs.h"
 #include "macros.h"
 
 
@@ -55,6 +57,15 @@ class charStream {
         virtual uint64_t
             getNextUnsafe() =0;
         
+        // the next n values (read mode, like n calls to getNextUnsafe but with a single virtual call),
+        // values are truncated to the output type
+        virtual void
+            decodeNext(uint32_t n, uint8_t *out)  { for (uint32_t i= 0; i<n; ++i) out[i]= getNextUnsafe(); }
+        virtual void
+            decodeNext(uint32_t n, uint16_t *out) { for (uint32_t i= 0; i<n; ++i) out[i]= getNextUnsafe(); }
+        virtual void
+            decodeNext(uint32_t n, uint64_t *out) { for (uint32_t i= 0; i<n; ++i) out[i]= getNextUnsafe(); }
+        
         virtual void
             reserve(uint32_t n) {}
         
@@ -112,6 +123,13 @@ class charStreamNative : public charStream {
                 return *(iter_++);
             }
         
+        inline void
+            decodeNext(uint32_t n, uint8_t *out)  { decodeNextT(n, out); }
+        inline void
+            decodeNext(uint32_t n, uint16_t *out) { decodeNextT(n, out); }
+        inline void
+            decodeNext(uint32_t n, uint64_t *out) { decodeNextT(n, out); }
+        
         inline void
             reserve(uint32_t n){ data_.reserve(n); }
         
@@ -141,6 +159,14 @@ class charStreamNative : public charStream {
             { return n*sizeof(T); }
         
     private:
+        
+        template <class outT>
+        inline void
+            decodeNextT(uint32_t n, outT *out){
+                std::copy(iter_, iter_+n, out);
+                iter_+= n;
+            }
+        
         uint32_t const sizeProp_;
         std::vector<T> data_;
         T* iter_;
@@ -191,6 +217,18 @@ class charStreamNonNative : public charStream {
         virtual void
             computeNum() =0;
         
+        // index of the value getNextUnsafe would return next
+        virtual uint32_t
+            getIterInd() const =0;
+        
+        template <int bits, class outT>
+        inline void
+            decodeNextT(uint32_t n, outT *out){
+                uint32_t const ind= getIterInd();
+                charStreamDecode<bits>( &data_[0] + 1, ind, n, out );
+                setIter(ind+n);
+            }
+        
         mutable std::vector<uint8_t> data_;
         uint32_t n_;
         
@@ -210,6 +248,9 @@ class charStream12 : public charStreamNonNative {
         void resetIter();
         void setIter(uint32_t index);
         uint64_t getNextUnsafe();
+        void decodeNext(uint32_t n, uint8_t *out)  { decodeNextT<12>(n, out); }
+        void decodeNext(uint32_t n, uint16_t *out) { decodeNextT<12>(n, out); }
+        void decodeNext(uint32_t n, uint64_t *out) { decodeNextT<12>(n, out); }
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
@@ -217,6 +258,7 @@ class charStream12 : public charStreamNonNative {
     private:
         void flush() const;
         void computeNum();
+        uint32_t getIterInd() const;
         
         bool isFirst_;
         uint8_t *iter_;
@@ -237,6 +279,9 @@ class charStream10 : public charStreamNonNative {
         void resetIter();
         void setIter(uint32_t index);
         uint64_t getNextUnsafe();
+        void decodeNext(uint32_t n, uint8_t *out)  { decodeNextT<10>(n, out); }
+        void decodeNext(uint32_t n, uint16_t *out) { decodeNextT<10>(n, out); }
+        void decodeNext(uint32_t n, uint64_t *out) { decodeNextT<10>(n, out); }
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
@@ -244,6 +289,7 @@ class charStream10 : public charStreamNonNative {
     private:
         void flush() const;
         void computeNum();
+        uint32_t getIterInd() const;
         
         uint8_t *iter_;
         uint8_t pos_;
@@ -266,6 +312,9 @@ class charStream6 : public charStreamNonNative {
         void resetIter();
         void setIter(uint32_t index);
         uint64_t getNextUnsafe();
+        void decodeNext(uint32_t n, uint8_t *out)  { decodeNextT<6>(n, out); }
+        void decodeNext(uint32_t n, uint16_t *out) { decodeNextT<6>(n, out); }
+        void decodeNext(uint32_t n, uint64_t *out) { decodeNextT<6>(n, out); }
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
@@ -273,6 +322,7 @@ class charStream6 : public charStreamNonNative {
     private:
         void flush() const;
         void computeNum();
+        uint32_t getIterInd() const;
         
         uint8_t *iter_;
         uint8_t pos_;
@@ -295,6 +345,9 @@ class charStream4 : public charStreamNonNative {
         void resetIter();
         void setIter(uint32_t index);
         uint64_t getNextUnsafe();
+        void decodeNext(uint32_t n, uint8_t *out)  { decodeNextT<4>(n, out); }
+        void decodeNext(uint32_t n, uint16_t *out) { decodeNextT<4>(n, out); }
+        void decodeNext(uint32_t n, uint64_t *out) { decodeNextT<4>(n, out); }
         void reserve(uint32_t n);
         void clear();
         static uint32_t numBytesForN(uint32_t n);
@@ -302,6 +355,7 @@ class charStream4 : public charStreamNonNative {
     private:
         void flush() const;
         void computeNum();
+        uint32_t getIterInd() const;
         
         uint8_t *iter_;
         bool isFirstHalf_;
@@ -16,7 +16,11 @@ No usage or redistribution is allowed without explicit permission.
 #define _COMPRESSOR_H_
 
 
+#include <cstring> // for memcpy
+#include <stdexcept>
 #include <stdint.h>
+#include <string>
+#include <vector>
 
 #include "char_streams.h"
 #include "macros.h"
@@ -95,6 +99,43 @@ class compressorWithDistance : public compressor {
                 delete []distsSq_;
                 return n;
             }
+        
+        // distances of nVecs query vectors to all compressed vectors, distsSq is nVecs x n (n is returned)
+        virtual uint32_t
+            getDistsSq( float const vecs[], uint32_t const nVecs, std::string const &data, float *&distsSq ) const {
+                uint32_t n= 0;
+                distsSq= NULL;
+                for (uint32_t iVec= 0; iVec<nVecs; ++iVec){
+                    float *thisDistsSq;
+                    n= getDistsSq(vecs + iVec*numDims(), data, thisDistsSq);
+                    if (distsSq==NULL)
+                        distsSq= new float[nVecs*n];
+                    std::memcpy( distsSq + iVec*n, thisDistsSq, n*sizeof(float) );
+                    delete []thisDistsSq;
+                }
+                return n;
+            }
+        
+        // same as above for data which is not in a string (e.g. pointing straight into an index)
+        virtual uint32_t
+            getDistsSq( float const vecs[], uint32_t const nVecs, unsigned char const *data, uint32_t const size, float *&distsSq ) const {
+                return getDistsSq( vecs, nVecs, std::string(reinterpret_cast<char const*>(data), size), distsSq );
+            }
+        
+        // optional: approximate distances computed from a compressor-specific layout of the data,
+        // which is prepared once with fastScanPack (returns the number of vectors)
+        virtual bool
+            hasFastScan() const { return false; }
+        
+        virtual uint32_t
+            fastScanPack( std::string const &data, std::string &packed ) const {
+                throw std::runtime_error("fast-scan not supported by this compressor");
+            }
+        
+        virtual void
+            getDistsSqFastScan( float const vec[], std::string const &packed, uint32_t const n, float *distsSq ) const {
+                throw std::runtime_error("fast-scan not supported by this compressor");
+            }
     
     private:
         DISALLOW_COPY_AND_ASSIGN(compressorWithDistance);
@@ -0,0 +1,210 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "opq_train.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdexcept>
+
+#include <iostream>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <Eigen/Dense>
+
+#include <fastann.hpp>
+
+#include "clst_centres.h"
+#include "macros.h"
+
+
+
+namespace opqTrain {
+
+
+
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> rowMatrixf;
+
+
+
+// Lloyd iterations on columns [dimStart, dimStart+subDims) of Y, writes the reconstruction into Yhat
+// and returns the sum of squared errors
+double
+subQuantKMeans( rowMatrixf const &Y, uint32_t const dimStart, uint32_t const subDims,
+                uint32_t const subQuantK, uint32_t const numKMeansIter,
+                std::vector<float> &centres,
+                std::vector<float> &subVecs,
+                std::vector<unsigned> &assigns,
+                rowMatrixf &Yhat ){
+    
+    uint32_t const n= Y.rows();
+    
+    // contiguous copy of the sub-vectors for fastann
+    subVecs.resize( static_cast<uint64_t>(n)*subDims );
+    for (uint32_t i= 0; i<n; ++i)
+        for (uint32_t d= 0; d<subDims; ++d)
+            subVecs[static_cast<uint64_t>(i)*subDims + d]= Y(i, dimStart+d);
+    
+    assigns.resize(n);
+    std::vector<float> distsSq(n);
+    std::vector<double> sums( static_cast<uint64_t>(subQuantK)*subDims );
+    std::vector<uint32_t> counts(subQuantK);
+    
+    for (uint32_t iter= 0; iter<numKMeansIter; ++iter){
+        
+        // assign
+        fastann::nn_obj<float> const *nn_obj= fastann::nn_obj_build_exact( &centres[0], subQuantK, subDims );
+        nn_obj->search_nn( &subVecs[0], n, &assigns[0], &distsSq[0] );
+        delete nn_obj;
+        
+        // update
+        std::fill( sums.begin(), sums.end(), 0.0 );
+        std::fill( counts.begin(), counts.end(), 0 );
+        for (uint32_t i= 0; i<n; ++i){
+            double *sum= &sums[ static_cast<uint64_t>(assigns[i])*subDims ];
+            float const *subVec= &subVecs[ static_cast<uint64_t>(i)*subDims ];
+            for (uint32_t d= 0; d<subDims; ++d)
+                sum[d]+= subVec[d];
+            ++counts[assigns[i]];
+        }
+        
+        // empty clusters keep their old centre
+        for (uint32_t k= 0; k<subQuantK; ++k)
+            if (counts[k]>0)
+                for (uint32_t d= 0; d<subDims; ++d)
+                    centres[static_cast<uint64_t>(k)*subDims + d]= sums[static_cast<uint64_t>(k)*subDims + d] / counts[k];
+        
+    }
+    
+    // final assignment (also makes the reconstruction consistent with the final centres)
+    fastann::nn_obj<float> const *nn_obj= fastann::nn_obj_build_exact( &centres[0], subQuantK, subDims );
+    nn_obj->search_nn( &subVecs[0], n, &assigns[0], &distsSq[0] );
+    delete nn_obj;
+    
+    double err= 0.0;
+    for (uint32_t i= 0; i<n; ++i){
+        err+= distsSq[i];
+        float const *centre= &centres[ static_cast<uint64_t>(assigns[i])*subDims ];
+        for (uint32_t d= 0; d<subDims; ++d)
+            Yhat(i, dimStart+d)= centre[d];
+    }
+    
+    return err;
+    
+}
+
+
+
+void
+train( float const *vecs, uint32_t const n, uint32_t const numDims,
+       uint32_t const nSubQuant, uint32_t const subQuantK,
+       std::vector<float> &rot,
+       std::vector< std::vector<float> > &centres,
+       uint32_t const numIter, uint32_t const numKMeansIter,
+       uint32_t const seed, bool const verbose ){
+    
+    if (nSubQuant==0 || numDims % nSubQuant != 0)
+        throw std::runtime_error("OPQ: the number of dimensions has to be divisible by the number of sub-quantizers");
+    if (n < subQuantK)
+        throw std::runtime_error("OPQ: fewer training vectors than sub-quantizer centres");
+    
+    uint32_t const subDims= numDims / nSubQuant;
+    
+    Eigen::Map<rowMatrixf const> X( vecs, n, numDims );
+    Eigen::MatrixXf R= Eigen::MatrixXf::Identity( numDims, numDims );
+    rowMatrixf Y= X;
+    rowMatrixf Yhat( n, numDims );
+    
+    // initialize the centres with distinct random training vectors
+    centres.clear();
+    centres.resize( nSubQuant, std::vector<float>( static_cast<uint64_t>(subQuantK)*subDims ) );
+    {
+        boost::mt19937 gen(seed);
+        std::vector<uint32_t> perm(n);
+        for (uint32_t i= 0; i<n; ++i)
+            perm[i]= i;
+        for (uint32_t k= 0; k<subQuantK; ++k){
+            boost::uniform_int<uint32_t> dist(k, n-1);
+            boost::variate_generator<boost::mt19937&, boost::uniform_int<uint32_t> > rand(gen, dist);
+            std::swap( perm[k], perm[rand()] );
+        }
+        for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub)
+            for (uint32_t k= 0; k<subQuantK; ++k)
+                for (uint32_t d= 0; d<subDims; ++d)
+                    centres[iSub][static_cast<uint64_t>(k)*subDims + d]= X(perm[k], iSub*subDims + d);
+    }
+    
+    std::vector<float> subVecs;
+    std::vector<unsigned> assigns;
+    
+    for (uint32_t iter= 0; iter<=numIter; ++iter){
+        
+        // sub-quantizers for the current rotation
+        double err= 0.0;
+        for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub)
+            err+= subQuantKMeans( Y, iSub*subDims, subDims, subQuantK, numKMeansIter,
+                                  centres[iSub], subVecs, assigns, Yhat );
+        
+        if (verbose)
+            std::cout<<"opqTrain::train: iter= "<<iter<<" / "<<numIter<<", distortion= "<<err/n<<"\n";
+        
+        if (iter==numIter)
+            break;
+        
+        // rotation: min_R || X R^T - Yhat ||, X^T Yhat = U S V^T => R= V U^T
+        Eigen::MatrixXd M= ( X.transpose() * Yhat ).cast<double>();
+        Eigen::JacobiSVD<Eigen::MatrixXd> svd( M, Eigen::ComputeFullU | Eigen::ComputeFullV );
+        R= ( svd.matrixV() * svd.matrixU().transpose() ).cast<float>();
+        
+        Y= X * R.transpose();
+        
+    }
+    
+    rot.resize( static_cast<uint64_t>(numDims)*numDims );
+    for (uint32_t i= 0; i<numDims; ++i)
+        for (uint32_t j= 0; j<numDims; ++j)
+            rot[i*numDims + j]= R(i, j);
+    
+}
+
+
+
+void
+saveCentres( std::string const &fn, float const *centres, uint32_t const numClst, uint32_t const numDims ){
+    clstCentres::save( fn, centres, numClst, numDims );
+}
+
+
+
+void
+save( std::string const &rotFn, std::vector<std::string> const &clstFns,
+      std::vector<float> const &rot, std::vector< std::vector<float> > const &centres ){
+    
+    ASSERT( clstFns.size()==centres.size() );
+    uint32_t const nSubQuant= centres.size();
+    uint32_t const numDims= static_cast<uint32_t>( sqrt( static_cast<double>(rot.size()) ) + 0.5 );
+    ASSERT( numDims*numDims==rot.size() );
+    ASSERT( numDims % nSubQuant == 0 );
+    uint32_t const subDims= numDims / nSubQuant;
+    
+    saveCentres( rotFn, &rot[0], numDims, numDims );
+    for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub)
+        saveCentres( clstFns[iSub], &centres[iSub][0], centres[iSub].size()/subDims, subDims );
+    
+}
+
+};
@@ -0,0 +1,54 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _OPQ_TRAIN_H_
+#define _OPQ_TRAIN_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+
+// Optimized product quantization (Ge et al. CVPR 2013, non-parametric version):
+// alternates k-means of the sub-quantizers in the rotated space with the orthogonal rotation
+// which best aligns the data with its current reconstruction (Procrustes, solved with an SVD).
+// The rotation starts from the identity so the result is never worse than plain PQ on the training data.
+// The output is used by productQuant (rotation file + one cluster centre file per sub-quantizer).
+
+namespace opqTrain {
+    
+    // vecs is n x numDims (row-major), numDims has to be divisible by nSubQuant
+    // rot is numDims x numDims (row-major), the rotated vector is rot*x
+    // centres[iSub] is subQuantK x (numDims/nSubQuant) (row-major), in the rotated space
+    // numKMeansIter Lloyd iterations are done (warm-started) for every rotation update
+    void
+        train( float const *vecs, uint32_t const n, uint32_t const numDims,
+               uint32_t const nSubQuant, uint32_t const subQuantK,
+               std::vector<float> &rot,
+               std::vector< std::vector<float> > &centres,
+               uint32_t const numIter= 30, uint32_t const numKMeansIter= 4,
+               uint32_t const seed= 43, bool const verbose= true );
+    
+    // the aligned .e3bin format of clstCentres (the rotation is saved as numDims "centres")
+    void
+        saveCentres( std::string const &fn, float const *centres, uint32_t const numClst, uint32_t const numDims );
+    
+    void
+        save( std::string const &rotFn, std::vector<std::string> const &clstFns,
+              std::vector<float> const &rot, std::vector< std::vector<float> > const &centres );
+    
+};
+
+#endif
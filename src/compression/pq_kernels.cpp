@@ -0,0 +1,237 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "pq_kernels.h"
+
+#include <algorithm>
+#include <math.h>
+
+#ifdef RR_PQ_KERNELS_SIMD
+#include <immintrin.h>
+#endif
+
+
+
+namespace pqKernels {
+
+
+
+void
+adcScan8Scalar(float const *lut, uint32_t K, uint8_t const *codes, uint32_t n, uint32_t m, float *distsSq){
+
+    for (uint32_t i= 0; i<n; ++i, ++distsSq){
+        float distSq= 0.0f;
+        float const *lutJ= lut;
+        for (uint32_t j= 0; j<m; ++j, ++codes, lutJ+= K)
+            distSq+= lutJ[*codes];
+        *distsSq= distSq;
+    }
+}
+
+
+
+#ifdef RR_PQ_KERNELS_SIMD
+
+__attribute__((target("avx2")))
+void
+adcScan8AVX2(float const *lut, uint32_t K, uint8_t const *codes, uint32_t n, uint32_t m, float *distsSq){
+
+    uint32_t i= 0;
+
+    // 8 vectors at a time, each lane sums its sub-quantizer distances in the same order as the scalar version
+    for (; i+8 <= n; i+= 8, codes+= 8*m){
+
+        __m256 distSq= _mm256_setzero_ps();
+        float const *lutJ= lut;
+
+        for (uint32_t j= 0; j<m; ++j, lutJ+= K){
+            __m256i const inds= _mm256_set_epi32(
+                codes[7*m+j], codes[6*m+j], codes[5*m+j], codes[4*m+j],
+                codes[3*m+j], codes[2*m+j], codes[  m+j], codes[    j]);
+            distSq= _mm256_add_ps( distSq, _mm256_i32gather_ps(lutJ, inds, 4) );
+        }
+        _mm256_storeu_ps(distsSq+i, distSq);
+    }
+
+    if (i<n)
+        adcScan8Scalar(lut, K, codes, n-i, m, distsSq+i);
+}
+
+#endif
+
+
+
+void
+adcScan8(float const *lut, uint32_t K, uint8_t const *codes, uint32_t n, uint32_t m, float *distsSq){
+    #ifdef RR_PQ_KERNELS_SIMD
+    if (hasAVX2()){
+        adcScan8AVX2(lut, K, codes, n, m, distsSq);
+        return;
+    }
+    #endif
+    adcScan8Scalar(lut, K, codes, n, m, distsSq);
+}
+
+
+
+void
+adcScan16(float const *lut, uint32_t K, uint16_t const *codes, uint32_t n, uint32_t m, float *distsSq){
+
+    for (uint32_t i= 0; i<n; ++i, ++distsSq){
+        float distSq= 0.0f;
+        float const *lutJ= lut;
+        for (uint32_t j= 0; j<m; ++j, ++codes, lutJ+= K)
+            distSq+= lutJ[*codes];
+        *distsSq= distSq;
+    }
+}
+
+
+
+void
+fastScanPack(uint8_t const *codes, uint32_t n, uint32_t m, std::vector<uint8_t> &packed){
+
+    uint32_t const nBlocks= (n+fastScanBlock-1)/fastScanBlock;
+    packed.assign(nBlocks*m*16, 0);
+
+    for (uint32_t i= 0; i<n; ++i){
+        uint32_t const iBlock= i/fastScanBlock, b= i%fastScanBlock;
+        uint8_t *out= &packed[iBlock*m*16 + b%16];
+        uint8_t const shift= (b<16) ? 0 : 4;
+        for (uint32_t j= 0; j<m; ++j, ++codes, out+= 16)
+            *out|= static_cast<uint8_t>( (*codes & 0x0F) << shift );
+    }
+}
+
+
+
+void
+fastScanQuantizeLUT(float const *lut, uint32_t m, uint8_t *qlut, float &scale, float &bias){
+
+    // subtract the per sub-quantizer minimum and use a common scale so that the largest range maps to 255
+    float maxRange= 0.0f;
+    bias= 0.0f;
+    for (uint32_t j= 0; j<m; ++j){
+        float const *lutJ= lut + j*16;
+        float const minJ= *std::min_element(lutJ, lutJ+16);
+        float const maxJ= *std::max_element(lutJ, lutJ+16);
+        bias+= minJ;
+        maxRange= std::max(maxRange, maxJ-minJ);
+    }
+    scale= (maxRange > 0.0f) ? 255.0f/maxRange : 1.0f;
+
+    for (uint32_t j= 0; j<m; ++j){
+        float const *lutJ= lut + j*16;
+        float const minJ= *std::min_element(lutJ, lutJ+16);
+        for (uint32_t c= 0; c<16; ++c)
+            qlut[j*16+c]= static_cast<uint8_t>( std::min( 255.0f, floorf( (lutJ[c]-minJ)*scale + 0.5f ) ) );
+    }
+}
+
+
+
+void
+fastScanScalar(uint8_t const *qlut, uint8_t const *packed, uint32_t n, uint32_t m, uint16_t *accs){
+
+    uint32_t const nBlocks= (n+fastScanBlock-1)/fastScanBlock;
+
+    for (uint32_t iBlock= 0; iBlock<nBlocks; ++iBlock, accs+= fastScanBlock){
+        std::fill(accs, accs+fastScanBlock, 0);
+        uint8_t const *qlutJ= qlut;
+        for (uint32_t j= 0; j<m; ++j, packed+= 16, qlutJ+= 16)
+            for (uint32_t b= 0; b<16; ++b){
+                accs[b   ]+= qlutJ[ packed[b] & 0x0F ];
+                accs[b+16]+= qlutJ[ packed[b] >> 4   ];
+            }
+    }
+}
+
+
+
+#ifdef RR_PQ_KERNELS_SIMD
+
+__attribute__((target("ssse3")))
+void
+fastScanSSSE3(uint8_t const *qlut, uint8_t const *packed, uint32_t n, uint32_t m, uint16_t *accs){
+
+    uint32_t const nBlocks= (n+fastScanBlock-1)/fastScanBlock;
+    __m128i const lowMask= _mm_set1_epi8(0x0F);
+    __m128i const zero= _mm_setzero_si128();
+
+    for (uint32_t iBlock= 0; iBlock<nBlocks; ++iBlock, accs+= fastScanBlock){
+
+        // 16-bit accumulators for vectors 0-7, 8-15, 16-23, 24-31
+        __m128i acc0= zero, acc1= zero, acc2= zero, acc3= zero;
+        uint8_t const *qlutJ= qlut;
+
+        for (uint32_t j= 0; j<m; ++j, packed+= 16, qlutJ+= 16){
+            __m128i const lut= _mm_loadu_si128( reinterpret_cast<__m128i const*>(qlutJ) );
+            __m128i const codes= _mm_loadu_si128( reinterpret_cast<__m128i const*>(packed) );
+
+            __m128i const dLow = _mm_shuffle_epi8(lut, _mm_and_si128(codes, lowMask));
+            __m128i const dHigh= _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(codes, 4), lowMask));
+
+            acc0= _mm_add_epi16(acc0, _mm_unpacklo_epi8(dLow, zero));
+            acc1= _mm_add_epi16(acc1, _mm_unpackhi_epi8(dLow, zero));
+            acc2= _mm_add_epi16(acc2, _mm_unpacklo_epi8(dHigh, zero));
+            acc3= _mm_add_epi16(acc3, _mm_unpackhi_epi8(dHigh, zero));
+        }
+
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(accs   ), acc0 );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(accs+ 8), acc1 );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(accs+16), acc2 );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(accs+24), acc3 );
+    }
+}
+
+#endif
+
+
+
+void
+fastScan(uint8_t const *qlut, uint8_t const *packed, uint32_t n, uint32_t m, uint16_t *accs){
+    #ifdef RR_PQ_KERNELS_SIMD
+    if (hasSSSE3()){
+        fastScanSSSE3(qlut, packed, n, m, accs);
+        return;
+    }
+    #endif
+    fastScanScalar(qlut, packed, n, m, accs);
+}
+
+
+
+bool
+hasAVX2(){
+    #ifdef RR_PQ_KERNELS_SIMD
+    static bool const has= __builtin_cpu_supports("avx2");
+    return has;
+    #else
+    return false;
+    #endif
+}
+
+
+
+bool
+hasSSSE3(){
+    #ifdef RR_PQ_KERNELS_SIMD
+    static bool const has= __builtin_cpu_supports("ssse3");
+    return has;
+    #else
+    return false;
+    #endif
+}
+
+};
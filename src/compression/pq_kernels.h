@@ -0,0 +1,91 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _PQ_KERNELS_H_
+#define _PQ_KERNELS_H_
+
+#include <stdint.h>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RR_PQ_KERNELS_SIMD
+#endif
+
+
+
+// Asymmetric distance computation (ADC) for product quantization.
+// lut is the per-query lookup table, m x K (row-major), lut[j*K+c] being the squared distance
+// between the j-th query sub-vector and the c-th centre of the j-th sub-quantizer.
+// The distance of a code is then the sum over j of lut[j*K+code[j]], summed in order of j,
+// and all versions do exactly the same float operations so they produce identical distances.
+
+namespace pqKernels {
+
+    // codes: n x m bytes
+    void
+        adcScan8(float const *lut, uint32_t K, uint8_t const *codes, uint32_t n, uint32_t m, float *distsSq);
+
+    void
+        adcScan8Scalar(float const *lut, uint32_t K, uint8_t const *codes, uint32_t n, uint32_t m, float *distsSq);
+
+    #ifdef RR_PQ_KERNELS_SIMD
+    // only call if hasAVX2()
+    void
+        adcScan8AVX2(float const *lut, uint32_t K, uint8_t const *codes, uint32_t n, uint32_t m, float *distsSq);
+    #endif
+
+    // codes: n x m, for codes which don't fit in a byte
+    void
+        adcScan16(float const *lut, uint32_t K, uint16_t const *codes, uint32_t n, uint32_t m, float *distsSq);
+
+
+
+    // 4-bit "fast-scan": lookup tables are quantized to 8 bits and kept in SIMD registers,
+    // the table lookups are done 16 at a time by a byte shuffle (pshufb).
+    // Codes are packed in blocks of fastScanBlock vectors, for each sub-quantizer j 16 bytes where
+    // the low nibble of byte b is the j-th code of vector b, and the high nibble of vector b+16.
+
+    uint32_t const fastScanBlock= 32;
+
+    // codes: n x m, one code (<16) per byte; the last block is padded with 0 codes
+    void
+        fastScanPack(uint8_t const *codes, uint32_t n, uint32_t m, std::vector<uint8_t> &packed);
+
+    // lut: m x 16 floats; distance ~= bias + sum(qlut) / scale
+    void
+        fastScanQuantizeLUT(float const *lut, uint32_t m, uint8_t *qlut, float &scale, float &bias);
+
+    // accumulates the quantized distances, accs needs room for n rounded up to fastScanBlock; m<=257 (no overflow)
+    void
+        fastScan(uint8_t const *qlut, uint8_t const *packed, uint32_t n, uint32_t m, uint16_t *accs);
+
+    void
+        fastScanScalar(uint8_t const *qlut, uint8_t const *packed, uint32_t n, uint32_t m, uint16_t *accs);
+
+    #ifdef RR_PQ_KERNELS_SIMD
+    // only call if hasSSSE3()
+    void
+        fastScanSSSE3(uint8_t const *qlut, uint8_t const *packed, uint32_t n, uint32_t m, uint16_t *accs);
+    #endif
+
+    // checked at runtime as the build only assumes SSE2
+    bool
+        hasAVX2();
+
+    bool
+        hasSSSE3();
+
+};
+
+#endif
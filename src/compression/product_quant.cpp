@@ -15,13 +15,17 @@ No usage or redistribution is allowed without explicit permission.
 #include "product_quant.h"
 
 #include <math.h>
+#include <algorithm>
 #include <cstring> // for memset and memcpy
+#include <stdexcept>
 
 #include <iostream>
 
+#include "pq_kernels.h"
 
 
-productQuant::productQuant( std::vector<std::string> const &clstFns, bool enableQuantize, bool approx ) : compressorWithDistance(), nSubQuant(clstFns.size()) {
+
+productQuant::productQuant( std::vector<std::string> const &clstFns, bool enableQuantize, bool approx, std::string const &rotationFn ) : compressorWithDistance(), rot_(NULL), nSubQuant(clstFns.size()) {
     
     numDims_= 0;
     
@@ -54,12 +58,20 @@ productQuant::productQuant( std::vector<std::string> const &clstFns, bool enable
         
     }
     
+    if (!rotationFn.empty()){
+        rot_= new clstCentres( rotationFn.c_str(), true );
+        if (rot_->numClst!=numDims_ || rot_->numDims!=numDims_)
+            throw std::runtime_error("The rotation has to be numDims x numDims, where numDims is the total dimensionality of the sub-quantizers");
+    }
+    
 }
 
 
 
 productQuant::~productQuant(){
     
+    if (rot_!=NULL)
+        delete rot_;
     for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
         delete clstCentres_objs[iSub];
         if (nn_objs!=NULL)
@@ -73,12 +85,42 @@ productQuant::~productQuant(){
 
 
 
+void
+productQuant::rotate( float const vec[], float *out, bool transpose ) const {
+    
+    float const *R= rot_->clstC_flat;
+    
+    if (!transpose){
+        for (uint32_t i= 0; i<numDims_; ++i, R+= numDims_){
+            float dot= 0.0f;
+            for (uint32_t j= 0; j<numDims_; ++j)
+                dot+= R[j]*vec[j];
+            out[i]= dot;
+        }
+    } else {
+        std::fill( out, out+numDims_, 0.0f );
+        for (uint32_t i= 0; i<numDims_; ++i, R+= numDims_)
+            for (uint32_t j= 0; j<numDims_; ++j)
+                out[j]+= R[j]*vec[i];
+    }
+    
+}
+
+
+
 void
 productQuant::quantize( float const vec[], charStream &charStream_obj ) const {
     
     unsigned clusterID;
     float distSq;
     
+    std::vector<float> rotated;
+    if (rot_!=NULL){
+        rotated.resize(numDims_);
+        rotate(vec, &rotated[0]);
+        vec= &rotated[0];
+    }
+    
     float const *subVec= vec;
     for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
         nn_objs[iSub]->search_nn(subVec, 1, &clusterID, &distSq);
@@ -115,18 +157,19 @@ productQuant::compress( float const vecs[], uint32_t const n, std::string &data
 void
 productQuant::decompress( std::string const &data, float *&vecs ) const {
     
-    charStream *charStream_obj= charStreamFactoryCreate();
-    charStream_obj->setDataCopy(data);
-    uint32_t n= charStream_obj->getNum() / nSubQuant;
+    uint8_t const *codes8;
+    std::vector<uint16_t> codes16;
+    uint32_t const n= getCodes(reinterpret_cast<unsigned char const*>(data.c_str()), data.length(), codes8, codes16);
     
     vecs= new float[numDims_ * n];
     float *thisSubVec= vecs;
+    uint32_t iCode= 0;
     
     for (uint32_t i= 0; i<n; ++i){
         
-        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub, ++iCode){
             
-            unsigned subClusterID= charStream_obj->getNextUnsafe();
+            unsigned subClusterID= (codes8!=NULL) ? codes8[iCode] : codes16[iCode];
             
             std::memcpy( thisSubVec, clstCentres_objs[iSub]->clstC_flat + subClusterID * (clstCentres_objs[iSub]->numDims), clstCentres_objs[iSub]->numDims * sizeof(float) );
             
@@ -136,121 +179,196 @@ productQuant::decompress( std::string const &data, float *&vecs ) const {
         
     }
     
-    delete charStream_obj;
+    if (rot_!=NULL){
+        // back to the original space
+        std::vector<float> rotated(numDims_);
+        for (float *thisVec= vecs; thisVec!=thisSubVec; thisVec+= numDims_){
+            std::copy( thisVec, thisVec+numDims_, rotated.begin() );
+            rotate( &rotated[0], thisVec, true );
+        }
+    }
     
 }
 
 
 
-uint32_t
-productQuant::getDistsSq( float const vec[], std::string const &data, float *&distsSq ) const {
-    
-    charStream *charStream_obj= charStreamFactoryCreate();
-    charStream_obj->setDataCopy(data);
-    uint32_t n= charStream_obj->getNum() / nSubQuant;
-    distsSq= new float[n];
-    
-    // remember distances to subclusters
+void
+productQuant::computeLUT( float const vec[], float *lut ) const {
     
-    float *dists[nSubQuant];
-    bool *wasComputed[nSubQuant];
+    std::vector<float> rotated;
+    if (rot_!=NULL){
+        rotated.resize(numDims_);
+        rotate(vec, &rotated[0]);
+        vec= &rotated[0];
+    }
     
-    float const *subVecs[nSubQuant]; // don't delete as there is no allocation
-    subVecs[0]= vec;
+    float const *subVec= vec;
     
-    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
+    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub, lut+= maxSubQuantK){
         
-        if (iSub+1<nSubQuant)
-            subVecs[iSub+1]= subVecs[iSub] + clstCentres_objs[iSub]->numDims;
+        clstCentres const &cc= *clstCentres_objs[iSub];
+        float const *itC= cc.clstC_flat;
         
-        dists[iSub]= new float[ clstCentres_objs[iSub]->numClst ];
-        wasComputed[iSub]= new bool[ clstCentres_objs[iSub]->numClst ];
-        
-        // compute none - do it on demand
-        std::memset( wasComputed[iSub], 0, clstCentres_objs[iSub]->numClst * sizeof(bool) );
+        for (uint32_t iClst= 0; iClst<cc.numClst; ++iClst, itC+= cc.numDims)
+            lut[iClst]= jp_dist_l2( subVec, itC, cc.numDims );
         
+        subVec+= cc.numDims;
     }
     
-    // do the work
+}
+
+
+
+uint32_t
+productQuant::getCodes( unsigned char const *data, uint32_t const size, uint8_t const *&codes8, std::vector<uint16_t> &codes16 ) const {
+    
+    if (isNative8bit()){
+        // charStreamNative<uint8_t> is just the codes
+        codes8= data;
+        return size / nSubQuant;
+    }
     
-//     if (charStream_obj->goNative())
-//         // a lot faster
-//         getDistsSq_8bit( vec, charStream_obj->getData(), n, distsSq, dists, wasComputed, subVecs );
-//     else
-        getDistsSq_otherbits( vec, *charStream_obj, n, distsSq, dists, wasComputed, subVecs );
+    codes8= NULL;
+    charStream *charStream_obj= charStreamFactoryCreate();
+    charStream_obj->setDataCopy( std::string(reinterpret_cast<char const*>(data), size) );
+    uint32_t const n= charStream_obj->getNum() / nSubQuant;
     
+    codes16.resize(n*nSubQuant);
+    if (!codes16.empty())
+        charStream_obj->decodeNext( codes16.size(), &codes16[0] );
     
-    // free
     delete charStream_obj;
-    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
-        delete []dists[iSub];
-        delete []wasComputed[iSub];
-    }
-    
     return n;
     
 }
 
 
 
-void
-productQuant::getDistsSq_8bit( float const vec[], unsigned char *iter, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const {
+uint32_t
+productQuant::getDistsSq( float const vec[], std::string const &data, float *&distsSq ) const {
     
-    // compute distances to all points
+    uint8_t const *codes8;
+    std::vector<uint16_t> codes16;
+    uint32_t const n= getCodes(reinterpret_cast<unsigned char const*>(data.c_str()), data.length(), codes8, codes16);
+    distsSq= new float[n];
+    if (n==0)
+        return 0;
     
-    for (uint32_t i= 0; i<n; ++i){
-        
-        distsSq[i]= 0;
-        
-        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
-            
-            unsigned subClusterID= static_cast<unsigned>( *iter );
-            ++iter;
-            
-            if (!wasComputed[iSub][subClusterID]){
-                dists[iSub][subClusterID]= jp_dist_l2(
-                    subVecs[iSub],
-                    clstCentres_objs[iSub]->clstC_flat + subClusterID * (clstCentres_objs[iSub]->numDims),
-                    clstCentres_objs[iSub]->numDims );
-                wasComputed[iSub][subClusterID]= true;
-            }
-            
-            distsSq[i]+= dists[iSub][subClusterID];
-            
+    float *lut= new float[lutSize()];
+    computeLUT(vec, lut);
+    
+    if (codes8!=NULL)
+        pqKernels::adcScan8( lut, maxSubQuantK, codes8, n, nSubQuant, distsSq );
+    else
+        pqKernels::adcScan16( lut, maxSubQuantK, &codes16[0], n, nSubQuant, distsSq );
+    
+    delete []lut;
+    
+    return n;
+    
+}
+
+
+
+uint32_t
+productQuant::getDistsSq( float const vecs[], uint32_t const nVecs, std::string const &data, float *&distsSq ) const {
+    return getDistsSq( vecs, nVecs, reinterpret_cast<unsigned char const*>(data.c_str()), data.length(), distsSq );
+}
+
+
+
+uint32_t
+productQuant::getDistsSq( float const vecs[], uint32_t const nVecs, unsigned char const *data, uint32_t const size, float *&distsSq ) const {
+    
+    uint8_t const *codes8;
+    std::vector<uint16_t> codes16;
+    uint32_t const n= getCodes(data, size, codes8, codes16);
+    distsSq= new float[nVecs*n];
+    if (n==0)
+        return 0;
+    
+    uint32_t const lutSize_= lutSize();
+    float *luts= new float[nVecs*lutSize_];
+    for (uint32_t iVec= 0; iVec<nVecs; ++iVec)
+        computeLUT( vecs + iVec*numDims_, luts + iVec*lutSize_ );
+    
+    // a block of codes stays in cache while it is scanned for all queries
+    uint32_t const blockSize= 1024;
+    
+    for (uint32_t iStart= 0; iStart<n; iStart+= blockSize){
+        uint32_t const thisN= std::min(blockSize, n-iStart);
+        for (uint32_t iVec= 0; iVec<nVecs; ++iVec){
+            float const *lut= luts + iVec*lutSize_;
+            float *thisDistsSq= distsSq + iVec*n + iStart;
+            if (codes8!=NULL)
+                pqKernels::adcScan8( lut, maxSubQuantK, codes8 + iStart*nSubQuant, thisN, nSubQuant, thisDistsSq );
+            else
+                pqKernels::adcScan16( lut, maxSubQuantK, &codes16[iStart*nSubQuant], thisN, nSubQuant, thisDistsSq );
         }
-        
     }
     
+    delete []luts;
+    
+    return n;
+    
 }
 
 
 
-void
-productQuant::getDistsSq_otherbits( float const vec[], charStream &charStream_obj, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const {
+uint32_t
+productQuant::fastScanPack( std::string const &data, std::string &packed ) const {
     
-    // compute distances to all points
+    ASSERT( hasFastScan() );
     
-    for (uint32_t i= 0; i<n; ++i){
-        
-        distsSq[i]= 0;
-        
-        for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub){
-            
-            unsigned subClusterID= charStream_obj.getNextUnsafe();
-            
-            if (!wasComputed[iSub][subClusterID]){
-                dists[iSub][subClusterID]= jp_dist_l2(
-                    subVecs[iSub],
-                    clstCentres_objs[iSub]->clstC_flat + subClusterID * (clstCentres_objs[iSub]->numDims),
-                    clstCentres_objs[iSub]->numDims );
-                wasComputed[iSub][subClusterID]= true;
-            }
-            
-            distsSq[i]+= dists[iSub][subClusterID];
-            
-        }
-        
-    }
+    charStream *charStream_obj= charStreamFactoryCreate();
+    charStream_obj->setDataCopy(data);
+    uint32_t const n= charStream_obj->getNum() / nSubQuant;
+    std::vector<uint8_t> codes(n*nSubQuant);
+    if (!codes.empty())
+        charStream_obj->decodeNext( codes.size(), &codes[0] );
+    delete charStream_obj;
+    
+    std::vector<uint8_t> packedVec;
+    pqKernels::fastScanPack( codes.empty() ? NULL : &codes[0], n, nSubQuant, packedVec );
+    packed.assign( packedVec.begin(), packedVec.end() );
+    
+    return n;
+    
+}
+
+
+
+void
+productQuant::getDistsSqFastScan( float const vec[], std::string const &packed, uint32_t const n, float *distsSq ) const {
+    
+    ASSERT( hasFastScan() );
+    if (n==0)
+        return;
+    
+    // pad the lookup table to 16 entries per sub-quantizer (unused entries are never looked up)
+    float lut[nSubQuant*16];
+    std::fill(lut, lut+nSubQuant*16, 0.0f);
+    float *subLut= new float[lutSize()];
+    computeLUT(vec, subLut);
+    for (uint8_t iSub= 0; iSub<nSubQuant; ++iSub)
+        std::copy( subLut + iSub*maxSubQuantK,
+                   subLut + iSub*maxSubQuantK + clstCentres_objs[iSub]->numClst,
+                   lut + iSub*16 );
+    delete []subLut;
+    
+    uint8_t qlut[nSubQuant*16];
+    float scale, bias;
+    pqKernels::fastScanQuantizeLUT( lut, nSubQuant, qlut, scale, bias );
+    
+    uint32_t const nPadded= (n+pqKernels::fastScanBlock-1)/pqKernels::fastScanBlock * pqKernels::fastScanBlock;
+    ASSERT( packed.length() == nPadded/pqKernels::fastScanBlock * nSubQuant * 16 );
+    uint16_t *accs= new uint16_t[nPadded];
+    pqKernels::fastScan( qlut, reinterpret_cast<uint8_t const*>(packed.c_str()), n, nSubQuant, accs );
+    
+    for (uint32_t i= 0; i<n; ++i)
+        distsSq[i]= bias + accs[i]/scale;
+    
+    delete []accs;
     
 }
 
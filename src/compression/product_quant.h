@@ -39,7 +39,9 @@ class productQuant : public compressorWithDistance, public compressorIndep {
     
     public:
         
-        productQuant( std::vector<std::string> const &clstFns, bool enableQuantize= false, bool approx= false );
+        // rotationFn (optional): numDims x numDims rotation in the cluster centre format (see opqTrain),
+        // vectors are rotated before being split into sub-vectors, and clstFns are in the rotated space
+        productQuant( std::vector<std::string> const &clstFns, bool enableQuantize= false, bool approx= false, std::string const &rotationFn= "" );
         
         ~productQuant();
         
@@ -59,9 +61,37 @@ class productQuant : public compressorWithDistance, public compressorIndep {
         
         // compressorWithDistance
         
+        using compressorWithDistance::getDistsSq;
+        
         uint32_t
             getDistsSq( float const vec[], std::string const &data, float *&distsSq  ) const;
         
+        // the same lookup tables for all data, which is scanned in blocks shared by all queries
+        uint32_t
+            getDistsSq( float const vecs[], uint32_t const nVecs, std::string const &data, float *&distsSq ) const;
+        
+        uint32_t
+            getDistsSq( float const vecs[], uint32_t const nVecs, unsigned char const *data, uint32_t const size, float *&distsSq ) const;
+        
+        // 4-bit codes (all sub-quantizers with at most 16 centres)
+        bool
+            hasFastScan() const { return maxSubQuantK<=16; }
+        
+        uint32_t
+            fastScanPack( std::string const &data, std::string &packed ) const;
+        
+        // approximate as the lookup tables are quantized to 8 bits
+        void
+            getDistsSqFastScan( float const vec[], std::string const &packed, uint32_t const n, float *distsSq ) const;
+        
+        // ADC lookup table for vec, nSubQuant x maxSubQuantK, (entries past a sub-quantizer's numClst are unused);
+        // vec is rotated first if there is a rotation, as distances are preserved
+        void
+            computeLUT( float const vec[], float *lut ) const;
+        
+        inline uint32_t
+            lutSize() const { return nSubQuant*maxSubQuantK; }
+        
         // compressorIndep
         
         charStream*
@@ -76,12 +106,19 @@ class productQuant : public compressorWithDistance, public compressorIndep {
     
     private:
         
-        void
-            getDistsSq_8bit( float const vec[], unsigned char *iter, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const;
+        // codes of all vectors (n x nSubQuant), returns n; 8-bit codes are not copied (codes8 points into data),
+        // otherwise they are decoded into codes16 (and codes8 is NULL)
+        uint32_t
+            getCodes( unsigned char const *data, uint32_t const size, uint8_t const *&codes8, std::vector<uint16_t> &codes16 ) const;
+        
+        inline bool
+            isNative8bit() const { return maxSubQuantK>64 && maxSubQuantK<=256; }
         
+        // out= R*vec (or R^T*vec)
         void
-            getDistsSq_otherbits( float const vec[], charStream &charStream_obj, uint32_t const n, float *distsSq, float *dists[], bool *wasComputed[], float const *subVecs[] ) const;
+            rotate( float const vec[], float *out, bool transpose= false ) const;
         
+        clstCentres const *rot_; // NULL for plain PQ
         clstCentres const **clstCentres_objs;
         fastann::nn_obj<float> const **nn_objs;
         uint8_t const nSubQuant;
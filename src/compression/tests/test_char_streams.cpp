@@ -71,6 +71,36 @@ testStreams(uint32_t bits){
             }
         }
         
+        // bulk decoding of random ranges, followed by getNextUnsafe to check the iterator is advanced
+        std::vector<uint64_t> out64(N);
+        std::vector<uint16_t> out16(N);
+        std::vector<uint8_t> out8(N);
+        for (uint32_t iRange= 0; iRange<20; ++iRange){
+            uint32_t start= randStream.getNext0ToN(N);
+            uint32_t n= randStream.getNext0ToN(N-start);
+            
+            c2->setIter(start);
+            c2->decodeNext(n, &out64[0]);
+            for (uint32_t i= 0; i<n; ++i)
+                ASSERT( out64[i] == vals[start+i] );
+            if (start+n<N)
+                ASSERT( c2->getNextUnsafe() == vals[start+n] );
+            
+            c2->setIter(start);
+            c2->decodeNext(n, &out16[0]);
+            for (uint32_t i= 0; i<n; ++i)
+                ASSERT( out16[i] == static_cast<uint16_t>(vals[start+i]) );
+            
+            c2->setIter(start);
+            c2->decodeNext(n, &out8[0]);
+            for (uint32_t i= 0; i<n; ++i)
+                ASSERT( out8[i] == static_cast<uint8_t>(vals[start+i]) );
+        }
+        c2->resetIter();
+        c2->decodeNext(N, &out64[0]);
+        for (uint32_t i= 0; i<N; ++i)
+            ASSERT( out64[i] == vals[i] );
+        
         delete c2;
     }
     
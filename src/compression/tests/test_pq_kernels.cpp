@@ -0,0 +1,163 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "pq_kernels.h"
+#include "same_random.h"
+#include "macros.h"
+
+#include <iostream>
+#include <vector>
+
+
+
+// lengths which are not multiples of the AVX2 width (8) or the fast-scan block (32) included
+uint32_t const ns[]= {0, 1, 5, 7, 8, 9, 31, 32, 33, 63, 100, 1001};
+uint32_t const nNs= sizeof(ns)/sizeof(ns[0]);
+
+
+
+void
+testADC(uint32_t m, uint32_t K){
+
+    std::cout<<"adcScan8, m= "<<m<<", K= "<<K<<": \t"; std::cout.flush();
+
+    sameRandomUint32 rand(1000000, 43+m);
+    sameRandomStreamUint32 randStream(rand);
+
+    std::vector<float> lut(m*K);
+    for (uint32_t i= 0; i<lut.size(); ++i)
+        lut[i]= randStream.getNextFloat() * 100;
+
+    for (uint32_t iN= 0; iN<nNs; ++iN){
+        uint32_t const n= ns[iN];
+        std::vector<uint8_t> codes(n*m+1);
+        for (uint32_t i= 0; i<n*m; ++i)
+            codes[i]= randStream.getNext0ToN(K);
+
+        std::vector<float> distsRef(n+1), dists(n+1);
+        pqKernels::adcScan8Scalar(&lut[0], K, &codes[0], n, m, &distsRef[0]);
+
+        // the scalar version is the plain sum in order of sub-quantizers
+        for (uint32_t i= 0; i<n; ++i){
+            float distSq= 0.0f;
+            for (uint32_t j= 0; j<m; ++j)
+                distSq+= lut[j*K + codes[i*m+j]];
+            ASSERT( distsRef[i]==distSq );
+        }
+
+        // bit-identical, not just close
+        pqKernels::adcScan8(&lut[0], K, &codes[0], n, m, &dists[0]);
+        for (uint32_t i= 0; i<n; ++i)
+            ASSERT( dists[i]==distsRef[i] );
+
+        #ifdef RR_PQ_KERNELS_SIMD
+        if (pqKernels::hasAVX2()){
+            std::fill(dists.begin(), dists.end(), -1.0f);
+            pqKernels::adcScan8AVX2(&lut[0], K, &codes[0], n, m, &dists[0]);
+            for (uint32_t i= 0; i<n; ++i)
+                ASSERT( dists[i]==distsRef[i] );
+            ASSERT( dists[n]==-1.0f ); // nothing written past the end
+        }
+        #endif
+    }
+
+    std::cout<<"OK\n";
+}
+
+
+
+void
+testFastScan(uint32_t m){
+
+    std::cout<<"fastScan, m= "<<m<<": \t"; std::cout.flush();
+
+    sameRandomUint32 rand(1000000, 53+m);
+    sameRandomStreamUint32 randStream(rand);
+
+    std::vector<float> lut(m*16);
+    for (uint32_t i= 0; i<lut.size(); ++i)
+        lut[i]= randStream.getNextFloat() * 100;
+    std::vector<uint8_t> qlut(m*16);
+    float scale, bias;
+    pqKernels::fastScanQuantizeLUT(&lut[0], m, &qlut[0], scale, bias);
+
+    for (uint32_t iN= 0; iN<nNs; ++iN){
+        uint32_t const n= ns[iN];
+        uint32_t const nBlocks= (n+pqKernels::fastScanBlock-1)/pqKernels::fastScanBlock;
+
+        std::vector<uint8_t> codes(n*m+1);
+        for (uint32_t i= 0; i<n*m; ++i)
+            codes[i]= randStream.getNext0ToN(16);
+
+        // packing round-trip: unpack by the documented layout, and padding codes are 0
+        std::vector<uint8_t> packed;
+        pqKernels::fastScanPack(&codes[0], n, m, packed);
+        ASSERT( packed.size()==nBlocks*m*16 );
+        for (uint32_t iBlock= 0; iBlock<nBlocks; ++iBlock)
+            for (uint32_t b= 0; b<pqKernels::fastScanBlock; ++b){
+                uint32_t const i= iBlock*pqKernels::fastScanBlock + b;
+                for (uint32_t j= 0; j<m; ++j){
+                    uint8_t const byte= packed[iBlock*m*16 + j*16 + b%16];
+                    uint8_t const code= (b<16) ? (byte & 0x0F) : (byte >> 4);
+                    ASSERT( code == ((i<n) ? codes[i*m+j] : 0) );
+                }
+            }
+
+        std::vector<uint16_t> accsRef(nBlocks*pqKernels::fastScanBlock+1), accs(nBlocks*pqKernels::fastScanBlock+1);
+        pqKernels::fastScanScalar(&qlut[0], &packed[0], n, m, &accsRef[0]);
+
+        for (uint32_t i= 0; i<n; ++i){
+            uint32_t acc= 0;
+            for (uint32_t j= 0; j<m; ++j)
+                acc+= qlut[j*16 + codes[i*m+j]];
+            ASSERT( accsRef[i]==acc );
+        }
+
+        pqKernels::fastScan(&qlut[0], &packed[0], n, m, &accs[0]);
+        for (uint32_t i= 0; i<nBlocks*pqKernels::fastScanBlock; ++i)
+            ASSERT( accs[i]==accsRef[i] );
+
+        #ifdef RR_PQ_KERNELS_SIMD
+        if (pqKernels::hasSSSE3()){
+            std::fill(accs.begin(), accs.end(), 0xFFFF);
+            pqKernels::fastScanSSSE3(&qlut[0], &packed[0], n, m, &accs[0]);
+            for (uint32_t i= 0; i<nBlocks*pqKernels::fastScanBlock; ++i)
+                ASSERT( accs[i]==accsRef[i] );
+            ASSERT( accs[nBlocks*pqKernels::fastScanBlock]==0xFFFF );
+        }
+        #endif
+    }
+
+    std::cout<<"OK\n";
+}
+
+
+
+int main(){
+
+    testADC( 1, 256);
+    testADC( 4, 256);
+    testADC( 8, 256);
+    testADC(16, 256);
+    testADC( 8, 16);
+
+    testFastScan( 1);
+    testFastScan( 8);
+    testFastScan(16);
+    testFastScan(64);
+
+    std::cout<<"\nAll OK\n";
+
+    return 0;
+}
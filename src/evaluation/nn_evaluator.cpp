@@ -23,6 +23,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "thread_queue.h"
 
 #include <stdio.h>
+#include <cstring> // for memcpy
 
 
 
@@ -144,9 +145,44 @@ nnEvaluator::computeAverageRec( nnSearcher const &nnSearcher_obj, uint32_t recal
 }
 
 double
-nnEvaluator::computeRecall( uint32_t queryID, nnSearcher const &nnSearcher_obj, uint32_t recallAt, double &time ) const {
+nnEvaluator::computeAverageRecBatch( nnSearcher const &nnSearcher_obj, uint32_t recallAt, std::vector<double> *recs, bool verbose ) const {
     
-    uint32_t posID= gt[queryID][0];
+    float *qVecsFlat= new float[nQueries*numDims];
+    for (uint32_t queryID= 0; queryID<nQueries; ++queryID)
+        std::memcpy( qVecsFlat + queryID*numDims, qVecs[queryID], numDims*sizeof(float) );
+    
+    std::vector< std::vector<nnSearcher::vecIDdist> > vecIDdists;
+    
+    double time= timing::tic();
+    nnSearcher_obj.findKNN( qVecsFlat, nQueries, recallAt, vecIDdists );
+    time= timing::toc( time );
+    delete []qVecsFlat;
+    
+    if (recs!=NULL){
+        recs->clear();
+        recs->resize(nQueries, 0);
+    }
+    
+    double rec= 0.0;
+    for (uint32_t queryID= 0; queryID<nQueries; ++queryID){
+        double thisRec= computeRecall( queryID, vecIDdists[queryID], recallAt );
+        rec+= thisRec;
+        if (recs!=NULL)
+            recs->at(queryID)= thisRec;
+    }
+    rec/= nQueries;
+    
+    if (verbose)
+        printf("\n\trecall@%d= %.4f, time= %.4f s, avgTime= %.4f ms\n\n", recallAt, rec, time/1000, time/nQueries);
+    
+    return rec;
+    
+}
+
+
+
+double
+nnEvaluator::computeRecall( uint32_t queryID, nnSearcher const &nnSearcher_obj, uint32_t recallAt, double &time ) const {
     
     std::vector<nnSearcher::vecIDdist> vecIDdists;
     
@@ -155,6 +191,17 @@ nnEvaluator::computeRecall( uint32_t queryID, nnSearcher const &nnSearcher_obj,
     nnSearcher_obj.findKNN( qVecs[queryID], recallAt, vecIDdists );
     time= timing::toc( time );
     
+    return computeRecall( queryID, vecIDdists, recallAt );
+    
+}
+
+
+
+double
+nnEvaluator::computeRecall( uint32_t queryID, std::vector<nnSearcher::vecIDdist> const &vecIDdists, uint32_t recallAt ) const {
+    
+    uint32_t posID= gt[queryID][0];
+    
     ASSERT( recallAt >= vecIDdists.size() );
     if ( recallAt > vecIDdists.size() ){
         std::cout<<"warning: didn't return enough enough for recall@"<<recallAt<<" ("<<vecIDdists.size()<<")\n";
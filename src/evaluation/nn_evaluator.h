@@ -35,9 +35,16 @@ class nnEvaluator {
         double
             computeAverageRec( nnSearcher const &nnSearcher_obj, uint32_t recallAt= 100, std::vector<double> *recs= NULL, bool verbose= false, bool semiVerbose= false ) const;
         
+        // all queries in a single nnSearcher::findKNN batch call (e.g. coarseResidual's grouped, multi-threaded search)
+        double
+            computeAverageRecBatch( nnSearcher const &nnSearcher_obj, uint32_t recallAt= 100, std::vector<double> *recs= NULL, bool verbose= false ) const;
+        
         double
             computeRecall( uint32_t queryID, nnSearcher const &nnSearcher_obj, uint32_t recallAt, double &time ) const;
         
+        double
+            computeRecall( uint32_t queryID, std::vector<nnSearcher::vecIDdist> const &vecIDdists, uint32_t recallAt ) const;
+        
         typedef std::pair<double,double> recResultType;
         
     private:
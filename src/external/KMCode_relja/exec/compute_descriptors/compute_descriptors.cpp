@@ -1,5 +1,7 @@
 #include "compute_descriptors.h"
 
+#include <algorithm>
+
 #include "../../ImageContent/imageContent.h"
 #include "../../descriptor/descriptor.h"
 #include "../../ttime/ttime.h"
@@ -186,17 +188,14 @@ int lib_main(int argc, char **argv){
 // avoid read/wrie to disk and share detected points in-memory
 // updated by @Abhishek Dutta (29 Mar. 2017)
 //
-// precondition  : jpg_filename must exist and be accessible
+// precondition  : image is a float gray image, it is deleted
 // postcondition : regions contain the regions of interest
-void compute_descriptors_sift(std::string jpg_filename,
-                              std::vector<ellipse> &regions,
-                              uint32_t& feat_count,
-                              float scale_multiplier,
-                              bool upright,
-                              float *&descs ) {
-  DARY *image = new ImageContent( jpg_filename.c_str() );
-  image->toGRAY();
-  image->char2float();
+static void compute_descriptors_sift(DARY *image,
+                                     std::vector<ellipse> &regions,
+                                     uint32_t& feat_count,
+                                     float scale_multiplier,
+                                     bool upright,
+                                     float *&descs ) {
   vector< CornerDescriptor* > descriptors;
 
   // regions -> descriptors
@@ -250,6 +249,12 @@ void compute_descriptors_sift(std::string jpg_filename,
   }
 
   feat_count = descriptors.size();
+  if (feat_count == 0) {
+    regions.clear();
+    descs = new float[0];
+    delete image;
+    return;
+  }
   uint32_t desc_dim = descriptors[0]->getSize();
 
   descs = new float[ feat_count * desc_dim ];
@@ -276,6 +281,39 @@ void compute_descriptors_sift(std::string jpg_filename,
       desc_iter++;
     }
   }
+
+  for (size_t i=0; i < descriptors.size(); ++i)
+    delete descriptors[i];
+  delete image;
+}
+
+// precondition  : jpg_filename must exist and be accessible
+// postcondition : regions contain the regions of interest
+void compute_descriptors_sift(std::string jpg_filename,
+                              std::vector<ellipse> &regions,
+                              uint32_t& feat_count,
+                              float scale_multiplier,
+                              bool upright,
+                              float *&descs ) {
+  DARY *image = new ImageContent( jpg_filename.c_str() );
+  image->toGRAY();
+  image->char2float();
+  compute_descriptors_sift(image, regions, feat_count, scale_multiplier, upright, descs);
+}
+
+// precondition  : gray is a row-major width x height 8-bit gray image (already decoded)
+// postcondition : regions contain the regions of interest
+void compute_descriptors_sift(unsigned char const *gray,
+                              uint32_t width, uint32_t height,
+                              std::vector<ellipse> &regions,
+                              uint32_t& feat_count,
+                              float scale_multiplier,
+                              bool upright,
+                              float *&descs ) {
+  DARY *image = new ImageContent( height, width, "uchar" );
+  std::copy(gray, gray + static_cast<size_t>(width)*height, image->bel[0]);
+  image->char2float();
+  compute_descriptors_sift(image, regions, feat_count, scale_multiplier, upright, descs);
 }
 
 
@@ -11,4 +11,12 @@ namespace KM_compute_descriptors {
                               bool upright,
                               float *& descs
                               );
+  void compute_descriptors_sift(unsigned char const *gray,
+                              uint32_t width, uint32_t height,
+                              std::vector<ellipse> &regions,
+                              uint32_t & feat_count,
+                              float scale_multi,
+                              bool upright,
+                              float *& descs
+                              );
 }
@@ -435,19 +435,13 @@ int lib_main(int argc, char **argv){
 // avoid read/wrie to disk and share detected points in-memory
 // updated by @Abhishek Dutta (29 Mar. 2017)
 //
-// precondition  : jpg_filename must exist and be accessible
+// precondition  : image is a float gray image, it is deleted
 // postcondition : regions contain the regions of interest
-void detect_points_hesaff(std::string jpg_filename,
-                          std::vector<ellipse> &regions) {
+static void detect_points_hesaff(DARY *image,
+                                 std::vector<ellipse> &regions) {
   float threshold = 100;
   vector< CornerDescriptor* > corner_descriptors;
 
-  DARY *image = new DARY(jpg_filename.c_str());
-  image->toGRAY();
-  image->char2float();
-  long ti;
-  init_time(&ti);
-
   multi_scale_hes(image, corner_descriptors, threshold, 1.2, 16);
   regions.resize(corner_descriptors.size());
 
@@ -470,6 +464,31 @@ void detect_points_hesaff(std::string jpg_filename,
                    corner_descriptors[i]->getY(),
                    U(1,1), U(2,1), U(2,2));
   }
+
+  for (size_t i=0; i < corner_descriptors.size(); ++i)
+    delete corner_descriptors[i];
+  delete image;
+}
+
+// precondition  : jpg_filename must exist and be accessible
+// postcondition : regions contain the regions of interest
+void detect_points_hesaff(std::string jpg_filename,
+                          std::vector<ellipse> &regions) {
+  DARY *image = new DARY(jpg_filename.c_str());
+  image->toGRAY();
+  image->char2float();
+  detect_points_hesaff(image, regions);
+}
+
+// precondition  : gray is a row-major width x height 8-bit gray image (already decoded)
+// postcondition : regions contain the regions of interest
+void detect_points_hesaff(unsigned char const *gray,
+                          uint32_t width, uint32_t height,
+                          std::vector<ellipse> &regions) {
+  DARY *image = new DARY(height, width, "uchar");
+  std::copy(gray, gray + static_cast<size_t>(width)*height, image->bel[0]);
+  image->char2float();
+  detect_points_hesaff(image, regions);
 }
 
 } // end of namespace: KM_detect_points
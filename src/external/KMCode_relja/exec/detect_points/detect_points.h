@@ -5,4 +5,5 @@
 namespace KM_detect_points {
   int lib_main(int argc, char **argv);
   void detect_points_hesaff(std::string jpg_filename, std::vector<ellipse> &regions);
+  void detect_points_hesaff(unsigned char const *gray, uint32_t width, uint32_t height, std::vector<ellipse> &regions);
 }
@@ -28,11 +28,23 @@ def codeToDtype(dtypeCode):
 
 
 
+# Cluster files (.e3bin), see clstCentres in clst_centres.h:
+# - legacy: [dtypeCode u8][shape 2 x u32][info 5 x u32][distortion f32], 33 bytes, the data is not aligned
+# - aligned: [0xFF u8][dtypeCode u8][2 x 0][shape 2 x u32][info 5 x u32][distortion f32] padded to 64 bytes,
+#   so that the data can be used straight from a memory mapping
+# New files are always saved in the aligned format, both are read.
+
+clstAlignedMarker= 0xFF
+clstLegacyHeaderSize= 1 + 4*2 + 5*4 + 4
+clstAlignedHeaderSize= 64
+
+
+
 def dkmeans3_save_clusters(clst_fn, clst_data, iter_num, niters, pnt_shape, seed, distortion):
     clst_out = open(clst_fn, 'wb')
 
-    # dtype code
-    header = np.array( dtypeToCode(clst_data.dtype), 'uint8' )
+    # format marker and dtype code
+    header = np.array( [clstAlignedMarker, dtypeToCode(clst_data.dtype), 0, 0], 'uint8' )
     header.tofile(clst_out)
 
     # shape
@@ -45,6 +57,10 @@ def dkmeans3_save_clusters(clst_fn, clst_data, iter_num, niters, pnt_shape, seed
     header= np.array( distortion, 'float32' )
     header.tofile(clst_out)
 
+    # pad the header
+    header= np.zeros( clstAlignedHeaderSize - (4 + 4*2 + 5*4 + 4), 'uint8' )
+    header.tofile(clst_out)
+
     # clst_data
     clst_data.tofile(clst_out)
 
@@ -52,11 +68,21 @@ def dkmeans3_save_clusters(clst_fn, clst_data, iter_num, niters, pnt_shape, seed
 
 
 
+# returns (dtypeCode, header size), the file is positioned at the shape
+def read_clusters_format(clst_in):
+    marker= np.fromfile(clst_in, 'uint8', 1)[0]
+    if marker != clstAlignedMarker:
+        return marker, clstLegacyHeaderSize
+    dtypeCode= np.fromfile(clst_in, 'uint8', 3)[0]
+    return dtypeCode, clstAlignedHeaderSize
+
+
+
 def dkmeans3_read_clusters(clst_fn, returnAll= False):
     clst_in = open(clst_fn, 'rb')
 
     # dtype code
-    dtypeCode= np.fromfile(clst_in, 'uint8', 1)[0]
+    dtypeCode, headerSize= read_clusters_format(clst_in)
     dtype, dtypeByteSize= codeToDtype(dtypeCode)
 
     # shape
@@ -67,6 +93,7 @@ def dkmeans3_read_clusters(clst_fn, returnAll= False):
     distortion= np.fromfile(clst_in, 'float32', 1)
 
     # clst_data
+    clst_in.seek(headerSize)
     clst_data= np.fromfile(clst_in, dtype, clst_shape[0]*clst_shape[1]).reshape(clst_shape[0], clst_shape[1])
 
     clst_in.close()
@@ -78,16 +105,16 @@ def dkmeans3_read_clusters(clst_fn, returnAll= False):
 
 
 def clusters_are_corrupt(clst_fn):
-    clstHeaderSize= 1 + 4*2 + 5*4 + 4
     byteSize= os.path.getsize(clst_fn)
-    if byteSize <= clstHeaderSize:
+    if byteSize <= clstLegacyHeaderSize:
         return True
 
     clst_in = open(clst_fn, 'rb')
 
-    dtypeCode= np.fromfile(clst_in, 'uint8', 1)[0]
+    dtypeCode, clstHeaderSize= read_clusters_format(clst_in)
     dtype, dtypeByteSize= codeToDtype(dtypeCode)
     if dtype == None:
+        clst_in.close()
         return True
     clst_shape= np.fromfile(clst_in, 'uint32', 2)
 
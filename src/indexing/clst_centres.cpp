@@ -14,76 +14,109 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "clst_centres.h"
 
-#include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <stdio.h>
+#include <string.h>
 
 
 
 clstCentres::clstCentres( const char fileName[], bool flat ){
     
-    std::ifstream clstF( fileName, std::ios::in | std::ios::binary);
-    if (!clstF.is_open()){
+    try {
+        file_= new mappedFile(fileName);
+    } catch (std::exception &e) {
         std::cout<<fileName<<"\n";
         throw std::runtime_error("Unable to open cluster centre file, does it exist?");
     }
     
-    clstF.seekg(0, std::ios::end);
-    uint32_t fileSize= clstF.tellg();
-    clstF.seekg(0, std::ios::beg);
+    if (file_->size() < legacyHeaderSize){
+        delete file_;
+        std::cout<<fileName<<"\n";
+        throw std::runtime_error("Invalid cluster centre file, too small for the header");
+    }
     
-    unsigned char dtypeCode;
-    clstF.read( (char*)&dtypeCode, sizeof(dtypeCode) );
-    clstF.read( (char*)&numClst, sizeof(numClst) );
-    clstF.read( (char*)&numDims, sizeof(numDims) );
-    const uint32_t clstHeaderSize= 1 + 4*2 + 5*4 + 4;
+    unsigned char marker, dtypeCode;
+    file_->read<unsigned char>(0, 1, &marker);
+    uint32_t clstHeaderSize;
+    if (marker==alignedMarker){
+        clstHeaderSize= alignedHeaderSize;
+        if (file_->size() < clstHeaderSize){
+            delete file_;
+            std::cout<<fileName<<"\n";
+            throw std::runtime_error("Invalid cluster centre file, too small for the header");
+        }
+        file_->read<unsigned char>(1, 1, &dtypeCode);
+        file_->read<uint32_t>(4, 1, &numClst);
+        file_->read<uint32_t>(8, 1, &numDims);
+    } else {
+        clstHeaderSize= legacyHeaderSize;
+        dtypeCode= marker;
+        file_->read<uint32_t>(1, 1, &numClst);
+        file_->read<uint32_t>(5, 1, &numDims);
+    }
     
-    if ( fileSize != numClst * numDims * sizeof(float) + clstHeaderSize ){
+    if ( file_->size() != static_cast<uint64_t>(numClst) * numDims * sizeof(float) + clstHeaderSize ){
+        delete file_;
         std::cout<<fileName<<"\n";
         throw std::runtime_error("Invalid cluster centre file, header and file size contradict each other (did you give me the .h5 file instead of .e3bin)?");
     }
     
     if (dtypeCode!=4){
+        delete file_;
         throw std::runtime_error("Header states the underylying cluster type is not float - only float is supported");
     }
     
-    clstF.seekg(clstHeaderSize, std::ios::beg);
+    view_= new mappedView<float>(*file_, clstHeaderSize, static_cast<uint64_t>(numClst)*numDims);
+    // read-only: the mapping is PROT_READ
+    clstC_flat= const_cast<float*>(view_->data());
+    if (!view_->isShared())
+        std::cout<<"clstCentres::clstCentres: "<<fileName<<" is in the legacy unaligned format, the centres are copied (re-save it to share them between processes)\n";
     
     if (flat){
         
         clstC= NULL;
-        clstC_flat= new float[ numClst*numDims ];
-        clstF.read( (char*)clstC_flat, sizeof(float)*numDims*numClst );
         
     } else {
         
-        clstC_flat= NULL;
         clstC= new float*[ numClst ];
-        for (uint32_t iC= 0; iC<numClst; ++iC){
-            clstC[iC]= new float[numDims];
-            clstF.read( (char*)clstC[iC], sizeof(float)*numDims );
-        }
+        for (uint32_t iC= 0; iC<numClst; ++iC)
+            clstC[iC]= clstC_flat + static_cast<uint64_t>(iC)*numDims;
         
     }
     
-    clstF.close();
-    
 }
 
 
 
 clstCentres::~clstCentres(){
     
-    if (clstC!=NULL){
-        
-        for (uint32_t iC= 0; iC<numClst; ++iC)
-            delete []clstC[iC];
+    if (clstC!=NULL)
         delete []clstC;
     
-    }
+    delete view_;
+    delete file_;
     
-    if (clstC_flat!=NULL){
-        delete []clstC_flat;
-    }
+}
+
+
+
+void
+clstCentres::save( std::string const &fileName, float const *centres, uint32_t numClst, uint32_t numDims ){
+    
+    FILE *f= fopen(fileName.c_str(), "wb");
+    if (f==NULL)
+        throw std::runtime_error( std::string("Failed to open for writing: ") + fileName );
+    
+    // k-means info (iterations, number of points, seed, distortion) is unknown here and left as zeros
+    unsigned char header[alignedHeaderSize]= {0};
+    header[0]= alignedMarker;
+    header[1]= 4; // float
+    memcpy( header+4, &numClst, sizeof(numClst) );
+    memcpy( header+8, &numDims, sizeof(numDims) );
+    fwrite( header, 1, alignedHeaderSize, f );
+    fwrite( centres, sizeof(float), static_cast<uint64_t>(numClst)*numDims, f );
+    
+    fclose(f);
     
 }
@@ -16,7 +16,21 @@ No usage or redistribution is allowed without explicit permission.
 #define _CLST_CENTRES_H_
 
 #include <stdint.h>
+#include <string>
 
+#include "macros.h"
+#include "mapped_file.h"
+
+
+// The file is memory mapped, clstC_flat points into the mapping if the data is aligned
+// (otherwise it is copied once), and clstC[iC] (if !flat) points to the iC-th centre inside clstC_flat.
+// Centres are read-only.
+//
+// .e3bin formats:
+// - legacy: [dtypeCode u8][numClst u32][numDims u32][5 x u32 k-means info][distortion f32], 33 bytes,
+//   so the float data is never aligned and always gets copied
+// - aligned: [0xFF u8][dtypeCode u8][2 x 0][numClst u32][numDims u32][5 x u32 k-means info][distortion f32]
+//   zero padded to 64 bytes, the data is used straight from the mapping and shared between processes
 
 class clstCentres {
     
@@ -26,10 +40,28 @@ class clstCentres {
         
         ~clstCentres();
         
+        // writes float centres in the aligned format
+        static void
+            save( std::string const &fileName, float const *centres, uint32_t numClst, uint32_t numDims );
+        
+        // false for legacy files, whose centres are copied into private memory
+        inline bool
+            isShared() const { return view_->isShared(); }
+        
         uint32_t numClst, numDims;
         float **clstC;
         float *clstC_flat;
+        
+        static const unsigned char alignedMarker= 0xFF;
+        static const uint32_t legacyHeaderSize= 1 + 4*2 + 5*4 + 4;
+        static const uint32_t alignedHeaderSize= 64;
     
+    private:
+        
+        mappedFile *file_;
+        mappedView<float> *view_;
+        
+        DISALLOW_COPY_AND_ASSIGN(clstCentres)
 };
 
 #endif
@@ -15,10 +15,11 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _DESC_FROM_FLAT_FILE_H_
 #define _DESC_FROM_FLAT_FILE_H_
 
-#include <stdio.h>
 #include <stdint.h>
+#include <string>
 
 #include "desc_getter_from_file.h"
+#include "mapped_file.h"
 #include "util.h"
 #include "macros.h"
 
@@ -28,7 +29,7 @@ class descFromFlatFile : public descGetterFromFile {
     
     public:
         
-        descFromFlatFile( const char fn[], uint32_t dim, uint32_t aNumDescPerDoc= 1, uint32_t aKeepFirstDim= 0, bool aDoNormalize= true ) : numDimsOrig_(dim), numDescPerDoc(aNumDescPerDoc), doNormalize(aDoNormalize) {
+        descFromFlatFile( const char fn[], uint32_t dim, uint32_t aNumDescPerDoc= 1, uint32_t aKeepFirstDim= 0, bool aDoNormalize= true ) : file_(fn), numDimsOrig_(dim), numDescPerDoc(aNumDescPerDoc), doNormalize(aDoNormalize) {
             
             if (aKeepFirstDim==0)
                 numDims_= numDimsOrig_;
@@ -36,17 +37,17 @@ class descFromFlatFile : public descGetterFromFile {
                 numDims_= aKeepFirstDim;
             ASSERT( numDims_ <= numDimsOrig_ );
             
-            uint64_t fileSize= util::fileSize(fn);
+            uint64_t fileSize= file_.size();
             ASSERT( fileSize % (dim*sizeof(float)*numDescPerDoc) == 0 );
             numDocs_= fileSize/(dim*sizeof(float)*numDescPerDoc);
             
-            f= fopen(fn,"rb");
-            f_d= fileno(f);
+            // no header so the floats are aligned and shared with other processes
+            descs_= new mappedView<float>(file_, 0, fileSize/sizeof(float));
             
         }
         
         ~descFromFlatFile(){
-            fclose(f);
+            delete descs_;
         }
         
         void
@@ -55,17 +56,14 @@ class descFromFlatFile : public descGetterFromFile {
                 numDescs= numDescPerDoc;
                 descs= new float[numDescs*numDims_];
                 
-                size_t temp_;
-                uint64_t offset= static_cast<uint64_t>(numDimsOrig_)*docID*numDescPerDoc*sizeof(float);
+                float const *in= descs_->data() + static_cast<uint64_t>(numDimsOrig_)*docID*numDescPerDoc;
                 for (uint32_t iDesc= 0; iDesc<numDescs; ++iDesc){
-                    temp_= pread64(f_d, descs+iDesc*numDims_, numDims_*sizeof(float), offset);
-                    offset+= numDimsOrig_*sizeof(float);
+                    std::memcpy(descs+iDesc*numDims_, in, numDims_*sizeof(float));
+                    in+= numDimsOrig_;
                     if (doNormalize)
                         util::l2normalize(descs+iDesc*numDims_, numDims_);
                 }
                 
-                if (false && temp_) {} // to avoid the warning about not checking temp_
-                
             }
         
         uint32_t
@@ -76,11 +74,13 @@ class descFromFlatFile : public descGetterFromFile {
     
     private:
         
-        FILE *f;
-        int f_d;
+        mappedFile file_;
+        mappedView<float> *descs_;
         uint32_t const numDimsOrig_, numDescPerDoc;
         bool doNormalize;
         uint32_t numDims_, numDocs_;
+        
+        DISALLOW_COPY_AND_ASSIGN(descFromFlatFile)
     
 };
 
@@ -15,10 +15,10 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _DESC_FROM_FVECS_FILE_H_
 #define _DESC_FROM_FVECS_FILE_H_
 
-#include <stdio.h>
 #include <stdint.h>
 
 #include "desc_getter_from_file.h"
+#include "mapped_file.h"
 #include "util.h"
 #include "macros.h"
 
@@ -28,26 +28,18 @@ class descFromFvecsFile : public descGetterFromFile {
     
     public:
         
-        descFromFvecsFile( const char fn[] ){
+        descFromFvecsFile( const char fn[] ) : file_(fn) {
             
-            uint64_t fileSize= util::fileSize(fn);
-            
-            f= fopen(fn,"rb");
-            f_d= fileno(f);
+            uint64_t fileSize= file_.size();
             
             int d;
-            size_t temp_= fread(&d, sizeof(int), 1, f);
-            if (false && temp_) {} // to avoid the warning about not checking temp_
+            file_.read<int>(0, 1, &d);
             numDims_= static_cast<uint32_t>(d);
             ASSERT( fileSize % ((d+1)*4) == 0 );
             numDocs_= fileSize/((d+1)*4);
             
         }
         
-        ~descFromFvecsFile(){
-            fclose(f);
-        }
-        
         void
             getDescs( uint32_t docID, uint32_t &numDescs, float *&descs ) const {
                 
@@ -56,12 +48,10 @@ class descFromFvecsFile : public descGetterFromFile {
                 numDescs= 1;
                 descs= new float[numDims_];
                 
-                size_t temp_;
-                temp_= pread64(f_d, &d_, sizeof(int), (numDims_+1)*docID*sizeof(float));
+                uint64_t const offset= static_cast<uint64_t>(numDims_+1)*docID*sizeof(float);
+                file_.read<int>(offset, 1, &d_);
                 ASSERT( static_cast<uint32_t>(d_)==numDims_ ); // check dimension is ok
-                temp_= pread64(f_d, descs, numDims_*sizeof(float), ((numDims_+1)*docID+1)*sizeof(float));
-                
-                if (false && temp_) {} // to avoid the warning about not checking temp_
+                file_.read<float>(offset+sizeof(float), numDims_, descs);
                 
             }
         
@@ -73,9 +63,10 @@ class descFromFvecsFile : public descGetterFromFile {
     
     private:
         
-        FILE *f;
-        int f_d;
+        mappedFile file_;
         uint32_t numDims_, numDocs_;
+        
+        DISALLOW_COPY_AND_ASSIGN(descFromFvecsFile)
     
 };
 
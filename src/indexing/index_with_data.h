@@ -44,6 +44,13 @@ class indexWithData {
         // returns the same value as getNumWithID(ID)
         virtual uint32_t
             getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const =0;
+        
+        // access to the data without allocating and copying, possible only if the index keeps it in RAM:
+        // returns false if not supported (use getData instead), otherwise vecIDs and data point into the index
+        virtual bool
+            getDataNoCopy( uint32_t ID, std::vector<uint32_t> const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                return false;
+            }
     
 };
 
@@ -115,6 +122,20 @@ class indexWithDataInRam : public indexWithData {
                 vecIDs= vecIDss[ID];
                 return Ns[ID];
             }
+        
+        bool
+            getDataNoCopy( uint32_t ID, std::vector<uint32_t> const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                if (ID>=numIDs_) {
+                    vecIDs= &empty_;
+                    data= NULL;
+                    size= 0;
+                    return true;
+                }
+                vecIDs= &vecIDss[ID];
+                data= datas[ID];
+                size= sizes[ID];
+                return true;
+            }
     
     private:
         
@@ -122,6 +143,7 @@ class indexWithDataInRam : public indexWithData {
         std::vector<uint32_t> Ns, sizes;
         std::vector< std::vector<uint32_t> > vecIDss;
         std::vector<unsigned char *> datas;
+        std::vector<uint32_t> const empty_;
     
 };
 
@@ -146,6 +168,8 @@ class indexWithDataInRamStartDisk : public indexWithData {
             getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const {
                 return slowCons_.getObject()->getData(ID, vecIDs, data, size);
             }
+        
+        // no getDataNoCopy as the object being pointed into can be swapped (and deleted) at any time
     
     private:
         
@@ -183,6 +207,12 @@ class indexesWithData : public indexWithData {
                 uint32_t ind= whichIdx(ID);
                 return idxs_->at(ind)->getData(ID-offsets_.at(ind), vecIDs, data, size);
             }
+        
+        bool
+            getDataNoCopy( uint32_t ID, std::vector<uint32_t> const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                uint32_t ind= whichIdx(ID);
+                return idxs_->at(ind)->getDataNoCopy(ID-offsets_.at(ind), vecIDs, data, size);
+            }
     
     protected:
         
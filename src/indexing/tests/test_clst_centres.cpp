@@ -0,0 +1,89 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "clst_centres.h"
+
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "macros.h"
+#include "util.h"
+
+
+
+void
+check( clstCentres const &clst, std::vector<float> const &centres, uint32_t numClst, uint32_t numDims ){
+    ASSERT( clst.numClst==numClst && clst.numDims==numDims );
+    for (uint32_t i= 0; i<numClst*numDims; ++i)
+        ASSERT( clst.clstC_flat[i]==centres[i] );
+    for (uint32_t iC= 0; iC<numClst; ++iC)
+        ASSERT( clst.clstC[iC][0]==centres[iC*numDims] );
+}
+
+
+
+// as written by the old dkmeans / opqTrain, 33 byte header
+void
+saveLegacy( std::string const &fn, std::vector<float> const &centres, uint32_t numClst, uint32_t numDims ){
+    FILE *f= fopen(fn.c_str(), "wb");
+    ASSERT(f!=NULL);
+    unsigned char const dtypeCode= 4;
+    char const info[5*4 + 4]= {0};
+    fwrite( &dtypeCode, 1, 1, f );
+    fwrite( &numClst, sizeof(numClst), 1, f );
+    fwrite( &numDims, sizeof(numDims), 1, f );
+    fwrite( info, 1, sizeof(info), f );
+    fwrite( &centres[0], sizeof(float), centres.size(), f );
+    fclose(f);
+}
+
+
+
+int main(){
+    
+    uint32_t const numClst= 100, numDims= 37;
+    std::vector<float> centres(numClst*numDims);
+    for (uint32_t i= 0; i<centres.size(); ++i)
+        centres[i]= i*0.5f - 7;
+    
+    std::string const fn= util::getTempFileName("", "test_clst_centres_", ".e3bin");
+    
+    // aligned format: used straight from the mapping
+    {
+        clstCentres::save( fn, &centres[0], numClst, numDims );
+        ASSERT( boost::filesystem::file_size(fn) == clstCentres::alignedHeaderSize + centres.size()*sizeof(float) );
+        clstCentres clst( fn.c_str() );
+        check( clst, centres, numClst, numDims );
+        ASSERT( clst.isShared() );
+        std::cout<<"aligned: OK\n";
+    }
+    
+    // legacy format: still readable, but copied
+    {
+        saveLegacy( fn, centres, numClst, numDims );
+        clstCentres clst( fn.c_str() );
+        check( clst, centres, numClst, numDims );
+        ASSERT( !clst.isShared() );
+        std::cout<<"legacy: OK\n";
+    }
+    
+    boost::filesystem::remove(fn);
+    
+    std::cout<<"\nAll OK\n";
+    
+    return 0;
+}
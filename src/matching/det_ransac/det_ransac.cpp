@@ -16,6 +16,8 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <Eigen/Dense>
 
+#include "inlier_kernels.h"
+#include "latency.h"
 #include "putative.h"
 
 
@@ -146,7 +148,9 @@ detRansac::match(
     uint32_t nReest,
     
     homography *H,
-    matchesType *inlierInds
+    matchesType *inlierInds,
+    
+    std::vector<double> const *hypQuality
     
     ){
     
@@ -190,7 +194,25 @@ detRansac::match(
     
     uint32_t globalNIter= 0;
     
-    sameRandomObj.shuffle<homography>( Hs.begin(), Hs.end() );
+    if (hypQuality==NULL)
+        sameRandomObj.shuffle<homography>( Hs.begin(), Hs.end() );
+    else {
+        // best quality first, random among equal quality
+        ASSERT( hypQuality->size() == nPutativeMatches );
+        std::vector<uint32_t> order(nPutativeMatches);
+        for (uint32_t iPM= 0; iPM < nPutativeMatches; ++iPM)
+            order[iPM]= iPM;
+        sameRandomObj.shuffle<uint32_t>( order.begin(), order.end() );
+        std::stable_sort( order.begin(), order.end(), qualityOrder(*hypQuality) );
+        std::vector<homography> HsOrdered;
+        HsOrdered.reserve( nPutativeMatches );
+        for (uint32_t iPM= 0; iPM < nPutativeMatches; ++iPM)
+            HsOrdered.push_back( Hs[ order[iPM] ] );
+        Hs.swap(HsOrdered);
+    }
+    
+    // with equal weights score==nInliers, so once the one-to-one bound is reached nothing can be strictly better
+    uint32_t const maxNInliers= delWeights ? inlierFinder_obj.getMaxInliers() : nPutativeMatches+1;
     
     {
         //------- RANSAC core
@@ -201,9 +223,13 @@ detRansac::match(
         double score;
         
         for (std::vector<homography>::const_iterator itH= Hs.begin();
-             itH!=Hs.end() && globalNIter < detRansac::getNStopping(pFail, nPutativeMatches, bestNInliers);
+             itH!=Hs.end() && globalNIter < detRansac::getNStopping(pFail, nPutativeMatches, bestNInliers) && bestNInliers < maxNInliers;
              ++itH, ++globalNIter, ++iH){
             
+            // out of time: keep the best so far (checked only every so often as it is not free)
+            if ((iH & 31)==31 && latency::pastDeadline())
+                break;
+            
             score= inlierFinder_obj.getScore( *itH, nInliers, NULL );
             
             if (nInliers>3 && score>bestScore) {
@@ -261,6 +287,28 @@ detRansac::match(
 
 
 
+uint32_t
+detRansac::getMaxNInliers( matchesType const &putativeMatches ){
+    
+    std::vector<uint32_t> ids1, ids2;
+    ids1.reserve( putativeMatches.size() );
+    ids2.reserve( putativeMatches.size() );
+    for (matchesType::const_iterator itPM= putativeMatches.begin();
+         itPM!=putativeMatches.end();
+         ++itPM){
+        ids1.push_back(itPM->first);
+        ids2.push_back(itPM->second);
+    }
+    std::sort(ids1.begin(), ids1.end());
+    std::sort(ids2.begin(), ids2.end());
+    
+    return std::min(
+        static_cast<uint32_t>( std::unique(ids1.begin(), ids1.end()) - ids1.begin() ),
+        static_cast<uint32_t>( std::unique(ids2.begin(), ids2.end()) - ids2.begin() ) );
+}
+
+
+
 void
 detRansac::getH( std::vector<ellipse> const &ellipses1,
                  std::vector<ellipse> const &ellipses2,
@@ -455,6 +503,8 @@ detRansac::inlierFinder::inlierFinder(
     errorThrSq(mysqr(aErrorThr)),
     lowAreaChangeSq(mysqr(aLowAreaChange)),
     highAreaChangeSq(mysqr(aHighAreaChange)),
+    els1(aEllipses1, aPutativeMatches, true),
+    els2(aEllipses2, aPutativeMatches, false),
     nPutativeMatches(aPutativeMatches.size()) {
     
     //------- get largest pIDs
@@ -470,14 +520,21 @@ detRansac::inlierFinder::inlierFinder(
     point1Used.clear(); point1Used.resize(maxpID1+1,0);
     point1Used.clear(); point2Used.resize(maxpID2+1,0);
     
-    ellipse::getCentres( aEllipses1, aEllipses2, *putativeMatches, x1, y1, x2, y2, areaDiffSq );
+    maxNInliers= detRansac::getMaxNInliers(*putativeMatches);
+    
+    areaDiffSq= new double[nPutativeMatches];
+    for (uint32_t iPM= 0; iPM < nPutativeMatches; ++iPM)
+        areaDiffSq[iPM]= els2.getPropAreaSq(iPM) / els1.getPropAreaSq(iPM);
+    
+    candInds= new uint32_t[nPutativeMatches];
     
 }
 
 
 
 detRansac::inlierFinder::~inlierFinder(){
-    delete []x1; delete []y1; delete []x2; delete []y2; delete []areaDiffSq;
+    delete []areaDiffSq;
+    delete []candInds;
 }
 
 
@@ -496,9 +553,7 @@ detRansac::inlierFinder::getScore( homography const &H, uint32_t &nInliers, matc
     detASq= mysqr( H.getDetAffine() );
     if (detASq<1e-4) return 0.0;
     
-    double error;
     uint32_t pID1, pID2, iPM;
-    double x, y, xi, yi;
     double lowAreaChangeSqByD =  lowAreaChangeSq / detASq;
     double highAreaChangeSqByD= highAreaChangeSq / detASq;
     
@@ -507,36 +562,29 @@ detRansac::inlierFinder::getScore( homography const &H, uint32_t &nInliers, matc
     
     ++nIter;
     
-    iPM= 0;
-    for (matchesType::const_iterator itPM= putativeMatches->begin();
-         itPM!=putativeMatches->end();
-         ++itPM, ++iPM){
+    // geometric check for all putative matches at once (SIMD),
+    // then go through the survivors in order to enforce one-to-one matching
+    uint32_t nCand= inlierKernels::findCandidates(
+        H.H, Hinv,
+        els1.x, els1.y, els2.x, els2.y, areaDiffSq,
+        nPutativeMatches,
+        errorThrSq, lowAreaChangeSqByD, highAreaChangeSqByD,
+        candInds);
+    
+    for (uint32_t iCand= 0; iCand < nCand; ++iCand){
         
-        pID1= itPM->first;
-        pID2= itPM->second;
+        iPM= candInds[iCand];
+        pID1= (*putativeMatches)[iPM].first;
+        pID2= (*putativeMatches)[iPM].second;
         if (point1Used[ pID1 ]==nIter || point2Used[ pID2 ]==nIter)
             continue;
         
-        homography::affTransform( H.H , x1[iPM], y1[iPM], x , y );
-        homography::affTransform( Hinv, x2[iPM], y2[iPM], xi, yi );
-        
-        error= mysqr( x1[iPM]-xi ) + mysqr( y1[iPM]-yi ) +
-               mysqr( x2[iPM]-x  ) + mysqr( y2[iPM]-y  );
-        
-        if (error < errorThrSq){
-            /*
-            areaChangeSq= detASq * ellipses2[ pID2 ].getPropAreaSq() / ellipses1[ pID1 ].getPropAreaSq();
-            if ( areaChangeSq > lowAreaChangeSq && areaChangeSq < highAreaChangeSq ){
-            */
-            if (areaDiffSq[iPM] > lowAreaChangeSqByD && areaDiffSq[iPM] < highAreaChangeSqByD) {
-                score+= PMweights->at(iPM);
-                ++nInliers;
-                point1Used[ pID1 ]= nIter;
-                point2Used[ pID2 ]= nIter;
-                if (inliers)
-                    inliers->push_back(std::make_pair(pID1,pID2));
-            }
-        }
+        score+= PMweights->at(iPM);
+        ++nInliers;
+        point1Used[ pID1 ]= nIter;
+        point2Used[ pID2 ]= nIter;
+        if (inliers)
+            inliers->push_back(std::make_pair(pID1,pID2));
         
     }
     
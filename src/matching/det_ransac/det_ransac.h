@@ -27,6 +27,7 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "quant_desc.h"
 #include "ellipse.h"
+#include "ellipse_soa.h"
 #include "homography.h"
 #include "same_random.h"
 
@@ -123,9 +124,17 @@ class detRansac {
                 uint32_t nReest= 4,
                 
                 homography *H= NULL,
-                matchesType *inlierInds= NULL
+                matchesType *inlierInds= NULL,
+                
+                // if specified, hypotheses are tried in decreasing order of match quality (PROSAC-like) instead of randomly
+                std::vector<double> const *hypQuality= NULL
                 
                 );
+        
+        // upper bound on the number of inliers due to one-to-one matching:
+        // min( #distinct first, #distinct second ) of putativeMatches
+        static uint32_t
+            getMaxNInliers( matchesType const &putativeMatches );
             
     private:
         
@@ -149,6 +158,16 @@ class detRansac {
         static void
             normPoints( double *x, double *y, uint32_t n, homography &Hnorm );
         
+        class qualityOrder {
+            public:
+                qualityOrder( std::vector<double> const &quality ) : quality_(&quality) {}
+                inline bool operator()(uint32_t i, uint32_t j) const {
+                    return quality_->at(i) > quality_->at(j);
+                }
+            private:
+                std::vector<double> const *quality_;
+        };
+        
         class sortH_helper{
             public:
                 sortH_helper( std::vector<homography> *aHs, bool a ): Hs(aHs){
@@ -180,11 +199,8 @@ class detRansac {
                 double
                     getScore( homography const &H, uint32_t &nInliers, matchesType *inliers= NULL );
                 
-                inline double
-                    getMaxScore(){ return static_cast<double>(nPutativeMatches); }
-                
                 inline uint32_t
-                    getMaxInliers(){ return nPutativeMatches; }
+                    getMaxInliers(){ return maxNInliers; }
                 
             private:
                 
@@ -194,11 +210,16 @@ class detRansac {
                 std::vector<double> const *PMweights;
                 double errorThrSq, lowAreaChangeSq, highAreaChangeSq;
                 
-                double *x1, *y1, *x2, *y2, *areaDiffSq;
+                // putative ellipses in SoA form, aligned with putativeMatches, for inlierKernels
+                ellipseSoA els1, els2;
+                double *areaDiffSq;
+                
+                // output of inlierKernels::findCandidates
+                uint32_t *candInds;
                 
                 std::vector<uint32_t> point1Used, point2Used;
                 
-                uint32_t nPutativeMatches;
+                uint32_t nPutativeMatches, maxNInliers;
         };
         
         
@@ -0,0 +1,46 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "ellipse_soa.h"
+
+
+
+ellipseSoA::ellipseSoA(
+        std::vector<ellipse> const &ellipses,
+        std::vector< std::pair<uint32_t, uint32_t> > const &inds,
+        bool useFirst) {
+    allocate(inds.size());
+    for (uint32_t i= 0; i<n_; ++i)
+        set(i, ellipses[ useFirst ? inds[i].first : inds[i].second ]);
+}
+
+
+
+ellipseSoA::~ellipseSoA(){
+    delete []data_;
+}
+
+
+
+void
+ellipseSoA::allocate(uint32_t n){
+    n_= n;
+    // one block for all five arrays
+    data_= new double[5*n_ + 1];
+    x= data_;
+    y= x + n_;
+    a= y + n_;
+    b= a + n_;
+    c= b + n_;
+}
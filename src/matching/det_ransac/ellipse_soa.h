@@ -0,0 +1,69 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _ELLIPSE_SOA_H_
+#define _ELLIPSE_SOA_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "ellipse.h"
+#include "macros.h"
+
+
+
+// structure-of-arrays storage of ellipses, i.e. x[i], y[i], a[i], b[i], c[i] describe the i-th ellipse
+// so that many ellipses can be processed in packed SIMD lanes (see inlierKernels)
+
+class ellipseSoA {
+
+    public:
+
+        // gathers ellipses[ inds[i].first ] (or inds[i].second if useFirst==false), e.g. one side of putative matches
+        ellipseSoA(std::vector<ellipse> const &ellipses,
+                   std::vector< std::pair<uint32_t, uint32_t> > const &inds,
+                   bool useFirst);
+
+        ~ellipseSoA();
+
+        inline uint32_t
+            size() const { return n_; }
+
+        inline ellipse
+            get(uint32_t i) const { return ellipse(x[i], y[i], a[i], b[i], c[i]); }
+
+        // a*c-b^2 of the i-th ellipse, same as ellipse::getPropAreaSq
+        inline double
+            getPropAreaSq(uint32_t i) const { return a[i]*c[i]-b[i]*b[i]; }
+
+        double *x, *y, *a, *b, *c;
+
+    private:
+
+        void
+            allocate(uint32_t n);
+
+        inline void
+            set(uint32_t i, ellipse const &el){
+                x[i]= el.x; y[i]= el.y; a[i]= el.a; b[i]= el.b; c[i]= el.c;
+            }
+
+        uint32_t n_;
+        double *data_;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(ellipseSoA)
+};
+
+#endif
@@ -0,0 +1,169 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "inlier_kernels.h"
+
+#ifdef RR_INLIER_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+
+
+namespace inlierKernels {
+
+
+
+inline double mysqr( double x ){ return x*x; }
+
+
+
+// identical to the original per-match test in detRansac::inlierFinder::getScore
+inline bool
+isCandidate(double const H[], double const Hinv[],
+            double x1, double y1, double x2, double y2,
+            double areaDiffSq,
+            double errorThrSq,
+            double lowAreaChangeSqByD, double highAreaChangeSqByD){
+
+    double x = H[0]*x1 + H[1]*y1 + H[2];
+    double y = H[3]*x1 + H[4]*y1 + H[5];
+    double xi= Hinv[0]*x2 + Hinv[1]*y2 + Hinv[2];
+    double yi= Hinv[3]*x2 + Hinv[4]*y2 + Hinv[5];
+
+    double error= mysqr( x1-xi ) + mysqr( y1-yi ) +
+                  mysqr( x2-x  ) + mysqr( y2-y  );
+
+    return error < errorThrSq &&
+           areaDiffSq > lowAreaChangeSqByD && areaDiffSq < highAreaChangeSqByD;
+}
+
+
+
+uint32_t
+findCandidatesScalar(double const H[], double const Hinv[],
+                     double const *x1, double const *y1,
+                     double const *x2, double const *y2,
+                     double const *areaDiffSq,
+                     uint32_t n,
+                     double errorThrSq,
+                     double lowAreaChangeSqByD, double highAreaChangeSqByD,
+                     uint32_t *candInds){
+
+    uint32_t nCand= 0;
+    for (uint32_t i= 0; i<n; ++i)
+        if (isCandidate(H, Hinv, x1[i], y1[i], x2[i], y2[i], areaDiffSq[i],
+                        errorThrSq, lowAreaChangeSqByD, highAreaChangeSqByD))
+            candInds[nCand++]= i;
+    return nCand;
+}
+
+
+
+#ifdef RR_INLIER_KERNELS_AVX2
+
+__attribute__((target("avx2")))
+uint32_t
+findCandidatesAVX2(double const H[], double const Hinv[],
+                   double const *x1, double const *y1,
+                   double const *x2, double const *y2,
+                   double const *areaDiffSq,
+                   uint32_t n,
+                   double errorThrSq,
+                   double lowAreaChangeSqByD, double highAreaChangeSqByD,
+                   uint32_t *candInds){
+
+    __m256d const h0= _mm256_set1_pd(H[0]), h1= _mm256_set1_pd(H[1]), h2= _mm256_set1_pd(H[2]),
+                  h3= _mm256_set1_pd(H[3]), h4= _mm256_set1_pd(H[4]), h5= _mm256_set1_pd(H[5]);
+    __m256d const hi0= _mm256_set1_pd(Hinv[0]), hi1= _mm256_set1_pd(Hinv[1]), hi2= _mm256_set1_pd(Hinv[2]),
+                  hi3= _mm256_set1_pd(Hinv[3]), hi4= _mm256_set1_pd(Hinv[4]), hi5= _mm256_set1_pd(Hinv[5]);
+    __m256d const thr= _mm256_set1_pd(errorThrSq),
+                  low= _mm256_set1_pd(lowAreaChangeSqByD),
+                  high= _mm256_set1_pd(highAreaChangeSqByD);
+
+    uint32_t nCand= 0, i= 0;
+
+    for (; i+4 <= n; i+= 4){
+
+        __m256d const vx1= _mm256_loadu_pd(x1+i), vy1= _mm256_loadu_pd(y1+i);
+        __m256d const vx2= _mm256_loadu_pd(x2+i), vy2= _mm256_loadu_pd(y2+i);
+
+        // no FMA on purpose, to get bit-identical results to the scalar version
+        __m256d x = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd(h0, vx1), _mm256_mul_pd(h1, vy1) ), h2 );
+        __m256d y = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd(h3, vx1), _mm256_mul_pd(h4, vy1) ), h5 );
+        __m256d xi= _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd(hi0, vx2), _mm256_mul_pd(hi1, vy2) ), hi2 );
+        __m256d yi= _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd(hi3, vx2), _mm256_mul_pd(hi4, vy2) ), hi5 );
+
+        __m256d d1= _mm256_sub_pd(vx1, xi), d2= _mm256_sub_pd(vy1, yi),
+                d3= _mm256_sub_pd(vx2, x ), d4= _mm256_sub_pd(vy2, y );
+        __m256d error= _mm256_add_pd(
+                           _mm256_add_pd(
+                               _mm256_add_pd( _mm256_mul_pd(d1, d1), _mm256_mul_pd(d2, d2) ),
+                               _mm256_mul_pd(d3, d3) ),
+                           _mm256_mul_pd(d4, d4) );
+
+        __m256d const area= _mm256_loadu_pd(areaDiffSq+i);
+        __m256d ok= _mm256_and_pd(
+                        _mm256_cmp_pd(error, thr, _CMP_LT_OQ),
+                        _mm256_and_pd( _mm256_cmp_pd(area, low, _CMP_GT_OQ),
+                                       _mm256_cmp_pd(area, high, _CMP_LT_OQ) ) );
+
+        int mask= _mm256_movemask_pd(ok);
+        for (uint32_t j= 0; mask!=0; ++j, mask>>= 1)
+            if (mask & 1)
+                candInds[nCand++]= i+j;
+    }
+
+    for (; i<n; ++i)
+        if (isCandidate(H, Hinv, x1[i], y1[i], x2[i], y2[i], areaDiffSq[i],
+                        errorThrSq, lowAreaChangeSqByD, highAreaChangeSqByD))
+            candInds[nCand++]= i;
+
+    return nCand;
+}
+
+#endif
+
+
+
+bool
+hasAVX2(){
+    #ifdef RR_INLIER_KERNELS_AVX2
+    static bool const has= __builtin_cpu_supports("avx2");
+    return has;
+    #else
+    return false;
+    #endif
+}
+
+
+
+uint32_t
+findCandidates(double const H[], double const Hinv[],
+               double const *x1, double const *y1,
+               double const *x2, double const *y2,
+               double const *areaDiffSq,
+               uint32_t n,
+               double errorThrSq,
+               double lowAreaChangeSqByD, double highAreaChangeSqByD,
+               uint32_t *candInds){
+    #ifdef RR_INLIER_KERNELS_AVX2
+    if (hasAVX2())
+        return findCandidatesAVX2(H, Hinv, x1, y1, x2, y2, areaDiffSq, n,
+                                  errorThrSq, lowAreaChangeSqByD, highAreaChangeSqByD, candInds);
+    #endif
+    return findCandidatesScalar(H, Hinv, x1, y1, x2, y2, areaDiffSq, n,
+                                errorThrSq, lowAreaChangeSqByD, highAreaChangeSqByD, candInds);
+}
+
+};
@@ -0,0 +1,73 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _INLIER_KERNELS_H_
+#define _INLIER_KERNELS_H_
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RR_INLIER_KERNELS_AVX2
+#endif
+
+
+
+// Geometric part of detRansac inlier scoring, evaluated for all putative matches of a hypothesis at once.
+// Putative match i is a candidate inlier if its symmetric transfer error under the affine H (and its inverse Hinv)
+// is < errorThrSq and its area change areaDiffSq[i] is in (lowAreaChangeSqByD, highAreaChangeSqByD).
+// Indices of candidates are written in increasing order into candInds (needs room for n) and their number is returned.
+// All versions do exactly the same double operations in the same order, so they produce identical candidates.
+
+namespace inlierKernels {
+
+    uint32_t
+        findCandidates(double const H[], double const Hinv[],
+                       double const *x1, double const *y1,
+                       double const *x2, double const *y2,
+                       double const *areaDiffSq,
+                       uint32_t n,
+                       double errorThrSq,
+                       double lowAreaChangeSqByD, double highAreaChangeSqByD,
+                       uint32_t *candInds);
+
+    uint32_t
+        findCandidatesScalar(double const H[], double const Hinv[],
+                             double const *x1, double const *y1,
+                             double const *x2, double const *y2,
+                             double const *areaDiffSq,
+                             uint32_t n,
+                             double errorThrSq,
+                             double lowAreaChangeSqByD, double highAreaChangeSqByD,
+                             uint32_t *candInds);
+
+    #ifdef RR_INLIER_KERNELS_AVX2
+    // only call if hasAVX2()
+    uint32_t
+        findCandidatesAVX2(double const H[], double const Hinv[],
+                           double const *x1, double const *y1,
+                           double const *x2, double const *y2,
+                           double const *areaDiffSq,
+                           uint32_t n,
+                           double errorThrSq,
+                           double lowAreaChangeSqByD, double highAreaChangeSqByD,
+                           uint32_t *candInds);
+    #endif
+
+    // checked at runtime as the build only assumes SSE2
+    bool
+        hasAVX2();
+
+};
+
+#endif
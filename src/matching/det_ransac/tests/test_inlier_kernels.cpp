@@ -0,0 +1,273 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include "det_ransac.h"
+#include "ellipse.h"
+#include "ellipse_soa.h"
+#include "homography.h"
+#include "inlier_kernels.h"
+#include "macros.h"
+#include "same_random.h"
+
+
+
+inline double mysqr( double x ){ return x*x; }
+
+// [lo, hi)
+inline double
+getNextDouble( sameRandomStreamUint32 &randStream, double lo, double hi ){
+    return lo + (hi-lo) * randStream.getNext0ToN(1000000) / 1000000.0;
+}
+
+
+
+// planted affine transformation with scaling, skew and translation,
+// lower triangular like the hypotheses detRansac generates from ellipse pairs
+void
+getPlantedH( sameRandomStreamUint32 &randStream, double h[] ){
+    h[0]= getNextDouble(randStream, 0.7, 1.4); h[1]= 0; h[2]= getNextDouble(randStream, -50, 50);
+    h[3]= getNextDouble(randStream, -0.3, 0.3); h[4]= getNextDouble(randStream, 0.7, 1.4); h[5]= getNextDouble(randStream, -50, 50);
+    h[6]= 0; h[7]= 0; h[8]= 1;
+}
+
+
+
+// ellipses1 are random, the first nGood of ellipses2 are ellipses1 moved by H (plus noise), the rest are random.
+// Putative matches are (i,i) plus random ones which share points, so the one-to-one check matters.
+void
+getProblem( sameRandomStreamUint32 &randStream, uint32_t nEllipses, uint32_t nGood, uint32_t nExtra,
+            double const h[],
+            std::vector<ellipse> &ellipses1, std::vector<ellipse> &ellipses2,
+            matchesType &putativeMatches ){
+
+    ellipses1.clear(); ellipses2.clear(); putativeMatches.clear();
+
+    for (uint32_t i= 0; i<nEllipses; ++i){
+        double a= getNextDouble(randStream, 0.001, 0.05);
+        double c= getNextDouble(randStream, 0.001, 0.05);
+        double b= getNextDouble(randStream, -0.5, 0.5) * std::sqrt(a*c);
+        ellipses1.push_back( ellipse( getNextDouble(randStream, 0, 500), getNextDouble(randStream, 0, 500), a, b, c ) );
+
+        ellipse el= ellipses1.back();
+        if (i<nGood){
+            el.transformAffine( const_cast<double*>(h) );
+            el.x+= getNextDouble(randStream, -3, 3);
+            el.y+= getNextDouble(randStream, -3, 3);
+        } else {
+            el.x= getNextDouble(randStream, 0, 500);
+            el.y= getNextDouble(randStream, 0, 500);
+        }
+        ellipses2.push_back(el);
+        putativeMatches.push_back( std::make_pair(i, i) );
+    }
+
+    for (uint32_t i= 0; i<nExtra && nEllipses>0; ++i)
+        putativeMatches.push_back( std::make_pair(
+            randStream.getNext0ToN(nEllipses),
+            randStream.getNext0ToN(nEllipses) ) );
+}
+
+
+
+// the original (pre-SIMD) detRansac::inlierFinder::getScore on AoS data
+double
+getScoreReference( std::vector<ellipse> const &ellipses1, std::vector<ellipse> const &ellipses2,
+                   matchesType const &putativeMatches,
+                   double errorThr, double lowAreaChange, double highAreaChange,
+                   homography const &H, uint32_t &nInliers, matchesType &inliers ){
+
+    double score= 0.0;
+    nInliers= 0;
+    inliers.clear();
+
+    double detASq= mysqr( H.getDetAffine() );
+    if (detASq<1e-4) return 0.0;
+
+    double *x1, *y1, *x2, *y2, *areaDiffSq;
+    ellipse::getCentres( ellipses1, ellipses2, putativeMatches, x1, y1, x2, y2, areaDiffSq );
+
+    std::vector<bool> point1Used(ellipses1.size(), false), point2Used(ellipses2.size(), false);
+
+    double errorThrSq= mysqr(errorThr);
+    double lowAreaChangeSqByD = mysqr(lowAreaChange) / detASq;
+    double highAreaChangeSqByD= mysqr(highAreaChange) / detASq;
+
+    double Hinv[9];
+    H.getInverse( Hinv );
+
+    double x, y, xi, yi, error;
+    for (uint32_t iPM= 0; iPM<putativeMatches.size(); ++iPM){
+        uint32_t pID1= putativeMatches[iPM].first, pID2= putativeMatches[iPM].second;
+        if (point1Used[pID1] || point2Used[pID2])
+            continue;
+
+        homography::affTransform( H.H , x1[iPM], y1[iPM], x , y );
+        homography::affTransform( Hinv, x2[iPM], y2[iPM], xi, yi );
+
+        error= mysqr( x1[iPM]-xi ) + mysqr( y1[iPM]-yi ) +
+               mysqr( x2[iPM]-x  ) + mysqr( y2[iPM]-y  );
+
+        if (error < errorThrSq &&
+            areaDiffSq[iPM] > lowAreaChangeSqByD && areaDiffSq[iPM] < highAreaChangeSqByD){
+            score+= 1.0;
+            ++nInliers;
+            point1Used[pID1]= true;
+            point2Used[pID2]= true;
+            inliers.push_back(putativeMatches[iPM]);
+        }
+    }
+
+    delete []x1; delete []y1; delete []x2; delete []y2; delete []areaDiffSq;
+
+    return score;
+}
+
+
+
+// all findCandidates versions against the original per-match test
+void
+testKernels( sameRandomStreamUint32 &randStream, uint32_t nEllipses ){
+
+    std::cout<<"kernels, n= "<<nEllipses<<": \t"; std::cout.flush();
+
+    double h[9];
+    getPlantedH(randStream, h);
+    std::vector<ellipse> ellipses1, ellipses2;
+    matchesType putativeMatches;
+    getProblem(randStream, nEllipses, nEllipses/2, nEllipses/3, h, ellipses1, ellipses2, putativeMatches);
+    uint32_t const n= putativeMatches.size();
+
+    // check the gather into SoA
+    ellipseSoA els1(ellipses1, putativeMatches, true), els2(ellipses2, putativeMatches, false);
+    ASSERT( els1.size()==n && els2.size()==n );
+    for (uint32_t i= 0; i<n; ++i){
+        ASSERT( els1.get(i)==ellipses1[ putativeMatches[i].first ] );
+        ASSERT( els2.get(i)==ellipses2[ putativeMatches[i].second ] );
+    }
+
+    double *x1, *y1, *x2, *y2, *areaDiffSq;
+    ellipse::getCentres( ellipses1, ellipses2, putativeMatches, x1, y1, x2, y2, areaDiffSq );
+
+    std::vector<uint32_t> candRef(n+1), cand(n+1);
+    uint32_t nTotal= 0;
+
+    // the planted H, then perturbed versions of it so that the candidate sets differ
+    for (uint32_t iH= 0; iH<20; ++iH){
+        homography H(h);
+        if (iH>0)
+            for (uint32_t i= 0; i<6; ++i)
+                if (i!=1)
+                    H.H[i]+= (i==2 || i==5) ? getNextDouble(randStream, -5, 5) : getNextDouble(randStream, -0.02, 0.02);
+        double Hinv[9];
+        H.getInverse( Hinv );
+        double detASq= mysqr( H.getDetAffine() );
+        double errorThrSq= mysqr(getNextDouble(randStream, 2, 15));
+        double lowByD= mysqr(1.0/6) / detASq, highByD= 36.0 / detASq;
+
+        uint32_t nRef= 0;
+        for (uint32_t i= 0; i<n; ++i){
+            double x, y, xi, yi;
+            homography::affTransform( H.H , x1[i], y1[i], x , y );
+            homography::affTransform( Hinv, x2[i], y2[i], xi, yi );
+            double error= mysqr( x1[i]-xi ) + mysqr( y1[i]-yi ) +
+                          mysqr( x2[i]-x  ) + mysqr( y2[i]-y  );
+            if (error < errorThrSq && areaDiffSq[i] > lowByD && areaDiffSq[i] < highByD)
+                candRef[nRef++]= i;
+        }
+        nTotal+= nRef;
+
+        uint32_t nCand= inlierKernels::findCandidatesScalar(H.H, Hinv, els1.x, els1.y, els2.x, els2.y, areaDiffSq, n, errorThrSq, lowByD, highByD, &cand[0]);
+        ASSERT( nCand==nRef );
+        for (uint32_t i= 0; i<nRef; ++i)
+            ASSERT( cand[i]==candRef[i] );
+
+        nCand= inlierKernels::findCandidates(H.H, Hinv, els1.x, els1.y, els2.x, els2.y, areaDiffSq, n, errorThrSq, lowByD, highByD, &cand[0]);
+        ASSERT( nCand==nRef );
+        for (uint32_t i= 0; i<nRef; ++i)
+            ASSERT( cand[i]==candRef[i] );
+
+        #ifdef RR_INLIER_KERNELS_AVX2
+        if (inlierKernels::hasAVX2()){
+            nCand= inlierKernels::findCandidatesAVX2(H.H, Hinv, els1.x, els1.y, els2.x, els2.y, areaDiffSq, n, errorThrSq, lowByD, highByD, &cand[0]);
+            ASSERT( nCand==nRef );
+            for (uint32_t i= 0; i<nRef; ++i)
+                ASSERT( cand[i]==candRef[i] );
+        }
+        #endif
+    }
+
+    delete []x1; delete []y1; delete []x2; delete []y2; delete []areaDiffSq;
+
+    std::cout<<"OK ("<<nTotal<<" candidates)\n";
+}
+
+
+
+// detRansac::match end-to-end: the returned inliers are exactly what the original scoring gives for the returned H
+void
+testMatch( sameRandomStreamUint32 &randStream, sameRandomUint32 const &sameRandomObj, uint32_t nEllipses ){
+
+    std::cout<<"match, n= "<<nEllipses<<": \t"; std::cout.flush();
+
+    double h[9];
+    getPlantedH(randStream, h);
+    std::vector<ellipse> ellipses1, ellipses2;
+    matchesType putativeMatches;
+    getProblem(randStream, nEllipses, nEllipses/2, nEllipses/4, h, ellipses1, ellipses2, putativeMatches);
+
+    double const errorThr= 10, lowAreaChange= 1.0/6, highAreaChange= 6;
+
+    uint32_t nInliers;
+    homography H;
+    matchesType inliers;
+    detRansac::match(sameRandomObj, nInliers, ellipses1, ellipses2, putativeMatches, NULL,
+                     errorThr, lowAreaChange, highAreaChange, 4, &H, &inliers);
+    ASSERT( nInliers>=nEllipses/4 ); // planted half of them
+    ASSERT( inliers.size()==nInliers );
+
+    uint32_t nInliersRef;
+    matchesType inliersRef;
+    getScoreReference(ellipses1, ellipses2, putativeMatches, errorThr, lowAreaChange, highAreaChange, H, nInliersRef, inliersRef);
+    ASSERT( nInliersRef==nInliers );
+    for (uint32_t i= 0; i<nInliers; ++i)
+        ASSERT( inliers[i]==inliersRef[i] );
+
+    std::cout<<"OK ("<<nInliers<<" inliers)\n";
+}
+
+
+
+int main(){
+
+    sameRandomUint32 rand(1000000, 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    // lengths which are not multiples of the SIMD width included
+    uint32_t const ns[]= {0, 1, 2, 3, 4, 5, 7, 8, 9, 31, 100, 1001};
+    for (uint32_t i= 0; i<sizeof(ns)/sizeof(ns[0]); ++i)
+        testKernels(randStream, ns[i]);
+
+    sameRandomUint32 sameRandomObj(5000, 44);
+    uint32_t const nsMatch[]= {20, 57, 200};
+    for (uint32_t i= 0; i<sizeof(nsMatch)/sizeof(nsMatch[0]); ++i)
+        testMatch(randStream, sameRandomObj, nsMatch[i]);
+
+    std::cout<<"\nAll OK\n";
+
+    return 0;
+}
@@ -14,9 +14,13 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "coarse_residual.h"
 
+#include <algorithm>
 #include <queue>
 
+#include <boost/thread.hpp>
+
 #include "nn_compressed.h"
+#include "thread_queue.h"
 #include "util.h"
 #include "jp_dist2.hpp"
 #include "macros.h"
@@ -46,14 +50,6 @@ coarseResidual::~coarseResidual(){
 void
 coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists, uint32_t const *origCoarseID ) const {
     
-    vecIDdists.clear();
-    vecIDdists.reserve( KNN>10000? 10000 : KNN );
-    
-    unsigned coarseID;
-    
-    std::vector<vecIDdist> vecIDds;
-    std::priority_queue<vecIDdist> heapVecIDds;
-    
     // assign to coarse clusters
     float *distSqs= new float[nVisitCoarse];
     unsigned *coarseIDs= new unsigned[nVisitCoarse];
@@ -83,6 +79,232 @@ coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist
     
     delete []distSqs;
     
+    searchLists( qVec, coarseIDs, KNN, vecIDdists );
+    
+    delete []coarseIDs;
+    
+}
+
+
+
+// batch search: a job is one coarse cell with all the queries which visit it
+
+typedef std::vector< std::pair< uint32_t, std::vector<nnSearcher::vecIDdist> > > coarseResidualBatchResult; // <query index, KNN in this list>
+
+
+
+class coarseResidualBatchWorker : public queueWorker<coarseResidualBatchResult> {
+    
+    public:
+        
+        coarseResidualBatchWorker( float const *qVecs,
+                                   std::vector<uint32_t> const &cells,
+                                   std::vector<uint32_t> const &cellStart,
+                                   std::vector<uint32_t> const &cellQueries,
+                                   uint32_t KNN,
+                                   clstCentres const &coarseClstC_obj,
+                                   compressorWithDistance const &compDist,
+                                   indexWithData const &idx )
+            : qVecs_(qVecs), cells_(&cells), cellStart_(&cellStart), cellQueries_(&cellQueries), KNN_(KNN),
+              coarseClstC_obj_(&coarseClstC_obj), compDist_(&compDist), idx_(&idx)
+            {}
+        
+        void
+            operator() ( uint32_t jobID, coarseResidualBatchResult &result ) const;
+    
+    private:
+        
+        float const *qVecs_;
+        std::vector<uint32_t> const *cells_, *cellStart_, *cellQueries_;
+        uint32_t const KNN_;
+        clstCentres const *coarseClstC_obj_;
+        compressorWithDistance const *compDist_;
+        indexWithData const *idx_;
+        
+        DISALLOW_COPY_AND_ASSIGN(coarseResidualBatchWorker)
+};
+
+
+
+void
+coarseResidualBatchWorker::operator() ( uint32_t jobID, coarseResidualBatchResult &result ) const {
+    
+    result.clear();
+    
+    uint32_t const coarseID= (*cells_)[jobID];
+    uint32_t const numDims= coarseClstC_obj_->numDims;
+    
+    // get the list, without copying if possible
+    std::vector<uint32_t> const *vecIDs;
+    unsigned char const *data;
+    uint32_t size;
+    std::vector<uint32_t> vecIDsCopy;
+    unsigned char *dataCopy= NULL;
+    if (!idx_->getDataNoCopy(coarseID, vecIDs, data, size)){
+        idx_->getData(coarseID, vecIDsCopy, dataCopy, size);
+        vecIDs= &vecIDsCopy;
+        data= dataCopy;
+    }
+    
+    if (size>0){
+        
+        // residuals of all queries visiting this cell
+        uint32_t const qBegin= (*cellStart_)[jobID], nQ= (*cellStart_)[jobID+1] - qBegin;
+        float const *centre= coarseClstC_obj_->clstC_flat + coarseID * numDims;
+        float *qVecsRes= new float[nQ*numDims];
+        for (uint32_t iQ= 0; iQ<nQ; ++iQ){
+            float const *qVec= qVecs_ + (*cellQueries_)[qBegin+iQ] * numDims;
+            for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+                qVecsRes[iQ*numDims+iDim]= qVec[iDim] - centre[iDim];
+        }
+        
+        float *distsSq;
+        uint32_t const n= compDist_->getDistsSq(qVecsRes, nQ, data, size, distsSq);
+        delete []qVecsRes;
+        
+        result.resize(nQ);
+        for (uint32_t iQ= 0; iQ<nQ; ++iQ){
+            result[iQ].first= (*cellQueries_)[qBegin+iQ];
+            std::vector<nnSearcher::vecIDdist> &vecIDdists= result[iQ].second;
+            nnCompressed::getKNN(distsSq + iQ*n, n, KNN_, vecIDdists);
+            for (uint32_t i= 0; i<vecIDdists.size(); ++i)
+                vecIDdists[i].ID= (*vecIDs)[ vecIDdists[i].ID ];
+        }
+        delete []distsSq;
+    }
+    
+    if (dataCopy!=NULL)
+        delete []dataCopy;
+}
+
+
+
+class coarseResidualBatchManager : public queueManager<coarseResidualBatchResult> {
+    
+    public:
+        
+        coarseResidualBatchManager( uint32_t nQueries, uint32_t KNN ) : KNN_(KNN), heaps_(nQueries) {}
+        
+        void
+            operator() ( uint32_t jobID, coarseResidualBatchResult &result );
+        
+        // sorted by ascending distance
+        void
+            getResults( std::vector< std::vector<nnSearcher::vecIDdist> > &vecIDdists );
+    
+    private:
+        
+        uint32_t const KNN_;
+        std::vector< std::priority_queue<nnSearcher::vecIDdist> > heaps_;
+        
+        DISALLOW_COPY_AND_ASSIGN(coarseResidualBatchManager)
+};
+
+
+
+void
+coarseResidualBatchManager::operator() ( uint32_t jobID, coarseResidualBatchResult &result ){
+    
+    for (uint32_t iQ= 0; iQ<result.size(); ++iQ){
+        std::priority_queue<nnSearcher::vecIDdist> &heap= heaps_[ result[iQ].first ];
+        std::vector<nnSearcher::vecIDdist> const &vecIDdists= result[iQ].second;
+        // vecIDdists are sorted by distance so stop as soon as one is further than the worst kept,
+        // equally distant ones can still get in by ID (as in searchLists)
+        for (std::vector<nnSearcher::vecIDdist>::const_iterator it= vecIDdists.begin(); it!=vecIDdists.end(); ++it){
+            if (heap.size()==KNN_){
+                if (!(*it < heap.top())){
+                    if (it->distSq > heap.top().distSq)
+                        break;
+                    continue;
+                }
+                heap.pop();
+            }
+            heap.push(*it);
+        }
+    }
+    
+}
+
+
+
+void
+coarseResidualBatchManager::getResults( std::vector< std::vector<nnSearcher::vecIDdist> > &vecIDdists ){
+    
+    vecIDdists.resize(heaps_.size());
+    
+    for (uint32_t iQuery= 0; iQuery<heaps_.size(); ++iQuery){
+        std::priority_queue<nnSearcher::vecIDdist> &heap= heaps_[iQuery];
+        std::vector<nnSearcher::vecIDdist> &thisVecIDdists= vecIDdists[iQuery];
+        thisVecIDdists.clear();
+        thisVecIDdists.reserve(heap.size());
+        while (!heap.empty()){
+            thisVecIDdists.push_back( heap.top() );
+            heap.pop();
+        }
+        std::reverse(thisVecIDdists.begin(), thisVecIDdists.end());
+    }
+    
+}
+
+
+
+void
+coarseResidual::findKNN( float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists, uint32_t numThreads ) const {
+    
+    vecIDdists.clear();
+    vecIDdists.resize(nQueries);
+    if (nQueries==0)
+        return;
+    
+    // assign to coarse clusters
+    float *distSqs= new float[nQueries*nVisitCoarse];
+    unsigned *coarseIDs= new unsigned[nQueries*nVisitCoarse];
+    nn_obj->search_knn(qVecs, nQueries, nVisitCoarse, coarseIDs, distSqs);
+    delete []distSqs;
+    
+    // group queries by coarse cell: (coarseID, query) sorted by coarseID
+    std::vector< std::pair<uint32_t, uint32_t> > cellQuery;
+    cellQuery.reserve(nQueries*nVisitCoarse);
+    for (uint32_t iQuery= 0; iQuery<nQueries; ++iQuery)
+        for (uint32_t iCoarse= 0; iCoarse<nVisitCoarse; ++iCoarse)
+            cellQuery.push_back( std::make_pair(coarseIDs[iQuery*nVisitCoarse+iCoarse], iQuery) );
+    delete []coarseIDs;
+    std::sort(cellQuery.begin(), cellQuery.end());
+    
+    std::vector<uint32_t> cells, cellStart, cellQueries;
+    cellQueries.reserve(cellQuery.size());
+    for (uint32_t i= 0; i<cellQuery.size(); ++i){
+        if (i==0 || cellQuery[i].first!=cellQuery[i-1].first){
+            cells.push_back(cellQuery[i].first);
+            cellStart.push_back(i);
+        }
+        cellQueries.push_back(cellQuery[i].second);
+    }
+    cellStart.push_back(cellQuery.size());
+    
+    if (numThreads==0)
+        numThreads= std::max(static_cast<uint32_t>(1), static_cast<uint32_t>(boost::thread::hardware_concurrency()));
+    
+    coarseResidualBatchWorker worker(qVecs, cells, cellStart, cellQueries, KNN, coarseClstC_obj, *compDist, *idx);
+    coarseResidualBatchManager manager(nQueries, KNN);
+    threadQueue<coarseResidualBatchResult>::start( cells.size(), worker, manager, numThreads );
+    
+    manager.getResults(vecIDdists);
+    
+}
+
+
+
+void
+coarseResidual::searchLists( float const qVec[], unsigned const coarseIDs[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const {
+    
+    vecIDdists.clear();
+    vecIDdists.reserve( KNN>10000? 10000 : KNN );
+    
+    unsigned coarseID;
+    
+    std::vector<vecIDdist> vecIDds;
+    std::priority_queue<vecIDdist> heapVecIDds;
     
     for (uint32_t iCoarse= 0; iCoarse<nVisitCoarse; ++iCoarse){
         
@@ -114,6 +336,8 @@ coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist
             nnCompressed::findKNN( *compDist, dataStr, qVecRes, KNN, vecIDdists );
             delete []data;
             coarseResidual::applyInd( vecIDs, vecIDdists );
+            // order equally distant ones by their (now global) IDs
+            std::sort( vecIDdists.begin(), vecIDdists.end() );
             
         } else {
             
@@ -122,14 +346,21 @@ coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist
 //             less efficient but clearer: coarseResidual::applyInd( vecIDs, vecIDds ); and then latter heapVecIDds.push( *it )
             vecIDdist toAdd;
             
-            std::vector<vecIDdist>::const_iterator it= vecIDds.begin();
-            for (; it!=vecIDds.end() && (heapVecIDds.size()<KNN || heapVecIDds.top().distSq > it->distSq); ++it){
-                
-                if (heapVecIDds.size()==KNN)
-                    heapVecIDds.pop();
+            // vecIDds are sorted by distance so stop as soon as one is further than the worst kept,
+            // equally distant ones can still get in by ID so that the order of lists doesn't matter
+            for (std::vector<vecIDdist>::const_iterator it= vecIDds.begin(); it!=vecIDds.end(); ++it){
                 
                 toAdd.distSq= it->distSq;
                 toAdd.ID= vecIDs[ it->ID ];
+                
+                if (heapVecIDds.size()==KNN){
+                    if (!(toAdd < heapVecIDds.top())){
+                        if (toAdd.distSq > heapVecIDds.top().distSq)
+                            break;
+                        continue;
+                    }
+                    heapVecIDds.pop();
+                }
                 heapVecIDds.push( toAdd );
             }
             
@@ -139,8 +370,6 @@ coarseResidual::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist
         
     }
     
-    delete []coarseIDs;
-    
     if (nVisitCoarse>1){
         
         vecIDdists.clear();
@@ -46,6 +46,16 @@ class coarseResidual : public nnSearcher {
         void
             findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists, uint32_t const *origCoarseID ) const;
         
+        // batch search: queries are grouped by coarse cell so that each visited list is fetched and scanned
+        // once for all queries visiting it, and lists are processed in parallel (numThreads= 0: all cores)
+        inline void
+            findKNN( float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists ) const {
+                findKNN( qVecs, nQueries, KNN, vecIDdists, 0 );
+            }
+        
+        void
+            findKNN( float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists, uint32_t numThreads ) const;
+        
         void
             findKNN( uint32_t coarseID, float const qVecRes[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const;
         
@@ -57,6 +67,10 @@ class coarseResidual : public nnSearcher {
     
     private:
         
+        // search the nVisitCoarse lists coarseIDs
+        void
+            searchLists( float const qVec[], unsigned const coarseIDs[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const;
+        
         static void
             applyInd( std::vector<uint32_t> const &origIDs, std::vector<vecIDdist> &inds );
         
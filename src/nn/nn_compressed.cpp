@@ -19,17 +19,67 @@ No usage or redistribution is allowed without explicit permission.
 
 
 
+nnCompressed::nnCompressed( compressorWithDistance const &compressor, std::string const &data, uint32_t aSize, bool fastScan ) : compDist_(&compressor), data_(data), numPacked_(0) {
+    if (fastScan && compDist_->hasFastScan())
+        numPacked_= compDist_->fastScanPack(data_, packed_);
+}
+
+
+
+void
+nnCompressed::findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const {
+    
+    if (packed_.empty()){
+        findKNN( *compDist_, data_, qVec, KNN, vecIDdists );
+        return;
+    }
+    
+    float *dsSq= new float[numPacked_];
+    compDist_->getDistsSqFastScan(qVec, packed_, numPacked_, dsSq);
+    getKNN(dsSq, numPacked_, KNN, vecIDdists);
+    delete []dsSq;
+    
+}
+
+
+
 void
 nnCompressed::findKNN( compressorWithDistance const &compDist, std::string const &data, float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) {
     
-    std::vector<float> dsSq;
-    compDist.getDistsSq(qVec, data, dsSq);
-    KNN= KNN<dsSq.size() ? KNN : dsSq.size();
+    float *dsSq;
+    uint32_t const n= compDist.getDistsSq(qVec, data, dsSq);
+    getKNN(dsSq, n, KNN, vecIDdists);
+    delete []dsSq;
+    
+}
+
+
+
+void
+nnCompressed::findKNN( compressorWithDistance const &compDist, std::string const &data, float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists ) {
+    
+    float *dsSq;
+    uint32_t const n= compDist.getDistsSq(qVecs, nQueries, data, dsSq);
+    
+    vecIDdists.resize(nQueries);
+    for (uint32_t iQuery= 0; iQuery<nQueries; ++iQuery)
+        getKNN(dsSq + iQuery*n, n, KNN, vecIDdists[iQuery]);
+    
+    delete []dsSq;
+    
+}
+
+
+
+void
+nnCompressed::getKNN( float const distsSq[], uint32_t n, uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) {
+    
+    KNN= KNN<n ? KNN : n;
     
     vecIDdists.clear();
-    vecIDdists.reserve(dsSq.size());
-    for (uint32_t i= 0; i<dsSq.size(); ++i)
-        vecIDdists.push_back( vecIDdist(i, dsSq[i]) );
+    vecIDdists.reserve(n);
+    for (uint32_t i= 0; i<n; ++i)
+        vecIDdists.push_back( vecIDdist(i, distsSq[i]) );
     
     std::partial_sort( vecIDdists.begin(), vecIDdists.begin()+KNN, vecIDdists.end() );
     
@@ -15,6 +15,7 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _NN_COMPRESSED_H_
 #define _NN_COMPRESSED_H_
 
+#include <string>
 #include <vector>
 #include <stdint.h>
 
@@ -28,16 +29,30 @@ class nnCompressed : public nnSearcher {
     
     public:
         
-        nnCompressed( compressorWithDistance const &compressor, std::string const &data, uint32_t aSize ) : compDist_(&compressor), data_(data) {}
+        // fastScan: use the compressor's (approximate) fast-scan distances if it has them
+        nnCompressed( compressorWithDistance const &compressor, std::string const &data, uint32_t aSize, bool fastScan= false );
+        
+        void
+            findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const;
         
         inline void
-            findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists ) const {
-                findKNN( *compDist_, data_, qVec, KNN, vecIDdists );
+            findKNN( float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists ) const {
+                if (packed_.empty())
+                    findKNN( *compDist_, data_, qVecs, nQueries, KNN, vecIDdists );
+                else
+                    nnSearcher::findKNN( qVecs, nQueries, KNN, vecIDdists );
             }
         
         static void
             findKNN( compressorWithDistance const &compDist, std::string const &data, float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDdists );
         
+        static void
+            findKNN( compressorWithDistance const &compDist, std::string const &data, float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDdists );
+        
+        // KNN of n distances (sorted)
+        static void
+            getKNN( float const distsSq[], uint32_t n, uint32_t KNN, std::vector<vecIDdist> &vecIDdists );
+        
         inline uint32_t
             numDims() const { return compDist_->numDims(); }
         
@@ -45,6 +60,9 @@ class nnCompressed : public nnSearcher {
         
         compressorWithDistance const *compDist_;
         std::string const data_;
+        // data_ packed for fast-scan, empty if not used
+        std::string packed_;
+        uint32_t numPacked_;
         
         DISALLOW_COPY_AND_ASSIGN(nnCompressed);
     
@@ -33,6 +33,14 @@ class nnSearcher {
         virtual void
             findKNN( float const qVec[], uint32_t KNN, std::vector<vecIDdist> &vecIDs ) const =0;
         
+        // nQueries query vectors one after another, vecIDs[iQuery] as for findKNN
+        virtual void
+            findKNN( float const qVecs[], uint32_t nQueries, uint32_t KNN, std::vector< std::vector<vecIDdist> > &vecIDs ) const {
+                vecIDs.resize(nQueries);
+                for (uint32_t iQuery= 0; iQuery<nQueries; ++iQuery)
+                    findKNN( qVecs + iQuery*numDims(), KNN, vecIDs[iQuery] );
+            }
+        
         virtual vecIDdist
             findNN( float const qVec[] ) const {
                 std::vector<vecIDdist> vecIDs;
@@ -45,7 +53,8 @@ class nnSearcher {
         
         struct vecIDdist {
             vecIDdist(uint32_t aID= 0, float aDistSq= -1.0) : ID(aID), distSq(aDistSq) {}
-            inline int operator<(vecIDdist const &rhs) const { return distSq < rhs.distSq; }
+            // ties broken by ID so that the KNN don't depend on the order in which candidates are seen
+            inline int operator<(vecIDdist const &rhs) const { return distSq < rhs.distSq || (distSq == rhs.distSq && ID < rhs.ID); }
             uint32_t ID;
             float distSq;
         };
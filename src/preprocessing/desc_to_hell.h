@@ -39,6 +39,15 @@ class descToHell : public descGetter {
                 convertToHell( numDims(), numDescs, descs );
             }
         
+        inline bool
+            supportsImage() const { return desc->supportsImage(); }
+        
+        void
+            getDescs( imageUtil::grayImage const &im, std::vector<ellipse> &regions, uint32_t &numDescs, float *&descs ) const {
+                desc->getDescs(im, regions, numDescs, descs);
+                convertToHell( numDims(), numDescs, descs );
+            }
+        
         static void
             convertToHell( uint32_t numDims, float *desc ){
                 uint32_t iDim;
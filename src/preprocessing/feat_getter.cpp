@@ -107,3 +107,51 @@ featGetter::getFeats( const char fileName[], uint32_t xl, uint32_t xu, uint32_t
 #endif
     
 }
+
+
+
+void
+featGetter::getFeatsOnce( const char fileName[], uint32_t maxImageSize, std::pair<uint32_t, uint32_t> &wh, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+    
+    imageUtil::grayImage im;
+    
+    if (!supportsImage() || !imageUtil::decodeGray( fileName, im, maxImageSize )){
+        // old way, decodes the image several times
+        wh= imageUtil::getWidthHeight( fileName );
+        if (wh.first==0 && wh.second==0){
+            numFeats= 0;
+            regions.clear();
+            descs= new float[0];
+            return;
+        }
+        getFeats( fileName, numFeats, regions, descs );
+        return;
+    }
+    
+    wh= std::make_pair(im.origWidth, im.origHeight);
+    
+    // same as imageUtil::checkAndConvertToJpegTemp
+    if (im.origWidth<10 || im.origHeight<10){
+        numFeats= 0;
+        regions.clear();
+        descs= new float[0];
+        return;
+    }
+    
+    getFeats( im, numFeats, regions, descs );
+    
+    if (im.scale!=1.0){
+        // a decoded pixel covers scale x scale original pixels
+        double const offset= (im.scale-1)/2, scaleSq= im.scale*im.scale;
+        for (std::vector<ellipse>::iterator itR= regions.begin();
+             itR!=regions.end();
+             ++itR) {
+            itR->x= itR->x*im.scale + offset;
+            itR->y= itR->y*im.scale + offset;
+            itR->a/= scaleSq;
+            itR->b/= scaleSq;
+            itR->c/= scaleSq;
+        }
+    }
+    
+}
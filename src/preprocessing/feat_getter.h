@@ -15,10 +15,12 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _FEAT_GETTER_H_
 #define _FEAT_GETTER_H_
 
+#include <stdexcept>
 #include <stdint.h>
 #include <vector>
 
 #include "ellipse.h"
+#include "image_util.h"
 #include "macros.h"
 #include "util.h"
 
@@ -30,6 +32,15 @@ class descGetter {
         virtual void
             getDescs( const char fileName[], std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const =0;
         
+        // overwrite both if descriptors can be computed from an already decoded image
+        virtual bool
+            supportsImage() const { return false; }
+        
+        virtual void
+            getDescs( imageUtil::grayImage const &im, std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const {
+                throw std::runtime_error("descGetter::getDescs: decoded images are not supported");
+            }
+        
         virtual std::string
             getRawDescs(float const *descs, uint32_t numFeats) const {
                 // overwrite if not float
@@ -61,6 +72,15 @@ class regionGetter {
         virtual void
             getRegs( const char fileName[], uint32_t &numRegs, std::vector<ellipse> &regions ) const =0;
         
+        // overwrite both if regions can be detected in an already decoded image
+        virtual bool
+            supportsImage() const { return false; }
+        
+        virtual void
+            getRegs( imageUtil::grayImage const &im, uint32_t &numRegs, std::vector<ellipse> &regions ) const {
+                throw std::runtime_error("regionGetter::getRegs: decoded images are not supported");
+            }
+        
         virtual ~regionGetter()
             {}
     
@@ -89,6 +109,22 @@ class featGetter {
         
         virtual uint8_t
             getDtypeCode() const =0;
+        
+        // overwrite both if features can be extracted from an already decoded image
+        virtual bool
+            supportsImage() const { return false; }
+        
+        virtual void
+            getFeats( imageUtil::grayImage const &im, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+                throw std::runtime_error("featGetter::getFeats: decoded images are not supported");
+            }
+        
+        // decodes the image only once, at reduced size if it is larger than maxImageSize (0 means no limit,
+        // see imageUtil::decodeGray), and returns regions in the original image coordinates.
+        // wh is the original image size, (0,0) if the image can't be read.
+        // Falls back to getFeats(fileName, ...) if decoded images are not supported
+        void
+            getFeatsOnce( const char fileName[], uint32_t maxImageSize, std::pair<uint32_t, uint32_t> &wh, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const;
 };
 
 
@@ -105,6 +141,17 @@ class splitRegDesc : public featGetter {
                 descGetterObj->getDescs( fileName, regions, numFeats, descs );
             }
         
+        inline bool
+            supportsImage() const {
+                return regionGetterObj->supportsImage() && descGetterObj->supportsImage();
+            }
+        
+        void
+            getFeats( imageUtil::grayImage const &im, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+                regionGetterObj->getRegs( im, numFeats, regions );
+                descGetterObj->getDescs( im, regions, numFeats, descs );
+            }
+        
         inline uint32_t
             numDims() const { return descGetterObj->numDims(); }
         
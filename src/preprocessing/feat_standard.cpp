@@ -147,27 +147,15 @@ void reg_KM_HessAff::getRegs( const char fileName[], uint32_t &numRegs, std::vec
 
 }
 
-/*
-// avoid read/wrie to disk and share detected points in-memory
-// updated by @Abhishek Dutta (29 Mar. 2017)
-void reg_KM_HessAff::getRegs( const char fileName[], uint32_t &numRegs, std::vector<ellipse> &regions ) const {
-  // convert to jpg if it isn't jpg already
-  std::string jpg_filename;
-  bool doDelJpeg= false;
-  if (!imageUtil::checkAndConvertToJpegTemp(fileName, jpg_filename, doDelJpeg)){
-    numRegs= 0;
-    regions.clear();
-    return;
-  }
-
-  KM_detect_points::detect_points_hesaff(jpg_filename, regions);
-
-  // image cleanup
-  if (doDelJpeg) {
-    boost::filesystem::remove( jpg_filename );
-  }
+void reg_KM_HessAff::getRegs( imageUtil::grayImage const &im, uint32_t &numRegs, std::vector<ellipse> &regions ) const {
+
+    // no temporary files, the image is not decoded again
+    KM_detect_points::detect_points_hesaff(&im.data[0], im.width, im.height, regions);
+    numRegs= regions.size();
+
 }
-*/
+
+
 
 void desc_KM_SIFT::getDescs( const char fileName[], std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const {
 
@@ -231,32 +219,21 @@ void desc_KM_SIFT::getDescs( const char fileName[], std::vector<ellipse> &region
 
 }
 
-/*
-// avoid read/wrie to disk and share detected points in-memory
-// updated by @Abhishek Dutta (29 Mar. 2017)
-void desc_KM_SIFT::getDescs( const char fileName[], std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const {
-  // convert to jpg if it isn't jpg already
-  std::string jpg_filename;
-  bool doDelJpeg= false;
-  if (regions.size()==0 || !imageUtil::checkAndConvertToJpegTemp(fileName, jpg_filename, doDelJpeg)){
-    numFeats= 0;
-    regions.clear();
-    descs= new float[0];
-    return;
-  }
-
-  // execute
-  KM_compute_descriptors::compute_descriptors_sift(jpg_filename,
-                                                   regions,
-                                                   numFeats,
-                                                   scaleMulti,
-                                                   upright,
-                                                   descs);
-  // image cleanup
-  if (doDelJpeg)
-    boost::filesystem::remove( jpg_filename );
+void desc_KM_SIFT::getDescs( imageUtil::grayImage const &im, std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const {
+
+    if (regions.size()==0){
+        numFeats= 0;
+        descs= new float[0];
+        return;
+    }
+
+    // no temporary files, the image is not decoded again
+    KM_compute_descriptors::compute_descriptors_sift(&im.data[0], im.width, im.height,
+                                                     regions, numFeats, scaleMulti, upright, descs);
+
 }
-*/
+
+
 
 std::string
 desc_KM_SIFT::getRawDescs(float const *descs, uint32_t numFeats) const {
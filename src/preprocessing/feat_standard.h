@@ -33,7 +33,10 @@ No usage or redistribution is allowed without explicit permission.
 
 // Hessian-Affine detector by Krystian Mikolajczyk
 class reg_KM_HessAff : public regionGetter {
-    public: void getRegs( const char fileName[], uint32_t &numRegs, std::vector<ellipse> &regions ) const;
+    public:
+        void getRegs( const char fileName[], uint32_t &numRegs, std::vector<ellipse> &regions ) const;
+        inline bool supportsImage() const { return true; }
+        void getRegs( imageUtil::grayImage const &im, uint32_t &numRegs, std::vector<ellipse> &regions ) const;
 };
 
 
@@ -43,6 +46,8 @@ class desc_KM_SIFT : public descGetter {
     public:
         desc_KM_SIFT(float aScaleMulti= 3.0, bool aUpright= false) : scaleMulti(aScaleMulti), upright(aUpright) {}
         void getDescs( const char fileName[], std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const;
+        inline bool supportsImage() const { return true; }
+        void getDescs( imageUtil::grayImage const &im, std::vector<ellipse> &regions, uint32_t &numFeats, float *&descs ) const;
         std::string getRawDescs(float const *descs, uint32_t numFeats) const;
         inline uint8_t getDtypeCode() const { return 0; /* uint8 */ }
         uint32_t numDims() const { return 128; }
@@ -135,6 +140,14 @@ class featGetter_standard : public featGetter {
             return featGetterObj->getFeats( fileName, numFeats, regions, descs );
         }
         
+        inline bool
+            supportsImage() const { return featGetterObj->supportsImage(); }
+        
+        inline void
+            getFeats( imageUtil::grayImage const &im, uint32_t &numFeats, std::vector<ellipse> &regions, float *&descs ) const {
+            return featGetterObj->getFeats( im, numFeats, regions, descs );
+        }
+        
         inline std::string getRawDescs(float const *descs, uint32_t numFeats) const {
             return featGetterObj->getRawDescs(descs, numFeats);
         }
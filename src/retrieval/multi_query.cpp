@@ -26,11 +26,29 @@ multiQueryIndpt::queryExecute( std::vector<query> const &queries, std::vector<in
     
     std::vector<double> scores(numDocs_);
     
-    mqIndpt_worker worker( *retriever_obj, queries, workerReturnOnlyTop() ? toReturn : 0 );
     queueManager<Result> *manager= getManager( scores );
     
-    // TODO: how many threads?
-    threadQueue<Result>::start( queries.size(), worker, *manager, 8 );
+    if (retriever_obj->supportsBatch()){
+        
+        // execute all queries together so that work (e.g. posting list fetches) is shared
+        std::vector< std::vector<indScorePair> > batchRes;
+        retriever_obj->queryExecuteBatch( queries, batchRes, workerReturnOnlyTop() ? toReturn : 0 );
+        
+        for (uint32_t jobID= 0; jobID < queries.size(); ++jobID){
+            // manager deletes this
+            Result result= new std::vector<indScorePair>;
+            result->swap( batchRes[jobID] );
+            (*manager)( jobID, result );
+        }
+        
+    } else {
+        
+        mqIndpt_worker worker( *retriever_obj, queries, workerReturnOnlyTop() ? toReturn : 0 );
+        
+        // TODO: how many threads?
+        threadQueue<Result>::start( queries.size(), worker, *manager, 8 );
+        
+    }
     
     // NOTE: important to call this before sorting the results
     delete manager;
@@ -44,6 +62,8 @@ multiQueryIndpt::queryExecute( std::vector<query> const &queries, std::vector<in
 void
 multiQueryIndpt::mqIndpt_worker::operator() ( uint32_t jobID, Result &result ) const {
     
+    latency::deadline deadlineScope(deadline);
+    
     // manager should delete this
     result= new std::vector<indScorePair>;
     result->reserve( toReturn );
@@ -19,6 +19,7 @@ No usage or redistribution is allowed without explicit permission.
 #include <string>
 #include <vector>
 
+#include "latency.h"
 #include "par_queue.h"
 #include "thread_queue.h"
 #include "retriever.h"
@@ -83,12 +84,14 @@ class multiQueryIndpt : public multiQuery {
         
         class mqIndpt_worker : public queueWorker<Result> {
             public:
-                mqIndpt_worker( retriever const &aRetriever_obj, std::vector<query> const &aQueries, uint32_t aToReturn ) : retriever_obj(&aRetriever_obj), queries(&aQueries), toReturn(aToReturn) {}
+                mqIndpt_worker( retriever const &aRetriever_obj, std::vector<query> const &aQueries, uint32_t aToReturn ) : retriever_obj(&aRetriever_obj), queries(&aQueries), toReturn(aToReturn), deadline(latency::currentDeadline()) {}
                 void operator() ( uint32_t jobID, Result &result ) const;
             private:
                 retriever const *retriever_obj;
                 std::vector<query> const *queries;
                 const uint32_t toReturn;
+                // of the request (the worker is created by its thread)
+                const double deadline;
         };
         
     
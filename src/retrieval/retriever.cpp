@@ -13,6 +13,7 @@ No usage or redistribution is allowed without explicit permission.
 */
 
 #include "retriever.h"
+#include "latency.h"
 #include "util.h"
 
 #include <algorithm>
@@ -32,8 +33,18 @@ retriever::externalQuery( std::string imageFn, query const &query_obj, std::vect
 
 
 
+void
+retriever::queryExecuteBatch( std::vector<query> const &queries, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn ) const {
+    queryRes.resize( queries.size() );
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        queryExecute( queries[i], queryRes[i], toReturn );
+}
+
+
+
 void
 retriever::sortResults( std::vector<indScorePair> &queryRes, uint32_t firstN, uint32_t toReturn ){
+    latency::span span(latency::sort);
     //TODO this can be more efficient for toReturn << min(firstN, size) ; stl partial_sort
     if (firstN==0 || firstN>=queryRes.size()) {
         sort( queryRes.begin(), queryRes.end(), compare );
@@ -48,6 +48,14 @@ class retriever {
         virtual uint32_t
             numDocs() const =0;
         
+        // queryRes[i] are the results of queries[i], by default the queries are simply executed one by one
+        virtual void
+            queryExecuteBatch( std::vector<query> const &queries, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn= 0 ) const;
+        
+        // true if queryExecuteBatch shares work between the queries (e.g. posting list fetches) so it is worth calling
+        virtual bool
+            supportsBatch() const { return false; }
+        
         void
             internalQuery( uint32_t docID, std::vector<indScorePair> &queryRes, uint32_t toReturn= 0 ) const {
                 query query_obj(docID, true);
@@ -23,13 +23,25 @@ struct spatParams {
     
     uint32_t spatialDepth, minInliers, maxReest;
     float errorThr, lowAreaChange, highAreaChange;
+    // try RANSAC hypotheses in order of match quality (e.g. Hamming weights) instead of randomly
+    bool guided;
+    // adaptive depth: verify (up to spatialDepth) in batches of adaptiveBatch in order of the first-stage score,
+    // stop when the next score is < adaptiveScoreRatio * the top score or after timeBudget ms (0= no budget)
+    bool adaptive;
+    uint32_t adaptiveBatch;
+    float adaptiveScoreRatio;
+    double timeBudget;
     
     spatParams( uint32_t aSpatialDepth= 200, uint32_t aMinInliers= 4,
                 float aErrorThr= 40.0,
                 float aLowAreaChange= 0, float aHighAreaChange= 31.63 /* =sqrt(1000) */,
-                uint32_t aMaxReest= 4
+                uint32_t aMaxReest= 4,
+                bool aGuided= false,
+                bool aAdaptive= false, uint32_t aAdaptiveBatch= 40,
+                float aAdaptiveScoreRatio= 0.1, double aTimeBudget= 0
                 ) : 
-                spatialDepth(aSpatialDepth), minInliers(aMinInliers), maxReest(aMaxReest), errorThr(aErrorThr), lowAreaChange(aLowAreaChange), highAreaChange(aHighAreaChange) {}
+                spatialDepth(aSpatialDepth), minInliers(aMinInliers), maxReest(aMaxReest), errorThr(aErrorThr), lowAreaChange(aLowAreaChange), highAreaChange(aHighAreaChange), guided(aGuided),
+                adaptive(aAdaptive), adaptiveBatch(aAdaptiveBatch), adaptiveScoreRatio(aAdaptiveScoreRatio), timeBudget(aTimeBudget) {}
 };
 
 static const spatParams spatParams_def;
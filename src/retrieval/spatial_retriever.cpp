@@ -13,3 +13,18 @@ No usage or redistribution is allowed without explicit permission.
 */
 
 #include "spatial_retriever.h"
+
+
+
+void
+spatialRetriever::spatialQueryBatch(
+        std::vector<query> const &queries,
+        std::vector< std::vector<indScorePair> > &queryRes,
+        std::vector< std::map<uint32_t, homography> > &Hs,
+        uint32_t toReturn ) const {
+    
+    queryRes.resize( queries.size() );
+    Hs.resize( queries.size() );
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        spatialQuery( queries[i], queryRes[i], Hs[i], toReturn );
+}
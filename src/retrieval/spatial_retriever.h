@@ -33,11 +33,20 @@ class spatialRetriever {
         
         spatialRetriever() : sameRandomObj_(10000) {}
         
+        // spatialDepth (optional) is set to the number of documents that were actually spatially verified
         virtual void
             spatialQuery( query const &queryObj,
                           std::vector<indScorePair> &queryRes,
                           std::map<uint32_t, homography> &Hs,
-                          uint32_t toReturn= 0 ) const =0;
+                          uint32_t toReturn= 0,
+                          uint32_t *spatialDepth= NULL ) const =0;
+        
+        // queryRes[i] and Hs[i] are the results of queries[i], by default the queries are simply executed one by one
+        virtual void
+            spatialQueryBatch( std::vector<query> const &queries,
+                               std::vector< std::vector<indScorePair> > &queryRes,
+                               std::vector< std::map<uint32_t, homography> > &Hs,
+                               uint32_t toReturn= 0 ) const;
         
         virtual void
             getMatches( query const &queryObj,
@@ -81,9 +90,12 @@ class fakeSpatialRetriever : public spatialRetriever {
             spatialQuery( query const &queryObj,
                           std::vector<indScorePair> &queryRes,
                           std::map<uint32_t, homography> &Hs,
-                          uint32_t toReturn= 0 ) const {
+                          uint32_t toReturn= 0,
+                          uint32_t *spatialDepth= NULL ) const {
                 Hs.clear();
                 trueRetriever_->queryExecute(queryObj, queryRes, toReturn);
+                if (spatialDepth!=NULL)
+                    *spatialDepth= 0;
             }
         
         virtual void
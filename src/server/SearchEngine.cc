@@ -18,6 +18,7 @@ void SearchEngine::Init(std::string name, boost::filesystem::path basedir) {
 
   engine_config_fn_    = enginedir_ / "user_settings.txt";
   transformed_imgdir_  = enginedir_ / "img";
+  transformed_img_width_fn_ = enginedir_ / "img_width.txt";
   training_datadir_    = enginedir_ / "training_data";
   tmp_datadir_         = enginedir_ / "tmp";
 
@@ -50,6 +51,75 @@ void SearchEngine::Init(std::string name, boost::filesystem::path basedir) {
 //
 // Workers for each state
 //
+// result of preprocessing one image
+struct PreprocessResult {
+  PreprocessResult() : status(PREPROCESS_FAILED), transformed_size(0) {}
+  enum { PREPROCESS_DONE, PREPROCESS_UP_TO_DATE, PREPROCESS_FAILED } status;
+  unsigned int transformed_size;
+  std::string error;
+};
+
+class PreprocessWorker : public queueWorker<PreprocessResult> {
+public:
+  PreprocessWorker(SearchEngine const &engine, std::string transformed_img_width, bool reprocess)
+    : engine_(&engine), transformed_img_width_(transformed_img_width), reprocess_(reprocess) {}
+
+  void operator() ( uint32_t jobID, PreprocessResult &result ) const {
+    engine_->PreprocessImage( jobID, transformed_img_width_, reprocess_, result );
+  }
+
+private:
+  SearchEngine const *engine_;
+  std::string const transformed_img_width_;
+  bool const reprocess_;
+};
+
+// runs in the calling thread, so the only one sending messages
+class PreprocessManager : public queueManager<PreprocessResult> {
+public:
+  PreprocessManager(SearchEngine &engine, uint32_t n_jobs)
+    : engine_(&engine), n_jobs_(n_jobs), n_completed_(0), n_done_(0), n_up_to_date_(0), n_failed_(0),
+      progress_step_( std::max<uint32_t>(1, n_jobs/200) ) {}
+
+  void operator() ( uint32_t jobID, PreprocessResult &result ) {
+    ++n_completed_;
+    switch ( result.status ) {
+    case PreprocessResult::PREPROCESS_DONE:
+      ++n_done_;
+      break;
+    case PreprocessResult::PREPROCESS_UP_TO_DATE:
+      ++n_up_to_date_;
+      break;
+    default:
+      ++n_failed_;
+      engine_->SendLog("Preprocess", "\nCannot load file " + engine_->imglist_.at(jobID) + " : Error [" + result.error + "]" );
+    }
+    engine_->imglist_fn_transformed_size_.at(jobID) = result.transformed_size;
+
+    // aggregate progress, to avoid overflow of the message queue
+    if ( (n_completed_ % progress_step_) == 0 || n_completed_ == n_jobs_ ) {
+      engine_->SendProgress( "Preprocess", n_completed_, n_jobs_ );
+      engine_->SendLog("Preprocess", ".");
+    }
+  }
+
+  std::string Summary() const {
+    std::ostringstream s;
+    s << "\nPreprocessed " << n_done_ << " images, " << n_up_to_date_ << " already up to date, " << n_failed_ << " failed ";
+    return s.str();
+  }
+
+  uint32_t NumFailed() const {
+    return n_failed_;
+  }
+
+private:
+  SearchEngine *engine_;
+  uint32_t const n_jobs_;
+  uint32_t n_completed_, n_done_, n_up_to_date_, n_failed_;
+  uint32_t const progress_step_;
+};
+
 void SearchEngine::Preprocess() {
   if ( imglist_.empty() ) {
     CreateFileList();
@@ -66,74 +136,43 @@ void SearchEngine::Preprocess() {
     } else {
       SendLog("Preprocess", "\nCopying original images to [" + transformed_imgdir_.string() + "] ");
     }
-    for ( unsigned int i=0; i<imglist_.size(); i++ ) {
-      boost::filesystem::path img_rel_path = imglist_.at(i);
-      boost::filesystem::path src_fn  = original_imgdir_ / img_rel_path;
-      boost::filesystem::path dest_fn = transformed_imgdir_ / img_rel_path;
-
-      if ( !boost::filesystem::exists( dest_fn ) ) {
-        try {
-          // check if image path exists
-          if ( ! boost::filesystem::is_directory( dest_fn.parent_path() ) ) {
-            boost::filesystem::create_directories( dest_fn.parent_path() );
-          }
 
-          if (transformed_img_width != "original") {
-            Magick::Image im;
-            im.read( src_fn.string() );
-            Magick::Geometry size = im.size();
-
-            double aspect_ratio =  ((double) size.height()) / ((double) size.width());
-
-            std::stringstream s;
-            s << transformed_img_width;
-            unsigned int new_width;
-            s >> new_width;
-
-            if ( new_width < size.width() ) {
-              unsigned int new_height = (unsigned int) (new_width * aspect_ratio);
-
-              Magick::Geometry resize = Magick::Geometry(new_width, new_height);
-              im.zoom( resize );
-
-              im.write( dest_fn.string() );
-              imglist_fn_transformed_size_.at(i) = boost::filesystem::file_size(dest_fn.string().c_str());
-              // to avoid overflow of the message queue
-              if ( (i % 5) == 0 ) {
-                SendProgress( "Preprocess", i+1, imglist_.size() );
-              }
-            } else {
-              // copy the original image since original image is already smaller than requested size
-              boost::filesystem::copy_file( src_fn, dest_fn );
-              imglist_fn_transformed_size_.at(i) = imglist_fn_original_size_.at(i);
-
-              // to avoid overflow of the message queue
-              if ( (i % 50) == 0 ) {
-                SendProgress( "Preprocess", i+1, imglist_.size() );
-              }
-            }
-          } else {
-            // just copy the files
-            boost::filesystem::copy_file( src_fn, dest_fn );
-            imglist_fn_transformed_size_.at(i) = imglist_fn_original_size_.at(i);
-
-            // to avoid overflow of the message queue
-            if ( (i % 50) == 0 ) {
-              SendProgress( "Preprocess", i+1, imglist_.size() );
-            }
-          }
-          if ( (i % 50) == 0 ) {
-            SendLog("Preprocess", ".");
-          }
-        } catch (std::exception &error) {
-          SendLog("Preprocess", "\nCannot load file " + src_fn.string() + " : Error [" + error.what() + "]" );
-        }
+    // create all output directories upfront so that workers don't race on them
+    std::set< boost::filesystem::path > dest_dirs;
+    for ( unsigned int i=0; i<imglist_.size(); i++ ) {
+      dest_dirs.insert( (transformed_imgdir_ / imglist_.at(i)).parent_path() );
+    }
+    for ( std::set< boost::filesystem::path >::const_iterator it = dest_dirs.begin(); it != dest_dirs.end(); ++it ) {
+      if ( ! boost::filesystem::is_directory( *it ) ) {
+        boost::filesystem::create_directories( *it );
       }
     }
-    if (transformed_img_width != "original") {
-      SendProgress( "Preprocess", imglist_.size(), imglist_.size() );
+
+    // existing transformed images can only be kept if they were made with the same width;
+    // the stamp is removed while reprocessing so that an interrupted run is redone with the new width
+    std::string previous_img_width;
+    if ( boost::filesystem::exists( transformed_img_width_fn_ ) ) {
+      std::ifstream f( transformed_img_width_fn_.string().c_str() );
+      std::getline( f, previous_img_width );
+    }
+    bool reprocess = ( previous_img_width != transformed_img_width );
+    if ( reprocess ) {
+      boost::filesystem::remove( transformed_img_width_fn_ );
+    }
+
+    // images are independent, process them in parallel using all cores
+    uint32_t num_threads = std::max<uint32_t>( 1, boost::thread::hardware_concurrency() );
+    PreprocessWorker worker( *this, transformed_img_width, reprocess );
+    PreprocessManager manager( *this, imglist_.size() );
+    threadQueue<PreprocessResult>::start( imglist_.size(), worker, manager, num_threads );
+
+    // a failed image might have left a transformed image of the previous width behind
+    if ( manager.NumFailed() == 0 ) {
+      std::ofstream f( transformed_img_width_fn_.string().c_str() );
+      f << transformed_img_width << "\n";
     }
 
+    SendLog("Preprocess", manager.Summary());
     SendLog("Preprocess", "[Done]");
     // this is needed to unblock the ViseMessageQueue (sometimes)
     // @todo improve the design of ViseMessageQueue to avoid such blocked state
@@ -144,6 +183,71 @@ void SearchEngine::Preprocess() {
   }
 }
 
+// Thread safe, only reads the engine state.
+// Unless reprocess is set (transformed_img_width changed), an existing transformed image is kept if it is
+// not older than the original one (i.e. an interrupted preprocessing resumes where it stopped); new images
+// are written to a temporary file and then renamed so that a partially written image is never taken as up to date.
+void SearchEngine::PreprocessImage(unsigned int index, std::string transformed_img_width, bool reprocess, PreprocessResult &result) const {
+  boost::filesystem::path img_rel_path = imglist_.at(index);
+  boost::filesystem::path src_fn  = original_imgdir_ / img_rel_path;
+  boost::filesystem::path dest_fn = transformed_imgdir_ / img_rel_path;
+
+  try {
+    if ( !reprocess &&
+         boost::filesystem::exists( dest_fn ) &&
+         boost::filesystem::file_size( dest_fn ) > 0 &&
+         boost::filesystem::last_write_time( dest_fn ) >= boost::filesystem::last_write_time( src_fn ) ) {
+      result.status = PreprocessResult::PREPROCESS_UP_TO_DATE;
+      result.transformed_size = boost::filesystem::file_size( dest_fn );
+      return;
+    }
+
+    // keeps the extension as Magick++ uses it to choose the output format
+    boost::filesystem::path tmp_fn = dest_fn.parent_path() / ( ".vise_tmp_" + dest_fn.filename().string() );
+
+    bool resize = false;
+    unsigned int new_width = 0, new_height = 0;
+    if (transformed_img_width != "original") {
+      std::stringstream s;
+      s << transformed_img_width;
+      s >> new_width;
+
+      // only the header is read to decide if resizing is needed
+      std::pair<uint32_t, uint32_t> wh = imageUtil::getWidthHeightFromHeader( src_fn.string() );
+      if ( wh.first == 0 || wh.second == 0 ) {
+        wh = imageUtil::getWidthHeight( src_fn.string() );
+      }
+
+      if ( new_width < wh.first ) {
+        double aspect_ratio =  ((double) wh.second) / ((double) wh.first);
+        new_height = (unsigned int) (new_width * aspect_ratio);
+        resize = true;
+      }
+    }
+
+    if ( resize ) {
+      // lets libjpeg decode large JPEGs directly at a reduced size (at least new_width x new_height)
+      Magick::Image im;
+      im.defineValue( "jpeg", "size", boost::lexical_cast<std::string>(new_width) + "x" + boost::lexical_cast<std::string>(new_height) );
+      im.read( src_fn.string() );
+
+      im.zoom( Magick::Geometry(new_width, new_height) );
+
+      im.write( tmp_fn.string() );
+    } else {
+      // copy the original image since it is already smaller than requested size (or no resizing was requested)
+      boost::filesystem::copy_file( src_fn, tmp_fn, boost::filesystem::copy_option::overwrite_if_exists );
+    }
+    boost::filesystem::rename( tmp_fn, dest_fn );
+
+    result.status = PreprocessResult::PREPROCESS_DONE;
+    result.transformed_size = boost::filesystem::file_size( dest_fn );
+  } catch (std::exception &error) {
+    result.status = PreprocessResult::PREPROCESS_FAILED;
+    result.error = error.what();
+  }
+}
+
 void SearchEngine::Descriptor() {
   std::string const trainDescsFn  = GetEngineConfigParam("descFn");
   boost::filesystem::path train_desc_fn( trainDescsFn );
@@ -202,10 +306,25 @@ void SearchEngine::Descriptor() {
                                                std::string(SIFTscale3 ? "-scale3" : "")
                                                ).c_str() );
 
+    uint32_t maxImageSize = 0;
+    if ( EngineConfigParamExists("maxImageSize") ) {
+      maxImageSize = boost::lexical_cast<uint32_t>( GetEngineConfigParam("maxImageSize") );
+    }
+
+    // uniform sample of descriptors over all (or trainNumImages) images instead of the first ones
+    bool uniformSample = ( GetEngineConfigParam("trainSampling") == "uniform" );
+    int32_t trainNumImages = -1;
+    if ( EngineConfigParamExists("trainNumImages") ) {
+      trainNumImages = boost::lexical_cast<int32_t>( GetEngineConfigParam("trainNumImages") );
+    }
+
     buildIndex::computeTrainDescs(trainImagelistFn, trainDatabasePath,
                                   trainDescsFn,
                                   trainNumDescs,
-                                  featGetter_obj);
+                                  featGetter_obj,
+                                  maxImageSize,
+                                  uniformSample,
+                                  trainNumImages);
   }
   SendLog("Descriptor", "Completed computing descriptors");
   std::cout << "\n@todo: Message queue size = " << ViseMessageQueue::Instance()->GetSize() << std::flush;
@@ -282,10 +401,21 @@ void SearchEngine::Assign() {
       useRootSIFT = true;
     }
 
-    buildIndex::computeTrainAssigns( GetEngineConfigParam("clstFn"),
-                                     useRootSIFT,
-                                     GetEngineConfigParam("descFn"),
-                                     GetEngineConfigParam("assignFn"));
+    if ( GetEngineConfigParam("fuseAssignHamm") == "on" ) {
+      // also computes hamm (with streaming medians), so Hamm() will find it done
+      uint32_t hammEmbBits = boost::lexical_cast<uint32_t>( GetEngineConfigParam("hammEmbBits") );
+      buildIndex::computeTrainAssignsHamming( GetEngineConfigParam("clstFn"),
+                                              useRootSIFT,
+                                              GetEngineConfigParam("descFn"),
+                                              GetEngineConfigParam("assignFn"),
+                                              GetEngineConfigParam("hammFn"),
+                                              hammEmbBits);
+    } else {
+      buildIndex::computeTrainAssigns( GetEngineConfigParam("clstFn"),
+                                       useRootSIFT,
+                                       GetEngineConfigParam("descFn"),
+                                       GetEngineConfigParam("assignFn"));
+    }
   }
 }
 
@@ -305,12 +435,15 @@ void SearchEngine::Hamm() {
       useRootSIFT = true;
     }
 
+    // "streaming": fixed-memory median estimates, so the visual words are split into one chunk per worker
+    // and the training descriptors are read once per worker (instead of once per 5000 words)
     buildIndex::computeHamming(GetEngineConfigParam("clstFn"),
                                useRootSIFT,
                                GetEngineConfigParam("descFn"),
                                GetEngineConfigParam("assignFn"),
                                GetEngineConfigParam("hammFn"),
-                               hammEmbBits);
+                               hammEmbBits,
+                               GetEngineConfigParam("hammMedian") == "streaming");
   }
 }
 
@@ -349,6 +482,11 @@ void SearchEngine::Index() {
     std::istringstream s(hamm_emb_bits);
     s >> hammEmbBits;
 
+    uint32_t maxImageSize = 0;
+    if ( EngineConfigParamExists("maxImageSize") ) {
+      maxImageSize = boost::lexical_cast<uint32_t>( GetEngineConfigParam("maxImageSize") );
+    }
+
     embedderFactory *embFactory= NULL;
     if ( EngineConfigParamExists("hammEmbBits") ) {
       embFactory= new hammingEmbedderFactory(GetEngineConfigParam("hammFn"), hammEmbBits);
@@ -364,7 +502,8 @@ void SearchEngine::Index() {
                       GetEngineConfigParam("tmpDir"),
                       featGetter_obj,
                       GetEngineConfigParam("clstFn"),
-                      embFactory);
+                      embFactory,
+                      maxImageSize);
 
     delete embFactory;
   }
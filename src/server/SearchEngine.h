@@ -26,17 +26,23 @@
 #include <cassert>               // for assert()
 
 #include <boost/filesystem.hpp>  // to query/update filesystem
+#include <boost/lexical_cast.hpp>
 
 #include <Magick++.h>            // to transform images
 
 #include "ViseMessageQueue.h"
 
 #include "feat_standard.h"
+#include "image_util.h"
 #include "train_descs.h"
 #include "train_assign.h"
+#include "train_assign_hamming.h"
 #include "train_hamming.h"
 #include "build_index.h"
 #include "hamming_embedder.h"
+#include "thread_queue.h"
+
+struct PreprocessResult;
 
 class SearchEngine {
 public:
@@ -100,6 +106,7 @@ public:
 
   boost::filesystem::path original_imgdir_;
   boost::filesystem::path transformed_imgdir_;
+  boost::filesystem::path transformed_img_width_fn_; // transformed_img_width used for transformed_imgdir_
   boost::filesystem::path imglist_fn_;
   std::vector< std::string > imglist_;
   std::vector< unsigned int > imglist_fn_original_size_;
@@ -128,6 +135,11 @@ public:
 
   void InitEngineResources( std::string name );
   void RunClusterCommand( boost::filesystem::path vise_src_code_dir );
+
+  // resize/copy a single image, called in parallel by Preprocess()
+  void PreprocessImage(unsigned int index, std::string transformed_img_width, bool reprocess, PreprocessResult &result) const;
+  friend class PreprocessWorker;
+  friend class PreprocessManager;
 };
 
 #endif /* _VISE_SEARCH_ENGINE_H */
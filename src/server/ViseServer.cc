@@ -326,6 +326,13 @@ void ViseServer::HandleConnection(boost::shared_ptr<tcp::socket> p_socket) {
       return;
     }
 
+    if ( http_method_uri == "/metrics" ) {
+      // per-stage query latency histograms, in the Prometheus text format
+      SendRawResponse( "text/plain; version=0.0.4", latency::prometheusText(), p_socket );
+      p_socket->close();
+      return;
+    }
+
     if ( http_method_uri == "/favicon.ico" ) {
       // @todo not implemented yet
       SendHttp404NotFound( p_socket );
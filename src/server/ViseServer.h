@@ -51,6 +51,7 @@
 #include "hamming.h"
 #include "hamming_embedder.h"
 #include "index_entry.pb.h"
+#include "latency.h"
 #include "macros.h"
 #include "mq_filter_outliers.h"
 #include "par_queue.h"
@@ -0,0 +1,197 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "clst_centres.h"
+#include "coarse_residual.h"
+#include "index_with_data.h"
+#include "macros.h"
+#include "product_quant.h"
+#include "same_random.h"
+#include "util.h"
+
+
+
+// lists kept in vectors, with or without no-copy access (the two code paths of the batch search)
+
+class indexWithDataVectors : public indexWithData {
+
+    public:
+
+        indexWithDataVectors(uint32_t numIDs, bool noCopy) : vecIDs_(numIDs), data_(numIDs), noCopy_(noCopy) {}
+
+        void
+            add( uint32_t ID, uint32_t vecID, std::string const &data ){
+                vecIDs_[ID].push_back(vecID);
+                data_[ID]+= data;
+            }
+
+        uint32_t
+            numIDs() const { return vecIDs_.size(); }
+
+        uint32_t
+            getNumWithID( uint32_t ID ) const { return vecIDs_[ID].size(); }
+
+        uint32_t
+            getData( uint32_t ID, std::vector<uint32_t> &vecIDs, unsigned char *&data, uint32_t &size ) const {
+                vecIDs= vecIDs_[ID];
+                size= data_[ID].size();
+                data= new unsigned char[size];
+                std::copy( data_[ID].begin(), data_[ID].end(), data );
+                return vecIDs.size();
+            }
+
+        bool
+            getDataNoCopy( uint32_t ID, std::vector<uint32_t> const *&vecIDs, unsigned char const *&data, uint32_t &size ) const {
+                if (!noCopy_)
+                    return false;
+                vecIDs= &vecIDs_[ID];
+                data= reinterpret_cast<unsigned char const *>(data_[ID].data());
+                size= data_[ID].size();
+                return true;
+            }
+
+    private:
+
+        std::vector< std::vector<uint32_t> > vecIDs_;
+        std::vector<std::string> data_;
+        bool const noCopy_;
+};
+
+
+
+void
+checkSame( std::vector<nnSearcher::vecIDdist> const &a, std::vector<nnSearcher::vecIDdist> const &b ){
+    ASSERT( a.size()==b.size() );
+    for (uint32_t i= 0; i<a.size(); ++i){
+        ASSERT( a[i].ID==b[i].ID );
+        ASSERT( a[i].distSq==b[i].distSq );
+        if (i>0)
+            ASSERT( a[i-1] < a[i] );
+    }
+}
+
+
+
+int main(){
+
+    uint32_t const numDims= 8, nSubQuant= 2, subQuantK= 256;
+    uint32_t const nDistinctCoarse= 4, nCoarse= 2*nDistinctCoarse;
+    uint32_t const nVecs= 400, nQueries= 40;
+
+    sameRandomUint32 rand(1000000, 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    std::string const tempPrefix= util::getTempFileName("", "coarse_residual_test_");
+    std::vector<std::string> fns(1, tempPrefix);
+
+    // product quantizer
+    std::vector<std::string> clstFns;
+    for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub){
+        std::vector<float> centres(subQuantK*numDims/nSubQuant);
+        for (uint32_t i= 0; i<centres.size(); ++i)
+            centres[i]= randStream.getNextFloat() - 0.5f;
+        clstFns.push_back( tempPrefix + "_pq" + util::uintToShortStr(iSub) + ".e3bin" );
+        clstCentres::save( clstFns.back(), &centres[0], subQuantK, numDims/nSubQuant );
+    }
+    fns.insert(fns.end(), clstFns.begin(), clstFns.end());
+    productQuant pq(clstFns, true);
+
+    // coarse centres come in identical pairs, so equal residuals and therefore equal distances
+    // appear in different lists
+    std::vector<float> coarse(nCoarse*numDims);
+    for (uint32_t iC= 0; iC<nDistinctCoarse; ++iC)
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim)
+            coarse[(2*iC)*numDims+iDim]= coarse[(2*iC+1)*numDims+iDim]= 4*randStream.getNextFloat();
+    std::string const coarseFn= tempPrefix + "_coarse.e3bin";
+    fns.push_back(coarseFn);
+    clstCentres::save( coarseFn, &coarse[0], nCoarse, numDims );
+
+    // database: every vector goes to one of the twin cells of its nearest centre,
+    // and some are duplicated (new ID, equal distance) into the same or the twin cell
+    indexWithDataVectors idxCopy(nCoarse, false), idxNoCopy(nCoarse, true);
+    std::vector<float> vec(numDims), res(numDims);
+    uint32_t vecID= 0;
+    for (uint32_t i= 0; i<nVecs; ++i){
+        uint32_t const iC= randStream.getNext0ToN(nDistinctCoarse);
+        for (uint32_t iDim= 0; iDim<numDims; ++iDim){
+            vec[iDim]= coarse[(2*iC)*numDims+iDim] + randStream.getNextFloat() - 0.5f;
+            res[iDim]= vec[iDim] - coarse[(2*iC)*numDims+iDim];
+        }
+        std::string code;
+        pq.compress(&res[0], 1, code);
+
+        uint32_t const nCopies= 1 + (i%3==0) + (i%7==0);
+        for (uint32_t iCopy= 0; iCopy<nCopies; ++iCopy, ++vecID){
+            uint32_t const cell= 2*iC + randStream.getNext0ToN(2);
+            idxCopy.add(cell, vecID, code);
+            idxNoCopy.add(cell, vecID, code);
+        }
+    }
+
+    std::vector<float> queries(nQueries*numDims);
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        queries[i]= 4*randStream.getNextFloat();
+
+    uint32_t const nVisits[]= {1, 2, 4, nCoarse};
+    uint32_t const KNNs[]= {1, 5, 30, 10000};
+    uint32_t const numThreads[]= {1, 3, 8};
+
+    for (uint32_t iIdx= 0; iIdx<2; ++iIdx){
+        indexWithData const &idx= (iIdx==0) ? static_cast<indexWithData const &>(idxCopy) : idxNoCopy;
+
+        for (uint32_t iV= 0; iV<sizeof(nVisits)/sizeof(nVisits[0]); ++iV){
+            coarseResidual cr(coarseFn, pq, idx, nVisits[iV], false);
+
+            for (uint32_t iK= 0; iK<sizeof(KNNs)/sizeof(KNNs[0]); ++iK){
+                uint32_t const KNN= KNNs[iK];
+                std::cout<<"noCopy= "<<iIdx<<", nVisitCoarse= "<<nVisits[iV]<<", KNN= "<<KNN<<": \t"; std::cout.flush();
+
+                std::vector< std::vector<nnSearcher::vecIDdist> > single(nQueries);
+                for (uint32_t iQ= 0; iQ<nQueries; ++iQ)
+                    cr.findKNN( &queries[iQ*numDims], KNN, single[iQ] );
+
+                // repeated, as with a scheduling dependence they would differ only sometimes
+                for (uint32_t iT= 0; iT<sizeof(numThreads)/sizeof(numThreads[0]); ++iT)
+                    for (uint32_t iRep= 0; iRep<5; ++iRep){
+                        std::vector< std::vector<nnSearcher::vecIDdist> > batch;
+                        cr.findKNN( &queries[0], nQueries, KNN, batch, numThreads[iT] );
+                        ASSERT( batch.size()==nQueries );
+                        for (uint32_t iQ= 0; iQ<nQueries; ++iQ)
+                            checkSame( single[iQ], batch[iQ] );
+                    }
+
+                // check that the data actually has ties at the cut-off
+                uint32_t nTies= 0;
+                for (uint32_t iQ= 0; iQ<nQueries; ++iQ)
+                    for (uint32_t i= 1; i<single[iQ].size(); ++i)
+                        nTies+= (single[iQ][i-1].distSq == single[iQ][i].distSq);
+                std::cout<<"OK ("<<nTies<<" ties)\n";
+            }
+        }
+    }
+
+    for (uint32_t i= 0; i<fns.size(); ++i)
+        boost::filesystem::remove(fns[i]);
+
+    std::cout<<"\nAll OK\n";
+
+    return 0;
+}
@@ -15,11 +15,14 @@ No usage or redistribution is allowed without explicit permission.
 #include <vector>
 #include <string>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <math.h>
 
 #include <boost/format.hpp>
 
+#include "opq_train.h"
 #include "product_quant.h"
 
 // #include "document_map.h"
@@ -44,17 +47,20 @@ int f2(bool doCompress= false, bool doTest= true, uint32_t nSubQuant= 8, uint32_
     std::string baseFn= util::expandUser("~/Relja/Data/Jegou_ANN/ANN_SIFT1M/sift_base.fvecs");
     std::string queryFn= util::expandUser("~/Relja/Data/Jegou_ANN/ANN_SIFT1M/sift_query.fvecs");
     std::string pqFn= util::expandUser( (boost::format("~/Relja/Data/Temp/PQ/sift1M_pq_%d_%d_43.bin") % nSubQuant % subQuantK).str() );
+    std::string rotFn= "";
     #else
+    // trained with trainOPQ, the data is rotated by productQuant
     std::string clstFnsTemplate= util::expandUser( "~/Relja/Data/Temp/OPQ/clst_sift_learn_%d_%d_43_opq%02d.e3bin" );
-    std::string baseFn= util::expandUser( (boost::format("~/Relja/Data/Temp/OPQ/sift_base_subQuant%d.fvecs") % nSubQuant).str() );
-    std::string queryFn= util::expandUser( (boost::format("~/Relja/Data/Temp/OPQ/sift_query_subQuant%d.fvecs") % nSubQuant).str() );
+    std::string baseFn= util::expandUser("~/Relja/Data/Jegou_ANN/ANN_SIFT1M/sift_base.fvecs");
+    std::string queryFn= util::expandUser("~/Relja/Data/Jegou_ANN/ANN_SIFT1M/sift_query.fvecs");
     std::string pqFn= util::expandUser( (boost::format("~/Relja/Data/Temp/OPQ/sift1M_opq_%d_%d_43.bin") % nSubQuant % subQuantK).str() );
+    std::string rotFn= util::expandUser( (boost::format("~/Relja/Data/Temp/OPQ/rot_sift_learn_%d_%d_43.e3bin") % nSubQuant % subQuantK).str() );
     #endif
     
     for (unsigned i= 0; i<nSubQuant; ++i)
         clstFns[i]= (boost::format(clstFnsTemplate) % nSubQuant % subQuantK % i ).str();
     
-    productQuant pq(clstFns, true);
+    productQuant pq(clstFns, true, false, rotFn);
     
     descFromFvecsFile descFile(baseFn.c_str());
     uint32_t numDescs= descFile.numDocs();
@@ -128,6 +134,41 @@ int f2(bool doCompress= false, bool doTest= true, uint32_t nSubQuant= 8, uint32_
 
 
 
+int trainOPQ(uint32_t nSubQuant= 8, uint32_t subQuantK= 256, uint32_t numTrain= 100000){
+    
+    std::string learnFn= util::expandUser("~/Relja/Data/Jegou_ANN/ANN_SIFT1M/sift_learn.fvecs");
+    std::string clstFnsTemplate= util::expandUser( "~/Relja/Data/Temp/OPQ/clst_sift_learn_%d_%d_43_opq%02d.e3bin" );
+    std::string rotFn= util::expandUser( (boost::format("~/Relja/Data/Temp/OPQ/rot_sift_learn_%d_%d_43.e3bin") % nSubQuant % subQuantK).str() );
+    
+    descFromFvecsFile descFile(learnFn.c_str());
+    numTrain= std::min(numTrain, descFile.numDocs());
+    uint32_t const numDims= 128;
+    
+    float *descs= new float[numTrain*numDims];
+    for (uint32_t docID= 0; docID<numTrain; ++docID){
+        uint32_t numDescs_;
+        float *thisDesc;
+        descFile.getDescs(docID, numDescs_, thisDesc);
+        ASSERT( numDescs_==1 );
+        std::memcpy(descs + docID*numDims, thisDesc, numDims*sizeof(float));
+        delete []thisDesc;
+    }
+    
+    std::vector<float> rot;
+    std::vector< std::vector<float> > centres;
+    opqTrain::train(descs, numTrain, numDims, nSubQuant, subQuantK, rot, centres);
+    delete []descs;
+    
+    std::vector<std::string> clstFns(nSubQuant);
+    for (unsigned i= 0; i<nSubQuant; ++i)
+        clstFns[i]= (boost::format(clstFnsTemplate) % nSubQuant % subQuantK % i ).str();
+    opqTrain::save(rotFn, clstFns, rot, centres);
+    
+    return 0;
+}
+
+
+
 /*
 int f1(){
     
@@ -225,5 +266,7 @@ int f1(){
 
 int main(int argc, char *argv[]){
 //     return f1();
+    if (argc>1 && argv[1][0]=='o')
+        return trainOPQ( argc>2 ? atoi(argv[2]) : 8, argc>3 ? atoi(argv[3]) : 256 );
     return f2( argc>1 && argv[1][0]=='c' , argc>1 && argv[1][1]=='t', argc>2 ? atoi(argv[2]) : 8, argc>3 ? atoi(argv[3]) : 256 );
 }
@@ -14,14 +14,233 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "image_util.h"
 
+#include <algorithm>
+#include <cctype>
+#include <csetjmp>
+#include <cstdio>
 #include <iostream>
 #include <stdexcept>
 
 #include <boost/algorithm/string.hpp>
+#include <jpeglib.h>
 
 #include "util.h"
 
 
+
+namespace imageUtil {
+
+enum imageFormat { formatUnknown, formatJPEG, formatPNG, formatPNM };
+
+
+
+static imageFormat
+getFormat(FILE *f){
+    unsigned char buf[8];
+    size_t n= fread(buf, 1, 8, f);
+    rewind(f);
+    if (n>=2 && buf[0]==0xFF && buf[1]==0xD8)
+        return formatJPEG;
+    static unsigned char const pngSig[8]= {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    if (n==8 && std::equal(buf, buf+8, pngSig))
+        return formatPNG;
+    if (n>=2 && buf[0]=='P' && buf[1]>='1' && buf[1]<='6')
+        return formatPNM;
+    return formatUnknown;
+}
+
+
+
+// libjpeg calls exit() on errors by default
+struct jpegErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf setjmpBuffer;
+};
+
+
+
+static void
+jpegErrorExit(j_common_ptr cinfo){
+    char msg[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, msg);
+    std::cerr<< "imageUtil: libjpeg error: "<<msg<<"\n";
+    longjmp( reinterpret_cast<jpegErrorManager*>(cinfo->err)->setjmpBuffer, 1 );
+}
+
+
+
+// only reads the header if im==NULL
+static bool
+readJpeg(FILE *f, std::pair<uint32_t, uint32_t> &wh, grayImage *im, uint32_t maxSize){
+    
+    jpeg_decompress_struct cinfo;
+    jpegErrorManager jerr;
+    cinfo.err= jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit= jpegErrorExit;
+    
+    if (setjmp(jerr.setjmpBuffer)){
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_read_header(&cinfo, TRUE);
+    wh= std::make_pair(cinfo.image_width, cinfo.image_height);
+    
+    if (im==NULL){
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+    
+    // same decoding parameters as KMCode's ImageContent so that features are unchanged at full size
+    cinfo.dct_method= JDCT_FASTEST;
+    cinfo.do_fancy_upsampling= FALSE;
+    
+    // decode in the DCT domain at the smallest of 1/2, 1/4, 1/8 scale which keeps the larger side >=maxSize
+    uint32_t const maxSide= std::max(cinfo.image_width, cinfo.image_height);
+    uint32_t denom= 1;
+    if (maxSize>0)
+        while (denom<8 && maxSide >= 2*denom*maxSize)
+            denom*= 2;
+    cinfo.scale_num= 1;
+    cinfo.scale_denom= denom;
+    
+    jpeg_start_decompress(&cinfo);
+    
+    uint32_t const nComp= cinfo.output_components;
+    if (nComp!=1 && nComp!=3){
+        std::cerr<< "imageUtil::decodeGray: Unsupported number of JPEG components: "<<nComp<<"\n";
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    
+    im->origWidth= cinfo.image_width;
+    im->origHeight= cinfo.image_height;
+    im->width= cinfo.output_width;
+    im->height= cinfo.output_height;
+    im->scale= denom;
+    im->data.resize(static_cast<size_t>(im->width) * im->height);
+    
+    // freed by jpeg_destroy_decompress, also on error
+    JSAMPARRAY row= (*cinfo.mem->alloc_sarray)(reinterpret_cast<j_common_ptr>(&cinfo), JPOOL_IMAGE, im->width * nComp, 1);
+    
+    while (cinfo.output_scanline < cinfo.output_height){
+        uint8_t *out= &(im->data[ static_cast<size_t>(cinfo.output_scanline) * im->width ]);
+        jpeg_read_scanlines(&cinfo, row, 1);
+        JSAMPLE const *in= row[0];
+        if (nComp==1)
+            std::copy(in, in + im->width, out);
+        else
+            for (uint32_t x= 0; x < im->width; ++x, in+= 3)
+                out[x]= static_cast<uint8_t>( (in[0]+in[1]+in[2])/3.0 );
+    }
+    
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+
+
+static uint32_t
+readBigEndian32(unsigned char const *buf){
+    return (static_cast<uint32_t>(buf[0])<<24) | (static_cast<uint32_t>(buf[1])<<16) |
+           (static_cast<uint32_t>(buf[2])<<8) | static_cast<uint32_t>(buf[3]);
+}
+
+
+
+// next integer in a PNM header, skipping whitespace and comments
+static bool
+readPnmInt(FILE *f, uint32_t &val){
+    int c= fgetc(f);
+    while (c!=EOF && (isspace(c) || c=='#')){
+        if (c=='#')
+            while (c!=EOF && c!='\n')
+                c= fgetc(f);
+        c= fgetc(f);
+    }
+    if (c==EOF || !isdigit(c))
+        return false;
+    val= 0;
+    for (; c!=EOF && isdigit(c); c= fgetc(f))
+        val= val*10 + (c-'0');
+    return true;
+}
+
+};
+
+
+
+std::pair<uint32_t, uint32_t>
+imageUtil::getWidthHeightFromHeader(std::string imageFn){
+    
+    FILE *f= fopen(imageFn.c_str(), "rb");
+    if (f==NULL)
+        return std::make_pair(0,0);
+    
+    std::pair<uint32_t, uint32_t> wh(0,0);
+    bool known= true;
+    
+    switch (getFormat(f)){
+        case formatJPEG:
+            if (!readJpeg(f, wh, NULL, 0))
+                wh= std::make_pair(0,0);
+            break;
+        case formatPNG:
+            {
+                // signature, IHDR length and type, width, height
+                unsigned char buf[24];
+                if (fread(buf, 1, 24, f)==24)
+                    wh= std::make_pair(readBigEndian32(buf+16), readBigEndian32(buf+20));
+            }
+            break;
+        case formatPNM:
+            {
+                uint32_t w, h;
+                fseek(f, 2, SEEK_SET);
+                if (readPnmInt(f, w) && readPnmInt(f, h))
+                    wh= std::make_pair(w, h);
+            }
+            break;
+        default:
+            known= false;
+    }
+    
+    fclose(f);
+    
+    if (!known)
+        return getWidthHeight(imageFn);
+    return wh;
+}
+
+
+
+bool
+imageUtil::decodeGray(std::string imageFn, grayImage &im, uint32_t maxSize){
+    
+    im= grayImage();
+    
+    FILE *f= fopen(imageFn.c_str(), "rb");
+    if (f==NULL){
+        std::cerr<< "imageUtil::decodeGray: Can't open "<<imageFn<<"\n";
+        return false;
+    }
+    bool const isJpeg= (getFormat(f)==formatJPEG);
+    bool success= false;
+    if (isJpeg){
+        std::pair<uint32_t, uint32_t> wh;
+        success= readJpeg(f, wh, &im, maxSize);
+    }
+    fclose(f);
+    
+    if (isJpeg)
+        return success;
+    return decodeGrayMagick(imageFn, im);
+}
+
+
 #ifdef RR_MAGICK
 
 #include <Magick++.h>
@@ -103,6 +322,28 @@ imageUtil::getWidthHeight(std::string imageFn){
 
 
 
+bool
+imageUtil::decodeGrayMagick(std::string imageFn, grayImage &im){
+    try {
+        Magick::Image mim;
+        mim.read(imageFn);
+        im.width= im.origWidth= mim.columns();
+        im.height= im.origHeight= mim.rows();
+        im.scale= 1.0;
+        std::vector<uint8_t> rgb( static_cast<size_t>(im.width) * im.height * 3 );
+        mim.write(0, 0, im.width, im.height, "RGB", Magick::CharPixel, &rgb[0]);
+        im.data.resize( static_cast<size_t>(im.width) * im.height );
+        for (size_t i= 0; i<im.data.size(); ++i)
+            im.data[i]= static_cast<uint8_t>( (rgb[3*i]+rgb[3*i+1]+rgb[3*i+2])/3.0 );
+        return true;
+    } catch (std::exception &error) {
+        std::cerr<< "imageUtil::decodeGrayMagick: Exception= "<<error.what()<<"\n";
+        return false;
+    }
+}
+
+
+
 #else
 
 
@@ -148,4 +389,12 @@ imageUtil::getWidthHeight(std::string imageFn){
 
 
 
+bool
+imageUtil::decodeGrayMagick(std::string imageFn, grayImage &im){
+    std::cerr<< "imageUtil::decodeGrayMagick: Need Magick++ to decode non-JPEG images\n";
+    return false;
+}
+
+
+
 #endif
@@ -17,6 +17,7 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 
 
@@ -37,6 +38,36 @@ namespace imageUtil {
     std::pair<uint32_t, uint32_t>
         getWidthHeight(std::string imageFn);
     
+    // reads only the header for JPEG, PNG and PNM files (falls back to getWidthHeight for other formats), (0,0) on failure
+    std::pair<uint32_t, uint32_t>
+        getWidthHeightFromHeader(std::string imageFn);
+    
+    
+    
+    // 8-bit grayscale image, row-major, gray= (R+G+B)/3 as in the feature detector.
+    // The image might have been decoded at a reduced size where a pixel covers scale x scale original pixels:
+    // original x= decoded x * scale + (scale-1)/2 (same for y), and the ellipse a, b, c are divided by scale^2
+    struct grayImage {
+        
+        grayImage() : width(0), height(0), origWidth(0), origHeight(0), scale(1.0) {}
+        
+        uint32_t width, height;
+        uint32_t origWidth, origHeight;
+        double scale;
+        std::vector<uint8_t> data;
+        
+    };
+    
+    // decodes the image once into im. If maxSize>0 and the larger side of a JPEG is above maxSize,
+    // libjpeg decodes it directly at 1/2, 1/4 or 1/8 size (the smallest one whose larger side is still >=maxSize).
+    // Non-JPEGs need Magick++. Success?
+    bool
+        decodeGray(std::string imageFn, grayImage &im, uint32_t maxSize= 0);
+    
+    // used by decodeGray for non-JPEGs, always at full size
+    bool
+        decodeGrayMagick(std::string imageFn, grayImage &im);
+    
 };
 
 #endif
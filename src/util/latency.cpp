@@ -0,0 +1,303 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "latency.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include "timing.h"
+
+
+
+namespace latency {
+
+
+
+static char const * const stageNames_[numStages]= {
+    "request", "query_rep", "feat_extract", "assign", "posting_fetch",
+    "scoring", "sort", "daat", "ransac", "serialize" };
+
+// upper bounds in seconds
+static double const bucketBounds_[]= {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+static uint32_t const numBuckets_= sizeof(bucketBounds_)/sizeof(bucketBounds_[0]);
+
+
+
+char const *
+stageName( stage s ){
+    return stageNames_[s];
+}
+
+
+
+// histograms of one thread; only the owner thread writes, prometheusText reads concurrently, so the counters
+// are atomics with relaxed ordering (exported values can be slightly stale, but each one is a value that
+// was written) and, as there is a single writer, are incremented by a plain load and store
+struct threadStats {
+    threadStats(){
+        for (uint32_t s= 0; s<numStages; ++s){
+            for (uint32_t b= 0; b<=numBuckets_; ++b)
+                buckets_[s][b].store(0, boost::memory_order_relaxed);
+            sumNs_[s].store(0, boost::memory_order_relaxed);
+        }
+    }
+    
+    static inline void
+        increment( boost::atomic<uint64_t> &counter, uint64_t by ){
+            counter.store( counter.load(boost::memory_order_relaxed) + by, boost::memory_order_relaxed );
+        }
+    
+    boost::atomic<uint64_t> buckets_[numStages][numBuckets_+1]; // last one is +Inf, not cumulative
+    boost::atomic<uint64_t> sumNs_[numStages]; // nanoseconds, as there is no portable atomic double
+};
+
+
+
+// all threadStats ever created; when a thread exits its stats go to the free list for reuse by a new
+// thread (so the counts are kept and the number of them is bounded by the number of concurrent threads)
+static boost::mutex registryLock_;
+static std::vector<threadStats*> allStats_, freeStats_;
+
+static void
+releaseStats( threadStats *stats ){
+    boost::mutex::scoped_lock lock(registryLock_);
+    freeStats_.push_back(stats);
+}
+
+static boost::thread_specific_ptr<threadStats> myStats_(&releaseStats);
+
+static __thread queryTrace *currentTrace_= NULL;
+
+static __thread double currentDeadline_= 0;
+
+static volatile bool enabled_= true;
+
+static boost::mutex traceLogLock_;
+static FILE *traceLog_= NULL;
+
+
+
+static threadStats &
+getMyStats(){
+    threadStats *stats= myStats_.get();
+    if (stats==NULL){
+        boost::mutex::scoped_lock lock(registryLock_);
+        if (freeStats_.empty()){
+            stats= new threadStats;
+            allStats_.push_back(stats);
+        } else {
+            stats= freeStats_.back();
+            freeStats_.pop_back();
+        }
+        lock.unlock();
+        myStats_.reset(stats);
+    }
+    return *stats;
+}
+
+
+
+void
+record( stage s, double seconds ){
+    
+    if (!enabled_)
+        return;
+    
+    threadStats &stats= getMyStats();
+    uint32_t const iBucket= std::lower_bound( bucketBounds_, bucketBounds_ + numBuckets_, seconds ) - bucketBounds_;
+    threadStats::increment( stats.buckets_[s][iBucket], 1 );
+    threadStats::increment( stats.sumNs_[s], static_cast<uint64_t>( std::max(seconds, 0.0)*1e9 + 0.5 ) );
+    
+    if (currentTrace_!=NULL)
+        currentTrace_->add(s, seconds);
+}
+
+
+
+void
+setEnabled( bool enabled ){
+    enabled_= enabled;
+}
+
+
+
+bool
+isEnabled(){
+    return enabled_;
+}
+
+
+
+void
+setTraceLog( std::string const &fileName ){
+    boost::mutex::scoped_lock lock(traceLogLock_);
+    if (traceLog_!=NULL)
+        fclose(traceLog_);
+    traceLog_= NULL;
+    if (!fileName.empty()){
+        traceLog_= fopen(fileName.c_str(), "a");
+        if (traceLog_==NULL)
+            std::cerr<<"latency::setTraceLog: failed to open "<<fileName<<"\n";
+    }
+}
+
+
+
+std::string
+prometheusText(){
+    
+    // sum over threads
+    std::vector<uint64_t> buckets( numStages*(numBuckets_+1), 0 );
+    std::vector<double> sums( numStages, 0.0 );
+    {
+        boost::mutex::scoped_lock lock(registryLock_);
+        for (uint32_t iStats= 0; iStats<allStats_.size(); ++iStats){
+            threadStats const &stats= *allStats_[iStats];
+            for (uint32_t s= 0; s<numStages; ++s){
+                for (uint32_t b= 0; b<=numBuckets_; ++b)
+                    buckets[s*(numBuckets_+1) + b]+= stats.buckets_[s][b].load(boost::memory_order_relaxed);
+                sums[s]+= stats.sumNs_[s].load(boost::memory_order_relaxed) * 1e-9;
+            }
+        }
+    }
+    
+    std::ostringstream out;
+    out<<"# HELP vise_stage_latency_seconds Latency of query processing stages.\n";
+    out<<"# TYPE vise_stage_latency_seconds histogram\n";
+    
+    for (uint32_t s= 0; s<numStages; ++s){
+        uint64_t cumulative= 0;
+        for (uint32_t b= 0; b<=numBuckets_; ++b){
+            cumulative+= buckets[s*(numBuckets_+1) + b];
+            out<<"vise_stage_latency_seconds_bucket{stage=\""<<stageNames_[s]<<"\",le=\"";
+            if (b<numBuckets_)
+                out<<bucketBounds_[b];
+            else
+                out<<"+Inf";
+            out<<"\"} "<<cumulative<<"\n";
+        }
+        out<<"vise_stage_latency_seconds_sum{stage=\""<<stageNames_[s]<<"\"} "<<sums[s]<<"\n";
+        out<<"vise_stage_latency_seconds_count{stage=\""<<stageNames_[s]<<"\"} "<<cumulative<<"\n";
+    }
+    
+    return out.str();
+}
+
+
+
+queryTrace::queryTrace( std::string const &name ) : name_(name), t0_(now()), active_(currentTrace_==NULL) {
+    std::fill(total_, total_+numStages, 0.0);
+    std::fill(count_, count_+numStages, 0);
+    if (active_)
+        currentTrace_= this;
+}
+
+
+
+queryTrace::~queryTrace(){
+    
+    if (!active_)
+        return;
+    currentTrace_= NULL;
+    
+    double const total= now()-t0_;
+    if (isEnabled())
+        record(request, total);
+    
+    boost::mutex::scoped_lock lock(traceLogLock_);
+    if (traceLog_==NULL)
+        return;
+    
+    // time name total_ms stage=ms/count ...
+    fprintf(traceLog_, "%s %s %.3f", timing::getTimeString().c_str(), name_.c_str(), total*1000);
+    for (uint32_t s= request+1; s<numStages; ++s)
+        if (count_[s]>0)
+            fprintf(traceLog_, " %s=%.3f/%u", stageNames_[s], total_[s]*1000, count_[s]);
+    fprintf(traceLog_, "\n");
+    fflush(traceLog_);
+}
+
+
+
+void
+queryTrace::add( stage s, double seconds ){
+    boost::mutex::scoped_lock lock(lock_);
+    total_[s]+= seconds;
+    ++count_[s];
+}
+
+
+
+double
+queryTrace::total( stage s ) const {
+    boost::mutex::scoped_lock lock(lock_);
+    return total_[s];
+}
+
+
+
+uint32_t
+queryTrace::count( stage s ) const {
+    boost::mutex::scoped_lock lock(lock_);
+    return count_[s];
+}
+
+
+
+queryTrace *
+queryTrace::current(){
+    return currentTrace_;
+}
+
+
+
+attach::attach( queryTrace *trace ) : prev_(currentTrace_) {
+    currentTrace_= trace;
+}
+
+
+
+attach::~attach(){
+    currentTrace_= prev_;
+}
+
+
+
+double
+currentDeadline(){
+    return currentDeadline_;
+}
+
+
+
+deadline::deadline( double at ) : prev_(currentDeadline_) {
+    currentDeadline_= at;
+}
+
+
+
+deadline::~deadline(){
+    currentDeadline_= prev_;
+}
+
+};
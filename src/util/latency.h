@@ -0,0 +1,168 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include "macros.h"
+
+
+
+// Low-overhead per-stage latency instrumentation of queries.
+// A span measures one stage (monotonic clock) and records it into a histogram owned by the current thread
+// (so recording needs no locking), and into the current thread's queryTrace if there is one.
+// The histograms of all threads are summed when exported (prometheusText), e.g. by ViseServer's /metrics.
+// Spans in worker threads only go into the histograms, unless the worker attaches to the trace of the
+// query it works for (as spatial verification does, so its daat/ransac times are summed over workers).
+// Stages can nest (e.g. posting_fetch inside scoring when posting lists are fetched on the fly).
+
+namespace latency {
+    
+    enum stage {
+        request= 0,   // whole API request (recorded by queryTrace)
+        queryRep,     // getting the query representation (internal: fidx/iidx lookups; external: loading the file)
+        featExtract,  // feature extraction of an external query image
+        assign,       // visual word assignment (and embedding) of the query features
+        postingFetch, // fetching and decoding posting lists (getUniqEntries etc.)
+        scoring,      // first stage (BoW/Hamming/WGC) scoring
+        sort,         // result sorting
+        daat,         // document-at-a-time iteration to get putative matches
+        ransac,       // spatial verification of one document
+        serialize,    // formatting of the reply
+        numStages
+    };
+    
+    char const *
+        stageName( stage s );
+    
+    // seconds, monotonic
+    inline double
+        now(){
+            struct timespec t;
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            return t.tv_sec + t.tv_nsec*1e-9;
+        }
+    
+    void
+        record( stage s, double seconds );
+    
+    // globally switch off recording (on by default)
+    void
+        setEnabled( bool enabled );
+    
+    bool
+        isEnabled();
+    
+    // append one line per finished queryTrace to fileName ("" to stop)
+    void
+        setTraceLog( std::string const &fileName );
+    
+    // histograms of all stages (summed over all threads) in the Prometheus text exposition format
+    std::string
+        prometheusText();
+    
+    
+    
+    class span {
+        public:
+            explicit span( stage s ) : stage_(s), t0_( isEnabled() ? now() : 0 ) {}
+            ~span(){ if (isEnabled()) record( stage_, now()-t0_ ); }
+        private:
+            stage const stage_;
+            double const t0_;
+            DISALLOW_COPY_AND_ASSIGN(span)
+    };
+    
+    
+    
+    // while it exists, spans recorded by this thread are accumulated into it, the total is recorded as the
+    // request stage on destruction; only the outermost trace of a thread is active
+    class queryTrace {
+        public:
+            explicit queryTrace( std::string const &name );
+            ~queryTrace();
+            
+            void
+                add( stage s, double seconds );
+            
+            // accumulated so far (the request stage is only recorded on destruction)
+            double
+                total( stage s ) const;
+            
+            uint32_t
+                count( stage s ) const;
+            
+            // the active trace of this thread, or NULL
+            static queryTrace *
+                current();
+            
+        private:
+            std::string const name_;
+            double const t0_;
+            double total_[numStages];
+            uint32_t count_[numStages];
+            bool active_;
+            mutable boost::mutex lock_; // attached worker threads add concurrently
+            DISALLOW_COPY_AND_ASSIGN(queryTrace)
+    };
+    
+    
+    
+    // makes trace (can be NULL) the current trace of this thread while it exists, for worker threads
+    // doing part of a query; the trace has to outlive it
+    class attach {
+        public:
+            explicit attach( queryTrace *trace );
+            ~attach();
+        private:
+            queryTrace *prev_;
+            DISALLOW_COPY_AND_ASSIGN(attach)
+    };
+    
+    
+    
+    // Request deadlines, per thread like the trace: the long stages of a query (scoring, DAAT, RANSAC) check
+    // pastDeadline() and stop early, returning what they have so far (e.g. documents which weren't spatially
+    // verified keep their first-stage scores). Worker threads doing part of a request have to set the deadline
+    // of the request themselves (as they do with attach).
+    
+    // now() seconds, 0 if there is no deadline
+    double
+        currentDeadline();
+    
+    inline bool
+        pastDeadline(){
+            double const d= currentDeadline();
+            return d>0 && now()>=d;
+        }
+    
+    // makes at (0: none) the deadline of this thread while it exists
+    class deadline {
+        public:
+            explicit deadline( double at );
+            ~deadline();
+        private:
+            double prev_;
+            DISALLOW_COPY_AND_ASSIGN(deadline)
+    };
+    
+};
+
+#endif
@@ -0,0 +1,58 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+mappedFile::mappedFile(std::string const fileName, bool willNeed) : data_(NULL), size_(0) {
+    
+    int fd= open(fileName.c_str(), O_RDONLY);
+    if (fd<0)
+        throw std::runtime_error("mappedFile: Unable to open "+fileName);
+    
+    struct stat st;
+    if (fstat(fd, &st)!=0){
+        close(fd);
+        throw std::runtime_error("mappedFile: Unable to stat "+fileName);
+    }
+    size_= st.st_size;
+    
+    if (size_>0){
+        void *addr= mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr==MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("mappedFile: Unable to map "+fileName);
+        }
+        data_= static_cast<char const *>(addr);
+        if (willNeed)
+            madvise(addr, size_, MADV_WILLNEED);
+    }
+    
+    // the mapping stays valid
+    close(fd);
+}
+
+
+
+mappedFile::~mappedFile(){
+    if (data_!=NULL)
+        munmap(const_cast<char*>(data_), size_);
+}
@@ -0,0 +1,112 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+
+#include "macros.h"
+
+
+
+// Read-only memory mapping of a whole file, so that opening it doesn't read it and all processes
+// using the same file (e.g. cluster centres, training descriptors) share the pages through the page cache.
+
+class mappedFile {
+    
+    public:
+        
+        // throws std::runtime_error if the file can't be opened or mapped.
+        // willNeed: ask the kernel to start reading the whole file in the background
+        mappedFile(std::string const fileName, bool willNeed= false);
+        
+        ~mappedFile();
+        
+        inline uint64_t
+            size() const { return size_; }
+        
+        inline char const *
+            data() const { return data_; }
+        
+        // copies count elements starting at byte offset, works for any alignment
+        template <class T>
+        inline void
+            read(uint64_t offset, uint64_t count, T *out) const {
+                ASSERT( offset + count*sizeof(T) <= size_ );
+                std::memcpy(out, data_ + offset, count*sizeof(T));
+            }
+    
+    private:
+        
+        char const *data_;
+        uint64_t size_;
+        
+        DISALLOW_COPY_AND_ASSIGN(mappedFile)
+};
+
+
+
+// Typed view of count elements of type T (float32, uint8, ..) starting at byte offset of a mappedFile.
+// Points straight into the mapping if it is suitably aligned for T, otherwise (e.g. float32 data following
+// an odd-sized header, like in legacy .e3bin files) the data is copied once into an aligned buffer.
+// The mappedFile must outlive the view.
+
+template <class T>
+class mappedView {
+    
+    public:
+        
+        mappedView(mappedFile const &file, uint64_t offset, uint64_t count) : copy_(NULL), count_(count) {
+            ASSERT( offset + count*sizeof(T) <= file.size() );
+            char const *start= file.data() + offset;
+            if ( reinterpret_cast<uintptr_t>(start) % sizeof(T) == 0 )
+                data_= reinterpret_cast<T const *>(start);
+            else {
+                copy_= new T[count];
+                file.read<T>(offset, count, copy_);
+                data_= copy_;
+            }
+        }
+        
+        ~mappedView(){
+            if (copy_!=NULL)
+                delete []copy_;
+        }
+        
+        inline T const *
+            data() const { return data_; }
+        
+        inline uint64_t
+            size() const { return count_; }
+        
+        inline T const &
+            operator[](uint64_t i) const { return data_[i]; }
+        
+        // true if the view doesn't use private memory, i.e. pages are shared with other processes
+        inline bool
+            isShared() const { return copy_==NULL; }
+    
+    private:
+        
+        T const *data_;
+        T *copy_;
+        uint64_t const count_;
+        
+        DISALLOW_COPY_AND_ASSIGN(mappedView)
+};
+
+#endif
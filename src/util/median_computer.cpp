@@ -93,3 +93,125 @@ medianComputer::getMedian(){
         
     }
 }
+
+
+
+streamingMedianComputer::streamingMedianComputer() : lo_(0.0f), binWidth_(0.0f), num_(0) {
+}
+
+
+
+void
+streamingMedianComputer::add(float value){
+    if (num_<numExact){
+        values_[num_]= value;
+    } else {
+        if (num_==numExact)
+            toHistogram();
+        addBinned(value);
+    }
+    ++num_;
+}
+
+
+
+void
+streamingMedianComputer::toHistogram(){
+    float values[numExact];
+    std::copy(values_, values_+numExact, values);
+
+    float const minV= *std::min_element(values, values+numExact);
+    float const maxV= *std::max_element(values, values+numExact);
+    lo_= minV;
+    // slightly wider so that maxV falls inside the last bin
+    binWidth_= (maxV-minV) / (numBins-1);
+    if (!(binWidth_ > 0.0f))
+        binWidth_= std::max( fabsf(minV), 1.0f ) * 1e-6f;
+
+    std::fill(hist_, hist_+numBins, 0);
+    for (uint32_t i= 0; i<numExact; ++i)
+        addBinned(values[i]);
+}
+
+
+
+void
+streamingMedianComputer::addBinned(float value){
+
+    // grow the range until value is inside by merging pairs of bins,
+    // extending towards the side of the value
+    while (value < lo_){
+        halveIfMergeOverflows();
+        for (int32_t i= numBins-1; i >= static_cast<int32_t>(numBins/2); --i){
+            uint32_t const j= 2*i - numBins;
+            hist_[i]= hist_[j] + hist_[j+1];
+        }
+        std::fill(hist_, hist_+numBins/2, 0);
+        lo_-= numBins*binWidth_;
+        binWidth_*= 2;
+    }
+    while (value >= lo_ + numBins*binWidth_){
+        halveIfMergeOverflows();
+        for (uint32_t i= 0; i<numBins/2; ++i)
+            hist_[i]= hist_[2*i] + hist_[2*i+1];
+        std::fill(hist_+numBins/2, hist_+numBins, 0);
+        binWidth_*= 2;
+    }
+
+    uint32_t iBin= static_cast<uint32_t>( (value-lo_)/binWidth_ );
+    if (iBin>=numBins) iBin= numBins-1; // rounding
+
+    if (hist_[iBin]==0xFFFF)
+        halve();
+    ++hist_[iBin];
+}
+
+
+
+void
+streamingMedianComputer::halve(){
+    // keep the proportions, the absolute counts are irrelevant for the median
+    for (uint32_t i= 0; i<numBins; ++i)
+        hist_[i]= (hist_[i]+1)/2;
+}
+
+
+
+void
+streamingMedianComputer::halveIfMergeOverflows(){
+    // halving rounds up (so non-empty bins stay non-empty), so once might not be enough: 2*0x8000 > 0xFFFF
+    for (uint32_t i= 0; i<numBins; i+= 2)
+        while (static_cast<uint32_t>(hist_[i]) + hist_[i+1] > 0xFFFF)
+            halve();
+}
+
+
+
+float
+streamingMedianComputer::getMedian(){
+    if (num_==0)
+        return 0.0;
+
+    if (num_<=numExact){
+        // exact
+        float * const end= values_+num_;
+        std::nth_element(values_, values_ + num_/2, end);
+        float const upper= values_[num_/2];
+        if (num_%2==1)
+            return upper;
+        return ( *std::max_element(values_, values_ + num_/2) + upper ) / 2;
+    }
+
+    uint32_t total= 0;
+    for (uint32_t i= 0; i<numBins; ++i)
+        total+= hist_[i];
+
+    double const half= total/2.0;
+    uint32_t iBin= 0, found= 0;
+    for (; iBin<numBins-1 && found + hist_[iBin] < half; ++iBin)
+        found+= hist_[iBin];
+
+    double const prop= hist_[iBin]==0 ? 0.5 : (half-found)/hist_[iBin];
+    ASSERT( prop > -1e-5 && prop < 1.0+1e-5 );
+    return lo_ + (iBin+prop)*binWidth_;
+}
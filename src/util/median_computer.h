@@ -42,4 +42,48 @@ class medianComputer {
         float min_, max_;
 };
 
+
+
+// Fixed-memory (76 bytes, no heap allocations) streaming median estimator with the same interface,
+// meant for keeping one estimator per (visual word, bit) for a whole vocabulary in memory at once.
+// The first numExact values are stored and the median is exact; after that they are replaced by
+// a histogram of numBins bins whose range grows (by merging pairs of bins) to cover every value,
+// so unlike medianComputer nothing is clamped. The median is linearly interpolated inside its bin.
+
+class streamingMedianComputer {
+
+    public:
+        streamingMedianComputer();
+
+        void
+            add(float value);
+
+        float
+            getMedian();
+
+        static uint32_t const numExact= 16, numBins= 32;
+
+    private:
+
+        void
+            toHistogram();
+
+        void
+            addBinned(float value);
+
+        void
+            halve();
+
+        void
+            halveIfMergeOverflows();
+
+        // values while num_<=numExact, histogram after
+        union {
+            float values_[numExact];
+            uint16_t hist_[numBins];
+        };
+        float lo_, binWidth_;
+        uint32_t num_;
+};
+
 #endif
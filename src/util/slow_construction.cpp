@@ -24,6 +24,9 @@ No usage or redistribution is allowed without explicit permission.
 
 
 sequentialConstructions::~sequentialConstructions(){
+    // nothing was constructed (e.g. the owner failed before starting)
+    if (!started)
+        return;
     t_->join();
     delete t_;
     for (uint32_t i= 0; i<cleanups_.size(); ++i)
@@ -35,7 +35,7 @@ class sequentialConstructions {
     
     public:
         
-        sequentialConstructions(): started(false) {}
+        sequentialConstructions(): started(false), t_(NULL) {}
         ~sequentialConstructions();
         
         void addFunction(boost::function<void()> f);
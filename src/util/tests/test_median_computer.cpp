@@ -59,6 +59,57 @@ int main(){
         expected( mc.getMedian(), 10 );
     }
     
+    // streaming: exact for a few values
+    {
+        streamingMedianComputer mc;
+        mc.add(1);
+        mc.add(2);
+        mc.add(3);
+        expected( mc.getMedian(), 2 );
+        mc.add(4);
+        expected( mc.getMedian(), 2.5 );
+    }
+    
+    // streaming: approximate, values in increasing order so the range keeps growing
+    {
+        streamingMedianComputer mc;
+        for (int i= 0; i<=1000; ++i)
+            mc.add(i/100.0);
+        expected( mc.getMedian(), 5 );
+    }
+    
+    // streaming: approximate, values around the median in both directions,
+    // enough of them for the counts to be rescaled
+    {
+        streamingMedianComputer mc;
+        for (int i= 0; i<200000; ++i)
+            mc.add( 3.0 + ((i%2==0) ? 1 : -1) * (i%1000)/1000.0 );
+        expected( mc.getMedian(), 3 );
+    }
+    
+    {
+        streamingMedianComputer mc;
+        for (int i= 0; i<300; ++i)
+            mc.add(10);
+        expected( mc.getMedian(), 10 );
+    }
+    
+    // streaming: two full bins which get merged when the range grows
+    {
+        streamingMedianComputer mc;
+        // lo= 0, binWidth= 1, so the 0s and 1s are in a pair of bins
+        mc.add(31);
+        mc.add(31);
+        for (int i= 0; i<0xFFFF; ++i){
+            mc.add(0);
+            mc.add(1);
+        }
+        mc.add(100);
+        float const median= mc.getMedian();
+        std::cout<<median<<" (exp: in the first bin)\n";
+        ASSERT( median >= 0 && median < 4 );
+    }
+    
     std::cout<<"\nAll OK\n";
     
     return 0;
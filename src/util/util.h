@@ -19,6 +19,7 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <vector>
 #include <algorithm>
+#include <fstream>
 #include <stdio.h>
 #include <iostream>
 #include <unistd.h>
@@ -200,6 +201,25 @@ namespace util {
     
     
     
+    // MemAvailable from /proc/meminfo in bytes, 0 if it is not known
+    inline uint64_t
+        availableMemory(){
+            
+            std::ifstream f("/proc/meminfo");
+            std::string key, rest;
+            uint64_t kB;
+            
+            while (f>>key>>kB){
+                if (key=="MemAvailable:")
+                    return kB*1024;
+                std::getline(f, rest);
+            }
+            
+            return 0;
+        }
+    
+    
+    
     inline void
         visitFile( std::string fn ){
             
@@ -0,0 +1,55 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "engine_budget.h"
+
+#include <algorithm>
+#include <utility>
+
+
+
+namespace engineBudget {
+
+
+
+bool
+plan( uint64_t needed, uint64_t budget, std::vector<engine> const &resident, std::vector<uint32_t> &toEvict ){
+
+    toEvict.clear();
+    if (budget==0)
+        return true;
+
+    uint64_t used= 0;
+    std::vector< std::pair<uint64_t, uint32_t> > evictable;
+    for (uint32_t i= 0; i<resident.size(); ++i){
+        used+= resident[i].ramBytes;
+        if (resident[i].evictable)
+            evictable.push_back( std::make_pair(resident[i].lastUsed, i) );
+    }
+
+    // least recently used first
+    std::sort(evictable.begin(), evictable.end());
+    for (uint32_t i= 0; i<evictable.size() && used+needed>budget; ++i){
+        toEvict.push_back(evictable[i].second);
+        used-= resident[ evictable[i].second ].ramBytes;
+    }
+
+    if (used+needed>budget){
+        toEvict.clear();
+        return false;
+    }
+    return true;
+}
+
+};
@@ -0,0 +1,45 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _ENGINE_BUDGET_H_
+#define _ENGINE_BUDGET_H_
+
+#include <stdint.h>
+#include <vector>
+
+
+
+// Memory budget of the engines served by multiEngineAPI: which resident engines to evict so that
+// another one can be loaded into RAM.
+
+namespace engineBudget {
+
+    struct engine {
+        engine( uint64_t aRamBytes= 0, uint64_t aLastUsed= 0, bool aEvictable= true ) :
+            ramBytes(aRamBytes), lastUsed(aLastUsed), evictable(aEvictable) {}
+        uint64_t ramBytes;
+        uint64_t lastUsed; // larger is more recent
+        bool evictable;    // false for the ones being loaded, they count as resident but can't be evicted yet
+    };
+
+    // resident: the engines in RAM (or being loaded) other than the one to load, which needs needed bytes.
+    // Returns whether it fits into budget (0: no limit) after evicting toEvict (indices into resident, least
+    // recently used first, as few as needed); if it doesn't fit even when evicting all that can be, toEvict is
+    // empty as the engine is then served from disk and evicting the others would gain nothing
+    bool
+        plan( uint64_t needed, uint64_t budget, std::vector<engine> const &resident, std::vector<uint32_t> &toEvict );
+
+};
+
+#endif
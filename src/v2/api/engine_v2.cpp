@@ -0,0 +1,613 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "engine_v2.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lambda/construct.hpp>
+#include <boost/lambda/lambda.hpp>
+#include <boost/lambda/bind.hpp>
+
+#include <boost/property_tree/ini_parser.hpp>
+
+#include "feat_standard.h"
+#include "hamming_embedder.h"
+#include "proto_db_file.h"
+#include "python_cfg_to_ini.h"
+#include "timing.h"
+#include "util.h"
+
+
+
+// ------- engineArtefacts
+
+
+
+engineArtefacts::vocabulary::vocabulary( std::string const &clstFn ){
+
+    std::cout<<"engineArtefacts::vocabulary: Loading cluster centres\n";
+    double t0= timing::tic();
+    clstCentres_obj= new clstCentres( clstFn.c_str(), true );
+    std::cout<<"engineArtefacts::vocabulary: Loading cluster centres - DONE ("<< timing::toc(t0) <<" ms)\n";
+
+    std::cout<<"engineArtefacts::vocabulary: Constructing NN search object\n";
+    t0= timing::tic();
+
+    nn=
+    #if 1
+        fastann::nn_obj_build_kdtree(
+            clstCentres_obj->clstC_flat,
+            clstCentres_obj->numClst,
+            clstCentres_obj->numDims, 8, 1024);
+    #else
+        fastann::nn_obj_build_exact(
+            clstCentres_obj->clstC_flat,
+            clstCentres_obj->numClst,
+            clstCentres_obj->numDims);
+    #endif
+    std::cout<<"engineArtefacts::vocabulary: Constructing NN search object - DONE ("<< timing::toc(t0) << " ms)\n";
+}
+
+
+
+engineArtefacts::vocabulary::~vocabulary(){
+    delete nn;
+    delete clstCentres_obj;
+}
+
+
+
+std::string
+engineArtefacts::contentHash( std::string const &fn ){
+
+    FILE *f= fopen(fn.c_str(), "rb");
+    if (f==NULL)
+        throw std::runtime_error( std::string("engineArtefacts::contentHash: Unable to open file ") + fn );
+
+    uint64_t hash= 14695981039346656037ULL, size= 0;
+    std::vector<unsigned char> buffer(1<<20);
+    size_t numRead;
+    while ( (numRead= fread(&buffer[0], 1, buffer.size(), f))>0 ){
+        for (size_t i= 0; i<numRead; ++i){
+            hash^= buffer[i];
+            hash*= 1099511628211ULL;
+        }
+        size+= numRead;
+    }
+    fclose(f);
+
+    return ( boost::format("%016x_%d") % hash % size ).str();
+}
+
+
+
+boost::shared_ptr<engineArtefacts::vocabulary const>
+engineArtefacts::getVocabulary( std::string const &clstFn ){
+
+    std::string const key= contentHash(clstFn);
+
+    boost::mutex::scoped_lock lock(lock_);
+    boost::shared_ptr<vocabulary const> voc= vocabularies_[key].lock();
+    if (voc){
+        std::cout<<"engineArtefacts::getVocabulary: sharing the loaded "<<clstFn<<"\n";
+    } else {
+        voc.reset( new vocabulary(clstFn) );
+        vocabularies_[key]= voc;
+    }
+    return voc;
+}
+
+
+
+boost::shared_ptr<hammingEmbedderFactory const>
+engineArtefacts::getHammingEmbedderFactory( std::string const &trainHammFn, uint32_t numBits ){
+
+    std::string const key= ( boost::format("%s_%d") % contentHash(trainHammFn) % numBits ).str();
+
+    boost::mutex::scoped_lock lock(lock_);
+    boost::shared_ptr<hammingEmbedderFactory const> factory= hammingFactories_[key].lock();
+    if (factory){
+        std::cout<<"engineArtefacts::getHammingEmbedderFactory: sharing the loaded "<<trainHammFn<<"\n";
+    } else {
+        factory.reset( new hammingEmbedderFactory(trainHammFn, numBits) );
+        hammingFactories_[key]= factory;
+    }
+    return factory;
+}
+
+
+
+uint32_t
+engineArtefacts::numLoaded(){
+
+    boost::mutex::scoped_lock lock(lock_);
+    uint32_t num= 0;
+
+    std::map< std::string, boost::weak_ptr<vocabulary const> >::iterator itV= vocabularies_.begin();
+    while (itV!=vocabularies_.end())
+        if (itV->second.expired())
+            vocabularies_.erase(itV++);
+        else {
+            ++num; ++itV;
+        }
+
+    std::map< std::string, boost::weak_ptr<hammingEmbedderFactory const> >::iterator itH= hammingFactories_.begin();
+    while (itH!=hammingFactories_.end())
+        if (itH->second.expired())
+            hammingFactories_.erase(itH++);
+        else {
+            ++num; ++itH;
+        }
+
+    return num;
+}
+
+
+
+// ------- engineV2
+
+
+
+void
+engineV2::readConfig( std::string const &configFn, boost::property_tree::ptree &pt ){
+    // pythonCfgToIni would exit
+    if (!boost::filesystem::exists(configFn))
+        throw std::runtime_error( std::string("engineV2::readConfig: Missing config file ") + configFn );
+    std::string tempConfigFn= util::getTempFileName();
+    pythonCfgToIni( configFn, tempConfigFn );
+    boost::property_tree::ini_parser::read_ini(tempConfigFn, pt);
+    remove(tempConfigFn.c_str());
+}
+
+
+
+void
+engineV2::getFiles( std::string const &dsetname, boost::property_tree::ptree const &pt, std::vector<std::string> &fns ){
+
+    fns.clear();
+    fns.push_back( util::expandUser(pt.get<std::string>( dsetname+".dsetFn" )) );
+    fns.push_back( util::expandUser(pt.get<std::string>( dsetname+".iidxFn" )) );
+    fns.push_back( util::expandUser(pt.get<std::string>( dsetname+".fidxFn" )) );
+    fns.push_back( util::expandUser(pt.get<std::string>( dsetname+".wghtFn" )) );
+    boost::optional<std::string> const clstFn= pt.get_optional<std::string>( dsetname+".clstFn" );
+    if (clstFn.is_initialized())
+        fns.push_back( util::expandUser(*clstFn) );
+    if (pt.get_optional<uint32_t>( dsetname+".hammEmbBits" ).is_initialized())
+        fns.push_back( util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" )) + "hamm.v2bin" );
+
+    // the loaders of most of them exit on a missing file, which would take a running server down on a reload
+    for (uint32_t i= 0; i<fns.size(); ++i)
+        if (!boost::filesystem::is_regular_file(fns[i]))
+            throw std::runtime_error( std::string("engineV2: Missing file ") + fns[i] );
+}
+
+
+
+uint64_t
+engineV2::estimateMemory( std::string const &dsetname, std::string const &configFn ){
+
+    boost::property_tree::ptree pt;
+    readConfig(configFn, pt);
+
+    std::vector<std::string> fns;
+    getFiles(dsetname, pt, fns);
+
+    uint64_t total= 0;
+    for (uint32_t i= 0; i<fns.size(); ++i)
+        total+= boost::filesystem::file_size(fns[i]);
+    return total;
+}
+
+
+
+engineV2::engineV2( std::string const &dsetname, std::string const &configFn, indexMode mode, engineArtefacts &artefacts )
+        : switchFidx_(NULL), switchIidx_(NULL),
+          clstCentres_obj_(NULL),
+          nn_(NULL) {
+
+    boost::property_tree::ptree pt;
+    readConfig(configFn, pt);
+
+    // throws if any is missing
+    std::vector<std::string> fns;
+    getFiles(dsetname, pt, fns);
+
+    // ------------------------------------ read config
+
+    std::string const dsetFn= util::expandUser(pt.get<std::string>( dsetname+".dsetFn" ));
+    boost::optional<std::string> const clstFn= pt.get_optional<std::string>( dsetname+".clstFn" );
+    std::string const iidxFn= util::expandUser(pt.get<std::string>( dsetname+".iidxFn" ));
+    std::string const fidxFn= util::expandUser(pt.get<std::string>( dsetname+".fidxFn" ));
+    std::string const wghtFn= util::expandUser(pt.get<std::string>( dsetname+".wghtFn" ));
+
+    boost::optional<uint32_t> const hammEmbBits= pt.get_optional<uint32_t>( dsetname+".hammEmbBits" );
+    bool const useHamm= hammEmbBits.is_initialized();
+
+    std::string const docMapFindPath= pt.get<std::string>( dsetname+".docMapFindPath", "" );
+    boost::optional<std::string> const docMapReplacePath= pt.get_optional<std::string>( dsetname+".docMapReplacePath" );
+    std::string databasePath= pt.get<std::string>( dsetname+".databasePath", "");
+    if (docMapReplacePath.is_initialized() && databasePath.length()>0)
+        throw std::runtime_error("engineV2: Only one of docMapReplacePath and databasePath can be given");
+    if (docMapReplacePath.is_initialized())
+        databasePath= *docMapReplacePath;
+
+    bool useRootSIFT= pt.get<bool>(dsetname+".RootSIFT", true);
+
+    spatParams spatParamsObj;
+    spatParamsObj.guided= pt.get<bool>(dsetname+".spatialGuided", false);
+    spatParamsObj.adaptive= pt.get<bool>(dsetname+".spatialAdaptive", false);
+    spatParamsObj.adaptiveBatch= pt.get<uint32_t>(dsetname+".spatialAdaptiveBatch", spatParamsObj.adaptiveBatch);
+    spatParamsObj.adaptiveScoreRatio= pt.get<float>(dsetname+".spatialScoreRatio", spatParamsObj.adaptiveScoreRatio);
+    spatParamsObj.timeBudget= pt.get<double>(dsetname+".spatialTimeBudget", 0.0);
+
+    // near duplicates request, off by default as all documents are sketched at startup
+    bool const useNearDup= pt.get<bool>(dsetname+".nearDup", false);
+    nearDupParams nearDupParamsObj;
+    nearDupParamsObj.numBands= pt.get<uint32_t>(dsetname+".nearDupBands", nearDupParamsObj.numBands);
+    nearDupParamsObj.rowsPerBand= pt.get<uint32_t>(dsetname+".nearDupRows", nearDupParamsObj.rowsPerBand);
+    nearDupParamsObj.jaccardThr= pt.get<float>(dsetname+".nearDupJaccardThr", nearDupParamsObj.jaccardThr);
+    nearDupParamsObj.maxBucketSize= pt.get<uint32_t>(dsetname+".nearDupMaxBucketSize", nearDupParamsObj.maxBucketSize);
+    nearDupParamsObj.minWords= pt.get<uint32_t>(dsetname+".nearDupMinWords", nearDupParamsObj.minWords);
+    nearDupParamsObj.seed= pt.get<uint32_t>(dsetname+".nearDupSeed", nearDupParamsObj.seed);
+    std::string const nearDupConfirm= pt.get<std::string>(dsetname+".nearDupConfirm", "none");
+    uint32_t const nearDupMinMatches= pt.get<uint32_t>(dsetname+".nearDupMinMatches", 10);
+    if (!( nearDupConfirm=="none" || nearDupConfirm=="spatial" || (nearDupConfirm=="hamming" && useHamm) ))
+        throw std::runtime_error( std::string("engineV2: Bad nearDupConfirm ") + nearDupConfirm );
+
+    dset_.reset( new datasetV2( dsetFn, databasePath, docMapFindPath ) ); // needed for register
+
+    std::cout<<dset_->getFn( 0 )<<"\n";;
+
+
+    // Set up forward and inverted index
+
+    ramBytes_= boost::filesystem::file_size(fidxFn) + boost::filesystem::file_size(iidxFn);
+
+    // opened first as this is where a bad file throws
+    dbFidx_file_.reset( new protoDbFile(fidxFn) );
+    dbIidx_file_.reset( new protoDbFile(iidxFn) );
+
+    if (mode==inRam) {
+        std::cout<<"engineV2::engineV2: Loading indexes into RAM\n";
+        double t0= timing::tic();
+
+        dbFidx_.reset( new protoDbInRam(*dbFidx_file_) );
+        dbIidx_.reset( new protoDbInRam(*dbIidx_file_) );
+
+        std::cout<<"engineV2::engineV2: Loading indexes into RAM - DONE ("<< timing::toc(t0) <<" ms)\n";
+    } else if (mode==switchable) {
+        switchFidx_= new protoDbSwitchable(*dbFidx_file_);
+        dbFidx_.reset(switchFidx_);
+
+        switchIidx_= new protoDbSwitchable(*dbIidx_file_);
+        dbIidx_.reset(switchIidx_);
+    } else {
+        consQueue_.reset( new sequentialConstructions() );
+
+        // the file dbs are kept (not deleted once the in-RAM ones are constructed) so that everything is
+        // owned by this object
+        boost::function<protoDb*()> fidxInRamConstructor= boost::lambda::bind(
+            boost::lambda::new_ptr<protoDbInRam>(),
+            boost::cref(*dbFidx_file_) );
+        dbFidx_.reset( new protoDbInRamStartDisk( *dbFidx_file_, fidxInRamConstructor, false, consQueue_.get() ) );
+
+        boost::function<protoDb*()> iidxInRamConstructor= boost::lambda::bind(
+            boost::lambda::new_ptr<protoDbInRam>(),
+            boost::cref(*dbIidx_file_) );
+        dbIidx_.reset( new protoDbInRamStartDisk( *dbIidx_file_, iidxInRamConstructor, false, consQueue_.get() ) );
+
+        // start the construction of inRam stuff
+        consQueue_->start();
+    }
+
+    fidx_.reset( new protoIndex(*dbFidx_, false) );
+    iidx_.reset( new protoIndex(*dbIidx_, false) );
+
+
+    // feature getter / assigner
+
+    if (clstFn.is_initialized()){
+
+        // feature getter
+        bool SIFTscale3= pt.get<bool>( dsetname+".SIFTscale3", true);
+        featGetter_obj_.reset( new featGetter_standard( (
+            std::string("hesaff-") +
+            std::string((useRootSIFT ? "rootsift" : "sift")) +
+            std::string(SIFTscale3 ? "-scale3" : "")
+            ).c_str() ) );
+
+        // clusters and NN search object
+        vocabulary_= artefacts.getVocabulary( util::expandUser(*clstFn) );
+        clstCentres_obj_= vocabulary_->clstCentres_obj;
+        nn_= vocabulary_->nn;
+
+        // soft assigner
+        if (!useHamm) {
+            if (useRootSIFT)
+                SA_.reset( new SA_exp( 0.02 ) );
+            else
+                SA_.reset( new SA_exp( 6250 ) );
+        }
+    }
+
+
+    // embedder
+    if (useHamm){
+        std::string const trainFilesPrefix= util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" ));
+        std::string const trainHammFn= trainFilesPrefix + "hamm.v2bin";
+
+        embFactory_= artefacts.getHammingEmbedderFactory(trainHammFn, *hammEmbBits);
+    }
+    else
+        embFactory_.reset( new noEmbedderFactory );
+
+    // create retrievers
+    retrieverFromIter *baseRetriever;
+    tfidfObj_.reset( new tfidfV2(
+        iidx_.get(), fidx_.get(), wghtFn,
+        featGetter_obj_.get(), nn_, SA_.get()) );
+
+    if (useHamm){
+        hammingObj_.reset( new hamming(
+            *tfidfObj_,
+            iidx_.get(),
+            *dynamic_cast<hammingEmbedderFactory const *>(embFactory_.get()),
+            fidx_.get(),
+            featGetter_obj_.get(), nn_, clstCentres_obj_) );
+        baseRetriever= hammingObj_.get();
+    } else
+        baseRetriever= tfidfObj_.get();
+
+    spatVerifObj_.reset( new spatialVerifV2(
+        *baseRetriever, iidx_.get(), fidx_.get(), true,
+        featGetter_obj_.get(), nn_, clstCentres_obj_,
+        spatParamsObj) );
+
+    // multiple queries
+
+    mqOrig_.reset( new multiQueryMax( *spatVerifObj_ ) );
+    multiQuery *mq;
+
+    if (hammingObj_){
+        mqFilter_.reset( new mqFilterOutliers(
+                        *mqOrig_,
+                        *spatVerifObj_,
+                        *dynamic_cast<hammingEmbedderFactory const *>(embFactory_.get()) ) );
+        mq= mqFilter_.get();
+    } else
+        mq= mqOrig_.get();
+
+    // near duplicates
+
+    if (useNearDup){
+        nearDupObj_.reset( new nearDuplicates( *fidx_, fidx_->numIDs(), nearDupParamsObj ) );
+        if (nearDupConfirm=="hamming")
+            nearDupConfirmerObj_.reset( new nearDupHammingConfirmer(
+                                    *hammingObj_,
+                                    *dynamic_cast<hammingEmbedderFactory const *>(embFactory_.get()),
+                                    nearDupMinMatches ) );
+        else if (nearDupConfirm=="spatial")
+            nearDupConfirmerObj_.reset( new nearDupSpatialConfirmer( *spatVerifObj_, nearDupMinMatches ) );
+    }
+
+    // API object
+
+    API_obj_.reset( new API( *spatVerifObj_, mq, *dset_, nearDupObj_.get(), nearDupConfirmerObj_.get() ) );
+}
+
+
+
+engineV2::~engineV2(){
+    // the members are released in the reverse order of declaration
+    std::cout<<"engineV2::~engineV2: releasing\n";
+}
+
+
+
+void
+engineV2::loadToRam() const {
+    if (switchFidx_==NULL)
+        return;
+    std::cout<<"engineV2::loadToRam: Loading indexes into RAM\n";
+    double t0= timing::tic();
+    switchFidx_->loadToRam();
+    switchIidx_->loadToRam();
+    std::cout<<"engineV2::loadToRam: Loading indexes into RAM - DONE ("<< timing::toc(t0) <<" ms)\n";
+}
+
+
+
+void
+engineV2::evictFromRam() const {
+    if (switchFidx_==NULL)
+        return;
+    switchIidx_->evictFromRam();
+    switchFidx_->evictFromRam();
+    std::cout<<"engineV2::evictFromRam: indexes evicted, "<<(ramBytes_>>20)<<" MB freed\n";
+}
+
+
+
+bool
+engineV2::isInRam() const {
+    return switchFidx_==NULL || (switchFidx_->inRam() && switchIidx_->inRam());
+}
+
+
+
+// ------- reloadableAPI
+
+
+
+reloadableAPI::reloadableAPI( std::string const &dsetname, std::string const &configFn, double memFactor,
+                              engineArtefacts *artefacts, bool evictable )
+        : dsetname_(dsetname),
+          configFn_(configFn),
+          memFactor_(memFactor),
+          evictable_(evictable),
+          ownArtefacts_(artefacts==NULL ? new engineArtefacts() : NULL),
+          artefacts_(artefacts==NULL ? ownArtefacts_ : artefacts),
+          generation_(0),
+          reloading_(false),
+          reloadStatus_("none"),
+          reloadThread_(NULL) {
+    current_.reset( new engineV2(dsetname, configFn,
+                                 evictable_ ? engineV2::switchable : engineV2::startDisk,
+                                 *artefacts_) );
+}
+
+
+
+reloadableAPI::~reloadableAPI(){
+    if (reloadThread_!=NULL){
+        reloadThread_->join();
+        delete reloadThread_;
+    }
+    current_.reset();
+    if (ownArtefacts_!=NULL)
+        delete ownArtefacts_;
+}
+
+
+
+reloadableAPI::engineGeneration
+reloadableAPI::current() const {
+    boost::mutex::scoped_lock lock(lock_);
+    return current_;
+}
+
+
+
+std::string
+reloadableAPI::getReply( boost::property_tree::ptree &pt, std::string const &request ) const {
+
+    if ( pt.count("reload") ){
+
+        return startReload( util::expandUser(pt.get<std::string>("reload.configFn", configFn_)) );
+
+    } else if ( pt.count("reloadStatus") ){
+
+        boost::mutex::scoped_lock lock(lock_);
+        return ( boost::format("<reloadStatus generation=\"%d\" reloading=\"%d\" status=\"%s\"/>")
+                 % generation_ % reloading_ % reloadStatus_ ).str();
+
+    }
+
+    // the generation stays alive until the request is done, even if a new one is swapped in meanwhile
+    engineGeneration engine= current();
+    return engine->getAPI().getReply(pt, request);
+}
+
+
+
+bool
+reloadableAPI::getDatasetReply( boost::property_tree::ptree &pt, std::string &reply ) const {
+    engineGeneration engine= current();
+    return engine->getAPI().getDatasetReply(pt, reply);
+}
+
+
+
+std::string
+reloadableAPI::startReload( std::string const &configFn ) const {
+
+    {
+        boost::mutex::scoped_lock lock(lock_);
+        if (reloading_)
+            return "<reload status=\"rejected\" reason=\"inProgress\"/>";
+        // claimed, so the (slow) checks below don't hold the lock which every request takes
+        reloading_= true;
+    }
+
+    // both generations are in RAM until the old one is released;
+    // also refuses a config with missing keys or files instead of failing (or exiting) while loading
+    uint64_t needed= 0;
+    std::string rejection;
+    try {
+        needed= static_cast<uint64_t>( memFactor_ * engineV2::estimateMemory(dsetname_, configFn) );
+        uint64_t const available= util::availableMemory();
+        if (available>0 && needed>available){
+            std::cerr<<"reloadableAPI::startReload: not enough memory, need "<<(needed>>20)<<" MB, available "<<(available>>20)<<" MB\n";
+            rejection= ( boost::format("<reload status=\"rejected\" reason=\"memory\" neededMB=\"%d\" availableMB=\"%d\"/>")
+                         % (needed>>20) % (available>>20) ).str();
+        }
+    } catch (std::exception &e) {
+        std::cerr<<"reloadableAPI::startReload: bad config: "<<e.what()<<"\n";
+        rejection= "<reload status=\"rejected\" reason=\"config\"/>";
+    }
+
+    boost::mutex::scoped_lock lock(lock_);
+
+    if (rejection.length()>0){
+        reloading_= false;
+        return rejection;
+    }
+
+    if (reloadThread_!=NULL){
+        // previous one is done, just clean up
+        reloadThread_->join();
+        delete reloadThread_;
+    }
+    reloadStatus_= "loading";
+    reloadThread_= new boost::thread( boost::bind(&reloadableAPI::reload, this, configFn) );
+
+    return ( boost::format("<reload status=\"started\" generation=\"%d\"/>") % (generation_+1) ).str();
+}
+
+
+
+void
+reloadableAPI::reload( std::string configFn ) const {
+
+    std::cout<<"reloadableAPI::reload: loading new generation from "<<configFn<<"\n";
+    double t0= timing::tic();
+
+    engineGeneration newEngine;
+    try {
+        if (evictable_){
+            // stay where the old generation is, if it gets evicted meanwhile the new one is evicted below
+            newEngine.reset( new engineV2(dsetname_, configFn, engineV2::switchable, *artefacts_) );
+            if (current()->isInRam())
+                newEngine->loadToRam();
+        } else
+            newEngine.reset( new engineV2(dsetname_, configFn, engineV2::inRam, *artefacts_) );
+    } catch (std::exception &e) {
+        std::cerr<<"reloadableAPI::reload: failed: "<<e.what()<<"\n";
+        boost::mutex::scoped_lock lock(lock_);
+        reloading_= false;
+        reloadStatus_= "failed";
+        return;
+    }
+
+    uint32_t generation;
+    {
+        boost::mutex::scoped_lock lock(lock_);
+        if (evictable_ && !current_->isInRam())
+            newEngine->evictFromRam();
+        current_.swap(newEngine);
+        generation= ++generation_;
+        reloading_= false;
+        reloadStatus_= "done";
+    }
+
+    std::cout<<"reloadableAPI::reload: generation "<<generation<<" swapped in ("<<timing::toc(t0)<<" ms)\n";
+
+    // newEngine now holds the old generation, which is released here or by the last request using it
+}
@@ -0,0 +1,257 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _ENGINE_V2_H_
+#define _ENGINE_V2_H_
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <fastann.hpp>
+
+#include "abs_api.h"
+#include "clst_centres.h"
+#include "dataset_v2.h"
+#include "embedder.h"
+#include "feat_getter.h"
+#include "hamming.h"
+#include "hamming_embedder.h"
+#include "macros.h"
+#include "mq_filter_outliers.h"
+#include "multi_query.h"
+#include "near_dup.h"
+#include "proto_db.h"
+#include "proto_index.h"
+#include "slow_construction.h"
+#include "soft_assigner.h"
+#include "spatial_api.h"
+#include "spatial_verif_v2.h"
+#include "tfidf_v2.h"
+
+
+
+// Vocabularies (cluster centres with the NN search structure on them) and Hamming embedders, which are the
+// largest parts of an engine besides the indexes, loaded once per file content (not name, as engines are often
+// built with copies of the same files) and shared by all engines and generations which use them; an artefact
+// is released when the last engine using it is.
+class engineArtefacts {
+
+    public:
+
+        struct vocabulary {
+
+            vocabulary( std::string const &clstFn );
+
+            ~vocabulary();
+
+            clstCentres const *clstCentres_obj;
+            fastann::nn_obj<float> const *nn;
+
+            DISALLOW_COPY_AND_ASSIGN(vocabulary)
+        };
+
+        engineArtefacts() {}
+
+        boost::shared_ptr<vocabulary const>
+            getVocabulary( std::string const &clstFn );
+
+        boost::shared_ptr<hammingEmbedderFactory const>
+            getHammingEmbedderFactory( std::string const &trainHammFn, uint32_t numBits );
+
+        // number of artefacts currently in use
+        uint32_t
+            numLoaded();
+
+        // FNV-1a of the file contents, combined with its size
+        static std::string
+            contentHash( std::string const &fn );
+
+    private:
+
+        // loading holds the lock: an artefact requested by several engines at the same time is loaded once
+        boost::mutex lock_;
+        std::map< std::string, boost::weak_ptr<vocabulary const> > vocabularies_;
+        std::map< std::string, boost::weak_ptr<hammingEmbedderFactory const> > hammingFactories_;
+
+        DISALLOW_COPY_AND_ASSIGN(engineArtefacts)
+};
+
+
+
+// One generation of the engine api_v2 serves: the dataset, indexes, retrievers and the API on top of them,
+// all constructed from the dsetname section of the config file, with the vocabulary and Hamming embedder
+// from artefacts. The iidx and fidx are:
+// startDisk:  used from disk until they are loaded into RAM in the background (fast startup)
+// inRam:      loaded into RAM in the constructor (for reloads, so that a new generation is as fast as the old
+//             one from the start)
+// switchable: used from disk until loadToRam(), and can be evicted back to disk (see multiEngineAPI)
+class engineV2 {
+
+    public:
+
+        enum indexMode { startDisk, inRam, switchable };
+
+        engineV2( std::string const &dsetname, std::string const &configFn, indexMode mode, engineArtefacts &artefacts );
+
+        ~engineV2();
+
+        inline API const &
+            getAPI() const { return *API_obj_; }
+
+        inline datasetV2 const &
+            getDataset() const { return *dset_; }
+
+        // the retriever behind getAPI() (spatial verification on top of tf-idf or Hamming)
+        inline spatialVerifV2 const &
+            getRetriever() const { return *spatVerifObj_; }
+
+        // loadToRam and evictFromRam do nothing and isInRam is true unless the mode is switchable;
+        // they can be called while the engine is serving requests
+        void
+            loadToRam() const;
+
+        void
+            evictFromRam() const;
+
+        bool
+            isInRam() const;
+
+        // RAM taken by the iidx and fidx when loaded
+        inline uint64_t
+            ramBytes() const { return ramBytes_; }
+
+        // reads a (Python style) config file
+        static void
+            readConfig( std::string const &configFn, boost::property_tree::ptree &pt );
+
+        // RAM needed by the engine in bytes (at least), estimated from the sizes of the files it loads
+        static uint64_t
+            estimateMemory( std::string const &dsetname, std::string const &configFn );
+
+    private:
+
+        // checks that all files the engine loads exist, throws otherwise
+        static void
+            getFiles( std::string const &dsetname, boost::property_tree::ptree const &pt, std::vector<std::string> &fns );
+
+        // released in the reverse order, so that nothing is deleted before the objects using it,
+        // also when the constructor throws part-way through
+        boost::scoped_ptr<datasetV2> dset_;
+        boost::scoped_ptr<protoDb> dbFidx_file_, dbIidx_file_, dbFidx_, dbIidx_;
+        protoDbSwitchable *switchFidx_, *switchIidx_; // dbFidx_ and dbIidx_ in the switchable mode
+        boost::scoped_ptr<protoIndex> fidx_, iidx_;
+        uint64_t ramBytes_;
+
+        boost::scoped_ptr<featGetter> featGetter_obj_;
+        boost::shared_ptr<engineArtefacts::vocabulary const> vocabulary_;
+        clstCentres const *clstCentres_obj_; // owned by vocabulary_
+        fastann::nn_obj<float> const *nn_;
+        boost::scoped_ptr<softAssigner> SA_;
+        boost::shared_ptr<embedderFactory const> embFactory_;
+
+        boost::scoped_ptr<tfidfV2> tfidfObj_;
+        boost::scoped_ptr<hamming> hammingObj_;
+        boost::scoped_ptr<spatialVerifV2> spatVerifObj_;
+        boost::scoped_ptr<multiQueryMax> mqOrig_;
+        boost::scoped_ptr<mqFilterOutliers> mqFilter_;
+        boost::scoped_ptr<nearDuplicates> nearDupObj_;
+        boost::scoped_ptr<nearDupConfirmer> nearDupConfirmerObj_;
+
+        boost::scoped_ptr<API> API_obj_;
+
+        // last, so that the background loading is finished first
+        boost::scoped_ptr<sequentialConstructions> consQueue_;
+
+        DISALLOW_COPY_AND_ASSIGN(engineV2)
+};
+
+
+
+// Serves the current generation of the engine and swaps in a new one without stopping:
+// the reload request (optionally with reload.configFn, otherwise the config file is re-read) constructs a new
+// generation in the background while queries are served by the old one, which is then atomically replaced.
+// Every request holds a reference to the generation it started with, so in-flight requests finish on the old
+// generation, which is released when the last of them is done.
+// Before loading, the estimated memory of the new generation times memFactor is checked against the available
+// memory as both generations are in RAM during the swap; the reload is rejected if there isn't enough.
+// reloadStatus returns the generation number and the status of the last reload.
+// Artefacts are shared through the given cache (own one if NULL), and evictable engines use the switchable
+// index mode, a new generation is loaded into RAM only if the old one was in RAM.
+class reloadableAPI : public absAPI {
+
+    public:
+
+        reloadableAPI( std::string const &dsetname, std::string const &configFn, double memFactor= 1.5,
+                       engineArtefacts *artefacts= NULL, bool evictable= false );
+
+        ~reloadableAPI();
+
+        // of the current generation, see engineV2
+        inline void
+            loadToRam() const { current()->loadToRam(); }
+
+        inline void
+            evictFromRam() const { current()->evictFromRam(); }
+
+        inline bool
+            isInRam() const { return current()->isInRam(); }
+
+        inline uint64_t
+            ramBytes() const { return current()->ramBytes(); }
+
+        std::string
+            getReply( boost::property_tree::ptree &pt, std::string const &request ) const;
+
+        bool
+            getDatasetReply( boost::property_tree::ptree &pt, std::string &reply ) const;
+
+    private:
+
+        typedef boost::shared_ptr<engineV2 const> engineGeneration;
+
+        engineGeneration
+            current() const;
+
+        std::string
+            startReload( std::string const &configFn ) const;
+
+        void
+            reload( std::string configFn ) const;
+
+        std::string const dsetname_;
+        std::string const configFn_;
+        double const memFactor_;
+        bool const evictable_;
+        engineArtefacts *ownArtefacts_, *artefacts_;
+
+        // all guarded by lock_ (as getReply is const)
+        mutable boost::mutex lock_;
+        mutable engineGeneration current_;
+        mutable uint32_t generation_;
+        mutable bool reloading_;
+        mutable std::string reloadStatus_;
+        mutable boost::thread *reloadThread_;
+
+        DISALLOW_COPY_AND_ASSIGN(reloadableAPI)
+};
+
+#endif
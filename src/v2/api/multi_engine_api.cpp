@@ -0,0 +1,270 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "multi_engine_api.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+
+#include "engine_budget.h"
+#include "timing.h"
+#include "util.h"
+
+
+
+multiEngineAPI::multiEngineAPI( uint64_t memBudget, double reloadMemFactor )
+        : memBudget_(memBudget),
+          reloadMemFactor_(reloadMemFactor),
+          useCounter_(0),
+          numLoading_(0) {
+}
+
+
+
+multiEngineAPI::~multiEngineAPI(){
+    boost::mutex::scoped_lock lock(lock_);
+    while (numLoading_>0)
+        loadingDone_.wait(lock);
+}
+
+
+
+bool
+multiEngineAPI::addEngine( std::string const &name, std::string const &configFn ) const {
+
+    {
+        boost::mutex::scoped_lock lock(lock_);
+        if (engines_.count(name))
+            return false;
+    }
+
+    std::cout<<"multiEngineAPI::addEngine: "<<name<<" from "<<configFn<<"\n";
+
+    // slow, so not holding the lock
+    enginePtr engine( new engineEntry(
+        boost::shared_ptr<reloadableAPI>( new reloadableAPI(name, configFn, reloadMemFactor_, &artefacts_, true) ),
+        configFn) );
+
+    boost::mutex::scoped_lock lock(lock_);
+    if (engines_.count(name))
+        return false;
+    engines_[name]= engine;
+    if (defaultEngine_.length()==0)
+        defaultEngine_= name;
+    engine->lastUsed= ++useCounter_;
+    startLoading(engine);
+    return true;
+}
+
+
+
+std::string
+multiEngineAPI::removeEngine( std::string const &name ) const {
+
+    enginePtr engine;
+    {
+        boost::mutex::scoped_lock lock(lock_);
+        if (name==defaultEngine_)
+            return "<removeEngine status=\"rejected\" reason=\"default\"/>";
+        std::map<std::string, enginePtr>::iterator it= engines_.find(name);
+        if (it==engines_.end())
+            return "<removeEngine status=\"rejected\" reason=\"unknown\"/>";
+        engine= it->second;
+        engines_.erase(it);
+    }
+
+    std::cout<<"multiEngineAPI::removeEngine: "<<name<<"\n";
+    // released here or by the last request (or loading) using it
+    return "<removeEngine status=\"removed\"/>";
+}
+
+
+
+multiEngineAPI::enginePtr
+multiEngineAPI::getEngine( boost::property_tree::ptree const &pt ) const {
+
+    boost::mutex::scoped_lock lock(lock_);
+
+    enginePtr engine= findEngine(pt);
+    if (engine){
+        engine->lastUsed= ++useCounter_;
+        startLoading(engine);
+    }
+    return engine;
+}
+
+
+
+multiEngineAPI::enginePtr
+multiEngineAPI::findEngine( boost::property_tree::ptree const &pt ) const {
+
+    std::string name= defaultEngine_;
+    if (!pt.empty())
+        name= pt.front().second.get<std::string>("engine", name);
+
+    std::map<std::string, enginePtr>::const_iterator it= engines_.find(name);
+    if (it==engines_.end())
+        return enginePtr();
+    return it->second;
+}
+
+
+
+void
+multiEngineAPI::startLoading( enginePtr const &engine ) const {
+    if (engine->loading || engine->api->isInRam())
+        return;
+    // an engine bigger than the whole budget is always served from disk
+    if (memBudget_>0 && engine->api->ramBytes()>memBudget_)
+        return;
+    engine->loading= true;
+    ++numLoading_;
+    boost::thread( boost::bind(&multiEngineAPI::makeResident, this, engine) ); // detached
+}
+
+
+
+void
+multiEngineAPI::makeResident( enginePtr engine ) const {
+
+    uint64_t const needed= engine->api->ramBytes();
+    std::vector<enginePtr> toEvict;
+    bool fits= true;
+
+    if (memBudget_>0){
+
+        boost::mutex::scoped_lock lock(lock_);
+
+        std::vector<enginePtr> others;
+        std::vector<engineBudget::engine> resident;
+        for (std::map<std::string, enginePtr>::const_iterator it= engines_.begin(); it!=engines_.end(); ++it){
+            enginePtr const &other= it->second;
+            if (other==engine || !(other->loading || other->api->isInRam()))
+                continue;
+            others.push_back(other);
+            resident.push_back( engineBudget::engine(other->api->ramBytes(), other->lastUsed, !other->loading) );
+        }
+
+        // nothing is evicted unless engine is then loaded
+        std::vector<uint32_t> inds;
+        fits= engineBudget::plan(needed, memBudget_, resident, inds);
+        for (uint32_t i= 0; i<inds.size(); ++i)
+            toEvict.push_back( others[inds[i]] );
+    }
+
+    for (uint32_t i= 0; i<toEvict.size(); ++i)
+        toEvict[i]->api->evictFromRam();
+
+    if (fits){
+        double t0= timing::tic();
+        try {
+            engine->api->loadToRam();
+            std::cout<<"multiEngineAPI::makeResident: loaded "<<(needed>>20)<<" MB ("<<timing::toc(t0)<<" ms)\n";
+        } catch (std::exception &e) {
+            std::cerr<<"multiEngineAPI::makeResident: loading failed: "<<e.what()<<"\n";
+        }
+    } else
+        // the rest of the budget is being loaded, try again on the next request
+        std::cout<<"multiEngineAPI::makeResident: doesn't fit into the budget at the moment, serving from disk\n";
+
+    boost::mutex::scoped_lock lock(lock_);
+    engine->loading= false;
+    --numLoading_;
+    loadingDone_.notify_all();
+}
+
+
+
+std::string
+multiEngineAPI::enginesReply() const {
+
+    boost::mutex::scoped_lock lock(lock_);
+
+    uint64_t used= 0;
+    std::ostringstream engines;
+    for (std::map<std::string, enginePtr>::const_iterator it= engines_.begin(); it!=engines_.end(); ++it){
+        enginePtr const &engine= it->second;
+        bool const inRam= engine->api->isInRam();
+        if (inRam)
+            used+= engine->api->ramBytes();
+        engines<< boost::format("<engine name=\"%s\" default=\"%d\" inRam=\"%d\" loading=\"%d\" ramMB=\"%d\" configFn=\"%s\"/>")
+                  % it->first % (it->first==defaultEngine_) % inRam % engine->loading
+                  % (engine->api->ramBytes()>>20) % engine->configFn;
+    }
+
+    return ( boost::format("<engines budgetMB=\"%d\" usedMB=\"%d\" sharedArtefacts=\"%d\">%s</engines>")
+             % (memBudget_>>20) % (used>>20) % artefacts_.numLoaded() % engines.str() ).str();
+}
+
+
+
+std::string
+multiEngineAPI::getReply( boost::property_tree::ptree &pt, std::string const &request ) const {
+
+    if ( pt.count("engines") ){
+
+        return enginesReply();
+
+    } else if ( pt.count("addEngine") ){
+
+        std::string const name= pt.get<std::string>("addEngine.name");
+        std::string const configFn= util::expandUser(pt.get<std::string>("addEngine.configFn"));
+        try {
+            if (!addEngine(name, configFn))
+                return "<addEngine status=\"rejected\" reason=\"exists\"/>";
+        } catch (std::exception &e) {
+            std::cerr<<"multiEngineAPI::getReply: adding "<<name<<" failed: "<<e.what()<<"\n";
+            return "<addEngine status=\"failed\"/>";
+        }
+        return "<addEngine status=\"added\"/>";
+
+    } else if ( pt.count("removeEngine") ){
+
+        return removeEngine( pt.get<std::string>("removeEngine.name") );
+
+    }
+
+    // the engine stays alive until the request is done, even if it is removed meanwhile
+    enginePtr engine= getEngine(pt);
+    if (!engine){
+        std::cerr << "Unknown engine: "<< request <<"\n";
+        return "";
+    }
+    return engine->api->getReply(pt, request);
+}
+
+
+
+bool
+multiEngineAPI::getDatasetReply( boost::property_tree::ptree &pt, std::string &reply ) const {
+    // only the cheap dataset lookups are answered here; they don't need the iidx or fidx,
+    // so they neither count as a use of the engine nor start loading it (getReply does)
+    if (!isDatasetRequest(pt))
+        return false;
+    enginePtr engine;
+    {
+        boost::mutex::scoped_lock lock(lock_);
+        engine= findEngine(pt);
+    }
+    if (!engine)
+        return false;
+    return engine->api->getDatasetReply(pt, reply);
+}
@@ -0,0 +1,111 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _MULTI_ENGINE_API_H_
+#define _MULTI_ENGINE_API_H_
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "abs_api.h"
+#include "engine_v2.h"
+#include "macros.h"
+
+
+
+// Several engines served by one process (each is a reloadableAPI, so it can be reloaded on its own).
+// A request goes to the engine named by its engine field, e.g. <internalQuery><engine>name</engine>...,
+// or to the default one (the first added) if there is none.
+// Vocabularies and Hamming embedders are shared by the engines which use identical files (engineArtefacts).
+// The iidx and fidx of an engine are loaded into RAM in the background when it is added or used, and while
+// they don't fit into memBudget bytes (0: no limit) the least recently used engines are evicted to disk;
+// evicted engines still answer queries (from disk), just slower.
+// Requests: engines (lists them), addEngine (name, configFn), removeEngine (name).
+class multiEngineAPI : public absAPI {
+
+    public:
+
+        multiEngineAPI( uint64_t memBudget= 0, double reloadMemFactor= 1.5 );
+
+        // waits for the loading in progress
+        ~multiEngineAPI();
+
+        // false if name is taken; const as it is also done on request
+        bool
+            addEngine( std::string const &name, std::string const &configFn ) const;
+
+        std::string
+            getReply( boost::property_tree::ptree &pt, std::string const &request ) const;
+
+        bool
+            getDatasetReply( boost::property_tree::ptree &pt, std::string &reply ) const;
+
+    private:
+
+        struct engineEntry {
+
+            engineEntry( boost::shared_ptr<reloadableAPI> const &aApi, std::string const &aConfigFn ) :
+                api(aApi), configFn(aConfigFn), lastUsed(0), loading(false) {}
+
+            boost::shared_ptr<reloadableAPI> api;
+            std::string configFn;
+            uint64_t lastUsed;
+            bool loading;
+        };
+
+        typedef boost::shared_ptr<engineEntry> enginePtr;
+
+        // engine the request is for (NULL if unknown), marked as used and loaded into RAM if needed
+        enginePtr
+            getEngine( boost::property_tree::ptree const &pt ) const;
+
+        // same but not counted as a use; lock_ has to be held
+        enginePtr
+            findEngine( boost::property_tree::ptree const &pt ) const;
+
+        // lock_ has to be held
+        void
+            startLoading( enginePtr const &engine ) const;
+
+        // run by the loading threads: if engine fits into the budget, evicts what is needed for it and loads it
+        void
+            makeResident( enginePtr engine ) const;
+
+        std::string
+            enginesReply() const;
+
+        std::string
+            removeEngine( std::string const &name ) const;
+
+        uint64_t const memBudget_;
+        double const reloadMemFactor_;
+        mutable engineArtefacts artefacts_;
+
+        // all guarded by lock_ (as getReply is const)
+        mutable boost::mutex lock_;
+        mutable std::map<std::string, enginePtr> engines_;
+        mutable std::string defaultEngine_;
+        mutable uint64_t useCounter_;
+        mutable uint32_t numLoading_;
+        mutable boost::condition_variable loadingDone_;
+
+        DISALLOW_COPY_AND_ASSIGN(multiEngineAPI)
+};
+
+#endif
@@ -0,0 +1,341 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+// Query throughput/latency benchmark of the engine api_v2 serves (engineV2, constructed from the same config file).
+//
+// query_bench dsetname configFn queriesFn [concurrency=1] [qps=0] [numRequests=0] [numWarmup=0] [outFn=""]
+//
+// queriesFn has one query per line, optionally with a ROI:
+//     internal docID [xl xu yl yu]
+//     external imageFn [xl xu yl yu]
+// Requests cycle through the queries, numRequests=0 replays the set once; numWarmup requests go first and
+// are not measured.
+// qps=0: closed loop, concurrency threads issue queries back-to-back.
+// qps>0: open loop, request i is due at i/qps and its latency is counted from then (so queueing behind
+//        busy threads is included), concurrency threads serve the requests.
+// The report (JSON, to outFn or stdout) has the throughput, peak RSS, and for the request and each stage
+// the mean/p50/p90/p99/p99.9/max over the requests which had the stage. Stage times of a request are the
+// sums of its latency spans, so nested stages (posting_fetch in scoring) overlap and the spatial
+// verification stages (daat, ransac) are summed over the worker threads.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include "engine_v2.h"
+#include "latency.h"
+#include "macros.h"
+#include "query.h"
+#include "spatial_verif_v2.h"
+#include "util.h"
+
+
+
+class benchQuery {
+    public:
+        benchQuery() : docID(0), isInternal(true), xl(-inf), xu(inf), yl(-inf), yu(inf) {}
+        uint32_t docID;
+        std::string imageFn;
+        bool isInternal;
+        double xl, xu, yl, yu;
+};
+
+
+
+void
+readQueries( std::string const &fileName, std::vector<benchQuery> &queries ){
+
+    queries.clear();
+    std::ifstream f(fileName.c_str());
+    ASSERT(f.is_open());
+
+    std::string line, type;
+    while (std::getline(f, line)){
+        std::istringstream iss(line);
+        if (!(iss >> type) || type[0]=='#')
+            continue;
+        benchQuery q;
+        if (type=="internal")
+            iss >> q.docID;
+        else {
+            ASSERT(type=="external");
+            q.isInternal= false;
+            iss >> q.imageFn;
+            q.imageFn= util::expandUser(q.imageFn);
+        }
+        ASSERT(!iss.fail());
+        double xl, xu, yl, yu;
+        if (iss >> xl >> xu >> yl >> yu){
+            q.xl= xl; q.xu= xu; q.yl= yl; q.yu= yu;
+        }
+        queries.push_back(q);
+    }
+}
+
+
+
+// MB, Linux reports ru_maxrss in kB
+double
+peakRSS(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+
+
+class benchRunner {
+
+    public:
+
+        benchRunner( spatialVerifV2 const &spatVerifObj,
+                     std::vector<benchQuery> const &queries,
+                     uint32_t numWarmup, uint32_t numRequests,
+                     double qps ) :
+            spatVerifObj_(&spatVerifObj), queries_(&queries),
+            numWarmup_(numWarmup), numRequests_(numRequests), qps_(qps),
+            next_(0), t0_(0),
+            stageTimes_(latency::numStages) {
+                for (uint32_t s= 0; s<latency::numStages; ++s)
+                    stageTimes_[s].reserve(numRequests_);
+            }
+
+        // returns the duration of the measured part in seconds
+        double
+            run( uint32_t concurrency ){
+
+                // warmup, not measured
+                {
+                    boost::thread_group threads;
+                    for (uint32_t i= 0; i<concurrency; ++i)
+                        threads.create_thread( boost::bind(&benchRunner::worker, this, numWarmup_, false) );
+                    threads.join_all();
+                }
+
+                next_= 0;
+                t0_= latency::now();
+                {
+                    boost::thread_group threads;
+                    for (uint32_t i= 0; i<concurrency; ++i)
+                        threads.create_thread( boost::bind(&benchRunner::worker, this, numRequests_, true) );
+                    threads.join_all();
+                }
+                return latency::now() - t0_;
+            }
+
+        // per stage, one value (seconds) for each request which had the stage
+        std::vector< std::vector<double> > const &
+            stageTimes() const { return stageTimes_; }
+
+    private:
+
+        void
+            worker( uint32_t numToDo, bool measure ){
+
+                std::vector<indScorePair> queryRes;
+                std::map<uint32_t,homography> Hs;
+
+                while (true){
+
+                    boost::mutex::scoped_lock lock(lock_);
+                    if (next_>=numToDo)
+                        break;
+                    uint32_t const requestInd= next_++;
+                    lock.unlock();
+
+                    double tStart;
+                    if (measure && qps_>0){
+                        tStart= t0_ + requestInd/qps_;
+                        double const wait= tStart - latency::now();
+                        if (wait>0)
+                            boost::this_thread::sleep( boost::posix_time::microseconds( static_cast<int64_t>(wait*1e6) ) );
+                    } else
+                        tStart= latency::now();
+
+                    benchQuery const &q= queries_->at( requestInd % queries_->size() );
+
+                    std::vector<double> stageTime(latency::numStages, -1.0);
+                    {
+                        latency::queryTrace trace("bench");
+
+                        if (q.isInternal){
+                            query queryObj(q.docID, true, "", q.xl, q.xu, q.yl, q.yu);
+                            spatVerifObj_->spatialQuery(queryObj, queryRes, Hs);
+                        } else {
+                            std::string const compDataFn= util::getTempFileName();
+                            query queryObj(0, false, compDataFn, q.xl, q.xu, q.yl, q.yu);
+                            spatVerifObj_->externalQuery_computeData(q.imageFn, queryObj);
+                            spatVerifObj_->spatialQuery(queryObj, queryRes, Hs);
+                            remove(compDataFn.c_str());
+                        }
+
+                        for (uint32_t s= latency::request+1; s<latency::numStages; ++s)
+                            if (trace.count(static_cast<latency::stage>(s))>0)
+                                stageTime[s]= trace.total(static_cast<latency::stage>(s));
+                    }
+                    stageTime[latency::request]= latency::now() - tStart;
+
+                    if (!measure)
+                        continue;
+
+                    lock.lock();
+                    for (uint32_t s= 0; s<latency::numStages; ++s)
+                        if (stageTime[s]>=0)
+                            stageTimes_[s].push_back(stageTime[s]);
+                }
+            }
+
+        spatialVerifV2 const *spatVerifObj_;
+        std::vector<benchQuery> const *queries_;
+        uint32_t const numWarmup_, numRequests_;
+        double const qps_;
+
+        boost::mutex lock_;
+        uint32_t next_;
+        double t0_;
+        std::vector< std::vector<double> > stageTimes_;
+
+        DISALLOW_COPY_AND_ASSIGN(benchRunner)
+};
+
+
+
+// nearest-rank percentile of sorted values, in ms
+double
+percentileMs( std::vector<double> const &sorted, double p ){
+    if (sorted.empty())
+        return 0;
+    uint32_t ind= static_cast<uint32_t>( std::ceil(p*sorted.size()) );
+    if (ind>0) --ind;
+    return sorted[ std::min(ind, static_cast<uint32_t>(sorted.size()-1)) ] * 1000;
+}
+
+
+
+int main(int argc, char* argv[]){
+    MPI_INIT_ENV
+
+    if (argc<4){
+        std::cerr<<"Usage: "<<argv[0]<<" dsetname configFn queriesFn [concurrency=1] [qps=0] [numRequests=0] [numWarmup=0] [outFn=\"\"]\n";
+        return 1;
+    }
+
+    std::string const dsetname= argv[1];
+    std::string const configFn= util::expandUser(argv[2]);
+    std::string const queriesFn= util::expandUser(argv[3]);
+    uint32_t const concurrency= (argc>4) ? std::max(atoi(argv[4]), 1) : 1;
+    double const qps= (argc>5) ? atof(argv[5]) : 0.0;
+    uint32_t numRequests= (argc>6) ? atoi(argv[6]) : 0;
+    uint32_t const numWarmup= (argc>7) ? atoi(argv[7]) : 0;
+    std::string const outFn= (argc>8) ? util::expandUser(argv[8]) : "";
+
+    std::vector<benchQuery> queries;
+    readQueries(queriesFn, queries);
+    ASSERT(!queries.empty());
+    if (numRequests==0)
+        numRequests= queries.size();
+
+    bool needFeats= false;
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        needFeats= needFeats || !queries[i].isInternal;
+
+    boost::property_tree::ptree pt;
+    engineV2::readConfig(configFn, pt);
+    ASSERT( !needFeats || pt.get_optional<std::string>( dsetname+".clstFn" ).is_initialized() );
+
+    // ------------------------------------ load as api_v2, all in RAM as that is its steady state
+
+    double const tLoad= latency::now();
+
+    engineArtefacts artefacts;
+    boost::scoped_ptr<engineV2> engine( new engineV2(dsetname, configFn, engineV2::inRam, artefacts) );
+
+    double const loadTime= latency::now() - tLoad;
+    double const peakRSSLoaded= peakRSS();
+
+    // ------------------------------------ run
+
+    std::cerr<<"query_bench: "<<numRequests<<" requests ("<<numWarmup<<" warmup) of "<<queries.size()<<" queries, "
+             <<(qps>0 ? (boost::format("open loop at %.2f QPS") % qps).str() : std::string("closed loop"))
+             <<", concurrency "<<concurrency<<"\n";
+
+    benchRunner runner(engine->getRetriever(), queries, numWarmup, numRequests, qps);
+    double const duration= runner.run(concurrency);
+
+    // ------------------------------------ report
+
+    std::ostringstream out;
+    out<<"{\n";
+    out<<"  \"dsetname\": \""<<dsetname<<"\",\n";
+    out<<"  \"configFn\": \""<<configFn<<"\",\n";
+    out<<"  \"queriesFn\": \""<<queriesFn<<"\",\n";
+    out<<"  \"numQueries\": "<<queries.size()<<",\n";
+    out<<"  \"mode\": \""<<(qps>0 ? "open" : "closed")<<"\",\n";
+    out<<"  \"targetQPS\": "<<qps<<",\n";
+    out<<"  \"concurrency\": "<<concurrency<<",\n";
+    out<<"  \"numRequests\": "<<numRequests<<",\n";
+    out<<"  \"numWarmup\": "<<numWarmup<<",\n";
+    out<<"  \"loadSec\": "<<(boost::format("%.3f") % loadTime)<<",\n";
+    out<<"  \"durationSec\": "<<(boost::format("%.3f") % duration)<<",\n";
+    out<<"  \"throughputQPS\": "<<(boost::format("%.3f") % (duration>0 ? numRequests/duration : 0))<<",\n";
+    out<<"  \"peakRSSLoadedMB\": "<<(boost::format("%.1f") % peakRSSLoaded)<<",\n";
+    out<<"  \"peakRSSMB\": "<<(boost::format("%.1f") % peakRSS())<<",\n";
+    out<<"  \"stages\": {";
+
+    std::vector< std::vector<double> > stageTimes= runner.stageTimes();
+    bool first= true;
+    for (uint32_t s= 0; s<latency::numStages; ++s){
+        std::vector<double> &times= stageTimes[s];
+        if (times.empty())
+            continue;
+        std::sort(times.begin(), times.end());
+        double sum= 0;
+        for (uint32_t i= 0; i<times.size(); ++i)
+            sum+= times[i];
+        out<<(first ? "\n" : ",\n"); first= false;
+        out<<"    \""<<latency::stageName(static_cast<latency::stage>(s))<<"\": "
+           <<(boost::format("{\"count\": %d, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"p999_ms\": %.3f, \"max_ms\": %.3f}")
+              % times.size() % (sum/times.size()*1000)
+              % percentileMs(times, 0.5) % percentileMs(times, 0.9)
+              % percentileMs(times, 0.99) % percentileMs(times, 0.999)
+              % (times.back()*1000) );
+    }
+    out<<"\n  }\n}\n";
+
+    if (outFn.length()>0){
+        std::ofstream f(outFn.c_str());
+        f<<out.str();
+    } else
+        std::cout<<out.str();
+
+    // before protobuf is shut down
+    engine.reset();
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+#include "engine_budget.h"
+#include "macros.h"
+
+
+
+bool
+planStale( uint64_t needed, uint64_t budget, std::vector<engineBudget::engine> const &resident,
+           std::vector<uint32_t> &toEvict ){
+    toEvict.push_back(1000); // stale, has to be cleared
+    return engineBudget::plan(needed, budget, resident, toEvict);
+}
+
+
+
+int main(){
+
+    std::vector<engineBudget::engine> resident;
+    std::vector<uint32_t> toEvict;
+
+    // ------- no limit
+
+    std::cout<<"no budget: \t"; std::cout.flush();
+    resident.push_back( engineBudget::engine(100, 5) );
+    resident.push_back( engineBudget::engine(100, 3) );
+    ASSERT( planStale(1000000, 0, resident, toEvict) && toEvict.empty() );
+    std::cout<<"OK\n";
+
+    // ------- nothing to evict
+
+    std::cout<<"fits: \t"; std::cout.flush();
+    ASSERT( planStale(100, 300, resident, toEvict) && toEvict.empty() );
+    ASSERT( planStale(100, 1000, std::vector<engineBudget::engine>(), toEvict) && toEvict.empty() );
+    std::cout<<"OK\n";
+
+    // ------- least recently used first, as few as needed
+
+    std::cout<<"LRU: \t"; std::cout.flush();
+    resident.clear();
+    resident.push_back( engineBudget::engine(100, 5) );
+    resident.push_back( engineBudget::engine(100, 2) );
+    resident.push_back( engineBudget::engine(100, 9) );
+    resident.push_back( engineBudget::engine(100, 7) );
+    ASSERT( planStale(100, 400, resident, toEvict) );
+    ASSERT( toEvict.size()==1 && toEvict[0]==1 );
+    ASSERT( planStale(150, 400, resident, toEvict) );
+    ASSERT( toEvict.size()==2 && toEvict[0]==1 && toEvict[1]==0 );
+    ASSERT( planStale(400, 400, resident, toEvict) );
+    ASSERT( toEvict.size()==4 && toEvict[0]==1 && toEvict[1]==0 && toEvict[2]==3 && toEvict[3]==2 );
+    std::cout<<"OK\n";
+
+    // ------- the ones being loaded count, but can't be evicted
+
+    std::cout<<"loading: \t"; std::cout.flush();
+    resident[1].evictable= false;
+    ASSERT( planStale(100, 400, resident, toEvict) );
+    ASSERT( toEvict.size()==1 && toEvict[0]==0 );
+    ASSERT( planStale(300, 400, resident, toEvict) );
+    ASSERT( toEvict.size()==3 && toEvict[0]==0 && toEvict[1]==3 && toEvict[2]==2 );
+    std::cout<<"OK\n";
+
+    // ------- doesn't fit: nothing is evicted
+
+    std::cout<<"doesn't fit: \t"; std::cout.flush();
+    ASSERT( !planStale(301, 400, resident, toEvict) && toEvict.empty() );
+    for (uint32_t i= 0; i<resident.size(); ++i)
+        resident[i].evictable= false;
+    ASSERT( !planStale(1, 400, resident, toEvict) && toEvict.empty() );
+    // bigger than the whole budget
+    ASSERT( !planStale(401, 400, std::vector<engineBudget::engine>(), toEvict) && toEvict.empty() );
+    std::cout<<"OK\n";
+
+    std::cout<<"\nAll OK\n";
+
+    return 0;
+}
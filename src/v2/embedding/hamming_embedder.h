@@ -15,6 +15,9 @@ No usage or redistribution is allowed without explicit permission.
 #ifndef _HAMMING_EMBEDDER_H_
 #define _HAMMING_EMBEDDER_H_
 
+#include <stdint.h>
+#include <vector>
+
 #include "char_streams.h"
 #include "embedder.h"
 #include "hamming_data.pb.h"
@@ -73,12 +76,17 @@ class hammingEmbedder : public embedder {
                 return numBits_;
             }
         
+        // decodes into sigs_, which is reused (only grows) as this is called for every query word
         inline void
             hammingDist(uint64_t val, int *itResult){
                 charStream_->resetIter();
                 uint32_t const n= charStream_->getNum();
+                if (sigs_.size()<n)
+                    sigs_.resize(n);
+                if (n>0)
+                    charStream_->decodeNext(n, &sigs_[0]);
                 for (uint32_t i= 0; i<n; ++i, ++itResult)
-                    *itResult= __builtin_popcountll(val ^ charStream_->getNextUnsafe());
+                    *itResult= __builtin_popcountll(val ^ sigs_[i]);
             }
         
         inline charStream *
@@ -88,6 +96,7 @@ class hammingEmbedder : public embedder {
         uint32_t k_, numBits_, numDims_;
         std::vector<float> const *median_, *rot_;
         charStream *charStream_;
+        std::vector<uint64_t> sigs_; // hammingDist buffer
         DISALLOW_COPY_AND_ASSIGN(hammingEmbedder)
     
 };
@@ -34,7 +34,6 @@ No usage or redistribution is allowed without explicit permission.
 #include "build_index_status.pb.h"
 #include "clst_centres.h"
 #include "dataset_v2.h"
-#include "image_util.h"
 #include "index_entry_util.h"
 #include "mpi_queue.h"
 #include "par_queue.h"
@@ -240,7 +239,8 @@ class buildWorkerSemiSorted : public queueWorker<buildResultSemiSorted> {
                               featGetter const &featGetter_obj,
                               fastann::nn_obj<float> const &nn_obj,
                               clstCentres const *clstCentres_obj= NULL,
-                              embedderFactory const *embFactory= NULL);
+                              embedderFactory const *embFactory= NULL,
+                              uint32_t const maxImageSize= 0);
 
         ~buildWorkerSemiSorted() {
             finish();
@@ -279,6 +279,7 @@ class buildWorkerSemiSorted : public queueWorker<buildResultSemiSorted> {
         std::string const databasePath_;
 
         featGetter const *featGetter_;
+        uint32_t const maxImageSize_;
         uint32_t const numDims_;
         fastann::nn_obj<float> const *nn_;
         clstCentres const *clstCentres_;
@@ -306,11 +307,13 @@ buildWorkerSemiSorted::buildWorkerSemiSorted(
         featGetter const &featGetter_obj,
         fastann::nn_obj<float> const &nn_obj,
         clstCentres const *clstCentres_obj,
-        embedderFactory const *embFactory)
+        embedderFactory const *embFactory,
+        uint32_t const maxImageSize)
         : fidx_fn_( util::getTempFileName( outDir, "fidxpart_", ".bin" ) ),
           fImagelist_(imagelistFn.c_str()),
           databasePath_(databasePath),
           featGetter_(&featGetter_obj),
+          maxImageSize_(maxImageSize),
           numDims_(featGetter_obj.numDims()),
           nn_(&nn_obj),
           clstCentres_(clstCentres_obj),
@@ -347,25 +350,24 @@ buildWorkerSemiSorted::operator() ( uint32_t jobID, buildResultSemiSorted &resul
     result.first= imageFn;
     imageFn= databasePath_ + imageFn;
 
-    // make sure the image exists and is readable
+    // make sure the image exists
     result.second= std::make_pair(0,0);
-    if (boost::filesystem::exists(imageFn) && boost::filesystem::is_regular_file(imageFn)){
-        result.second= imageUtil::getWidthHeight(imageFn);
-    } else {
+    if (!boost::filesystem::exists(imageFn) || !boost::filesystem::is_regular_file(imageFn)){
         std::cerr<<"buildWorkerSemiSorted::operator(): "<<imageFn<<" doesn't exist\n";
         return;
     }
-    if (result.second.first==0 && result.second.second==0){
-        std::cerr<<"buildWorkerSemiSorted::operator(): "<<imageFn<<" is corrupt or 0x0\n";
-        return;
-    }
 
     uint32_t numFeats;
     std::vector<ellipse> regions;
     float *descs;
 
-    // extract features
-    featGetter_->getFeats(imageFn.c_str(), numFeats, regions, descs);
+    // extract features, decoding the image only once (also checks it is readable)
+    featGetter_->getFeatsOnce(imageFn.c_str(), maxImageSize_, result.second, numFeats, regions, descs);
+    if (result.second.first==0 && result.second.second==0){
+        std::cerr<<"buildWorkerSemiSorted::operator(): "<<imageFn<<" is corrupt or 0x0\n";
+        delete []descs;
+        return;
+    }
     if (numFeats==0){
         delete []descs;
         return;
@@ -1017,7 +1019,8 @@ build(
         std::string const tmpDir,
         featGetter const &featGetter_obj,
         std::string const clstFn,
-        embedderFactory const *embFactory) {
+        embedderFactory const *embFactory,
+        uint32_t const maxImageSize) {
 
     MPI_GLOBAL_ALL
     bool useThreads= detectUseThreads();
@@ -1131,7 +1134,8 @@ build(
                     featGetter_obj,
                     *nn_obj,
                     &clstCentres_obj,
-                    embFactory) );
+                    embFactory,
+                    maxImageSize) );
 
             // start feature extraction + assignment
             threadQueue<buildResultSemiSorted>::start( numDocs, workers, *manager );
@@ -1158,7 +1162,8 @@ build(
                 featGetter_obj,
                 *nn_obj,
                 &clstCentres_obj,
-                embFactory);
+                embFactory,
+                maxImageSize);
             mpiQueue<buildResultSemiSorted>::start( numDocs, worker, manager );
             worker.finish();
 
@@ -29,7 +29,8 @@ namespace buildIndex {
               std::string const tmpDir,
               featGetter const &featGetter_obj,
               std::string const clstFn,
-              embedderFactory const *embFactory= NULL);
+              embedderFactory const *embFactory= NULL,
+              uint32_t const maxImageSize= 0);
 };
 
 #endif
@@ -27,6 +27,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "mpi_queue.h"
 #include "python_cfg_to_ini.h"
 #include "train_assign.h"
+#include "train_assign_hamming.h"
 #include "train_descs.h"
 #include "train_hamming.h"
 #include "util.h"
@@ -63,6 +64,8 @@ int main(int argc, char* argv[]){
     
     bool const useRootSIFT= pt.get<bool>(dsetname+".RootSIFT", true);
     bool const SIFTscale3= pt.get<bool>( dsetname+".SIFTscale3", true);
+    // larger JPEGs are decoded at reduced size (1/2, 1/4 or 1/8), 0 means always full size
+    uint32_t const maxImageSize= pt.get<uint32_t>( dsetname+".maxImageSize", 0 );
     
     
     if (stage=="trainDescs"){
@@ -81,6 +84,11 @@ int main(int argc, char* argv[]){
         std::string const databasePath= util::expandUser(pt.get<std::string>( dsetname+".databasePath", "" ));
         std::string const trainDatabasePath= util::expandUser(pt.get<std::string>( dsetname+".trainDatabasePath", databasePath));
         int32_t trainNumDescs= pt.get<int32_t>( dsetname+".trainNumDescs", -1 );
+        // "first": descriptors of images in shuffled order until trainNumDescs, "uniform": uniform sample over trainNumImages images
+        std::string const trainSampling= pt.get<std::string>( dsetname+".trainSampling", "first" );
+        int32_t const trainNumImages= pt.get<int32_t>( dsetname+".trainNumImages", -1 );
+        if (trainSampling!="first" && trainSampling!="uniform")
+            throw std::runtime_error( std::string("Unrecognized trainSampling: ") + trainSampling);
         std::string const trainFilesPrefix= util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" ));
         std::string const trainDescsFn= trainFilesPrefix+"descs.e3bin";
         
@@ -88,7 +96,10 @@ int main(int argc, char* argv[]){
             trainImagelistFn, trainDatabasePath,
             trainDescsFn,
             trainNumDescs,
-            featGetter_obj);
+            featGetter_obj,
+            maxImageSize,
+            trainSampling=="uniform",
+            trainNumImages);
         
     } else if (stage=="trainAssign"){
         // ------------------------------------ assign training descs to clusters
@@ -108,8 +119,24 @@ int main(int argc, char* argv[]){
         std::string const trainDescsFn= trainFilesPrefix+"descs.e3bin";
         std::string const trainAssignsFn= trainFilesPrefix + util::uintToShortStr(vocSize) + "_assigns.bin";
         std::string const trainHammFn= trainFilesPrefix + util::uintToShortStr(vocSize) + "_hamm" + boost::lexical_cast<std::string>(hammEmbBits) + ".v2bin";
+        // "exact": exact medians (memory limits the number of words processed at once), "streaming": fixed-memory estimates in a single pass
+        std::string const hammMedian= pt.get<std::string>( dsetname+".hammMedian", "exact" );
+        if (hammMedian!="exact" && hammMedian!="streaming")
+            throw std::runtime_error( std::string("Unrecognized hammMedian: ") + hammMedian);
         
-        buildIndex::computeHamming(clstFn, useRootSIFT, trainDescsFn, trainAssignsFn, trainHammFn, hammEmbBits);
+        buildIndex::computeHamming(clstFn, useRootSIFT, trainDescsFn, trainAssignsFn, trainHammFn, hammEmbBits,
+                                   hammMedian=="streaming");
+        
+    } else if (stage=="trainAssignHamm"){
+        // ------------------------------------ trainAssign and trainHamm (with streaming medians) in a single pass
+        
+        uint32_t const hammEmbBits= pt.get<uint32_t>( dsetname+".hammEmbBits" );
+        std::string const trainFilesPrefix= util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" ));
+        std::string const trainDescsFn= trainFilesPrefix+"descs.e3bin";
+        std::string const trainAssignsFn= trainFilesPrefix + util::uintToShortStr(vocSize) + "_assigns.bin";
+        std::string const trainHammFn= trainFilesPrefix + util::uintToShortStr(vocSize) + "_hamm" + boost::lexical_cast<std::string>(hammEmbBits) + ".v2bin";
+        
+        buildIndex::computeTrainAssignsHamming(clstFn, useRootSIFT, trainDescsFn, trainAssignsFn, trainHammFn, hammEmbBits);
         
     } else if (stage=="index"){
         // ------------------------------------ compute index
@@ -148,7 +175,8 @@ int main(int argc, char* argv[]){
                           tmpDir,
                           featGetter_obj,
                           clstFn,
-                          embFactory );
+                          embFactory,
+                          maxImageSize );
         
         delete embFactory;
     } else {
@@ -40,6 +40,8 @@ daat::daat(
         entries_.push_back( ueIter->getEntries() );
         bool isEmpty= indexEntryUtil::isEmpty( *entries_.back() );
         entryVecs_.push_back( new indexEntryVector(*entries_.back()) );
+        if (docIDs_!=NULL && !isEmpty)
+            entryVecs_.back()->buildSkips();
         
         isEnd_= isEnd_ && isEmpty;
         
@@ -79,7 +81,7 @@ daat::advance() {
             if (docIDs_==NULL)
                 docID_= currID;
             else {
-                for (; docIDInd_ < docIDs_->size() && docIDs_->at(docIDInd_) < currID; ++docIDInd_);
+                docIDInd_= std::lower_bound( docIDs_->begin() + docIDInd_, docIDs_->end(), currID ) - docIDs_->begin();
                 if (docIDInd_ < docIDs_->size())
                     docID_= docIDs_->at(docIDInd_);
                 else {
@@ -120,9 +122,8 @@ daat::advanceOne(bool doMatching){
     ievIterator lb= std::lower_bound( entryVec.getIter(entryInd.second), entryVec.endIter(), docID_ );
     entryInd.first= lb.getInd();
     #else
-    for (entryInd.first= entryInd.second;
-         entryInd.first < num && entryVec.getID(entryInd.first) < docID_;
-         ++entryInd.first);
+    // gallops if skips were built (i.e. docIDs_ specified), linear otherwise
+    entryInd.first= entryVec.nextGEQ(entryInd.second, docID_);
     #endif
     
     if (doMatching){
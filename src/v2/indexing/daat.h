@@ -30,6 +30,8 @@ No usage or redistribution is allowed without explicit permission.
 
 
 // for efficiency iterating is done only over unique IDs (i.e. using ueIter->incrementToDifferent)
+// when docIDs are specified (e.g. candidates for spatial verification) posting lists are traversed
+// by galloping over their skip entries (indexEntryVector::nextGEQ) instead of element by element
 
 class daat {
     
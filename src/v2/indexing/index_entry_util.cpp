@@ -15,6 +15,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "index_entry_util.h"
 
 
+#include <algorithm>
 #include <cmath>
 
 #include "protobuf_util.h"
@@ -570,7 +571,7 @@ std::pair<uint32_t, int>
 indexEntryVector::getInds(uint32_t ind) const {
     
     uint32_t iEntry= 0;
-    for (; iEntry < entriesSize_ && ind < offset_[iEntry]; ++iEntry);
+    for (; iEntry+1 < entriesSize_ && ind >= offset_[iEntry+1]; ++iEntry);
     ASSERT(iEntry<entriesSize_);
     
     return std::make_pair(iEntry, ind - offset_[iEntry]);
@@ -584,7 +585,7 @@ indexEntryVector::getID(uint32_t ind) const {
     ASSERT(!diffIDs_);
     
     uint32_t iEntry= 0;
-    for (; iEntry < entriesSize_ && ind < offset_[iEntry]; ++iEntry);
+    for (; iEntry+1 < entriesSize_ && ind >= offset_[iEntry+1]; ++iEntry);
     ASSERT(iEntry<entriesSize_);
     
     return entries_->at(iEntry).id(ind - offset_[iEntry]);
@@ -593,6 +594,56 @@ indexEntryVector::getID(uint32_t ind) const {
 
 
 
+void
+indexEntryVector::buildSkips() {
+    
+    ASSERT(!diffIDs_);
+    
+    skipIDs_.clear();
+    skipIDs_.reserve( (num_ + skipBlockSize - 1) / skipBlockSize );
+    for (uint32_t ind= skipBlockSize-1; ind < num_; ind+= skipBlockSize)
+        skipIDs_.push_back( getID(ind) );
+    if (num_ % skipBlockSize != 0)
+        skipIDs_.push_back( getID(num_-1) );
+}
+
+
+
+uint32_t
+indexEntryVector::nextGEQ(uint32_t from, uint32_t ID) const {
+    
+    if (from >= num_)
+        return num_;
+    
+    if (!skipIDs_.empty()){
+        
+        uint32_t const numBlocks= skipIDs_.size();
+        uint32_t iBlock= from / skipBlockSize;
+        
+        if (skipIDs_[iBlock] < ID){
+            // gallop over blocks to find the range containing the first block with last ID >= ID
+            uint32_t lo= iBlock, step= 1, hi= iBlock+1;
+            while (hi < numBlocks && skipIDs_[hi] < ID){
+                lo= hi;
+                step*= 2;
+                hi= lo + step;
+            }
+            hi= std::min(hi+1, numBlocks);
+            iBlock= std::lower_bound( skipIDs_.begin() + lo + 1, skipIDs_.begin() + hi, ID ) - skipIDs_.begin();
+            if (iBlock >= numBlocks)
+                return num_;
+            from= iBlock * skipBlockSize;
+        }
+        
+        // the answer is in this block as its last ID is >= ID
+    }
+    
+    for (; from < num_ && getID(from) < ID; ++from);
+    return from;
+}
+
+
+
 uint32_t
 ievIterator::dereference() const {
     return iev_->getID(ind_);
@@ -265,6 +265,18 @@ class indexEntryVector {
         inline uint32_t
             getNum() const { return num_; }
         
+        // block-level skip entries (last ID of every skipBlockSize IDs), needed for fast nextGEQ
+        // only worth it when jumping over large parts of the list, e.g. DAAT restricted to a few docIDs
+        void
+            buildSkips();
+        
+        // smallest ind >= from such that getID(ind) >= ID, or getNum() if there is none
+        // gallops over skip entries if buildSkips() has been called, otherwise linear scan
+        uint32_t
+            nextGEQ(uint32_t from, uint32_t ID) const;
+        
+        static const uint32_t skipBlockSize= 64;
+        
         inline ievIterator
             beginIter() const {
                 return ievIterator(0, this);
@@ -286,6 +298,7 @@ class indexEntryVector {
         std::vector<int> nEntry_;
         std::vector<uint32_t> offset_;
         bool diffIDs_;
+        std::vector<uint32_t> skipIDs_;
         
     private:
         DISALLOW_COPY_AND_ASSIGN(indexEntryVector)
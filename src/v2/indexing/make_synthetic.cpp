@@ -0,0 +1,102 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+// Writes a synthetic engine (see synthetic_index.h) to the files named in the config, so that api_v2 and
+// query_bench can use the same config. Besides the usual dsetFn, iidxFn, fidxFn, wghtFn, vocSize and
+// (optional) hammEmbBits, trainFilesPrefix, the synth* keys below set the generator parameters.
+//
+// make_synthetic dsetname configFn
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+#include <google/protobuf/stubs/common.h>
+
+#include "proto_db.h"
+#include "proto_db_file.h"
+#include "proto_index.h"
+#include "python_cfg_to_ini.h"
+#include "synthetic_index.h"
+#include "tfidf_v2.h"
+#include "util.h"
+
+
+
+int main(int argc, char* argv[]){
+
+    if (argc<3){
+        std::cerr<<"Usage: "<<argv[0]<<" dsetname configFn\n";
+        return 1;
+    }
+
+    std::string const dsetname= argv[1];
+    std::string const configFn= util::expandUser(argv[2]);
+    std::string tempConfigFn= util::getTempFileName();
+    pythonCfgToIni( configFn, tempConfigFn );
+
+    boost::property_tree::ptree pt;
+    boost::property_tree::ini_parser::read_ini(tempConfigFn, pt);
+    remove(tempConfigFn.c_str());
+
+    // ------------------------------------ read config
+
+    std::string const dsetFn= util::expandUser(pt.get<std::string>( dsetname+".dsetFn" ));
+    std::string const iidxFn= util::expandUser(pt.get<std::string>( dsetname+".iidxFn" ));
+    std::string const fidxFn= util::expandUser(pt.get<std::string>( dsetname+".fidxFn" ));
+    std::string const wghtFn= util::expandUser(pt.get<std::string>( dsetname+".wghtFn" ));
+
+    syntheticParams params;
+    params.vocSize= pt.get<uint32_t>( dsetname+".vocSize", params.vocSize );
+    params.hammEmbBits= pt.get<uint32_t>( dsetname+".hammEmbBits", 0 );
+    params.numDocs= pt.get<uint32_t>( dsetname+".synthNumDocs", params.numDocs );
+    params.featsPerImage= pt.get<double>( dsetname+".synthFeatsPerImage", params.featsPerImage );
+    params.zipfExponent= pt.get<double>( dsetname+".synthZipfExponent", params.zipfExponent );
+    params.width= pt.get<uint32_t>( dsetname+".synthWidth", params.width );
+    params.height= pt.get<uint32_t>( dsetname+".synthHeight", params.height );
+    params.minScale= pt.get<float>( dsetname+".synthMinScale", params.minScale );
+    params.maxScale= pt.get<float>( dsetname+".synthMaxScale", params.maxScale );
+    params.maxRatio= pt.get<float>( dsetname+".synthMaxRatio", params.maxRatio );
+    params.dupGroupSize= pt.get<uint32_t>( dsetname+".synthDupGroupSize", params.dupGroupSize );
+    params.dupFraction= pt.get<float>( dsetname+".synthDupFraction", params.dupFraction );
+    params.dupMaxScaleChange= pt.get<float>( dsetname+".synthDupMaxScaleChange", params.dupMaxScaleChange );
+    params.hammNoise= pt.get<float>( dsetname+".synthHammNoise", params.hammNoise );
+    params.maxPostingsInRAM= pt.get<uint64_t>( dsetname+".synthMaxPostingsInRAM", params.maxPostingsInRAM );
+    params.seed= pt.get<uint32_t>( dsetname+".synthSeed", params.seed );
+    uint32_t const numWorkerThreads= pt.get<uint32_t>( dsetname+".synthNumThreads", 8 );
+
+    // the file api_v2 loads
+    std::string trainHammFn;
+    if (params.hammEmbBits>0)
+        trainHammFn= util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" )) + "hamm.v2bin";
+
+    // ------------------------------------ build
+
+    buildIndex::buildSynthetic(params, dsetFn, iidxFn, fidxFn, trainHammFn, numWorkerThreads);
+
+    // tf-idf weights, computed from the index as for real data
+    {
+        protoDbFile dbFidx(fidxFn);
+        protoIndex fidx(dbFidx, false);
+        protoDbFile dbIidx(iidxFn);
+        protoIndex iidx(dbIidx, false);
+        tfidfV2 tfidfObj(&iidx, &fidx, wghtFn);
+    }
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
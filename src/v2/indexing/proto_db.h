@@ -22,6 +22,8 @@ No usage or redistribution is allowed without explicit permission.
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <google/protobuf/stubs/common.h>
 
 #include "macros.h"
@@ -198,6 +200,76 @@ class protoDbInRamStartDisk : public protoDb {
 
 
 
+// Serves db (typically from disk) until loadToRam(), and from the in-RAM copy until evictFromRam(), which can
+// be repeated any number of times while requests are being served; used to keep only the indexes of the most
+// used engines in RAM (see multiEngineAPI). Doesn't take ownership of db.
+class protoDbSwitchable : public protoDb {
+
+    public:
+
+        protoDbSwitchable( protoDb const &db ) : db_(&db), inRam_(NULL) {}
+
+        ~protoDbSwitchable(){
+            if (inRam_!=NULL)
+                delete inRam_;
+        }
+
+        inline uint32_t
+            numIDs() const { return db_->numIDs(); }
+
+        inline void
+            getData( uint32_t ID, std::vector<std::string> &data ) const {
+                boost::shared_lock<boost::shared_mutex> lock(lock_);
+                (inRam_!=NULL ? inRam_ : db_)->getData(ID, data);
+            }
+
+        // the copy is made without blocking getData, which only waits for the swap
+        void
+            loadToRam(){
+                {
+                    boost::shared_lock<boost::shared_mutex> lock(lock_);
+                    if (inRam_!=NULL)
+                        return;
+                }
+                protoDb const *inRam= new protoDbInRam(*db_, false);
+                {
+                    boost::unique_lock<boost::shared_mutex> lock(lock_);
+                    if (inRam_==NULL)
+                        std::swap(inRam_, inRam);
+                }
+                if (inRam!=NULL) // loaded concurrently by someone else
+                    delete inRam;
+            }
+
+        void
+            evictFromRam(){
+                protoDb const *inRam= NULL;
+                {
+                    boost::unique_lock<boost::shared_mutex> lock(lock_);
+                    std::swap(inRam_, inRam);
+                }
+                if (inRam!=NULL)
+                    delete inRam;
+            }
+
+        inline bool
+            inRam() const {
+                boost::shared_lock<boost::shared_mutex> lock(lock_);
+                return inRam_!=NULL;
+            }
+
+    private:
+
+        protoDb const *db_;
+        protoDb const *inRam_;
+        mutable boost::shared_mutex lock_;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(protoDbSwitchable)
+};
+
+
+
 class protoDbs : public protoDb {
     
     public:
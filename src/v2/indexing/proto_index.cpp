@@ -13,6 +13,7 @@ No usage or redistribution is allowed without explicit permission.
 */
 
 #include "proto_index.h"
+#include "latency.h"
 
 #include <algorithm>
 
@@ -88,11 +89,29 @@ class uniqLoaderWorker : public queueWorker<bool> {
 
 
 
+void
+protoIndex::loadEntries(
+        std::vector<uint32_t> const &IDs,
+        std::vector<bool> const &keep,
+        std::vector< std::vector<rr::indexEntry> > &allEntries ) const {
+    
+    allEntries.resize(IDs.size());
+    queueManager<bool> manager; // does nothing
+    uniqLoaderWorker worker(*this, IDs, keep, allEntries);
+    threadQueue<bool>::start( allEntries.size(), worker, manager, 4);
+}
+
+
+
 void
 protoIndex::getUniqEntries(
         rr::indexEntry &queryRep,
         uniqEntries &entries ) const {
     
+    latency::span span(latency::postingFetch);
+    
+    selectEntries(queryRep);
+    
     std::vector<uint32_t> &index= entries.index_;
     std::vector< std::vector<rr::indexEntry> > &allEntries= entries.allEntries_;
     
@@ -117,7 +136,7 @@ protoIndex::getUniqEntries(
     
     #else
     
-    // get list of unique IDs and index
+    // get list of unique IDs and index, a unique ID is kept if any of its features is kept
     
     std::vector<uint32_t> uniqIDs;
     std::vector<bool> keep;
@@ -126,27 +145,52 @@ protoIndex::getUniqEntries(
     
     for (int i= 0; i<queryRep.id_size(); ++i){
         currID= queryRep.id(i);
-        keep.push_back( queryRep.keep_size()==0 || queryRep.keep(i) );
         if (i==0 || currID!=prevID) {
             ASSERT(i==0 || prevID<currID);
             uniqIDs.push_back(currID);
+            keep.push_back(false);
         }
+        if (queryRep.keep_size()==0 || queryRep.keep(i))
+            keep.back()= true;
         index.push_back( uniqIDs.size()-1 );
         prevID= currID;
     }
     
-    // load entries in parallel (basically for parallel protobuf decoding)
-    
-    allEntries.resize(uniqIDs.size());
-    queueManager<bool> manager; // does nothing
-    uniqLoaderWorker worker(*this, uniqIDs, keep, allEntries);
-    threadQueue<bool>::start( allEntries.size(), worker, manager, 4);
+    loadEntries(uniqIDs, keep, allEntries);
     
     #endif
 }
 
 
 
+void
+protoIndex::getBatchEntries(
+        std::vector<rr::indexEntry> &queryReps,
+        batchEntries &entries ) const {
+    
+    latency::span span(latency::postingFetch);
+    
+    std::vector<uint32_t> &IDs= entries.IDs_;
+    IDs.clear();
+    
+    // union of kept IDs of all queries
+    
+    for (uint32_t iQuery= 0; iQuery<queryReps.size(); ++iQuery){
+        rr::indexEntry &queryRep= queryReps[iQuery];
+        selectEntries(queryRep);
+        for (int i= 0; i<queryRep.id_size(); ++i)
+            if (queryRep.keep_size()==0 || queryRep.keep(i))
+                IDs.push_back(queryRep.id(i));
+    }
+    std::sort(IDs.begin(), IDs.end());
+    IDs.erase( std::unique(IDs.begin(), IDs.end()), IDs.end() );
+    
+    std::vector<bool> keep(IDs.size(), true);
+    loadEntries(IDs, keep, entries.allEntries_);
+}
+
+
+
 uint32_t
 protoIndex::getInverseEntryInds(
         uint32_t invID,
@@ -34,6 +34,7 @@ No usage or redistribution is allowed without explicit permission.
 
 
 class uniqEntries;
+class batchEntries;
 
 class protoIndex {
     
@@ -73,10 +74,16 @@ class protoIndex {
         // output: allEntries[ index[i] ]= getEntries( query.id(i) )
         // index.size==query.id_size, but allEntries.size <= query.id_size
         // assumes query.id is sorted
-        virtual void
+        void
             getUniqEntries( rr::indexEntry &queryRep,
                             uniqEntries &entries ) const;
         
+        // getEntries for the union of all queryReps[i].id, each ID is fetched once
+        // queryReps[i] are modified as in getUniqEntries (see selectEntries), use entries.getUniqEntries(queryReps[i], ..) afterwards
+        void
+            getBatchEntries( std::vector<rr::indexEntry> &queryReps,
+                             batchEntries &entries ) const;
+        
         uint32_t
             getInverseEntryInds( uint32_t invID,
                                  std::vector<uint32_t> &ID,
@@ -94,6 +101,16 @@ class protoIndex {
     
     protected:
         
+        // called before loading entries of queryRep, can set queryRep.keep to false for IDs which shouldn't be loaded
+        virtual void
+            selectEntries( rr::indexEntry &queryRep ) const {}
+        
+        // load entries of IDs[i] (or clear if !keep[i]) in parallel (basically for parallel protobuf decoding)
+        void
+            loadEntries( std::vector<uint32_t> const &IDs,
+                         std::vector<bool> const &keep,
+                         std::vector< std::vector<rr::indexEntry> > &allEntries ) const;
+        
         uint32_t
             getInverseEntryInds( uint32_t invID,
                                  std::vector<uint32_t> &ID,
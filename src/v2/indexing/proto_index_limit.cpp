@@ -40,9 +40,7 @@ bool IDCountComp(std::pair<int, uint64_t> const &l, std::pair<int, uint64_t> con
 
 
 void
-protoIndexLimit::getUniqEntries(
-        rr::indexEntry &queryRep,
-        uniqEntries &entries ) const {
+protoIndexLimit::selectEntries( rr::indexEntry &queryRep ) const {
     
     uint32_t prevID= 0, currID;
     
@@ -100,7 +98,4 @@ protoIndexLimit::getUniqEntries(
 //         }
     }
     
-    
-    // load remaining entries
-    protoIndex::getUniqEntries(queryRep, entries);
 }
@@ -46,9 +46,11 @@ class protoIndexLimit : public protoIndex {
                 return protoIndex::getEntries(ID, entries);
             }
         
+    protected:
+        
+        // don't load the largest posting lists if the total number of entries would exceed the limit
         void
-            getUniqEntries( rr::indexEntry &queryRep,
-                            uniqEntries &entries ) const;
+            selectEntries( rr::indexEntry &queryRep ) const;
     
     private:
         uint64_t const limit_;
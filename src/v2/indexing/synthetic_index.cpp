@@ -0,0 +1,560 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "synthetic_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/poisson_distribution.hpp>
+
+#include "char_streams.h"
+#include "dataset_v2.h"
+#include "index_entry.pb.h"
+#include "par_queue.h"
+#include "proto_db_file.h"
+#include "proto_index.h"
+#include "thread_queue.h"
+#include "timing.h"
+#include "train_hamming.h"
+#include "util.h"
+
+
+
+namespace buildIndex {
+
+static uint32_t const docsPerJob_= 1000;
+static int const maxPostingsPerEntry_= 1000000; // protobufs are not designed for more
+static uint32_t const hammNumDims_= 128;
+
+
+
+struct synthFeat {
+    uint32_t wordID;
+    float x, y, a, b, c;
+    uint64_t sig;
+};
+
+typedef std::pair<uint32_t, synthFeat> synthPosting; // docID, feature
+
+
+
+// independent seeds for (seed, stream, i, j)
+inline uint32_t
+mixSeed(uint32_t seed, uint32_t stream, uint32_t i, uint32_t j){
+    uint64_t x= (static_cast<uint64_t>(seed) << 32) ^ (static_cast<uint64_t>(stream) << 28) ^ (static_cast<uint64_t>(i) * 0x9E3779B97F4A7C15ULL) ^ j;
+    x^= x >> 30; x*= 0xBF58476D1CE4E5B9ULL;
+    x^= x >> 27; x*= 0x94D049BB133111EBULL;
+    x^= x >> 31;
+    return static_cast<uint32_t>(x ^ (x >> 32));
+}
+
+
+
+// [0,1)
+inline double
+uniform01(boost::mt19937 &rng){
+    return rng() / 4294967296.0;
+}
+
+
+
+inline uint32_t
+poisson(boost::mt19937 &rng, double lambda){
+    if (lambda<=0)
+        return 0;
+    boost::random::poisson_distribution<uint32_t, double> dist(lambda);
+    return dist(rng);
+}
+
+
+
+class synthGenerator {
+
+    public:
+
+        synthGenerator(syntheticParams const &params);
+
+        inline uint32_t
+            numRanges() const { return rangeStart_.size()-1; }
+
+        inline uint32_t
+            rangeStart(uint32_t iRange) const { return rangeStart_[iRange]; }
+
+        // appends features of docID with words in range iRange (in no particular order)
+        void
+            getFeatures(uint32_t docID, uint32_t iRange, std::vector<synthFeat> &feats) const;
+
+    private:
+
+        void
+            addFeatures(boost::mt19937 &rng, uint32_t n, uint32_t iRange, std::vector<synthFeat> &feats) const;
+
+        syntheticParams const params_;
+        uint64_t const sigMask_;
+        // cdf_[w]= probability of words < w
+        std::vector<double> cdf_;
+        std::vector<uint32_t> rangeStart_;
+
+        DISALLOW_COPY_AND_ASSIGN(synthGenerator)
+};
+
+
+
+synthGenerator::synthGenerator(syntheticParams const &params) :
+        params_(params),
+        sigMask_( params.hammEmbBits>=64 ? ~static_cast<uint64_t>(0) : ((static_cast<uint64_t>(1) << params.hammEmbBits) - 1) ) {
+
+    ASSERT(params_.vocSize>0 && params_.numDocs>0);
+    ASSERT(params_.dupGroupSize>0);
+    ASSERT(params_.hammEmbBits<=64);
+    uint32_t const V= params_.vocSize;
+
+    // Zipf over ranks, ranks randomly assigned to words
+    std::vector<uint32_t> wordOfRank(V);
+    for (uint32_t i= 0; i<V; ++i)
+        wordOfRank[i]= i;
+    boost::mt19937 rng( mixSeed(params_.seed, 4, 0, 0) );
+    for (uint32_t i= V-1; i>0; --i)
+        std::swap(wordOfRank[i], wordOfRank[ rng() % (i+1) ]);
+
+    std::vector<double> p(V);
+    double total= 0;
+    for (uint32_t r= 0; r<V; ++r){
+        p[ wordOfRank[r] ]= std::pow(r+1.0, -params_.zipfExponent);
+        total+= p[ wordOfRank[r] ];
+    }
+
+    cdf_.resize(V+1);
+    cdf_[0]= 0;
+    for (uint32_t w= 0; w<V; ++w)
+        cdf_[w+1]= cdf_[w] + p[w]/total;
+    cdf_[V]= 1.0;
+
+    // word ranges with at most maxPostingsInRAM expected postings (unless a single word has more)
+    double const totalFeats= static_cast<double>(params_.numDocs) * params_.featsPerImage;
+    rangeStart_.push_back(0);
+    double inRange= 0;
+    for (uint32_t w= 0; w<V; ++w){
+        double const expected= totalFeats * p[w]/total;
+        if (inRange>0 && inRange + expected > params_.maxPostingsInRAM){
+            rangeStart_.push_back(w);
+            inRange= 0;
+        }
+        inRange+= expected;
+    }
+    rangeStart_.push_back(V);
+}
+
+
+
+void
+synthGenerator::addFeatures(boost::mt19937 &rng, uint32_t n, uint32_t iRange, std::vector<synthFeat> &feats) const {
+
+    uint32_t const w0= rangeStart_[iRange], w1= rangeStart_[iRange+1];
+    double const cdf0= cdf_[w0], cdfRange= cdf_[w1] - cdf_[w0];
+    double const logMinScale= std::log(params_.minScale);
+    double const logScaleRange= std::log(params_.maxScale) - logMinScale;
+    double const logMaxRatio= std::log(params_.maxRatio);
+
+    synthFeat f;
+    for (uint32_t i= 0; i<n; ++i){
+
+        double const u= cdf0 + uniform01(rng) * cdfRange;
+        f.wordID= std::upper_bound(cdf_.begin() + w0, cdf_.begin() + w1 + 1, u) - cdf_.begin() - 1;
+        f.wordID= std::min(std::max(f.wordID, w0), w1-1);
+
+        f.x= uniform01(rng) * params_.width;
+        f.y= uniform01(rng) * params_.height;
+
+        // ellipse x'Mx=1, M= R diag(1/r1^2, 1/r2^2) R'
+        double const radius= std::exp( logMinScale + uniform01(rng) * logScaleRange );
+        double const ratio= std::exp( uniform01(rng) * logMaxRatio );
+        double const angle= (uniform01(rng) - 0.5) * M_PI;
+        double const i1= 1.0 / (radius*radius*ratio), i2= ratio / (radius*radius);
+        double const co= std::cos(angle), si= std::sin(angle);
+        f.a= co*co*i1 + si*si*i2;
+        f.b= co*si*(i1 - i2);
+        f.c= si*si*i1 + co*co*i2;
+
+        if (params_.hammEmbBits>0){
+            uint64_t const hi= rng();
+            f.sig= ((hi << 32) | rng()) & sigMask_;
+        } else
+            f.sig= 0;
+
+        feats.push_back(f);
+    }
+}
+
+
+
+void
+synthGenerator::getFeatures(uint32_t docID, uint32_t iRange, std::vector<synthFeat> &feats) const {
+
+    double const pRange= cdf_[ rangeStart_[iRange+1] ] - cdf_[ rangeStart_[iRange] ];
+    if (pRange<=0)
+        return;
+
+    bool const useGroups= params_.dupGroupSize>1 && params_.dupFraction>0;
+    double const ownFraction= useGroups ? 1.0 - params_.dupFraction : 1.0;
+
+    // features of this image only
+    {
+        boost::mt19937 rng( mixSeed(params_.seed, 0, docID, iRange) );
+        addFeatures(rng, poisson(rng, params_.featsPerImage * ownFraction * pRange), iRange, feats);
+    }
+
+    if (!useGroups)
+        return;
+
+    // features of the group's scene, same for all images of the group
+    uint32_t const first= feats.size();
+    {
+        boost::mt19937 rng( mixSeed(params_.seed, 1, docID / params_.dupGroupSize, iRange) );
+        addFeatures(rng, poisson(rng, params_.featsPerImage * params_.dupFraction * pRange), iRange, feats);
+    }
+
+    if (docID % params_.dupGroupSize == 0)
+        return;
+
+    // the scene as seen by this image (the transformation doesn't depend on iRange)
+    boost::mt19937 rngT( mixSeed(params_.seed, 2, docID, 0) );
+    double const logMaxScaleChange= std::log(params_.dupMaxScaleChange);
+    double const s= std::exp( (2*uniform01(rngT) - 1) * logMaxScaleChange );
+    double const tx= (uniform01(rngT) - 0.5) * 0.2 * params_.width;
+    double const ty= (uniform01(rngT) - 0.5) * 0.2 * params_.height;
+    double const cx= params_.width/2.0, cy= params_.height/2.0;
+
+    boost::mt19937 rngN( mixSeed(params_.seed, 3, docID, iRange) );
+
+    uint32_t iOut= first;
+    for (uint32_t i= first; i<feats.size(); ++i){
+        synthFeat f= feats[i];
+        double const x= s*(f.x - cx) + cx + tx;
+        double const y= s*(f.y - cy) + cy + ty;
+        if (x<0 || x>=params_.width || y<0 || y>=params_.height)
+            continue;
+        f.x= x; f.y= y;
+        f.a/= s*s; f.b/= s*s; f.c/= s*s;
+        for (uint32_t iBit= 0; iBit<params_.hammEmbBits; ++iBit)
+            if (uniform01(rngN) < params_.hammNoise)
+                f.sig^= static_cast<uint64_t>(1) << iBit;
+        feats[iOut++]= f;
+    }
+    feats.resize(iOut);
+}
+
+
+
+// ------------------------------------
+// ------------------------------------ fidx
+// ------------------------------------
+
+
+
+typedef std::vector<rr::indexEntry> synthFidxResult;
+
+
+
+class synthFidxWorker : public queueWorker<synthFidxResult> {
+    public:
+
+        synthFidxWorker(synthGenerator const &generator, uint32_t numDocs) : generator_(&generator), numDocs_(numDocs) {}
+
+        void
+            operator() ( uint32_t jobID, synthFidxResult &result ) const;
+
+    private:
+        synthGenerator const *generator_;
+        uint32_t const numDocs_;
+        DISALLOW_COPY_AND_ASSIGN(synthFidxWorker)
+};
+
+
+
+void
+synthFidxWorker::operator() ( uint32_t jobID, synthFidxResult &result ) const {
+
+    uint32_t const docStart= jobID * docsPerJob_;
+    uint32_t const docEnd= std::min(docStart + docsPerJob_, numDocs_);
+    result.resize(docEnd - docStart);
+
+    std::vector<synthFeat> feats;
+    std::vector<uint32_t> wordIDs;
+
+    for (uint32_t docID= docStart; docID<docEnd; ++docID){
+        feats.clear();
+        for (uint32_t iRange= 0; iRange<generator_->numRanges(); ++iRange)
+            generator_->getFeatures(docID, iRange, feats);
+
+        wordIDs.resize(feats.size());
+        for (uint32_t i= 0; i<feats.size(); ++i)
+            wordIDs[i]= feats[i].wordID;
+        std::sort(wordIDs.begin(), wordIDs.end());
+        std::vector<uint32_t>::const_iterator newEnd= std::unique(wordIDs.begin(), wordIDs.end());
+
+        google::protobuf::RepeatedField<uint32_t> *fidxWordID= result[docID-docStart].mutable_id();
+        fidxWordID->Reserve(newEnd - wordIDs.begin());
+        for (std::vector<uint32_t>::const_iterator it= wordIDs.begin(); it!=newEnd; ++it)
+            fidxWordID->AddAlreadyReserved(*it);
+    }
+}
+
+
+
+class synthFidxManager : public managerWithTiming<synthFidxResult> {
+    public:
+
+        synthFidxManager(uint32_t nJobs, indexBuilder &idxBuilder)
+            : managerWithTiming<synthFidxResult>(nJobs, "buildSynthetic fidx"),
+              idxBuilder_(&idxBuilder),
+              nextID_(0) {}
+
+        void
+            compute( uint32_t jobID, synthFidxResult &result );
+
+    private:
+        indexBuilder *idxBuilder_;
+        uint32_t nextID_;
+        std::map<uint32_t, synthFidxResult> results_;
+
+        DISALLOW_COPY_AND_ASSIGN(synthFidxManager)
+};
+
+
+
+void
+synthFidxManager::compute( uint32_t jobID, synthFidxResult &result ){
+    // entries have to be added in increasing docID
+    results_[jobID].swap(result);
+    for (std::map<uint32_t, synthFidxResult>::iterator it= results_.begin();
+         it!=results_.end() && it->first==nextID_;
+         ++nextID_){
+        synthFidxResult &res= it->second;
+        for (uint32_t i= 0; i<res.size(); ++i)
+            if (res[i].id_size()>0)
+                idxBuilder_->addEntry(nextID_ * docsPerJob_ + i, res[i]);
+        results_.erase(it++);
+    }
+}
+
+
+
+// ------------------------------------
+// ------------------------------------ iidx
+// ------------------------------------
+
+
+
+typedef std::vector<synthPosting> synthIidxResult;
+
+
+
+class synthIidxWorker : public queueWorker<synthIidxResult> {
+    public:
+
+        synthIidxWorker(synthGenerator const &generator, uint32_t numDocs, uint32_t iRange) : generator_(&generator), numDocs_(numDocs), iRange_(iRange) {}
+
+        void
+            operator() ( uint32_t jobID, synthIidxResult &result ) const {
+                uint32_t const docStart= jobID * docsPerJob_;
+                uint32_t const docEnd= std::min(docStart + docsPerJob_, numDocs_);
+                std::vector<synthFeat> feats;
+                for (uint32_t docID= docStart; docID<docEnd; ++docID){
+                    feats.clear();
+                    generator_->getFeatures(docID, iRange_, feats);
+                    for (uint32_t i= 0; i<feats.size(); ++i)
+                        result.push_back( std::make_pair(docID, feats[i]) );
+                }
+            }
+
+    private:
+        synthGenerator const *generator_;
+        uint32_t const numDocs_, iRange_;
+        DISALLOW_COPY_AND_ASSIGN(synthIidxWorker)
+};
+
+
+
+// appends postings in increasing docID (jobs are consecutive docs)
+class synthIidxManager : public managerWithTiming<synthIidxResult> {
+    public:
+
+        synthIidxManager(uint32_t nJobs, std::string const &prefix, std::vector<synthPosting> &postings)
+            : managerWithTiming<synthIidxResult>(nJobs, prefix),
+              postings_(&postings),
+              nextID_(0) {}
+
+        void
+            compute( uint32_t jobID, synthIidxResult &result ){
+                results_[jobID].swap(result);
+                for (std::map<uint32_t, synthIidxResult>::iterator it= results_.begin();
+                     it!=results_.end() && it->first==nextID_;
+                     ++nextID_){
+                    postings_->insert(postings_->end(), it->second.begin(), it->second.end());
+                    results_.erase(it++);
+                }
+            }
+
+    private:
+        std::vector<synthPosting> *postings_;
+        uint32_t nextID_;
+        std::map<uint32_t, synthIidxResult> results_;
+
+        DISALLOW_COPY_AND_ASSIGN(synthIidxManager)
+};
+
+
+
+// postings sorted by docID, all with words in [w0, w1)
+void
+saveSynthRange(std::vector<synthPosting> const &postings,
+               uint32_t w0, uint32_t w1,
+               uint32_t hammEmbBits,
+               indexBuilder &idxBuilder){
+
+    // counting sort by wordID, stable so docIDs stay sorted
+    std::vector<uint32_t> offsets(w1 - w0 + 1, 0);
+    for (uint32_t i= 0; i<postings.size(); ++i)
+        ++offsets[ postings[i].second.wordID - w0 + 1 ];
+    for (uint32_t w= 1; w<offsets.size(); ++w)
+        offsets[w]+= offsets[w-1];
+    std::vector<uint32_t> order(postings.size());
+    {
+        std::vector<uint32_t> pos(offsets.begin(), offsets.end()-1);
+        for (uint32_t i= 0; i<postings.size(); ++i)
+            order[ pos[ postings[i].second.wordID - w0 ]++ ]= i;
+    }
+
+    for (uint32_t w= w0; w<w1; ++w){
+        uint32_t const start= offsets[w-w0], end= offsets[w-w0+1];
+
+        for (uint32_t chunkStart= start; chunkStart<end; chunkStart+= maxPostingsPerEntry_){
+            uint32_t const chunkEnd= std::min(chunkStart + maxPostingsPerEntry_, end);
+            int const n= chunkEnd - chunkStart;
+
+            rr::indexEntry entry;
+            entry.mutable_id()->Reserve(n);
+            entry.mutable_x()->Reserve(n);
+            entry.mutable_y()->Reserve(n);
+            entry.mutable_a()->Reserve(n);
+            entry.mutable_b()->Reserve(n);
+            entry.mutable_c()->Reserve(n);
+            charStream *sigs= hammEmbBits>0 ? charStream::charStreamCreate(hammEmbBits) : NULL;
+
+            for (uint32_t i= chunkStart; i<chunkEnd; ++i){
+                synthPosting const &p= postings[ order[i] ];
+                entry.mutable_id()->AddAlreadyReserved( p.first );
+                entry.mutable_x()->AddAlreadyReserved( p.second.x );
+                entry.mutable_y()->AddAlreadyReserved( p.second.y );
+                entry.mutable_a()->AddAlreadyReserved( p.second.a );
+                entry.mutable_b()->AddAlreadyReserved( p.second.b );
+                entry.mutable_c()->AddAlreadyReserved( p.second.c );
+                if (sigs!=NULL)
+                    sigs->add( p.second.sig );
+            }
+            if (sigs!=NULL){
+                entry.set_data( sigs->getDataCopy() );
+                delete sigs;
+            }
+
+            idxBuilder.addEntry(w, entry);
+        }
+    }
+}
+
+
+
+// ------------------------------------
+// ------------------------------------ build
+// ------------------------------------
+
+
+
+void
+buildSynthetic(syntheticParams const &params,
+               std::string const dsetFn,
+               std::string const iidxFn,
+               std::string const fidxFn,
+               std::string const trainHammFn,
+               uint32_t numWorkerThreads){
+
+    double t0= timing::tic();
+
+    synthGenerator generator(params);
+    uint32_t const nJobs= (params.numDocs + docsPerJob_ - 1) / docsPerJob_;
+
+    std::cout<<"buildIndex::buildSynthetic: "<<params.numDocs<<" images, "<<params.vocSize<<" words, "
+             <<generator.numRanges()<<" word ranges\n";
+
+    // dataset
+
+    {
+        datasetBuilder dsetBuilder(dsetFn);
+        for (uint32_t docID= 0; docID<params.numDocs; ++docID)
+            dsetBuilder.add( (boost::format("synthetic/%08d.jpg") % docID).str(), params.width, params.height );
+        dsetBuilder.close();
+    }
+
+    // fidx
+
+    {
+        protoDbFileBuilder dbBuilder(fidxFn, "index");
+        indexBuilder idxBuilder(dbBuilder, true, true, true);
+        synthFidxWorker worker(generator, params.numDocs);
+        synthFidxManager manager(nJobs, idxBuilder);
+        threadQueue<synthFidxResult>::start( nJobs, worker, manager, numWorkerThreads );
+        idxBuilder.close();
+    }
+
+    // iidx, one pass over all images per word range
+
+    {
+        protoDbFileBuilder dbBuilder(iidxFn, "index");
+        indexBuilder idxBuilder(dbBuilder, true, true, true);
+
+        for (uint32_t iRange= 0; iRange<generator.numRanges(); ++iRange){
+            std::vector<synthPosting> postings;
+            synthIidxWorker worker(generator, params.numDocs, iRange);
+            synthIidxManager manager(nJobs,
+                                     (boost::format("buildSynthetic iidx %d/%d") % (iRange+1) % generator.numRanges()).str(),
+                                     postings);
+            threadQueue<synthIidxResult>::start( nJobs, worker, manager, numWorkerThreads );
+
+            saveSynthRange(postings,
+                           generator.rangeStart(iRange), generator.rangeStart(iRange+1),
+                           params.hammEmbBits, idxBuilder);
+        }
+        idxBuilder.close();
+    }
+
+    // Hamming data
+
+    if (params.hammEmbBits>0 && trainHammFn.length()>0){
+        std::vector<float> rot(params.hammEmbBits * hammNumDims_, 0.0f);
+        for (uint32_t iBit= 0; iBit<params.hammEmbBits; ++iBit)
+            rot[iBit*hammNumDims_ + iBit]= 1.0f;
+        std::vector<float> median(static_cast<size_t>(params.vocSize) * params.hammEmbBits, 0.0f);
+        saveHammingData(trainHammFn, params.vocSize, hammNumDims_, rot, median);
+    }
+
+    std::cout<<"buildIndex::buildSynthetic: done in "<< timing::hrminsec(timing::toc(t0)/1000) <<"\n";
+}
+
+};
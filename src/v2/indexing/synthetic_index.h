@@ -0,0 +1,81 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _SYNTHETIC_INDEX_H_
+#define _SYNTHETIC_INDEX_H_
+
+#include <stdint.h>
+#include <string>
+
+
+
+// Synthetic dataset/iidx/fidx (and Hamming data) in exactly the format buildIndex::build produces, without
+// images, for testing index formats, memory footprints and query scaling at sizes which can't be easily
+// assembled. Visual words have Zipfian frequencies (a fixed random permutation of the ranks gives the
+// wordIDs), the number of features per image is Poisson, positions are uniform in the image and ellipses
+// have log-uniform scale, aspect ratio and uniform orientation.
+// Consecutive images form groups showing the same "scene": dupFraction of the features of an image come
+// from its group's scene (the first image shows it as is, others scaled and translated, features falling
+// outside are dropped, signature bits flipped with probability hammNoise), so spatial verification has
+// something to find.
+// Everything is a deterministic function of the seed: the features of an image in a range of words are
+// generated independently of other ranges, so the iidx is built in passes over word ranges holding at
+// most about maxPostingsInRAM postings, making the RAM needed independent of the number of images.
+
+struct syntheticParams {
+
+    uint32_t numDocs, vocSize;
+    double featsPerImage;
+    double zipfExponent;
+    uint32_t width, height;
+    float minScale, maxScale, maxRatio; // ellipse radius range (pixels) and max ratio of axes
+    uint32_t dupGroupSize; // 1= no groups
+    float dupFraction, dupMaxScaleChange;
+    uint32_t hammEmbBits; // 0= no Hamming signatures
+    float hammNoise;
+    uint64_t maxPostingsInRAM;
+    uint32_t seed;
+
+    syntheticParams( uint32_t aNumDocs= 10000, uint32_t aVocSize= 1000000,
+                     double aFeatsPerImage= 1000, double aZipfExponent= 0.8,
+                     uint32_t aWidth= 1024, uint32_t aHeight= 768,
+                     float aMinScale= 4, float aMaxScale= 64, float aMaxRatio= 3,
+                     uint32_t aDupGroupSize= 5, float aDupFraction= 0.3, float aDupMaxScaleChange= 1.5,
+                     uint32_t aHammEmbBits= 0, float aHammNoise= 0.05,
+                     uint64_t aMaxPostingsInRAM= 200000000, uint32_t aSeed= 43
+                     ) :
+                     numDocs(aNumDocs), vocSize(aVocSize), featsPerImage(aFeatsPerImage), zipfExponent(aZipfExponent),
+                     width(aWidth), height(aHeight), minScale(aMinScale), maxScale(aMaxScale), maxRatio(aMaxRatio),
+                     dupGroupSize(aDupGroupSize), dupFraction(aDupFraction), dupMaxScaleChange(aDupMaxScaleChange),
+                     hammEmbBits(aHammEmbBits), hammNoise(aHammNoise),
+                     maxPostingsInRAM(aMaxPostingsInRAM), seed(aSeed) {}
+};
+
+
+
+namespace buildIndex {
+
+    // trainHammFn is written if hammEmbBits>0 (identity rotation of 128-D residuals, zero medians, which is
+    // only used to decode the signatures as the features don't have descriptors)
+    void
+        buildSynthetic(syntheticParams const &params,
+                       std::string const dsetFn,
+                       std::string const iidxFn,
+                       std::string const fidxFn,
+                       std::string const trainHammFn= "",
+                       uint32_t numWorkerThreads= 8);
+
+};
+
+#endif
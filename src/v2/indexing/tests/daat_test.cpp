@@ -12,16 +12,23 @@ The library belongs to Relja Arandjelovic and the University of Oxford.
 No usage or redistribution is allowed without explicit permission.
 */
 
+#include <algorithm>
+#include <iostream>
+#include <map>
 #include <stdint.h>
 #include <string>
 #include <vector>
 
 #include "daat.h"
 #include "index_entry.pb.h"
+#include "index_entry_util.h"
+#include "macros.h"
 #include "proto_db.h"
 #include "proto_db_file.h"
 #include "proto_index.h"
+#include "same_random.h"
 #include "timing.h"
+#include "uniq_entries.h"
 
 
 
@@ -42,7 +49,167 @@ void check(std::vector<uint32_t> const &ID_inv, std::vector< std::pair<uint32_t,
 
 
 
+// posting list of numDocs documents (each is in it with probability 1/sparsity, a few times if repeat),
+// split into entries of the given sizes (cycled), which don't have to align with the skip blocks
+void
+makePostingList( sameRandomStreamUint32 &randStream, uint32_t numDocs, uint32_t sparsity, bool repeat,
+                 std::vector<uint32_t> const &entrySizes, std::vector<rr::indexEntry> &entries, std::vector<uint32_t> &flat ){
+    
+    flat.clear();
+    for (uint32_t docID= 0; docID<numDocs; ++docID)
+        if (randStream.getNext0ToN(sparsity)==0){
+            uint32_t const n= repeat ? 1 + randStream.getNext0ToN(3) : 1;
+            for (uint32_t i= 0; i<n; ++i)
+                flat.push_back(docID);
+        }
+    
+    entries.clear();
+    for (uint32_t ind= 0, iSize= 0; ind<flat.size(); ++iSize){
+        entries.resize( entries.size()+1 );
+        uint32_t const end= std::min( ind + entrySizes[iSize % entrySizes.size()], static_cast<uint32_t>(flat.size()) );
+        for (; ind<end; ++ind)
+            entries.back().add_id(flat[ind]);
+    }
+}
+
+
+
+// indexEntryVector::getID and nextGEQ (with and without skips) against the flattened posting list
+void
+checkNextGEQ( std::vector<rr::indexEntry> const &entries, std::vector<uint32_t> const &flat ){
+    
+    indexEntryVector iev(entries);
+    ASSERT( iev.getNum()==flat.size() );
+    for (uint32_t ind= 0; ind<flat.size(); ++ind)
+        ASSERT( iev.getID(ind)==flat[ind] );
+    
+    uint32_t const maxID= flat.empty() ? 1 : flat.back()+2;
+    
+    for (uint32_t iSkips= 0; iSkips<2; ++iSkips){
+        if (iSkips==1)
+            iev.buildSkips();
+        for (uint32_t from= 0; from<=flat.size(); ++from)
+            for (uint32_t ID= 0; ID<=maxID; ++ID){
+                uint32_t expected= from;
+                for (; expected<flat.size() && flat[expected]<ID; ++expected);
+                ASSERT( iev.nextGEQ(from, ID)==expected );
+            }
+    }
+}
+
+
+
+// docID -> (word, matching [start, end) in its posting list) of all matches
+typedef std::map< uint32_t, std::vector< std::pair<uint32_t, std::pair<uint32_t,uint32_t> > > > daatMatches;
+
+void
+runDAAT( uniqEntries &ue, std::vector<uint32_t> const *docIDs, daatMatches &matches ){
+    
+    matches.clear();
+    precompUEIterator ueIter(ue);
+    daat daatIter(&ueIter, docIDs);
+    
+    std::vector< std::pair<uint32_t,uint32_t> > const *entryInd;
+    std::vector<uint32_t> const *nonEmptyEntryInd;
+    
+    while (!daatIter.isEnd()){
+        daatIter.advance();
+        if (!daatIter.getMatches(entryInd, nonEmptyEntryInd))
+            continue;
+        std::vector< std::pair<uint32_t, std::pair<uint32_t,uint32_t> > > &docMatches= matches[daatIter.getDocID()];
+        ASSERT( docMatches.empty() );
+        for (uint32_t i= 0; i<nonEmptyEntryInd->size(); ++i){
+            uint32_t const wordInd= nonEmptyEntryInd->at(i);
+            docMatches.push_back( std::make_pair(wordInd, entryInd->at(wordInd)) );
+        }
+        std::sort(docMatches.begin(), docMatches.end());
+    }
+}
+
+
+
+// DAAT restricted to docIDs (galloping over the skips) gives the same matches as the full (linear) traversal
+void
+testSynthetic(){
+    
+    sameRandomUint32 rand(1000000, 43);
+    sameRandomStreamUint32 randStream(rand);
+    
+    uint32_t const numDocs= 3000;
+    
+    // entries around and across the skip block boundaries
+    uint32_t const blockSize= indexEntryVector::skipBlockSize;
+    std::vector<uint32_t> entrySizes;
+    entrySizes.push_back(1);
+    entrySizes.push_back(blockSize-1);
+    entrySizes.push_back(blockSize);
+    entrySizes.push_back(blockSize+1);
+    entrySizes.push_back(3*blockSize+7);
+    
+    uint32_t const sparsities[]= {1, 2, 5, 20, 300};
+    uint32_t const numWords= 2*sizeof(sparsities)/sizeof(sparsities[0]);
+    
+    uniqEntries ue;
+    ue.allEntries_.resize(numWords);
+    std::vector<uint32_t> flat;
+    
+    std::cout<<"daatTest: nextGEQ: \t"; std::cout.flush();
+    for (uint32_t iWord= 0; iWord<numWords; ++iWord){
+        ue.index_.push_back(iWord);
+        // even words cycle through all entry sizes (starting with a one ID long entry), odd ones have entries
+        // spanning several blocks, and the last word is a single entry
+        std::vector<uint32_t> sizes(entrySizes.begin() + (iWord%2==0 ? 0 : entrySizes.size()-1), entrySizes.end());
+        if (iWord==numWords-1)
+            sizes.assign(1, numDocs*3);
+        makePostingList(randStream, numDocs, sparsities[iWord/2], iWord%2==1, sizes, ue.allEntries_[iWord], flat);
+        // nextGEQ is quadratic to check, so only on the shorter ones
+        if (flat.size()<1200)
+            checkNextGEQ(ue.allEntries_[iWord], flat);
+    }
+    std::cout<<"OK\n";
+    
+    daatMatches all;
+    runDAAT(ue, NULL, all);
+    
+    // very sparse (long jumps), dense (mostly within a block), and past the end of all posting lists
+    uint32_t const docSparsities[]= {1, 3, 50, 400};
+    for (uint32_t iS= 0; iS<sizeof(docSparsities)/sizeof(docSparsities[0]); ++iS){
+        std::cout<<"daatTest: docIDs, sparsity= "<<docSparsities[iS]<<": \t"; std::cout.flush();
+        
+        std::vector<uint32_t> docIDs;
+        for (uint32_t docID= 0; docID<numDocs+100; ++docID)
+            if (randStream.getNext0ToN(docSparsities[iS])==0)
+                docIDs.push_back(docID);
+        
+        daatMatches expected;
+        for (uint32_t i= 0; i<docIDs.size(); ++i){
+            daatMatches::const_iterator it= all.find(docIDs[i]);
+            if (it!=all.end())
+                expected.insert(*it);
+        }
+        
+        daatMatches restricted;
+        runDAAT(ue, &docIDs, restricted);
+        ASSERT( restricted==expected );
+        
+        // and a single docID
+        for (uint32_t i= 0; i<docIDs.size(); i+= 1 + docIDs.size()/20){
+            std::vector<uint32_t> single(1, docIDs[i]);
+            runDAAT(ue, &single, restricted);
+            ASSERT( restricted.size()==all.count(docIDs[i]) );
+            if (!restricted.empty())
+                ASSERT( restricted.begin()->second==all.find(docIDs[i])->second );
+        }
+        
+        std::cout<<"OK ("<<expected.size()<<" docs with matches)\n";
+    }
+}
+
+
+
 int main(){
+    
+    testSynthetic();
    
     std::string iidxFn= "/home/relja/Relja/Data/tmp/indexing_v2/iidx_oxc1_5k_hesaff_sift_hell_1000000_43.v2bin";
     
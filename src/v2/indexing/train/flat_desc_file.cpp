@@ -22,54 +22,42 @@ namespace buildIndex {
 
 
 flatDescsFile::flatDescsFile(std::string const descsFn, bool const doHellinger)
-        : doHellinger_(doHellinger) {
-    f_= fopen(descsFn.c_str(), "rb");
-    ASSERT(f_!=NULL);
-    uint64_t fileSize= util::fileSize(descsFn);
+        : file_(descsFn),
+          doHellinger_(doHellinger) {
     
-    int temp_;
-    temp_= fread(&numDims_, sizeof(numDims_), 1, f_);
-    temp_= fread(&dtypeCode_, sizeof(dtypeCode_), 1, f_);
-    REMOVE_UNUSED_WARNING(temp_);
+    ASSERT( file_.size()>=5 );
+    file_.read<uint32_t>(0, 1, &numDims_);
+    file_.read<uint8_t>(4, 1, &dtypeCode_);
     
     ASSERT( dtypeCode_==0 || dtypeCode_==4 );
     
     uint8_t size= dtypeCode_==0 ? 1 : sizeof(float);
-    ASSERT( (fileSize-5) % (numDims_*size) == 0 );
-    numDescs_= static_cast<uint32_t>( (fileSize-5) / (numDims_*size) );
-    
-    fd_= fileno(f_);
+    ASSERT( (file_.size()-5) % (numDims_*size) == 0 );
+    numDescs_= static_cast<uint32_t>( (file_.size()-5) / (numDims_*size) );
 }
 
 
 
 void
 flatDescsFile::getDescs(uint32_t start, uint32_t end, float *&descs) const {
-    ASSERT(end>=start);
+    ASSERT(end>=start && end<=numDescs_);
     descs= new float[(end-start)*numDims_];
     
-    int temp_;
-    
     if (dtypeCode_==0){
         
-        uint8_t *descsRaw= new uint8_t[(end-start)*numDims_];
-        temp_= pread64(fd_, descsRaw,
-                       (end-start)*numDims_,
-                       static_cast<uint64_t>(start)*numDims_ + 5 );
-        
-        uint8_t const *inIter= descsRaw;
+        // convert straight from the mapping
+        uint8_t const *inIter= reinterpret_cast<uint8_t const *>(file_.data() + 5) + static_cast<uint64_t>(start)*numDims_;
         float *outIter= descs;
         float *outIterEnd= descs + (end-start)*numDims_;
         for (; outIter!=outIterEnd; ++inIter, ++outIter)
             *outIter= static_cast<float>(*inIter);
         
-        delete []descsRaw;
-        
     } else if (dtypeCode_==4) {
         
-        temp_= pread64(fd_, descs,
-                       (end-start)*numDims_*sizeof(float),
-                       5 + start*numDims_*sizeof(float) );
+        // floats are not aligned due to the 5 byte header
+        file_.read<float>( 5 + static_cast<uint64_t>(start)*numDims_*sizeof(float),
+                           static_cast<uint64_t>(end-start)*numDims_,
+                           descs );
         
     } else ASSERT(0);
     
@@ -78,8 +66,6 @@ flatDescsFile::getDescs(uint32_t start, uint32_t end, float *&descs) const {
         for (; start!=end; ++start, thisDesc+=numDims_)
             descToHell::convertToHell(numDims_, thisDesc);
     }
-    
-    REMOVE_UNUSED_WARNING(temp_);
 }
 
 
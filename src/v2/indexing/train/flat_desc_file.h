@@ -16,10 +16,10 @@ No usage or redistribution is allowed without explicit permission.
 #define _FLAT_DESC_FILE_H_
 
 #include <stdint.h>
-#include <stdio.h>
 #include <string>
 
 #include "macros.h"
+#include "mapped_file.h"
 
 
 
@@ -42,8 +42,8 @@ class flatDescsFile {
             getDescs(uint32_t start, uint32_t end, float *&descs) const;
         
     private:
-        FILE *f_;
-        int fd_;
+        // memory mapped, so concurrent readers (threads and processes) share the pages
+        mappedFile file_;
         uint8_t dtypeCode_;
         uint32_t numDims_, numDescs_;
         bool const doHellinger_;
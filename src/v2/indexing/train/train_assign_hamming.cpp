@@ -0,0 +1,378 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "train_assign_hamming.h"
+
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#ifdef RR_MPI
+#include <boost/mpi/collectives.hpp>
+#include <boost/serialization/utility.hpp> // for std::pair
+#include <boost/serialization/vector.hpp>
+#endif
+
+#include <fastann.hpp>
+
+#include "ViseMessageQueue.h"
+#include "clst_centres.h"
+#include "flat_desc_file.h"
+#include "median_computer.h"
+#include "mpi_queue.h"
+#include "par_queue.h"
+#include "timing.h"
+#include "train_assign.h"
+#include "train_hamming.h"
+
+
+
+
+namespace buildIndex {
+
+
+typedef std::pair< std::vector<uint32_t>, std::vector<float> > trainAssignsHammingResult; // clusterIDs, projections of residuals
+
+
+
+class trainAssignsHammingManager : public managerWithTiming<trainAssignsHammingResult> {
+    public:
+
+        trainAssignsHammingManager(uint32_t const nJobs,
+                                   std::string const trainAssignsFn,
+                                   std::string const trainHammFn,
+                                   std::vector<float> const &rot,
+                                   uint32_t const numDims,
+                                   uint32_t const numClst)
+            : managerWithTiming<trainAssignsHammingResult>(nJobs, "trainAssignsHammingManager"),
+              trainHammFn_(trainHammFn),
+              numDims_(numDims),
+              numClst_(numClst),
+              hammEmbBits_(rot.size() / numDims),
+              rot_(&rot),
+              medianComp_(numClst*hammEmbBits_),
+              nextID_(0),
+              totalJobs_(nJobs) {
+                ASSERT(rot.size() % numDims==0);
+                f_= fopen(trainAssignsFn.c_str(), "wb");
+                ASSERT(f_!=NULL);
+            }
+
+        ~trainAssignsHammingManager();
+
+        void
+            compute( uint32_t jobID, trainAssignsHammingResult &result );
+
+    private:
+        FILE *f_;
+        std::string const trainHammFn_;
+        uint32_t const numDims_, numClst_, hammEmbBits_;
+        std::vector<float> const *rot_;
+        // the median computers are fed in job order so that the result is deterministic;
+        // numClst*hammEmbBits of them, bounded by maxStreamingMedianBytes in computeTrainAssignsHamming
+        std::vector<streamingMedianComputer> medianComp_;
+        uint32_t nextID_, totalJobs_;
+        std::map<uint32_t, trainAssignsHammingResult> results_;
+
+        DISALLOW_COPY_AND_ASSIGN(trainAssignsHammingManager)
+};
+
+
+
+trainAssignsHammingManager::~trainAssignsHammingManager(){
+    fclose(f_);
+
+    std::vector<float> median;
+    median.reserve(medianComp_.size());
+    for (uint32_t i= 0; i<medianComp_.size(); ++i)
+        median.push_back( medianComp_[i].getMedian() );
+
+    saveHammingData(trainHammFn_, numClst_, numDims_, *rot_, median);
+}
+
+
+
+void
+trainAssignsHammingManager::compute( uint32_t jobID, trainAssignsHammingResult &result ){
+    // make sure results are processed sorted by job!
+    trainAssignsHammingResult &res= results_[jobID];
+    res.first.swap(result.first);
+    res.second.swap(result.second);
+    if (jobID!=nextID_)
+        return;
+
+    for (std::map<uint32_t, trainAssignsHammingResult>::iterator it= results_.begin();
+         it!=results_.end() && it->first==nextID_;
+         ++nextID_){
+
+        std::vector<uint32_t> const &clusterIDs= it->second.first;
+        std::vector<float> const &projections= it->second.second;
+        ASSERT(projections.size()==clusterIDs.size()*hammEmbBits_);
+
+        if (clusterIDs.size()>0)
+            fwrite( &clusterIDs[0], sizeof(uint32_t), clusterIDs.size(), f_ );
+
+        float const *itProj= projections.empty() ? NULL : &projections[0];
+        for (uint32_t iDesc= 0; iDesc<clusterIDs.size(); ++iDesc){
+            streamingMedianComputer *itMC= &medianComp_[0] + clusterIDs[iDesc] * hammEmbBits_;
+            for (uint32_t iBit= 0; iBit<hammEmbBits_; ++iBit, ++itMC, ++itProj)
+                itMC->add(*itProj);
+        }
+
+        results_.erase(it++);
+    }
+
+    std::ostringstream s;
+    s << "Assignment log \nProcessed " << nextID_ << " / " << totalJobs_;
+    ViseMessageQueue::Instance()->Push( s.str() );
+}
+
+
+
+class trainAssignsHammingWorker : public queueWorker<trainAssignsHammingResult> {
+    public:
+
+        trainAssignsHammingWorker(fastann::nn_obj<float> const &nn_obj,
+                                  flatDescsFile const &descFile,
+                                  clstCentres const &clstCentres_obj,
+                                  std::vector<float> const &rot,
+                                  uint32_t chunkSize)
+            : nn_obj_(&nn_obj),
+              descFile_(&descFile),
+              clstCentres_obj_(&clstCentres_obj),
+              rot_(&rot),
+              chunkSize_(chunkSize),
+              numDescs_(descFile.numDescs()),
+              numDims_(descFile.numDims()),
+              hammEmbBits_(rot.size() / descFile.numDims())
+            {}
+
+        void
+            operator() ( uint32_t jobID, trainAssignsHammingResult &result ) const;
+
+    private:
+
+        fastann::nn_obj<float> const *nn_obj_;
+        flatDescsFile const *descFile_;
+        clstCentres const *clstCentres_obj_;
+        std::vector<float> const *rot_;
+        uint32_t const chunkSize_, numDescs_, numDims_, hammEmbBits_;
+
+        DISALLOW_COPY_AND_ASSIGN(trainAssignsHammingWorker)
+};
+
+
+
+void
+trainAssignsHammingWorker::operator() ( uint32_t jobID, trainAssignsHammingResult &result ) const {
+
+    uint32_t const start= jobID*chunkSize_;
+    uint32_t const end= std::min( (jobID+1)*chunkSize_, numDescs_ );
+    uint32_t const count= end-start;
+
+    std::vector<uint32_t> &clusterIDs= result.first;
+    std::vector<float> &projections= result.second;
+
+    float *descs;
+    descFile_->getDescs(start, end, descs);
+
+    // assign
+    clusterIDs.resize(count);
+    float *distSq= new float[count];
+    nn_obj_->search_nn(descs, count, &clusterIDs[0], distSq);
+    delete []distSq;
+
+    // project residuals, as in trainHammingWorker
+    projections.resize(count*hammEmbBits_);
+    float *itDesc= descs;
+    float *itProj= &projections[0];
+
+    for (uint32_t iDesc= 0; iDesc<count; ++iDesc, itDesc+= numDims_){
+
+        float const *itC= clstCentres_obj_->clstC_flat + clusterIDs[iDesc] * numDims_;
+        for (uint32_t iDim= 0; iDim<numDims_; ++iDim)
+            itDesc[iDim]-= itC[iDim];
+
+        float const *itRot= &((*rot_)[0]);
+        float const *itDescEnd= itDesc+numDims_;
+        for (uint32_t iBit= 0; iBit<hammEmbBits_; ++iBit, ++itProj){
+            float projection= 0.0f;
+            for (float const *itDescC= itDesc; itDescC!=itDescEnd; ++itDescC, ++itRot)
+                projection+= *itDescC * (*itRot);
+            *itProj= projection;
+        }
+    }
+
+    delete []descs;
+}
+
+
+
+void
+computeTrainAssignsHamming(
+        std::string const clstFn,
+        bool const RootSIFT,
+        std::string const trainDescsFn,
+        std::string const trainAssignsFn,
+        std::string const trainHammFn,
+        uint32_t const hammEmbBits){
+
+    MPI_GLOBAL_ALL;
+
+    bool const assignsExist= boost::filesystem::exists(trainAssignsFn);
+    bool const hammExists= boost::filesystem::exists(trainHammFn);
+
+    // nothing to gain from fusing if one of them is already there (e.g. resuming)
+    if (assignsExist){
+        computeHamming(clstFn, RootSIFT, trainDescsFn, trainAssignsFn, trainHammFn, hammEmbBits, true);
+        return;
+    }
+    if (hammExists){
+        computeTrainAssigns(clstFn, RootSIFT, trainDescsFn, trainAssignsFn);
+        return;
+    }
+    ASSERT( boost::filesystem::exists(trainDescsFn) );
+    ASSERT( hammEmbBits<=64 );
+    if (flatDescsFile(trainDescsFn, RootSIFT).numDescs()==0)
+        throw std::runtime_error( std::string("No training descriptors in ") + trainDescsFn );
+
+    bool useThreads= detectUseThreads();
+    uint32_t numWorkerThreads= 8;
+
+    // clusters
+    if (rank==0)
+        ViseMessageQueue::Instance()->Push( "Assignment log \nLoading cluster centers ..." );
+    double t0= timing::tic();
+    clstCentres clstCentres_obj( clstFn.c_str(), true );
+    uint32_t const numClst= clstCentres_obj.numClst;
+    uint32_t const numDims= clstCentres_obj.numDims;
+    ASSERT(numDims>=hammEmbBits);
+    if (rank==0) {
+        std::ostringstream s;
+        s << "Assignment log done (" << timing::toc(t0) << " ms)";
+        ViseMessageQueue::Instance()->Push( s.str() );
+    }
+
+    // the manager keeps the median computers of all words, if they don't fit do the separate passes
+    // (computeHamming then shards the words so that its computers fit)
+    if (static_cast<uint64_t>(numClst) * hammEmbBits * sizeof(streamingMedianComputer) > maxStreamingMedianBytes){
+        if (rank==0)
+            ViseMessageQueue::Instance()->Push( "Assignment log \nToo many words for a single pass, assigning and training Hamming separately" );
+        computeTrainAssigns(clstFn, RootSIFT, trainDescsFn, trainAssignsFn);
+        computeHamming(clstFn, RootSIFT, trainDescsFn, trainAssignsFn, trainHammFn, hammEmbBits, true);
+        return;
+    }
+
+    if (rank==0)
+        ViseMessageQueue::Instance()->Push( "Assignment log \nConstructing NN search object ..." );
+
+    t0= timing::tic();
+    fastann::nn_obj<float> const *nn_obj=
+        fastann::nn_obj_build_kdtree(
+            clstCentres_obj.clstC_flat,
+            clstCentres_obj.numClst,
+            clstCentres_obj.numDims, 8, 1024);
+    if (rank==0) {
+        std::ostringstream s;
+        s << "Assignment log done (" << timing::toc(t0) << " ms)";
+        ViseMessageQueue::Instance()->Push( s.str() );
+    }
+
+    flatDescsFile const descFile(trainDescsFn, RootSIFT);
+    uint32_t const numTrainDescs= descFile.numDescs();
+    ASSERT(descFile.numDims()==numDims);
+
+    // rotation, from the same sample as computeHamming uses, but assigned here
+    // (it is small compared to all training descriptors so reading it twice is fine)
+    std::vector<float> rot;
+
+    if (rank==0){
+        uint32_t numTrainDescsPCA= std::min( numTrainDescs, static_cast<uint32_t>(100000) );
+        uint32_t const blockSize= std::min(numTrainDescsPCA, static_cast<uint32_t>(1000));
+        numTrainDescsPCA-= numTrainDescsPCA%blockSize;
+        uint32_t const blockStep= numTrainDescs / (numTrainDescsPCA/blockSize);
+
+        std::ostringstream s;
+        s << "Hamm log \nReading " << numTrainDescsPCA << " training descriptors for PCA";
+        ViseMessageQueue::Instance()->Push( s.str() );
+
+        float *descs= new float[numTrainDescsPCA*numDims];
+        float *itDesc= descs;
+        float const *descsEnd= descs + numTrainDescsPCA*numDims;
+        uint32_t *clusterIDs= new uint32_t[blockSize];
+        float *distSq= new float[blockSize];
+
+        for (uint32_t iDescStart= 0; itDesc!=descsEnd; iDescStart+= blockStep){
+            float *thisBlockDescs;
+            descFile.getDescs(iDescStart, iDescStart+blockSize, thisBlockDescs);
+            nn_obj->search_nn(thisBlockDescs, blockSize, clusterIDs, distSq);
+            // subtract cluster centres
+            float const *thisDescIt= thisBlockDescs;
+            uint32_t const *endClstID= clusterIDs + blockSize;
+            for (uint32_t const *itClusterID= clusterIDs; itClusterID!=endClstID; ++itClusterID){
+                float const *itC= clstCentres_obj.clstC_flat + (*itClusterID) * numDims;
+                for (uint32_t iDim= 0; iDim<numDims; ++iDim, ++itDesc, ++itC, ++thisDescIt)
+                    *itDesc= *thisDescIt - *itC;
+            }
+            delete []thisBlockDescs;
+        }
+        delete []distSq;
+        delete []clusterIDs;
+
+        t0= timing::tic();
+        computeHammingRotation(descs, numTrainDescsPCA, numDims, hammEmbBits, rot);
+        delete []descs;
+
+        s.str("");
+        s.clear();
+        s << "Hamm log \nFinished with rotation (" << timing::toc(t0) << " ms)";
+        ViseMessageQueue::Instance()->Push( s.str() );
+    }
+
+    #ifdef RR_MPI
+    // communicate the rotation to everyone
+    if (!useThreads)
+        boost::mpi::broadcast(comm, rot, 0);
+    #endif
+
+    uint32_t const chunkSize=
+        std::min( static_cast<uint32_t>(10000),
+                  static_cast<uint32_t>(
+                      std::ceil(static_cast<double>(numTrainDescs)/std::max(numWorkerThreads, numProc))) );
+    uint32_t const nJobs= static_cast<uint32_t>( std::ceil(static_cast<double>(numTrainDescs)/chunkSize) );
+
+    #ifdef RR_MPI
+    if (!useThreads) comm.barrier();
+    #endif
+
+    trainAssignsHammingManager *manager= (rank==0) ?
+        new trainAssignsHammingManager(nJobs, trainAssignsFn, trainHammFn, rot, numDims, numClst) :
+        NULL;
+
+    trainAssignsHammingWorker worker(*nn_obj, descFile, clstCentres_obj, rot, chunkSize);
+
+    if (useThreads)
+        threadQueue<trainAssignsHammingResult>::start( nJobs, worker, *manager, numWorkerThreads );
+    else
+        mpiQueue<trainAssignsHammingResult>::start( nJobs, worker, manager );
+
+    if (rank==0) delete manager;
+
+    delete nn_obj;
+}
+
+};
@@ -0,0 +1,37 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _TRAIN_ASSIGN_HAMMING_H_
+#define _TRAIN_ASSIGN_HAMMING_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace buildIndex {
+    
+    // Same output as computeTrainAssigns followed by computeHamming (with streaming medians),
+    // but the training descriptors are read only once: each one is assigned to its cluster
+    // and its residual projections are fed to the median computers straight away.
+    // The median computers of all words are kept in memory (76 bytes per word and bit), if that is over
+    // maxStreamingMedianBytes the two are done separately instead, with the same result
+    void
+        computeTrainAssignsHamming(std::string const clstFn,
+                                   bool const RootSIFT,
+                                   std::string const trainDescsFn,
+                                   std::string const trainAssignsFn,
+                                   std::string const trainHammFn,
+                                   uint32_t const hammEmbBits);
+}
+
+#endif
@@ -15,6 +15,7 @@
 #include "train_descs.h"
 
 #include <fstream>
+#include <queue>
 #include <vector>
 #include <sstream>
 
@@ -27,7 +28,6 @@
 #endif
 
 #include "ViseMessageQueue.h"
-#include "image_util.h"
 #include "mpi_queue.h"
 #include "par_queue.h"
 #include "same_random.h"
@@ -139,12 +139,137 @@ namespace buildIndex {
 
 
 
+  // Keeps a uniform random sample of trainNumDescs out of all descriptors of all processed images.
+  // Each descriptor gets a pseudo-random key computed from (docID, feature index) and the ones with the
+  // smallest keys are kept (bottom-k sampling). Unlike taking descriptors in job order, or reservoir sampling,
+  // the sample doesn't depend on the order in which results arrive, so results are not buffered until they
+  // become contiguous, and memory is bounded by trainNumDescs descriptors.
+  class trainDescsSampleManager : public queueManager<trainDescsResult> {
+  public:
+
+    trainDescsSampleManager(uint32_t numDocs,
+                            uint32_t numDims,
+                            uint8_t dtypeCode,
+                            uint32_t trainNumDescs,
+                            std::string const trainDescsFn)
+      : numDims_(numDims),
+        dtypeCode_(dtypeCode),
+        trainNumDescs_(trainNumDescs),
+        trainDescsFn_(trainDescsFn),
+        descSize_(0),
+        numDescsSeen_(0),
+        progressPrint_(numDocs, std::string("Descriptor")),
+        numDocs_(numDocs),
+        numDocsDone_(0) {
+    }
+
+    void
+    operator()( uint32_t jobID, trainDescsResult &result );
+
+    // saves the sample
+    void
+    finalize();
+
+    // splitmix64 of the (docID, feature index) pair
+    static inline uint64_t
+    getKey( uint32_t docID, uint32_t iFeat ){
+      uint64_t z= ( (static_cast<uint64_t>(docID)<<32) | iFeat ) + 0x9E3779B97F4A7C15ULL;
+      z= (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z= (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      return z ^ (z >> 31);
+    }
+
+  private:
+    uint32_t const numDims_;
+    uint8_t const dtypeCode_;
+    uint32_t const trainNumDescs_;
+    std::string const trainDescsFn_;
+    uint32_t descSize_;
+    // trainNumDescs_ slots of descSize_ bytes
+    std::string samples_;
+    // (key, slot), largest key on top
+    std::priority_queue< std::pair<uint64_t, uint32_t> > heap_;
+    uint64_t numDescsSeen_;
+    timing::progressPrint progressPrint_;
+    uint32_t const numDocs_;
+    uint32_t numDocsDone_;
+
+    DISALLOW_COPY_AND_ASSIGN(trainDescsSampleManager)
+  };
+
+
+
+  void
+  trainDescsSampleManager::operator()( uint32_t jobID, trainDescsResult &result ){
+
+    progressPrint_.inc();
+    ++numDocsDone_;
+    if ( (numDocsDone_ % std::max<uint32_t>(1, numDocs_/200)) == 0 || numDocsDone_==numDocs_ ){
+      std::ostringstream progress;
+      progress << "Descriptor progress " << numDocsDone_ << "/" << numDocs_;
+      ViseMessageQueue::Instance()->Push( progress.str() );
+    }
+
+    uint32_t const numFeats= result.first;
+    if (numFeats==0)
+      return;
+
+    // nothing to sample (and heap_.top() below must not be called on an empty heap)
+    if (trainNumDescs_==0){
+      numDescsSeen_+= numFeats;
+      return;
+    }
+
+    ASSERT( result.second.size() % numFeats == 0 );
+    if (descSize_==0){
+      descSize_= result.second.size() / numFeats;
+      samples_.resize( static_cast<size_t>(trainNumDescs_) * descSize_ );
+    }
+    ASSERT( result.second.size() == static_cast<size_t>(numFeats) * descSize_ );
+
+    char const *desc= result.second.c_str();
+    for (uint32_t iFeat= 0; iFeat<numFeats; ++iFeat, desc+= descSize_){
+      ++numDescsSeen_;
+      uint64_t const key= getKey(jobID, iFeat);
+      uint32_t slot;
+      if (heap_.size() < trainNumDescs_){
+        slot= heap_.size();
+      } else if (key < heap_.top().first){
+        slot= heap_.top().second;
+        heap_.pop();
+      } else
+        continue;
+      heap_.push( std::make_pair(key, slot) );
+      std::copy( desc, desc + descSize_, &samples_[ static_cast<size_t>(slot) * descSize_ ] );
+    }
+  }
+
+
+
+  void
+  trainDescsSampleManager::finalize(){
+
+    FILE *f= fopen(trainDescsFn_.c_str(), "wb");
+    ASSERT(f!=NULL);
+    fwrite( &numDims_, sizeof(numDims_), 1, f );
+    fwrite( &dtypeCode_, sizeof(dtypeCode_), 1, f );
+    fwrite( samples_.c_str(), sizeof(char), static_cast<size_t>(heap_.size()) * descSize_, f );
+    fclose(f);
+
+    std::ostringstream s;
+    s << "Descriptor log \nSampled " << heap_.size() << " descriptors out of " << numDescsSeen_ << " from " << numDocsDone_ << " images";
+    ViseMessageQueue::Instance()->Push( s.str() );
+  }
+
+
+
   class trainDescsWorker : public queueWorker<trainDescsResult> {
   public:
 
     trainDescsWorker(std::vector<std::string> const &imageFns,
                      std::string const trainDatabasePath,
-                     featGetter const &featGetter_obj);
+                     featGetter const &featGetter_obj,
+                     uint32_t const maxImageSize);
 
     void
     operator() ( uint32_t jobID, trainDescsResult &result ) const;
@@ -155,6 +280,7 @@ namespace buildIndex {
     std::string const databasePath_;
 
     featGetter const *featGetter_;
+    uint32_t const maxImageSize_;
 
     DISALLOW_COPY_AND_ASSIGN(trainDescsWorker)
   };
@@ -164,10 +290,12 @@ namespace buildIndex {
   trainDescsWorker::trainDescsWorker(
                                      std::vector<std::string> const &imageFns,
                                      std::string const trainDatabasePath,
-                                     featGetter const &featGetter_obj)
+                                     featGetter const &featGetter_obj,
+                                     uint32_t const maxImageSize)
     : imageFns_(&imageFns),
       databasePath_(trainDatabasePath),
-      featGetter_(&featGetter_obj) {
+      featGetter_(&featGetter_obj),
+      maxImageSize_(maxImageSize) {
   }
 
 
@@ -181,25 +309,24 @@ namespace buildIndex {
     // get filename
     std::string imageFn= databasePath_ + imageFns_->at(docID);
 
-    // make sure the image exists and is readable
-    std::pair<uint32_t, uint32_t> wh= std::make_pair(0,0);
-    if (boost::filesystem::exists(imageFn) && boost::filesystem::is_regular_file(imageFn)){
-      wh= imageUtil::getWidthHeight(imageFn);
-    } else {
-      std::cerr<<"buildWorkerSemiSorted::operator(): "<<imageFn<<" doesn't exist\n";
-      return;
-    }
-    if (wh.first==0 && wh.second==0){
-      std::cerr<<"buildWorkerSemiSorted::operator(): "<<imageFn<<" is corrupt or 0x0\n";
+    // make sure the image exists
+    if (!boost::filesystem::exists(imageFn) || !boost::filesystem::is_regular_file(imageFn)){
+      std::cerr<<"trainDescsWorker::operator(): "<<imageFn<<" doesn't exist\n";
       return;
     }
 
     uint32_t numFeats;
     std::vector<ellipse> regions;
     float *descs;
+    std::pair<uint32_t, uint32_t> wh;
 
-    // extract features
-    featGetter_->getFeats(imageFn.c_str(), numFeats, regions, descs);
+    // extract features, decoding the image only once (also checks it is readable)
+    featGetter_->getFeatsOnce(imageFn.c_str(), maxImageSize_, wh, numFeats, regions, descs);
+    if (wh.first==0 && wh.second==0){
+      std::cerr<<"trainDescsWorker::operator(): "<<imageFn<<" is corrupt or 0x0\n";
+      delete []descs;
+      return;
+    }
     result.first= numFeats;
     if (numFeats==0){
       delete []descs;
@@ -219,7 +346,10 @@ namespace buildIndex {
                     std::string const trainDatabasePath,
                     std::string const trainDescsFn,
                     int32_t const trainNumDescs,
-                    featGetter const &featGetter_obj){
+                    featGetter const &featGetter_obj,
+                    uint32_t const maxImageSize,
+                    bool const uniformSample,
+                    int32_t const trainNumImages){
 
     MPI_GLOBAL_RANK;
 
@@ -256,6 +386,9 @@ namespace buildIndex {
       boost::mpi::broadcast(comm, imageFns, 0);
 #endif
     uint32_t nJobs= imageFns.size();
+    // images are shuffled so these are a uniform random subset
+    if (uniformSample && trainNumImages>0)
+      nJobs= std::min(nJobs, static_cast<uint32_t>(trainNumImages));
 
     // compute training descriptors
 
@@ -263,15 +396,23 @@ namespace buildIndex {
     if (!useThreads) comm.barrier();
 #endif
 
-    trainDescsManager *manager= (rank==0) ?
-      new trainDescsManager(nJobs,
-                            featGetter_obj.numDims(),
-                            featGetter_obj.getDtypeCode(),
-                            trainNumDescs,
-                            trainDescsFn) :
-      NULL;
+    queueManager<trainDescsResult> *manager= NULL;
+    if (rank==0){
+      if (uniformSample && trainNumDescs>=0)
+        manager= new trainDescsSampleManager(nJobs,
+                                             featGetter_obj.numDims(),
+                                             featGetter_obj.getDtypeCode(),
+                                             trainNumDescs,
+                                             trainDescsFn);
+      else
+        manager= new trainDescsManager(nJobs,
+                                       featGetter_obj.numDims(),
+                                       featGetter_obj.getDtypeCode(),
+                                       trainNumDescs,
+                                       trainDescsFn);
+    }
 
-    trainDescsWorker worker(imageFns, trainDatabasePath, featGetter_obj);
+    trainDescsWorker worker(imageFns, trainDatabasePath, featGetter_obj, maxImageSize);
 
     if (useThreads)
       threadQueue<trainDescsResult>::start( nJobs, worker, *manager, numWorkerThreads );
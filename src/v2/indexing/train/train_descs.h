@@ -22,11 +22,17 @@ No usage or redistribution is allowed without explicit permission.
 
 namespace buildIndex {
 
+    // By default descriptors are taken from images in (shuffled) list order until trainNumDescs are collected.
+    // With uniformSample a uniform sample of trainNumDescs descriptors is drawn from all descriptors of the
+    // first trainNumImages images of the shuffled list (all if <=0), i.e. from a uniform random subset of images.
     void
         computeTrainDescs(std::string const trainImagelistFn, std::string const trainDatabasePath,
                           std::string const trainDescsFn,
                           int32_t const trainNumDescs,
-                          featGetter const &featGetter_obj);
+                          featGetter const &featGetter_obj,
+                          uint32_t const maxImageSize= 0,
+                          bool const uniformSample= false,
+                          int32_t const trainNumImages= -1);
 }
 
 #endif
@@ -15,6 +15,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "train_hamming.h"
 
 #include <fstream>
+#include <stdexcept>
 #include <vector>
 
 #include <boost/filesystem.hpp>
@@ -42,6 +43,43 @@ No usage or redistribution is allowed without explicit permission.
 namespace buildIndex {
 
 
+void
+saveHammingData(
+        std::string const trainHammFn,
+        uint32_t const numClst,
+        uint32_t const numDims,
+        std::vector<float> const &rot,
+        std::vector<float> const &median){
+
+    ASSERT(rot.size() % numDims==0);
+    uint32_t const hammEmbBits= rot.size() / numDims;
+    ASSERT(median.size()==numClst*hammEmbBits);
+
+    rr::hammingData hamm;
+    hamm.set_k(numClst);
+    hamm.set_numdims(numDims);
+    hamm.set_numbits(hammEmbBits);
+
+    // organization:
+    // magicNumber, sizeof(header), header, rotation, medians
+    std::string headerStr;
+    hamm.SerializeToString(&headerStr);
+    uint32_t const magicNumber= 0xF1234987;
+    uint32_t const headerSize= headerStr.length();
+
+    FILE *f= fopen(trainHammFn.c_str(), "wb");
+
+    fwrite( &(magicNumber), sizeof(uint32_t), 1, f );
+    fwrite( &(headerSize), sizeof(uint32_t), 1, f );
+    fwrite( &(headerStr[0]), sizeof(char), headerSize, f );
+    fwrite( &(rot[0]), sizeof(float), rot.size(), f );
+    fwrite( &median[0], sizeof(float), median.size(), f );
+
+    fclose(f);
+}
+
+
+
 typedef std::vector<float> trainHammingResult; // medians after cluster centres were subtracted
 
 
@@ -93,22 +131,7 @@ class trainHammingManager : public managerWithTiming<trainHammingResult> {
 
 
 trainHammingManager::~trainHammingManager(){
-    // organization:
-    // magicNumber, sizeof(header), header, rotation, medians
-    std::string headerStr;
-    hamm_.SerializeToString(&headerStr);
-    uint32_t const magicNumber= 0xF1234987;
-    uint32_t const headerSize= headerStr.length();
-
-    FILE *f= fopen(trainHammFn_.c_str(), "wb");
-
-    fwrite( &(magicNumber), sizeof(uint32_t), 1, f );
-    fwrite( &(headerSize), sizeof(uint32_t), 1, f );
-    fwrite( &(headerStr[0]), sizeof(char), headerSize, f );
-    fwrite( &((*rot_)[0]), sizeof(float), rot_->size(), f );
-    fwrite( &median_[0], sizeof(float), median_.size(), f );
-
-    fclose(f);
+    saveHammingData(trainHammFn_, hamm_.k(), hamm_.numdims(), *rot_, median_);
 }
 
 
@@ -138,7 +161,8 @@ class trainHammingWorker : public queueWorker<trainHammingResult> {
                            bool const RootSIFT,
                            std::vector<float> const &rot,
                            clstCentres const &clstCentres_obj,
-                           uint32_t const vocChunkSize)
+                           uint32_t const vocChunkSize,
+                           bool const streamingMedian)
                            : descFile_(trainDescsFn, RootSIFT),
                              hammEmbBits_(rot.size() / descFile_.numDims()),
                              numClst_(clstCentres_obj.numClst),
@@ -146,7 +170,8 @@ class trainHammingWorker : public queueWorker<trainHammingResult> {
                              numDims_(descFile_.numDims()),
                              numDescs_(descFile_.numDescs()),
                              rot_(&rot),
-                             clstCentres_obj_(&clstCentres_obj){
+                             clstCentres_obj_(&clstCentres_obj),
+                             streamingMedian_(streamingMedian){
                   ASSERT(clstCentres_obj_->numDims==numDims_);
                   ASSERT(rot.size() % numDims_==0);
                   f_= fopen(trainAssignsFn.c_str(), "rb");
@@ -159,12 +184,18 @@ class trainHammingWorker : public queueWorker<trainHammingResult> {
             operator() ( uint32_t jobID, trainHammingResult &result ) const;
 
     private:
+
+        template<class medianComputerT>
+        void
+            computeMedians( uint32_t wordStart, uint32_t const wordEnd, trainHammingResult &result ) const;
+
         flatDescsFile const descFile_;
         FILE *f_;
         int fd_;
         uint32_t const hammEmbBits_, numClst_, vocChunkSize_, numDims_, numDescs_;
         std::vector<float> const *rot_;
         clstCentres const *clstCentres_obj_;
+        bool const streamingMedian_;
 
         DISALLOW_COPY_AND_ASSIGN(trainHammingWorker)
 };
@@ -176,9 +207,22 @@ trainHammingWorker::operator() ( uint32_t jobID, trainHammingResult &result ) co
 
     result.clear();
 
-    uint32_t wordStart= jobID*vocChunkSize_;
+    uint32_t const wordStart= jobID*vocChunkSize_;
     uint32_t const wordEnd= std::min( (jobID+1)*vocChunkSize_, numClst_ );
-    std::vector<medianComputer> medianComp( (wordEnd-wordStart)*hammEmbBits_ );
+
+    if (streamingMedian_)
+        computeMedians<streamingMedianComputer>(wordStart, wordEnd, result);
+    else
+        computeMedians<medianComputer>(wordStart, wordEnd, result);
+}
+
+
+
+template<class medianComputerT>
+void
+trainHammingWorker::computeMedians( uint32_t wordStart, uint32_t const wordEnd, trainHammingResult &result ) const {
+
+    std::vector<medianComputerT> medianComp( (wordEnd-wordStart)*hammEmbBits_ );
 
     uint32_t const descChunkSize= 1000;
     uint32_t clusterIDs[descChunkSize];
@@ -213,7 +257,7 @@ trainHammingWorker::operator() ( uint32_t jobID, trainHammingResult &result ) co
                 *itDesc-= *itC;
 
             // rotate and add to median computer for every projection dimension
-            medianComputer *itMC= &medianComp[0] + (*itClusterID-wordStart) * hammEmbBits_;
+            medianComputerT *itMC= &medianComp[0] + (*itClusterID-wordStart) * hammEmbBits_;
             float projection;
             float const *itDescEnd= thisDesc+numDims_;
             float const *itDescC;
@@ -235,7 +279,7 @@ trainHammingWorker::operator() ( uint32_t jobID, trainHammingResult &result ) co
 
     result.clear();
     result.reserve( (wordEnd-wordStart)*hammEmbBits_ );
-    for (medianComputer *itMC= &medianComp[0]; wordStart<wordEnd; ++wordStart){
+    for (medianComputerT *itMC= &medianComp[0]; wordStart<wordEnd; ++wordStart){
         for (uint32_t iDim= 0; iDim < hammEmbBits_; ++iDim, ++itMC)
             result.push_back( itMC->getMedian() );
     }
@@ -244,6 +288,55 @@ trainHammingWorker::operator() ( uint32_t jobID, trainHammingResult &result ) co
 
 
 
+void
+computeHammingRotation(
+        float *residuals,
+        uint32_t const numResiduals,
+        uint32_t const numDims,
+        uint32_t const hammEmbBits,
+        std::vector<float> &rot){
+
+    //std::cout<<"buildIndex::computeHamming: Computing PCA\n";
+    ViseMessageQueue::Instance()->Push( "Hamm log \nComputing PCA" );
+
+    Eigen::Map<Eigen::MatrixXf> trainData(residuals, numDims, numResiduals);
+    Eigen::JacobiSVD<Eigen::MatrixXf> svdForPCA(trainData, Eigen::ComputeThinU);
+    // doing SVD of trainData is like eig(trainData*trainData'), leftmost columns of U are largest eigenvectors
+    Eigen::MatrixXf PCA= svdForPCA.matrixU().block(0,0, numDims,hammEmbBits);
+    ASSERT(PCA.rows()==numDims && PCA.cols()==hammEmbBits);
+
+    // --- get the random rotation (hammEmbBits x hammEmbBits)
+    //std::cout<<"buildIndex::computeHamming: Computing random rotation\n";
+    ViseMessageQueue::Instance()->Push( "Hamm log \nComputing random rotation" );
+
+    // make random matrix
+    sameRandomUint32 sr(hammEmbBits * hammEmbBits, 43);
+    sameRandomStreamUint32 srS(sr);
+    Eigen::MatrixXf randMatrix(hammEmbBits, hammEmbBits);
+    for (uint32_t i= 0; i<hammEmbBits; ++i)
+        for (uint32_t j= 0; j<hammEmbBits; ++j)
+            randMatrix(i,j)= srS.getNextFloat();
+
+    // get random orthonormal matrix by doing SVD
+    Eigen::JacobiSVD<Eigen::MatrixXf> svdForRR(randMatrix, Eigen::ComputeFullU);
+    Eigen::MatrixXf R= svdForRR.matrixU();
+    ASSERT(R.cols()==hammEmbBits && R.rows()==hammEmbBits);
+    // check stuff orthogonal just in case, but there is no way it isn't
+    for (uint32_t i= 0; i<hammEmbBits; ++i)
+        ASSERT( fabs( R.row(i).norm() -1)<1e-4 );
+
+    // --- finally, compute the final rotation via R*PCA'
+    R*= PCA.transpose();
+
+    // copy the rotation matrix into vector
+    rot.reserve(hammEmbBits*numDims);
+    for (uint32_t i= 0; i<hammEmbBits; ++i)
+        for (uint32_t j= 0; j<numDims; ++j)
+            rot.push_back(R(i,j));
+}
+
+
+
 void
 computeHamming(
         std::string const clstFn,
@@ -251,7 +344,8 @@ computeHamming(
         std::string const trainDescsFn,
         std::string const trainAssignsFn,
         std::string const trainHammFn,
-        uint32_t const hammEmbBits){
+        uint32_t const hammEmbBits,
+        bool const streamingMedian){
 
     MPI_GLOBAL_ALL;
     std::ostringstream s;
@@ -266,6 +360,8 @@ computeHamming(
     ASSERT( boost::filesystem::exists(trainDescsFn) );
     ASSERT( boost::filesystem::exists(trainAssignsFn) );
     ASSERT( hammEmbBits<=64 );
+    if (flatDescsFile(trainDescsFn, RootSIFT).numDescs()==0)
+        throw std::runtime_error( std::string("No training descriptors in ") + trainDescsFn );
 
     // clusters
     if (rank==0) {
@@ -347,39 +443,9 @@ computeHamming(
 
         double t0= timing::tic();
 
-        //std::cout<<"buildIndex::computeHamming: Computing PCA\n";
-        ViseMessageQueue::Instance()->Push( "Hamm log \nComputing PCA" );
-
-        Eigen::Map<Eigen::MatrixXf> trainData(descs, numDims, numTrainDescsPCA);
-        Eigen::JacobiSVD<Eigen::MatrixXf> svdForPCA(trainData, Eigen::ComputeThinU);
-        // doing SVD of trainData is like eig(trainData*trainData'), leftmost columns of U are largest eigenvectors
-        Eigen::MatrixXf PCA= svdForPCA.matrixU().block(0,0, numDims,hammEmbBits);
-        ASSERT(PCA.rows()==numDims && PCA.cols()==hammEmbBits);
+        computeHammingRotation(descs, numTrainDescsPCA, numDims, hammEmbBits, rot);
         delete []descs;
 
-        // --- get the random rotation (hammEmbBits x hammEmbBits)
-        //std::cout<<"buildIndex::computeHamming: Computing random rotation\n";
-        ViseMessageQueue::Instance()->Push( "Hamm log \nComputing random rotation" );
-
-        // make random matrix
-        sameRandomUint32 sr(hammEmbBits * hammEmbBits, 43);
-        sameRandomStreamUint32 srS(sr);
-        Eigen::MatrixXf randMatrix(hammEmbBits, hammEmbBits);
-        for (uint32_t i= 0; i<hammEmbBits; ++i)
-            for (uint32_t j= 0; j<hammEmbBits; ++j)
-                randMatrix(i,j)= srS.getNextFloat();
-
-        // get random orthonormal matrix by doing SVD
-        Eigen::JacobiSVD<Eigen::MatrixXf> svdForRR(randMatrix, Eigen::ComputeFullU);
-        Eigen::MatrixXf R= svdForRR.matrixU();
-        ASSERT(R.cols()==hammEmbBits && R.rows()==hammEmbBits);
-        // check stuff orthogonal just in case, but there is no way it isn't
-        for (uint32_t i= 0; i<hammEmbBits; ++i)
-            ASSERT( fabs( R.row(i).norm() -1)<1e-4 );
-
-        // --- finally, compute the final rotation via R*PCA'
-        R*= PCA.transpose();
-
         #else
 
         // just do random rotation
@@ -405,14 +471,14 @@ computeHamming(
         for (uint32_t i= 0; i<hammEmbBits; ++i)
             ASSERT( fabs( R.row(i).norm() -1)<1e-4 );
 
-        #endif
-
         // copy the rotation matrix into vector
         rot.reserve(hammEmbBits*numDims);
         for (uint32_t i= 0; i<hammEmbBits; ++i)
             for (uint32_t j= 0; j<numDims; ++j)
                 rot.push_back(R(i,j));
 
+        #endif
+
         //std::cout<<"buildIndex::computeHamming: Done with rotation ("<< timing::toc(t0) <<" ms)\n";
         s.str("");
         s.clear();
@@ -428,8 +494,17 @@ computeHamming(
 
     // Parallelization is done a bit differently than normally, due to memory:
     // Each worker will process a range of visual words to find the medians
+    // (and each job reads all training descriptors, skipping those assigned to other words).
+    // Streaming median computers have fixed small memory so the words are split into only as many
+    // chunks as there are workers, i.e. the data is read #workers times, concurrently,
+    // unless the computers of the concurrent jobs would exceed maxStreamingMedianBytes.
+    // Splitting the descriptors instead would need estimators for all words in every worker
+    // (numClst*hammEmbBits*76 bytes each); computeTrainAssignsHamming is the single-pass alternative.
+    uint32_t const maxStreamingChunkSize= std::max( static_cast<uint64_t>(1),
+        maxStreamingMedianBytes / (static_cast<uint64_t>(hammEmbBits) * sizeof(streamingMedianComputer)) /
+        (useThreads ? numWorkerThreads : 1) );
     uint32_t const vocChunkSize=
-        std::min( static_cast<uint32_t>(5000),
+        std::min( streamingMedian ? maxStreamingChunkSize : static_cast<uint32_t>(5000),
                   static_cast<uint32_t>(
                       std::ceil(static_cast<double>(numClst)/std::max(numWorkerThreads, numProc))) );
     uint32_t const nJobs= static_cast<uint32_t>( std::ceil(static_cast<double>(numClst)/vocChunkSize) );
@@ -446,7 +521,8 @@ computeHamming(
 
     trainHammingWorker worker(trainDescsFn, trainAssignsFn,
                               RootSIFT,
-                              rot, clstCentres_obj, vocChunkSize);
+                              rot, clstCentres_obj, vocChunkSize,
+                              streamingMedian);
 
     if (useThreads)
         threadQueue<trainHammingResult>::start( nJobs, worker, *manager, numWorkerThreads );
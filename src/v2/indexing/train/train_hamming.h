@@ -17,18 +17,41 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include "ViseMessageQueue.h"
 
 namespace buildIndex {
     
+    // upper bound on the memory of the streaming median computers (one per word and bit) kept at once,
+    // above it words are processed in several passes over the training descriptors
+    uint64_t const maxStreamingMedianBytes= static_cast<uint64_t>(1)<<30;
+    
     void
         computeHamming(std::string const clstFn,
                        bool const RootSIFT,
                        std::string const trainDescsFn,
                        std::string const trainAssignsFn,
                        std::string const trainHammFn,
-                       uint32_t const hammEmbBits);
+                       uint32_t const hammEmbBits,
+                       bool const streamingMedian= false);
+    
+    // rotation (hammEmbBits x numDims, row-major) from PCA of the numResiduals residuals
+    // (numDims x numResiduals, i.e. one after another) followed by a random rotation
+    void
+        computeHammingRotation(float *residuals,
+                               uint32_t const numResiduals,
+                               uint32_t const numDims,
+                               uint32_t const hammEmbBits,
+                               std::vector<float> &rot);
+    
+    // medians are numClst x hammEmbBits, hammEmbBits= rot.size()/numDims
+    void
+        saveHammingData(std::string const trainHammFn,
+                        uint32_t const numClst,
+                        uint32_t const numDims,
+                        std::vector<float> const &rot,
+                        std::vector<float> const &median);
 }
 
 #endif
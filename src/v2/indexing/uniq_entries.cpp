@@ -14,6 +14,10 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "uniq_entries.h"
 
+#include "latency.h"
+
+#include <algorithm>
+
 
 
 void
@@ -27,6 +31,59 @@ uniqEntries::getUniqIndToInd(std::vector<int> &uniqIndToInd) const {
 
 
 
+std::vector<rr::indexEntry> const *
+batchEntries::getEntries(uint32_t ID) const {
+    std::vector<uint32_t>::const_iterator it= std::lower_bound(IDs_.begin(), IDs_.end(), ID);
+    if (it==IDs_.end() || *it!=ID)
+        return NULL;
+    return &allEntries_[it - IDs_.begin()];
+}
+
+
+
+void
+batchEntries::getUniqEntries(rr::indexEntry const &queryRep, uniqEntries &ue) const {
+    
+    std::vector<uint32_t> &index= ue.index_;
+    std::vector< std::vector<rr::indexEntry> > &allEntries= ue.allEntries_;
+    
+    index.clear();
+    index.reserve(queryRep.id_size());
+    allEntries.clear();
+    
+    // a word is kept if any of its query features is kept (as in protoIndex::getUniqEntries)
+    
+    std::vector<uint32_t> uniqIDs;
+    std::vector<bool> keep;
+    uniqIDs.reserve(queryRep.id_size());
+    keep.reserve(queryRep.id_size());
+    
+    uint32_t prevID= 0, currID;
+    
+    for (int i= 0; i<queryRep.id_size(); ++i){
+        currID= queryRep.id(i);
+        if (i==0 || currID!=prevID) {
+            ASSERT(i==0 || prevID<currID);
+            uniqIDs.push_back(currID);
+            keep.push_back(false);
+        }
+        if (queryRep.keep_size()==0 || queryRep.keep(i))
+            keep.back()= true;
+        index.push_back( uniqIDs.size()-1 );
+        prevID= currID;
+    }
+    
+    allEntries.resize(uniqIDs.size());
+    for (uint32_t i= 0; i<uniqIDs.size(); ++i)
+        if (keep[i]){
+            std::vector<rr::indexEntry> const *entries= getEntries(uniqIDs[i]);
+            ASSERT(entries!=NULL);
+            allEntries[i]= *entries;
+        }
+}
+
+
+
 std::vector<rr::indexEntry>*
 precompUEIterator::getEntriesConst() const {
     return &( ue_->allEntries_[ ue_->index_[ind_] ] );
@@ -47,6 +104,7 @@ std::vector<rr::indexEntry>*
 onlineUEIterator::getEntries() {
     uint32_t currID= queryRep_->id(ind_);
     if (firstLoad_ || loadedID_!=currID){
+        latency::span span(latency::postingFetch);
         loadedID_= currID;
         idx_->getEntries(loadedID_, entries_);
         firstLoad_= false;
@@ -41,6 +41,28 @@ struct uniqEntries {
 
 
 
+// posting lists of the union of words of a batch of queries, each fetched only once (see protoIndex::getBatchEntries)
+// IDs_ is sorted and allEntries_[i] are the entries of IDs_[i]
+struct batchEntries {
+    batchEntries(){}
+    std::vector<uint32_t> IDs_;
+    std::vector< std::vector<rr::indexEntry> > allEntries_;
+    
+    // NULL if ID is not in the batch
+    std::vector<rr::indexEntry> const *
+        getEntries(uint32_t ID) const;
+    
+    // same output as protoIndex::getUniqEntries but copies the entries from here (so ue can be modified, e.g. by hamming);
+    // queryRep has to be one of the queries the batch was fetched for
+    void
+        getUniqEntries(rr::indexEntry const &queryRep, uniqEntries &ue) const;
+    
+    private:
+        DISALLOW_COPY_AND_ASSIGN(batchEntries)
+};
+
+
+
 class ueIterator {
     
     public:
@@ -0,0 +1,177 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+// Finds the clusters of near-duplicate images of an engine (see near_dup.h), configured from the same config
+// file as api_v2. Besides the usual fidxFn (and iidxFn, wghtFn, hammEmbBits, trainFilesPrefix for
+// confirmation), the nearDup* keys below set the parameters; nearDupConfirm is "none", "hamming" or "spatial".
+//
+// find_near_dups dsetname configFn [outFn=""] [pairsFn=""]
+//
+// outFn (stdout if not given) has one cluster per line: its docIDs separated by spaces, largest clusters first.
+// pairsFn has one pair per line: docID1 docID2 jaccard numMatches
+
+#include <stdint.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+
+#include <google/protobuf/stubs/common.h>
+
+#include "hamming.h"
+#include "hamming_embedder.h"
+#include "macros.h"
+#include "near_dup.h"
+#include "proto_db.h"
+#include "proto_db_file.h"
+#include "proto_index.h"
+#include "python_cfg_to_ini.h"
+#include "spatial_verif_v2.h"
+#include "tfidf_v2.h"
+#include "timing.h"
+#include "util.h"
+
+
+
+int main(int argc, char* argv[]){
+
+    if (argc<3){
+        std::cerr<<"Usage: "<<argv[0]<<" dsetname configFn [outFn=\"\"] [pairsFn=\"\"]\n";
+        return 1;
+    }
+
+    std::string const dsetname= argv[1];
+    std::string const configFn= util::expandUser(argv[2]);
+    std::string const outFn= (argc>3) ? argv[3] : "";
+    std::string const pairsFn= (argc>4) ? argv[4] : "";
+
+    std::string tempConfigFn= util::getTempFileName();
+    pythonCfgToIni( configFn, tempConfigFn );
+
+    boost::property_tree::ptree pt;
+    boost::property_tree::ini_parser::read_ini(tempConfigFn, pt);
+    remove(tempConfigFn.c_str());
+
+    // ------------------------------------ read config
+
+    std::string const fidxFn= util::expandUser(pt.get<std::string>( dsetname+".fidxFn" ));
+
+    nearDupParams params;
+    params.numBands= pt.get<uint32_t>( dsetname+".nearDupBands", params.numBands );
+    params.rowsPerBand= pt.get<uint32_t>( dsetname+".nearDupRows", params.rowsPerBand );
+    params.jaccardThr= pt.get<float>( dsetname+".nearDupJaccardThr", params.jaccardThr );
+    params.maxBucketSize= pt.get<uint32_t>( dsetname+".nearDupMaxBucketSize", params.maxBucketSize );
+    params.minWords= pt.get<uint32_t>( dsetname+".nearDupMinWords", params.minWords );
+    params.seed= pt.get<uint32_t>( dsetname+".nearDupSeed", params.seed );
+    std::string const confirm= pt.get<std::string>( dsetname+".nearDupConfirm", "none" );
+    uint32_t const minMatches= pt.get<uint32_t>( dsetname+".nearDupMinMatches", 10 );
+    uint32_t const numWorkerThreads= pt.get<uint32_t>( dsetname+".nearDupNumThreads", 8 );
+
+    ASSERT( confirm=="none" || confirm=="hamming" || confirm=="spatial" );
+
+    // ------------------------------------ load
+
+    protoDbFile dbFidx(fidxFn);
+    protoIndex fidx(dbFidx, false);
+
+    protoDbFile *dbIidx= NULL;
+    protoIndex *iidx= NULL;
+    tfidfV2 *tfidfObj= NULL;
+    hammingEmbedderFactory *embFactory= NULL;
+    hamming *hammingObj= NULL;
+    spatialVerifV2 *spatVerifObj= NULL;
+    nearDupConfirmer *confirmer= NULL;
+
+    if (confirm!="none"){
+
+        std::string const iidxFn= util::expandUser(pt.get<std::string>( dsetname+".iidxFn" ));
+        std::string const wghtFn= util::expandUser(pt.get<std::string>( dsetname+".wghtFn" ));
+        boost::optional<uint32_t> const hammEmbBits= pt.get_optional<uint32_t>( dsetname+".hammEmbBits" );
+
+        dbIidx= new protoDbFile(iidxFn);
+        iidx= new protoIndex(*dbIidx, false);
+        tfidfObj= new tfidfV2(iidx, &fidx, wghtFn);
+
+        if (hammEmbBits.is_initialized()){
+            std::string const trainFilesPrefix= util::expandUser(pt.get<std::string>( dsetname+".trainFilesPrefix" ));
+            embFactory= new hammingEmbedderFactory(trainFilesPrefix + "hamm.v2bin", *hammEmbBits);
+            hammingObj= new hamming(*tfidfObj, iidx, *embFactory, &fidx);
+        }
+
+        if (confirm=="hamming"){
+            ASSERT(hammingObj!=NULL);
+            confirmer= new nearDupHammingConfirmer(*hammingObj, *embFactory, minMatches);
+        } else {
+            retrieverFromIter const &baseRetriever= (hammingObj!=NULL) ?
+                static_cast<retrieverFromIter const &>(*hammingObj) :
+                static_cast<retrieverFromIter const &>(*tfidfObj);
+            spatVerifObj= new spatialVerifV2(baseRetriever, iidx, &fidx, true);
+            confirmer= new nearDupSpatialConfirmer(*spatVerifObj, minMatches);
+        }
+    }
+
+    // ------------------------------------ find
+
+    double t0= timing::tic();
+
+    nearDuplicates nearDupObj(fidx, fidx.numIDs(), params, numWorkerThreads);
+
+    std::vector<nearDupPair> pairs;
+    nearDupObj.getAllPairs(pairs, confirmer, numWorkerThreads);
+
+    std::vector< std::vector<uint32_t> > clusters;
+    nearDuplicates::getClusters(pairs, clusters);
+
+    uint32_t numInClusters= 0;
+    for (uint32_t iCl= 0; iCl<clusters.size(); ++iCl)
+        numInClusters+= clusters[iCl].size();
+
+    std::cerr<<"find_near_dups: "<<pairs.size()<<" pairs, "<<clusters.size()<<" clusters with "<<numInClusters
+             <<" of "<<nearDupObj.numDocs()<<" documents, "<<timing::toc(t0)<<" ms\n";
+
+    // ------------------------------------ save
+
+    std::ofstream fout;
+    if (outFn.length()>0)
+        fout.open(outFn.c_str());
+    std::ostream &out= (outFn.length()>0) ? fout : std::cout;
+
+    for (uint32_t iCl= 0; iCl<clusters.size(); ++iCl){
+        for (uint32_t i= 0; i<clusters[iCl].size(); ++i)
+            out<<(i>0 ? " " : "")<<clusters[iCl][i];
+        out<<"\n";
+    }
+
+    if (pairsFn.length()>0){
+        std::ofstream fpairs(pairsFn.c_str());
+        for (uint32_t i= 0; i<pairs.size(); ++i)
+            fpairs<<pairs[i].docID1<<" "<<pairs[i].docID2<<" "<<pairs[i].jaccard<<" "<<pairs[i].numMatches<<"\n";
+    }
+
+    // ------------------------------------ clean up
+
+    if (confirmer!=NULL) delete confirmer;
+    if (spatVerifObj!=NULL) delete spatVerifObj;
+    if (hammingObj!=NULL) delete hammingObj;
+    if (embFactory!=NULL) delete embFactory;
+    if (tfidfObj!=NULL) delete tfidfObj;
+    if (iidx!=NULL) delete iidx;
+    if (dbIidx!=NULL) delete dbIidx;
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
@@ -16,6 +16,7 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "argsort.h"
 #include "bitcount.h"
+#include "latency.h"
 
 
 
@@ -96,6 +97,7 @@ hamming::queryExecute(
     
     double queryL2= 0.0;
     uint32_t wordID, prevDocID, thisNum;
+    std::vector<uint64_t> dbSigs;
     double thisIncScore, thisOneScore;
     int hammDist;
     
@@ -108,6 +110,10 @@ hamming::queryExecute(
     
     for (int iQueryWord= 0; iQueryWord < queryRep.id_size();){
         
+        // out of time: the scores are from the words so far
+        if (latency::pastDeadline())
+            break;
+        
         wordID= queryRep.id(iQueryWord);
         
         // get the boundaries of the current query visual word
@@ -151,9 +157,15 @@ hamming::queryExecute(
                 charStream* csDb= heDb->getCharStream();
                 ASSERT(csDb->getNum() == static_cast<uint32_t>(entry.id_size()));
                 
+                // decode the whole posting list at once
+                dbSigs.resize(entry.id_size());
+                if (!dbSigs.empty())
+                    csDb->decodeNext(dbSigs.size(), &dbSigs[0]);
+                uint64_t const *itSig= dbSigs.empty() ? NULL : &dbSigs[0];
+                
                 while (itID!=endID){
-                    for (; itID!=endID && *itID==prevDocID; ++itID, ++thisNum){
-                        hammDist= bitcount64(querySig ^ csDb->getNextUnsafe());
+                    for (; itID!=endID && *itID==prevDocID; ++itID, ++itSig, ++thisNum){
+                        hammDist= bitcount64(querySig ^ *itSig);
                         if (hammDist <= distThrSpatial_){
                             thisOneScore=
                             #if HAMM_DO_WEIGHTED
@@ -14,9 +14,12 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "image_graph.h"
 
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <set>
 
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
 #ifdef RR_MPI
@@ -29,6 +32,9 @@ No usage or redistribution is allowed without explicit permission.
 #include "par_queue.h"
 #include "proto_db_file.h"
 #include "proto_index.h"
+#include "query.h"
+#include "spatial_verif_v2.h"
+#include "thread_queue.h"
 #include "timing.h"
 
 
@@ -307,6 +313,266 @@ imageGraph::computeParallel(
 
 
 
+// ------- imageGraph::computeResumable and helper functions
+
+
+
+class imageGraphBatchManager : public queueManager<imageGraphResult> {
+    public:
+        
+        // docIDs in the part file are relative to batchStart
+        imageGraphBatchManager(std::string partFn,
+                               uint32_t batchStart,
+                               double scoreThr,
+                               timing::progressPrint &progress)
+            : dbBuilder_(partFn, "image graph part"),
+              idxBuilder_(dbBuilder_, false, false, false),
+              batchStart_(batchStart),
+              scoreThr_(scoreThr),
+              progress_(&progress),
+              nextJobID_(0)
+                {}
+        
+        void
+            operator() (uint32_t jobID, imageGraphResult &queryRes);
+        
+        void
+            finalize();
+        
+        imageGraph::imageGraphType graph_;
+        
+    private:
+        protoDbFileBuilder dbBuilder_;
+        indexBuilder idxBuilder_;
+        uint32_t const batchStart_;
+        double const scoreThr_;
+        timing::progressPrint *progress_;
+        std::map<uint32_t, rr::indexEntry> buffer_;
+        uint32_t nextJobID_;
+};
+
+
+
+void
+imageGraphBatchManager::operator() (uint32_t jobID, imageGraphResult &queryRes){
+    
+    uint32_t const docID= batchStart_ + jobID;
+    std::vector<indScorePair> neighs;
+    rr::indexEntry &entry= buffer_[jobID];
+    
+    for (std::vector<indScorePair>::const_iterator itRes= queryRes.begin();
+         itRes!=queryRes.end();
+         ++itRes){
+        
+        // skip self
+        if (itRes->first == docID)
+            continue;
+        
+        // sorted in non-increasing order, so no future scores will be large enough
+        if (itRes->second < scoreThr_)
+            break;
+        
+        entry.add_id(itRes->first);
+        entry.add_weight(itRes->second);
+        neighs.push_back( *itRes );
+    }
+    
+    if (neighs.size() > 0)
+        graph_[docID]= neighs;
+    
+    // IDs have to be added in ascending order
+    for (; buffer_.count(nextJobID_)!=0; ++nextJobID_){
+        rr::indexEntry &entryToSave= buffer_[nextJobID_];
+        if (entryToSave.id_size()>0)
+            idxBuilder_.addEntry(nextJobID_, entryToSave);
+        buffer_.erase(nextJobID_);
+    }
+    
+    progress_->inc();
+}
+
+
+
+void
+imageGraphBatchManager::finalize(){
+    ASSERT(buffer_.size()==0);
+    idxBuilder_.close();
+}
+
+
+
+class imageGraphBatchWorker : public queueWorker<imageGraphResult> {
+    
+    public:
+        
+        // reverse: for a document, the edges (from previous batches) which point to it
+        imageGraphBatchWorker(
+            retriever const &retrieverObj,
+            uint32_t batchStart,
+            uint32_t maxNeighs,
+            imageGraph::imageGraphType const &reverse)
+                : retriever_(&retrieverObj),
+                  spatVerif_(dynamic_cast<spatialVerifV2 const *>(&retrieverObj)),
+                  batchStart_(batchStart),
+                  maxNeighs_(maxNeighs),
+                  reverse_(&reverse) {}
+        
+        void
+            operator() ( uint32_t jobID, imageGraphResult &queryRes ) const;
+        
+    private:
+        retriever const *retriever_;
+        spatialVerifV2 const *spatVerif_;
+        uint32_t const batchStart_, maxNeighs_;
+        imageGraph::imageGraphType const *reverse_;
+};
+
+
+
+void
+imageGraphBatchWorker::operator() ( uint32_t jobID, imageGraphResult &queryRes ) const {
+    
+    uint32_t const docID= batchStart_ + jobID;
+    queryRes.clear();
+    
+    imageGraph::imageGraphType::const_iterator itRev= reverse_->find(docID);
+    
+    if (spatVerif_==NULL || itRev==reverse_->end()){
+        retriever_->internalQuery(docID, queryRes, maxNeighs_);
+        ASSERT( maxNeighs_==0 || queryRes.size()<=maxNeighs_ );
+        return;
+    }
+    
+    // these pairs have already been verified
+    std::vector<indScorePair> const &known= itRev->second;
+    std::set<uint32_t> ignoreDocs;
+    for (std::vector<indScorePair>::const_iterator it= known.begin(); it!=known.end(); ++it)
+        ignoreDocs.insert(it->first);
+    
+    rr::indexEntry queryRep;
+    spatVerif_->getQueryRep( query(docID, true), queryRep );
+    spatVerif_->spatialQueryExecute( queryRep, queryRes, NULL, &ignoreDocs, maxNeighs_ );
+    
+    queryRes.insert( queryRes.end(), known.begin(), known.end() );
+    retriever::sortResults( queryRes, 0, maxNeighs_ );
+}
+
+
+
+void
+imageGraph::computeResumable(
+        std::string filename,
+        uint32_t numDocs,
+        retriever const &retrieverObj,
+        uint32_t maxNeighs,
+        double scoreThr,
+        uint32_t batchSize,
+        uint32_t numWorkerThreads ) {
+    
+    ASSERT(batchSize>0);
+    
+    std::cout<<"imageGraph::computeResumable\n";
+    
+    graph_.clear();
+    
+    std::string const statusFn= filename + ".status";
+    std::vector<std::string> partFns;
+    uint32_t batchStart= 0;
+    
+    // resume: load the finished batches
+    
+    if (boost::filesystem::exists(statusFn)){
+        std::vector<uint32_t> batchStarts;
+        {
+            std::ifstream status(statusFn.c_str());
+            uint32_t thisStart, thisEnd;
+            while (status >> thisStart >> thisEnd){
+                std::string const partFn= (boost::format("%s.part%09d") % filename % thisStart).str();
+                if (thisStart!=batchStart || thisEnd>numDocs || !boost::filesystem::exists(partFn))
+                    break;
+                addFromFile(partFn, thisStart);
+                partFns.push_back(partFn);
+                batchStarts.push_back(thisStart);
+                batchStart= thisEnd;
+            }
+        }
+        // drop whatever couldn't be used as it will be recomputed
+        std::ofstream status(statusFn.c_str(), std::ios::trunc);
+        for (uint32_t i= 0; i<batchStarts.size(); ++i)
+            status << batchStarts[i] << " " << (i+1<batchStarts.size() ? batchStarts[i+1] : batchStart) << "\n";
+        std::cout<<"imageGraph::computeResumable: resuming from docID "<<batchStart<<"\n";
+    }
+    
+    // edges pointing to documents which are yet to be queried
+    imageGraphType reverse;
+    for (imageGraphType::const_iterator itG= graph_.begin(); itG!=graph_.end(); ++itG)
+        for (std::vector<indScorePair>::const_iterator it= itG->second.begin(); it!=itG->second.end(); ++it)
+            if (it->first >= batchStart)
+                reverse[it->first].push_back( std::make_pair(itG->first, it->second) );
+    
+    uint64_t numReused= 0;
+    timing::progressPrint progress(numDocs - batchStart, "imageGraph");
+    
+    for (; batchStart<numDocs; batchStart+= batchSize){
+        
+        uint32_t const batchEnd= std::min(batchStart + batchSize, numDocs);
+        std::string const partFn= (boost::format("%s.part%09d") % filename % batchStart).str();
+        std::string const tmpPartFn= partFn + ".tmp";
+        
+        for (uint32_t docID= batchStart; docID<batchEnd; ++docID)
+            if (reverse.count(docID))
+                numReused+= reverse[docID].size();
+        
+        imageGraphBatchManager manager(tmpPartFn, batchStart, scoreThr, progress);
+        imageGraphBatchWorker worker(retrieverObj, batchStart, maxNeighs, reverse);
+        threadQueue<imageGraphResult>::start( batchEnd - batchStart, worker, manager, numWorkerThreads );
+        
+        // checkpoint: the part only gets its final name once complete
+        boost::filesystem::rename(tmpPartFn, partFn);
+        {
+            std::ofstream status(statusFn.c_str(), std::ios::app);
+            status << batchStart << " " << batchEnd << "\n";
+        }
+        partFns.push_back(partFn);
+        
+        // add to the graph
+        for (imageGraphType::const_iterator itG= manager.graph_.begin(); itG!=manager.graph_.end(); ++itG){
+            for (std::vector<indScorePair>::const_iterator it= itG->second.begin(); it!=itG->second.end(); ++it)
+                if (it->first >= batchEnd)
+                    reverse[it->first].push_back( std::make_pair(itG->first, it->second) );
+            graph_[itG->first]= itG->second;
+        }
+        for (uint32_t docID= batchStart; docID<batchEnd; ++docID)
+            reverse.erase(docID);
+    }
+    
+    if (numReused>0)
+        std::cout<<"imageGraph::computeResumable: "<<numReused<<" verified pairs reused\n";
+    
+    // merge the parts
+    
+    {
+        protoDbFileBuilder dbBuilder(filename, "image graph");
+        indexBuilder idxBuilder(dbBuilder, false, false, false);
+        for (imageGraphType::const_iterator itG= graph_.begin(); itG!=graph_.end(); ++itG){
+            rr::indexEntry entry;
+            for (std::vector<indScorePair>::const_iterator it= itG->second.begin(); it!=itG->second.end(); ++it){
+                entry.add_id(it->first);
+                entry.add_weight(it->second);
+            }
+            idxBuilder.addEntry(itG->first, entry);
+        }
+        idxBuilder.close();
+    }
+    
+    for (uint32_t i= 0; i<partFns.size(); ++i)
+        boost::filesystem::remove(partFns[i]);
+    boost::filesystem::remove(statusFn);
+    
+}
+
+
+
 // -------
 
 
@@ -317,6 +583,16 @@ imageGraph::loadFromFile( std::string filename ){
     std::cout<<"imageGraph::loadFromFile\n";
     
     graph_.clear();
+    addFromFile(filename);
+    
+    std::cout<<"imageGraph::loadFromFile - DONE\n";
+    
+}
+
+
+
+void
+imageGraph::addFromFile( std::string filename, uint32_t docIDOffset ){
     
     // open files
     protoDbFile db(filename);
@@ -335,7 +611,7 @@ imageGraph::loadFromFile( std::string filename ){
             
             // copy from indexEntry to graph_
             rr::indexEntry const &entry= entries[0];
-            std::vector<indScorePair> &neighs= graph_[docID];
+            std::vector<indScorePair> &neighs= graph_[docIDOffset + docID];
             ASSERT( entry.id_size() == entry.weight_size() );
             neighs.reserve( entry.id_size() );
             
@@ -347,6 +623,4 @@ imageGraph::loadFromFile( std::string filename ){
         
     }
     
-    std::cout<<"imageGraph::loadFromFile - DONE\n";
-    
 }
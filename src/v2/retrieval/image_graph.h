@@ -50,12 +50,33 @@ class imageGraph {
                              uint32_t maxNeighs= 0,
                              double scoreThr= -inf );
         
+        // compute in parallel, in batches of batchSize documents which are checkpointed: each finished batch is
+        // saved to filename.partNNNNNNNNN (NNNNNNNNN= first docID) and listed in filename.status, so that an
+        // interrupted computation resumes from the first unfinished batch; the parts are merged into filename
+        // (the same format as computeSingle) at the end.
+        // If the retriever is spatialVerifV2, edges found in previous batches are used in the opposite direction:
+        // for the edge (i,j) found when querying with i, j is queried without verifying i again (the first-stage
+        // ranking then has i removed and verifies one more document) and gets the edge (j,i) with the same score
+        void
+            computeResumable( std::string filename,
+                              uint32_t numDocs,
+                              retriever const &retriever,
+                              uint32_t maxNeighs= 0,
+                              double scoreThr= -inf,
+                              uint32_t batchSize= 1000,
+                              uint32_t numWorkerThreads= 4 );
+        
         void
             loadFromFile( std::string filename );
         
         imageGraphType graph_;
     
     private:
+        
+        // adds the edges saved in filename, offsetting the docIDs
+        void
+            addFromFile( std::string filename, uint32_t docIDOffset= 0 );
+        
         DISALLOW_COPY_AND_ASSIGN(imageGraph)
         
 };
@@ -60,9 +60,9 @@ mqFilterOutliers::queryExecute( std::vector<query> const &queries, std::vector<i
         ASSERT(cs->getNum() == static_cast<uint32_t>(queryReps[iQ].id_size()));
         
         std::vector<uint64_t> &sig= hammingSigs[iQ];
-        sig.reserve(queryReps[iQ].id_size());
-        for (int i= 0; i<queryReps[iQ].id_size(); ++i)
-            sig.push_back( cs->getNextUnsafe() );
+        sig.resize(queryReps[iQ].id_size());
+        if (!sig.empty())
+            cs->decodeNext(sig.size(), &sig[0]);
         
         delete emb;
     }
@@ -0,0 +1,513 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include "near_dup.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include "bitcount.h"
+#include "homography.h"
+#include "thread_queue.h"
+#include "timing.h"
+
+
+
+// ------- confirmers
+
+
+
+nearDupHammingConfirmer::nearDupHammingConfirmer(
+        retrieverV2 const &retrieverObj,
+        hammingEmbedderFactory const &embFactory,
+        uint32_t minMatches,
+        int distThr )
+        : nearDupConfirmer(minMatches),
+          retriever_(&retrieverObj),
+          embFactory_(&embFactory),
+          distThr_(distThr) {
+    // as the hamming retriever, for 64 it's 24
+    if (distThr_<0)
+        distThr_= static_cast<int>( round( static_cast<float>(embFactory.numBits()) * 24.0 / 64.0 ) );
+}
+
+
+
+static void
+decodeSigs( hammingEmbedderFactory const &embFactory, rr::indexEntry const &rep, std::vector<uint64_t> &sigs ){
+    sigs.resize(rep.id_size());
+    if (sigs.empty())
+        return;
+    hammingEmbedder *emb= embFactory.getEmbedder();
+    emb->setDataCopy(rep.data());
+    charStream *cs= emb->getCharStream();
+    ASSERT(cs->getNum() == sigs.size());
+    cs->decodeNext(sigs.size(), &sigs[0]);
+    delete emb;
+}
+
+
+
+uint32_t
+nearDupHammingConfirmer::numMatches( query const &queryObj, uint32_t docID2 ) const {
+
+    rr::indexEntry rep1, rep2;
+    retriever_->getQueryRep(queryObj, rep1);
+    retriever_->getQueryRep(query(docID2, true), rep2);
+
+    std::vector<uint64_t> sigs1, sigs2;
+    decodeSigs(*embFactory_, rep1, sigs1);
+    decodeSigs(*embFactory_, rep2, sigs2);
+
+    // both are sorted by wordID, merge
+    uint32_t numMatches= 0;
+    int i1= 0, i2= 0;
+    int const n1= rep1.id_size(), n2= rep2.id_size();
+
+    while (i1<n1 && i2<n2){
+        uint32_t const wordID= rep1.id(i1);
+        if (wordID < rep2.id(i2)){
+            ++i1;
+            continue;
+        }
+        if (wordID > rep2.id(i2)){
+            ++i2;
+            continue;
+        }
+
+        int end2= i2;
+        for (; end2<n2 && rep2.id(end2)==wordID; ++end2);
+
+        for (; i1<n1 && rep1.id(i1)==wordID; ++i1)
+            for (int j= i2; j<end2; ++j)
+                if (bitcount64(sigs1[i1] ^ sigs2[j]) <= distThr_){
+                    ++numMatches;
+                    break;
+                }
+
+        i2= end2;
+    }
+
+    return numMatches;
+}
+
+
+
+uint32_t
+nearDupSpatialConfirmer::numMatches( query const &queryObj, uint32_t docID2 ) const {
+    homography H;
+    std::vector< std::pair<ellipse,ellipse> > matches;
+    spatialRetriever_->getMatches(queryObj, docID2, H, matches);
+    return matches.size();
+}
+
+
+
+// ------- nearDuplicates
+
+
+
+class nearDuplicates::sketchWorker : public queueWorker<bool> {
+
+    public:
+
+        sketchWorker( nearDuplicates &nearDupObj, uint32_t docsPerJob )
+            : nearDup_(&nearDupObj), docsPerJob_(docsPerJob) {}
+
+        void
+            operator() ( uint32_t jobID, bool &result ) const {
+
+                uint32_t const start= jobID * docsPerJob_;
+                uint32_t const end= std::min(start + docsPerJob_, nearDup_->numDocs_);
+
+                std::vector<rr::indexEntry> entries;
+                std::vector<uint32_t> wordIDs;
+
+                for (uint32_t docID= start; docID<end; ++docID){
+                    entries.clear();
+                    nearDup_->fidx_->getEntries(docID, entries);
+                    ASSERT(entries.size()<=1);
+                    wordIDs.clear();
+                    if (!entries.empty())
+                        wordIDs.assign( entries[0].id().begin(), entries[0].id().end() );
+                    nearDup_->valid_[docID]= nearDup_->getSketch(
+                        wordIDs,
+                        &nearDup_->sketches_[ static_cast<uint64_t>(docID) * nearDup_->numHashes_ ] );
+                }
+                result= true;
+            }
+
+    private:
+        nearDuplicates *nearDup_;
+        uint32_t const docsPerJob_;
+        DISALLOW_COPY_AND_ASSIGN(sketchWorker)
+};
+
+
+
+nearDuplicates::nearDuplicates(
+        protoIndex const &fidx,
+        uint32_t numDocs,
+        nearDupParams const &params,
+        uint32_t numWorkerThreads )
+        : fidx_(&fidx),
+          numDocs_(numDocs),
+          params_(params),
+          numHashes_(params.numBands * params.rowsPerBand) {
+
+    ASSERT(numHashes_>0);
+
+    // hash functions
+    boost::mt19937 rng(params_.seed);
+    hashA_.resize(numHashes_);
+    hashB_.resize(numHashes_);
+    for (uint32_t k= 0; k<numHashes_; ++k){
+        hashA_[k]= ( (static_cast<uint64_t>(rng()) << 32) | rng() ) | 1;
+        hashB_[k]= (static_cast<uint64_t>(rng()) << 32) | rng();
+    }
+
+    // sketches
+
+    double t0= timing::tic();
+
+    sketches_.resize( static_cast<uint64_t>(numDocs_) * numHashes_ );
+    valid_.resize(numDocs_, 0);
+
+    uint32_t const docsPerJob= 1000;
+    queueManager<bool> manager; // does nothing, workers write the sketches directly
+    sketchWorker worker(*this, docsPerJob);
+    threadQueue<bool>::start( (numDocs_ + docsPerJob - 1) / docsPerJob, worker, manager, numWorkerThreads );
+
+    // bands, sorted by key
+
+    std::vector< std::pair<uint64_t, uint32_t> > keys;
+    keys.reserve(numDocs_);
+    bands_.resize(params_.numBands);
+
+    for (uint32_t iBand= 0; iBand<params_.numBands; ++iBand){
+        keys.clear();
+        for (uint32_t docID= 0; docID<numDocs_; ++docID)
+            if (valid_[docID])
+                keys.push_back( std::make_pair( bandKey(docSketch(docID), iBand), docID ) );
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<uint32_t> &band= bands_[iBand];
+        band.reserve(keys.size());
+        for (uint32_t i= 0; i<keys.size(); ++i)
+            band.push_back(keys[i].second);
+    }
+
+    std::cout<<"nearDuplicates::nearDuplicates: sketched "<<numDocs_<<" documents ("
+             <<std::count(valid_.begin(), valid_.end(), 1)<<" valid) in "<<timing::toc(t0)<<" ms\n";
+}
+
+
+
+bool
+nearDuplicates::getSketch( std::vector<uint32_t> const &wordIDs, uint32_t *sketch ) const {
+
+    std::vector<uint32_t> words(wordIDs);
+    std::sort(words.begin(), words.end());
+    words.erase( std::unique(words.begin(), words.end()), words.end() );
+
+    if (words.size() < params_.minWords || words.empty()){
+        std::fill(sketch, sketch + numHashes_, 0xFFFFFFFF);
+        return false;
+    }
+
+    for (uint32_t k= 0; k<numHashes_; ++k){
+        uint64_t const a= hashA_[k], b= hashB_[k];
+        uint32_t minHash= 0xFFFFFFFF;
+        for (std::vector<uint32_t>::const_iterator itW= words.begin(); itW!=words.end(); ++itW){
+            uint32_t const h= static_cast<uint32_t>( (a * (*itW) + b) >> 32 );
+            if (h < minHash)
+                minHash= h;
+        }
+        sketch[k]= minHash;
+    }
+    return true;
+}
+
+
+
+uint64_t
+nearDuplicates::bandKey( uint32_t const *sketch, uint32_t iBand ) const {
+    // FNV-1a over the rows of the band
+    uint64_t key= 14695981039346656037ULL;
+    uint32_t const *it= sketch + iBand * params_.rowsPerBand;
+    for (uint32_t r= 0; r<params_.rowsPerBand; ++r, ++it)
+        key= (key ^ (*it)) * 1099511628211ULL;
+    return key;
+}
+
+
+
+float
+nearDuplicates::jaccard( uint32_t const *sketch1, uint32_t const *sketch2 ) const {
+    uint32_t numSame= 0;
+    for (uint32_t k= 0; k<numHashes_; ++k)
+        numSame+= (sketch1[k]==sketch2[k]);
+    return static_cast<float>(numSame) / numHashes_;
+}
+
+
+
+void
+nearDuplicates::getWords( query const &queryObj, std::vector<uint32_t> &wordIDs ) const {
+
+    wordIDs.clear();
+
+    if (queryObj.isInternal){
+        std::vector<rr::indexEntry> entries;
+        fidx_->getEntries(queryObj.docID, entries);
+        ASSERT(entries.size()<=1);
+        if (!entries.empty())
+            wordIDs.assign( entries[0].id().begin(), entries[0].id().end() );
+    } else {
+        // as retrieverV2::getQueryRep
+        rr::indexEntry queryRep;
+        std::ifstream in(queryObj.compDataFn.c_str(), std::ios::binary);
+        if (!queryRep.ParseFromIstream(&in))
+            std::cout<<"failed to parse protobuf in "<<queryObj.compDataFn<<"\n";
+        else
+            wordIDs.assign( queryRep.id().begin(), queryRep.id().end() );
+    }
+}
+
+
+
+class nearDuplicates::confirmWorker : public queueWorker<bool> {
+
+    public:
+
+        confirmWorker( nearDupConfirmer const &confirmer, std::vector<nearDupPair> &pairs )
+            : confirmer_(&confirmer), pairs_(&pairs) {}
+
+        void
+            operator() ( uint32_t jobID, bool &result ) const {
+                nearDupPair &pair= pairs_->at(jobID);
+                pair.numMatches= confirmer_->numMatches( query(pair.docID1, true), pair.docID2 );
+                result= confirmer_->confirmed(pair.numMatches);
+            }
+
+    private:
+        nearDupConfirmer const *confirmer_;
+        std::vector<nearDupPair> *pairs_;
+        DISALLOW_COPY_AND_ASSIGN(confirmWorker)
+};
+
+
+
+void
+nearDuplicates::getAllPairs(
+        std::vector<nearDupPair> &pairs,
+        nearDupConfirmer const *confirmer,
+        uint32_t numWorkerThreads ) const {
+
+    pairs.clear();
+
+    // candidates from the band buckets
+
+    std::vector< std::pair<uint32_t, uint32_t> > cands;
+
+    for (uint32_t iBand= 0; iBand<params_.numBands; ++iBand){
+
+        std::vector<uint32_t> const &band= bands_[iBand];
+
+        for (uint32_t start= 0; start<band.size();){
+            uint64_t const key= bandKey(docSketch(band[start]), iBand);
+            uint32_t end= start+1;
+            for (; end<band.size() && bandKey(docSketch(band[end]), iBand)==key; ++end);
+
+            uint32_t const firstEnd= (end-start > params_.maxBucketSize) ? start+1 : end;
+            for (uint32_t i= start; i<firstEnd; ++i)
+                for (uint32_t j= i+1; j<end; ++j)
+                    cands.push_back( std::make_pair( std::min(band[i], band[j]), std::max(band[i], band[j]) ) );
+
+            start= end;
+        }
+    }
+
+    std::sort(cands.begin(), cands.end());
+    cands.erase( std::unique(cands.begin(), cands.end()), cands.end() );
+
+    // filter by the Jaccard estimate
+
+    for (std::vector< std::pair<uint32_t, uint32_t> >::const_iterator itC= cands.begin(); itC!=cands.end(); ++itC){
+        float const J= jaccard( docSketch(itC->first), docSketch(itC->second) );
+        if (J >= params_.jaccardThr)
+            pairs.push_back( nearDupPair(itC->first, itC->second, J) );
+    }
+
+    std::cout<<"nearDuplicates::getAllPairs: "<<cands.size()<<" candidates, "<<pairs.size()<<" above the Jaccard threshold\n";
+
+    if (confirmer==NULL || pairs.empty())
+        return;
+
+    // confirm
+
+    double t0= timing::tic();
+
+    queueManager<bool> manager; // does nothing, workers write numMatches directly
+    confirmWorker worker(*confirmer, pairs);
+    threadQueue<bool>::start( pairs.size(), worker, manager, numWorkerThreads );
+
+    uint32_t numConfirmed= 0;
+    for (uint32_t i= 0; i<pairs.size(); ++i)
+        if (confirmer->confirmed(pairs[i].numMatches))
+            pairs[numConfirmed++]= pairs[i];
+    pairs.resize(numConfirmed);
+
+    std::cout<<"nearDuplicates::getAllPairs: "<<numConfirmed<<" confirmed in "<<timing::toc(t0)<<" ms\n";
+}
+
+
+
+static bool
+higherJaccard( nearDupPair const &a, nearDupPair const &b ){
+    return a.jaccard > b.jaccard || (a.jaccard == b.jaccard && a.docID2 < b.docID2);
+}
+
+
+
+void
+nearDuplicates::getDuplicates(
+        query const &queryObj,
+        std::vector<nearDupPair> &dups,
+        nearDupConfirmer const *confirmer ) const {
+
+    dups.clear();
+
+    uint32_t const queryDocID= queryObj.isInternal ? queryObj.docID : 0;
+
+    std::vector<uint32_t> querySketchStorage;
+    uint32_t const *querySketch;
+
+    if (queryObj.isInternal){
+        ASSERT(queryObj.docID < numDocs_);
+        if (!valid_[queryObj.docID])
+            return;
+        querySketch= docSketch(queryObj.docID);
+    } else {
+        std::vector<uint32_t> wordIDs;
+        getWords(queryObj, wordIDs);
+        querySketchStorage.resize(numHashes_);
+        if (!getSketch(wordIDs, &querySketchStorage[0]))
+            return;
+        querySketch= &querySketchStorage[0];
+    }
+
+    // candidates: all documents in the query's buckets (binary search as bands are sorted by key)
+
+    std::vector<uint32_t> cands;
+
+    for (uint32_t iBand= 0; iBand<params_.numBands; ++iBand){
+
+        std::vector<uint32_t> const &band= bands_[iBand];
+        uint64_t const key= bandKey(querySketch, iBand);
+
+        uint32_t lo= 0, hi= band.size();
+        while (lo<hi){
+            uint32_t const mid= lo + (hi-lo)/2;
+            if (bandKey(docSketch(band[mid]), iBand) < key)
+                lo= mid+1;
+            else
+                hi= mid;
+        }
+
+        for (; lo<band.size() && bandKey(docSketch(band[lo]), iBand)==key; ++lo)
+            if (!queryObj.isInternal || band[lo]!=queryObj.docID)
+                cands.push_back(band[lo]);
+    }
+
+    std::sort(cands.begin(), cands.end());
+    cands.erase( std::unique(cands.begin(), cands.end()), cands.end() );
+
+    for (std::vector<uint32_t>::const_iterator itC= cands.begin(); itC!=cands.end(); ++itC){
+        float const J= jaccard(querySketch, docSketch(*itC));
+        if (J < params_.jaccardThr)
+            continue;
+        nearDupPair pair(queryDocID, *itC, J);
+        if (confirmer!=NULL){
+            pair.numMatches= confirmer->numMatches(queryObj, *itC);
+            if (!confirmer->confirmed(pair.numMatches))
+                continue;
+        }
+        dups.push_back(pair);
+    }
+
+    std::sort(dups.begin(), dups.end(), higherJaccard);
+}
+
+
+
+static uint32_t
+findRoot( std::map<uint32_t, uint32_t> &parent, uint32_t x ){
+    uint32_t root= x;
+    while (parent[root]!=root)
+        root= parent[root];
+    // path compression
+    while (parent[x]!=root){
+        uint32_t const next= parent[x];
+        parent[x]= root;
+        x= next;
+    }
+    return root;
+}
+
+
+
+static bool
+largerCluster( std::vector<uint32_t> const &a, std::vector<uint32_t> const &b ){
+    return a.size() > b.size() || (a.size() == b.size() && a[0] < b[0]);
+}
+
+
+
+void
+nearDuplicates::getClusters(
+        std::vector<nearDupPair> const &pairs,
+        std::vector< std::vector<uint32_t> > &clusters ){
+
+    clusters.clear();
+
+    // union-find
+    std::map<uint32_t, uint32_t> parent;
+    for (std::vector<nearDupPair>::const_iterator itP= pairs.begin(); itP!=pairs.end(); ++itP){
+        if (!parent.count(itP->docID1)) parent[itP->docID1]= itP->docID1;
+        if (!parent.count(itP->docID2)) parent[itP->docID2]= itP->docID2;
+        uint32_t const root1= findRoot(parent, itP->docID1);
+        uint32_t const root2= findRoot(parent, itP->docID2);
+        if (root1!=root2)
+            parent[ std::max(root1, root2) ]= std::min(root1, root2);
+    }
+
+    // docIDs are visited in increasing order so clusters are sorted
+    std::map<uint32_t, uint32_t> rootToCluster;
+    for (std::map<uint32_t, uint32_t>::const_iterator itD= parent.begin(); itD!=parent.end(); ++itD){
+        uint32_t const root= findRoot(parent, itD->first);
+        if (!rootToCluster.count(root)){
+            rootToCluster[root]= clusters.size();
+            clusters.push_back( std::vector<uint32_t>() );
+        }
+        clusters[ rootToCluster[root] ].push_back(itD->first);
+    }
+
+    std::sort(clusters.begin(), clusters.end(), largerCluster);
+}
@@ -0,0 +1,215 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#ifndef _NEAR_DUP_H_
+#define _NEAR_DUP_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "hamming_embedder.h"
+#include "index_entry.pb.h"
+#include "macros.h"
+#include "proto_index.h"
+#include "query.h"
+#include "retriever.h"
+#include "retriever_v2.h"
+#include "spatial_retriever.h"
+
+
+
+// Near-duplicate detection without querying with every image (cf. imageGraph): each document is represented
+// by the min-hash sketch of its set of visual words (numBands*rowsPerBand independent hash functions), and
+// documents whose sketches agree on all rows of at least one band (locality sensitive hashing) are
+// candidates, which takes near-linear time in the number of documents. Candidates with the fraction of
+// agreeing min-hashes (an estimate of the Jaccard similarity of the word sets) below jaccardThr are
+// discarded, the rest can be confirmed with a nearDupConfirmer.
+// A band bucket with more than maxBucketSize documents (e.g. many exact copies) only yields the pairs of
+// its first document with the others, which is enough for the clusters and keeps the number of candidates
+// linear. Documents with fewer than minWords distinct words are ignored as their sketches are unreliable.
+
+struct nearDupParams {
+
+    uint32_t numBands, rowsPerBand;
+    float jaccardThr;
+    uint32_t maxBucketSize;
+    uint32_t minWords;
+    uint32_t seed;
+
+    nearDupParams( uint32_t aNumBands= 25, uint32_t aRowsPerBand= 4,
+                   float aJaccardThr= 0.3,
+                   uint32_t aMaxBucketSize= 100,
+                   uint32_t aMinWords= 10,
+                   uint32_t aSeed= 43
+                   ) :
+                   numBands(aNumBands), rowsPerBand(aRowsPerBand),
+                   jaccardThr(aJaccardThr),
+                   maxBucketSize(aMaxBucketSize),
+                   minWords(aMinWords),
+                   seed(aSeed) {}
+};
+
+
+
+struct nearDupPair {
+
+    nearDupPair( uint32_t aDocID1= 0, uint32_t aDocID2= 0, float aJaccard= 0, uint32_t aNumMatches= 0 ) :
+        docID1(aDocID1), docID2(aDocID2), jaccard(aJaccard), numMatches(aNumMatches) {}
+
+    uint32_t docID1, docID2; // docID1 < docID2 for pairs of documents
+    float jaccard; // min-hash estimate
+    uint32_t numMatches; // set by the confirmer, 0 if not confirmed
+};
+
+
+
+// confirms a candidate pair by the number of matching features
+class nearDupConfirmer {
+
+    public:
+
+        nearDupConfirmer( uint32_t minMatches ) : minMatches_(minMatches) {}
+
+        virtual
+            ~nearDupConfirmer() {}
+
+        virtual uint32_t
+            numMatches( query const &queryObj, uint32_t docID2 ) const =0;
+
+        inline bool
+            confirmed( uint32_t numMatches ) const {
+                return numMatches >= minMatches_;
+            }
+
+    private:
+        uint32_t const minMatches_;
+        DISALLOW_COPY_AND_ASSIGN(nearDupConfirmer)
+};
+
+
+
+// matches: features with the same visual word and a Hamming signature within distThr (default as for the
+// hamming retriever), each feature of the query is counted at most once;
+// retrieverObj provides the query representations (from the fidx or iidx) and has to use the embFactory
+class nearDupHammingConfirmer : public nearDupConfirmer {
+
+    public:
+
+        nearDupHammingConfirmer( retrieverV2 const &retrieverObj,
+                                 hammingEmbedderFactory const &embFactory,
+                                 uint32_t minMatches,
+                                 int distThr= -1 );
+
+        uint32_t
+            numMatches( query const &queryObj, uint32_t docID2 ) const;
+
+    private:
+        retrieverV2 const *retriever_;
+        hammingEmbedderFactory const *embFactory_;
+        int distThr_;
+        DISALLOW_COPY_AND_ASSIGN(nearDupHammingConfirmer)
+};
+
+
+
+// matches: RANSAC inliers
+class nearDupSpatialConfirmer : public nearDupConfirmer {
+
+    public:
+
+        nearDupSpatialConfirmer( spatialRetriever const &spatialRetrieverObj, uint32_t minInliers ) :
+            nearDupConfirmer(minInliers), spatialRetriever_(&spatialRetrieverObj) {}
+
+        uint32_t
+            numMatches( query const &queryObj, uint32_t docID2 ) const;
+
+    private:
+        spatialRetriever const *spatialRetriever_;
+        DISALLOW_COPY_AND_ASSIGN(nearDupSpatialConfirmer)
+};
+
+
+
+class nearDuplicates {
+
+    public:
+
+        // sketches all documents of fidx, which is only used in the constructor and for internal queries
+        nearDuplicates( protoIndex const &fidx,
+                        uint32_t numDocs,
+                        nearDupParams const &params= nearDupParams(),
+                        uint32_t numWorkerThreads= 4 );
+
+        // all pairs of near duplicates, sorted by docID1 then docID2;
+        // with confirmer only the confirmed ones, confirmations are done in parallel
+        void
+            getAllPairs( std::vector<nearDupPair> &pairs,
+                         nearDupConfirmer const *confirmer= NULL,
+                         uint32_t numWorkerThreads= 4 ) const;
+
+        // near duplicates of the query (internal or external, ROI is ignored) in decreasing order of the
+        // Jaccard estimate; for internal queries the document itself is not returned.
+        // docID1 of the pairs is the query docID (0 for external)
+        void
+            getDuplicates( query const &queryObj,
+                           std::vector<nearDupPair> &dups,
+                           nearDupConfirmer const *confirmer= NULL ) const;
+
+        // connected components with at least two documents, each sorted by docID, in decreasing order of size
+        static void
+            getClusters( std::vector<nearDupPair> const &pairs,
+                         std::vector< std::vector<uint32_t> > &clusters );
+
+        inline uint32_t
+            numDocs() const { return numDocs_; }
+
+        // sketch of a bag of words (repetitions are ignored), false if it has fewer than minWords distinct words
+        bool
+            getSketch( std::vector<uint32_t> const &wordIDs, uint32_t *sketch ) const;
+
+    private:
+
+        class sketchWorker;
+        class confirmWorker;
+
+        inline uint32_t const *
+            docSketch( uint32_t docID ) const { return &sketches_[ static_cast<uint64_t>(docID) * numHashes_ ]; }
+
+        uint64_t
+            bandKey( uint32_t const *sketch, uint32_t iBand ) const;
+
+        float
+            jaccard( uint32_t const *sketch1, uint32_t const *sketch2 ) const;
+
+        void
+            getWords( query const &queryObj, std::vector<uint32_t> &wordIDs ) const;
+
+        protoIndex const *fidx_;
+        uint32_t const numDocs_;
+        nearDupParams const params_;
+        uint32_t const numHashes_;
+
+        // multiply-add-shift hash functions, const after constructor
+        std::vector<uint64_t> hashA_, hashB_;
+
+        std::vector<uint32_t> sketches_;
+        std::vector<uint8_t> valid_; // not vector<bool> as it is written by the worker threads
+
+        // for each band the valid docIDs sorted by the band key (keys are recomputed from the sketches)
+        std::vector< std::vector<uint32_t> > bands_;
+
+        DISALLOW_COPY_AND_ASSIGN(nearDuplicates)
+};
+
+#endif
@@ -14,19 +14,23 @@ No usage or redistribution is allowed without explicit permission.
 
 #include "retriever_v2.h"
 
+#include <algorithm>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 #include "argsort.h"
-#include "image_util.h"
 #include "index_entry_util.h"
+#include "latency.h"
 
 
 
 void
 retrieverV2::getQueryRep( query const &queryObj, rr::indexEntry &queryRep ) const {
     
+    latency::span span(latency::queryRep);
+    
     bool queryWholeImage= queryObj.allInf();
     bool needXYForThis= needXY_ || !queryWholeImage;
     bool alreadyFiltered= false;
@@ -119,34 +123,88 @@ retrieverV2::getQueryRep( query const &queryObj, rr::indexEntry &queryRep ) cons
 
 
 
+void
+retrieverV2::queryExecuteBatch( std::vector<query> const &queries, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn ) const {
+    std::vector<rr::indexEntry> queryReps( queries.size() );
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        getQueryRep( queries[i], queryReps[i] );
+    queryExecuteBatch( queryReps, queryRes, toReturn );
+}
+
+
+
+void
+retrieverV2::queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn ) const {
+    queryRes.resize( queryReps.size() );
+    for (uint32_t i= 0; i<queryReps.size(); ++i)
+        queryExecute( queryReps[i], queryRes[i], toReturn );
+}
+
+
+
+void
+retrieverFromIter::queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn ) const {
+    
+    ASSERT(iidx_!=NULL);
+    
+    batchEntries entries;
+    iidx_->getBatchEntries(queryReps, entries);
+    
+    queryRes.resize( queryReps.size() );
+    
+    queueManager<bool> manager; // does nothing, workers write into queryRes directly
+    batchWorker worker(*this, queryReps, entries, queryRes, toReturn);
+    uint32_t const numThreads= std::max(static_cast<uint32_t>(1), static_cast<uint32_t>(boost::thread::hardware_concurrency()));
+    threadQueue<bool>::start( queryReps.size(), worker, manager, numThreads );
+}
+
+
+
+void
+retrieverFromIter::batchWorker::operator() ( uint32_t jobID, bool &result ) const {
+    
+    rr::indexEntry &queryRep= queryReps_->at(jobID);
+    
+    // copy as the retriever might change entries (e.g. hamming sets weights)
+    uniqEntries ue;
+    entries_->getUniqEntries(queryRep, ue);
+    precompUEIterator ueIter(ue);
+    
+    retriever_->queryExecute( queryRep, &ueIter, queryRes_->at(jobID), toReturn_ );
+}
+
+
+
 void
 retrieverV2::externalQuery_computeData( std::string imageFn, query const &queryObj ) const {
     
     ASSERT( featGetter_!=NULL );
     ASSERT( nn_!=NULL );
     
-    // make sure the image exists and is readable
-    std::pair<uint32_t, uint32_t> wh= std::make_pair(0,0);
-    if (boost::filesystem::exists(imageFn) && boost::filesystem::is_regular_file(imageFn)){
-        wh= imageUtil::getWidthHeight(imageFn);
-        if (wh.first==0 && wh.second==0) {
-            std::cerr<<"retrieverV2::externalQuery_computeData: "<<imageFn<<" is corrupt or 0x0\n";
-            return;
-        }
-    } else {
+    // make sure the image exists
+    if (!boost::filesystem::exists(imageFn) || !boost::filesystem::is_regular_file(imageFn)){
         std::cerr<<"retrieverV2::externalQuery_computeData: "<<imageFn<<" doesn't exist\n";
         return;
     }
     
-    // compute features
+    // compute features, decoding the image only once (at full size) which also checks it is readable
     
     uint32_t numFeats;
     std::vector<ellipse> regions;
     float *descs;
+    std::pair<uint32_t, uint32_t> wh;
     
     std::cout<<"retrieverV2::externalQuery_computeData: Extracting features\n";
-    featGetter_->getFeats(imageFn.c_str(), numFeats, regions, descs);
+    {
+        latency::span span(latency::featExtract);
+        featGetter_->getFeatsOnce(imageFn.c_str(), 0, wh, numFeats, regions, descs);
+    }
     std::cout<<"retrieverV2::externalQuery_computeData: Extracting features - DONE\n";
+    if (wh.first==0 && wh.second==0) {
+        std::cerr<<"retrieverV2::externalQuery_computeData: "<<imageFn<<" is corrupt or 0x0\n";
+        delete []descs;
+        return;
+    }
     if (numFeats==0){
         delete []descs;
         return;
@@ -180,6 +238,7 @@ retrieverV2::externalQuery_computeData( std::string imageFn, query const &queryO
     float *residual= new float[numDims];
     
     std::cout<<"retrieverV2::externalQuery_computeData: assigning to clusters\n";
+    double const tAssign= latency::now();
     
     for (uint32_t iFeat=0; iFeat<numFeats; ++iFeat){
         
@@ -210,6 +269,7 @@ retrieverV2::externalQuery_computeData( std::string imageFn, query const &queryO
         }
         
     }
+    latency::record(latency::assign, latency::now()-tAssign);
     std::cout<<"retrieverV2::externalQuery_computeData: assigning to clusters - DONE\n";
     
     // cleanup
@@ -21,9 +21,11 @@ No usage or redistribution is allowed without explicit permission.
 #include "embedder.h"
 #include "feat_getter.h"
 #include "index_entry.pb.h"
+#include "latency.h"
 #include "macros.h"
 #include "proto_index.h"
 #include "retriever.h"
+#include "thread_queue.h"
 #include "uniq_entries.h"
 
 
@@ -63,6 +65,14 @@ class retrieverV2 : public retriever {
                 queryExecute(queryRep, queryRes, toReturn);
             }
         
+        // computes query representations and calls the queryRep version
+        void
+            queryExecuteBatch( std::vector<query> const &queries, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn= 0 ) const;
+        
+        // by default executes the queries one by one
+        virtual void
+            queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn= 0 ) const;
+        
         virtual void
             externalQuery_computeData( std::string imageFn, query const &queryObj ) const;
         
@@ -117,16 +127,42 @@ class retrieverFromIter : public retrieverV2 {
                 iidx_->getUniqEntries(queryRep, ue);
                 precompUEIterator ueIter(ue);
                 #endif
+                latency::span span(latency::scoring);
                 queryExecute(queryRep, &ueIter, queryRes, toReturn);
             }
         
         virtual void
             queryExecute( rr::indexEntry &queryRep, ueIterator *ueIter, std::vector<indScorePair> &queryRes, uint32_t toReturn= 0 ) const =0;
         
+        using retrieverV2::queryExecuteBatch;
+        
+        // posting lists of the union of query words are fetched once and shared (copied) between the queries,
+        // which are then executed in parallel
+        virtual void
+            queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn= 0 ) const;
+        
+        bool
+            supportsBatch() const { return true; }
+        
         virtual bool
             changesEntryWeights() const { return false; }
     
     private:
+        
+        class batchWorker : public queueWorker<bool> {
+            public:
+                batchWorker( retrieverFromIter const &retrieverObj, std::vector<rr::indexEntry> &queryReps, batchEntries const &entries, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn )
+                    : retriever_(&retrieverObj), queryReps_(&queryReps), entries_(&entries), queryRes_(&queryRes), toReturn_(toReturn) {}
+                void operator() ( uint32_t jobID, bool &result ) const;
+            private:
+                retrieverFromIter const *retriever_;
+                std::vector<rr::indexEntry> *queryReps_;
+                batchEntries const *entries_;
+                std::vector< std::vector<indScorePair> > *queryRes_;
+                uint32_t const toReturn_;
+                DISALLOW_COPY_AND_ASSIGN(batchWorker)
+        };
+        
         DISALLOW_COPY_AND_ASSIGN(retrieverFromIter)
 };
 
@@ -17,6 +17,10 @@ No usage or redistribution is allowed without explicit permission.
 #include <algorithm>
 #include <string>
 
+#include <boost/thread.hpp>
+
+#include "latency.h"
+#include "timing.h"
 #include "uniq_entries.h"
 #include "util.h"
 
@@ -58,12 +62,12 @@ spatialVerifV2::spatialQueryExecute(
         std::set<uint32_t> *ignoreDocs,
         uint32_t toReturn,
         bool queryFirst,
-        bool forgetFirst) const {
+        bool forgetFirst,
+        uint32_t *spatialDepth) const {
     
     assert( !forgetFirst || queryFirst );
-    ASSERT(queryRep.id_size()==queryRep.x_size() || queryRep.id_size()==queryRep.qx_size());
-    ASSERT(queryRep.id_size()==queryRep.y_size() || queryRep.id_size()==queryRep.qy_size());
-    ASSERT( ignoreDocs==NULL ); // TODO
+    
+    double const t0= timing::tic();
     
     uint32_t spatialDepthEff= spatParams_.spatialDepth;
     
@@ -73,18 +77,109 @@ spatialVerifV2::spatialQueryExecute(
     ASSERT(verifyFromIidx_);
     uniqEntries ue;
     iidx_->getUniqEntries(queryRep, ue);
+    
+    spatialQueryExecuteCore(queryRep, ue, queryRes, Hs, spatialDepthEff, toReturn, queryFirst, forgetFirst, t0, spatialDepth, ignoreDocs);
+}
+
+
+
+void
+spatialVerifV2::spatialQueryExecuteBatch(
+        std::vector<rr::indexEntry> &queryReps,
+        std::vector< std::vector<indScorePair> > &queryRes,
+        std::vector< std::map<uint32_t, homography> > *Hs,
+        uint32_t toReturn) const {
+    
+    ASSERT(verifyFromIidx_);
+    batchEntries entries;
+    iidx_->getBatchEntries(queryReps, entries);
+    
+    queryRes.resize( queryReps.size() );
+    if (Hs!=NULL)
+        Hs->resize( queryReps.size() );
+    
+    queueManager<bool> manager; // does nothing, workers write into queryRes directly
+    batchWorker worker(*this, queryReps, entries, queryRes, Hs, toReturn);
+    uint32_t const numThreads= std::max(static_cast<uint32_t>(1), static_cast<uint32_t>(boost::thread::hardware_concurrency()));
+    threadQueue<bool>::start( queryReps.size(), worker, manager, numThreads );
+}
+
+
+
+void
+spatialVerifV2::batchWorker::operator() (uint32_t jobID, bool &result) const {
+    
+    double const t0= timing::tic();
+    
+    // copy as the first retriever might change entries (e.g. hamming sets weights)
+    uniqEntries ue;
+    entries_->getUniqEntries(queryReps_->at(jobID), ue);
+    
+    spatVerif_->spatialQueryExecuteCore(
+        queryReps_->at(jobID), ue, queryRes_->at(jobID),
+        Hs_==NULL ? NULL : &(Hs_->at(jobID)),
+        spatVerif_->spatParams_.spatialDepth, toReturn_, true, false, t0, NULL);
+}
+
+
+
+void
+spatialVerifV2::spatialQueryBatch(
+        std::vector<query> const &queries,
+        std::vector< std::vector<indScorePair> > &queryRes,
+        std::vector< std::map<uint32_t, homography> > &Hs,
+        uint32_t toReturn) const {
+    
+    std::vector<rr::indexEntry> queryReps( queries.size() );
+    for (uint32_t i= 0; i<queries.size(); ++i)
+        getQueryRep( queries[i], queryReps[i] );
+    spatialQueryExecuteBatch( queryReps, queryRes, &Hs, toReturn );
+}
+
+
+
+void
+spatialVerifV2::spatialQueryExecuteCore(
+        rr::indexEntry &queryRep,
+        uniqEntries &ue,
+        std::vector<indScorePair> &queryRes,
+        std::map<uint32_t, homography> *Hs,
+        uint32_t spatialDepthEff,
+        uint32_t toReturn,
+        bool queryFirst,
+        bool forgetFirst,
+        double t0,
+        uint32_t *spatialDepth,
+        std::set<uint32_t> const *ignoreDocs) const {
+    
+    ASSERT(queryRep.id_size()==queryRep.x_size() || queryRep.id_size()==queryRep.qx_size());
+    ASSERT(queryRep.id_size()==queryRep.y_size() || queryRep.id_size()==queryRep.qy_size());
+    
     precompUEIterator ueIter(ue);
     
     if (queryFirst){
         uint32_t toReturnFirst= toReturn;
+        if (toReturn!=0 && ignoreDocs!=NULL)
+            toReturnFirst+= ignoreDocs->size();
         if (toReturn!=0 && toReturnFirst < spatialDepthEff )
             toReturnFirst= spatialDepthEff;
         std::vector<indScorePair> queryResDummy;
+        latency::span span(latency::scoring);
         firstRetriever_->queryExecute( queryRep, &ueIter, forgetFirst ? queryResDummy : queryRes, toReturnFirst );
         // queryExecute could change queryRep, so check it hasn't changed id_size
         ASSERT(ueIter.getNum()==static_cast<uint32_t>(queryRep.id_size()));
     }
     
+    if (ignoreDocs!=NULL && !ignoreDocs->empty()){
+        // remove them keeping the ranking, spatialDepthEff included room for them
+        std::vector<indScorePair>::iterator itOut= queryRes.begin();
+        for (std::vector<indScorePair>::const_iterator itRes= queryRes.begin(); itRes!=queryRes.end(); ++itRes)
+            if (ignoreDocs->count(itRes->first)==0)
+                *(itOut++)= *itRes;
+        queryRes.erase(itOut, queryRes.end());
+        spatialDepthEff= (spatialDepthEff > ignoreDocs->size()) ? spatialDepthEff - ignoreDocs->size() : 0;
+    }
+    
     if (spatialDepthEff>queryRes.size())
         spatialDepthEff= queryRes.size();
     
@@ -92,44 +187,75 @@ spatialVerifV2::spatialQueryExecute(
     std::vector<ellipse> ellipses1;
     createEllipses(queryRep, ellipses1);
     
-    // which docIDs to verify?
-    std::vector<uint32_t> docIDtoVerify(spatialDepthEff);
-    for (uint32_t i= 0; i<spatialDepthEff; ++i)
-        docIDtoVerify[i]= queryRes[i].first;
-    std::sort(docIDtoVerify.begin(), docIDtoVerify.end());
-    
     // prepare for DAAT output (returns ind into unique queryRep.id's)
     std::vector<int> uniqIndToInd;
     ue.getUniqIndToInd(uniqIndToInd);
     
-    // create DAAT iterator
-    ueIter.reset();
-    daat daatIter(&ueIter, &docIDtoVerify);
-    
-    // prepare parallel
-    
-    boost::mutex daatLock;
-    
-    // synchronous DAAT call is relatively expensive so the gain of using
-    // multiple threads is not large (maybe re-evalaute this?)
-    uint32_t const numWorkerThreads= std::min(
-        static_cast<uint32_t>(detectUseThreads() ? 10 : 1),
-        spatialDepthEff);
-    
-    std::vector<queueWorker<Result> const *> workers;
-    for (uint32_t iThread= 0; iThread < numWorkerThreads; ++iThread)
-        workers.push_back( new spatWorker(ellipses1, ue, daatIter, daatLock, uniqIndToInd, spatParams_, elUnquant_, sameRandomObj_) );
+    // verify in batches of consecutive first-stage ranks (a single batch if not adaptive)
+    uint32_t const batchSize= (spatParams_.adaptive && spatParams_.adaptiveBatch>0) ?
+        spatParams_.adaptiveBatch : spatialDepthEff;
+    double const minScore= (spatParams_.adaptive && spatialDepthEff>0) ?
+        spatParams_.adaptiveScoreRatio * queryRes[0].second : 0;
     
-    spatManager manager( queryRes, spatParams_, spatialDepthEff, Hs );
+    // only the top toReturn are returned, so documents which can't make it there needn't be verified
+    uint32_t const topK= (toReturn!=0 && toReturn < spatialDepthEff) ? toReturn : 0;
     
-    // start the threads
+    uint32_t numVerified= 0;
     
-    threadQueue<Result>::start(
-        spatialDepthEff, workers, manager
-    );
+    while (numVerified < spatialDepthEff){
+        
+        uint32_t const batchEnd= std::min(numVerified + batchSize, spatialDepthEff);
+        
+        // which docIDs to verify?
+        std::vector<uint32_t> docIDtoVerify(batchEnd - numVerified);
+        for (uint32_t i= numVerified; i<batchEnd; ++i)
+            docIDtoVerify[i-numVerified]= queryRes[i].first;
+        std::sort(docIDtoVerify.begin(), docIDtoVerify.end());
+        
+        // create DAAT iterator
+        ueIter.reset();
+        daat daatIter(&ueIter, &docIDtoVerify);
+        
+        // prepare parallel
+        
+        boost::mutex daatLock;
+        
+        // synchronous DAAT call is relatively expensive so the gain of using
+        // multiple threads is not large (maybe re-evalaute this?)
+        uint32_t const numWorkerThreads= std::min(
+            static_cast<uint32_t>(detectUseThreads() ? 10 : 1),
+            static_cast<uint32_t>(docIDtoVerify.size()));
+        
+        spatManager manager( queryRes, spatParams_, spatialDepthEff, Hs, topK );
+        
+        std::vector<queueWorker<Result> const *> workers;
+        for (uint32_t iThread= 0; iThread < numWorkerThreads; ++iThread)
+            workers.push_back( new spatWorker(ellipses1, ue, daatIter, daatLock, uniqIndToInd, spatParams_, elUnquant_, sameRandomObj_, manager) );
+        
+        // start the threads
+        
+        threadQueue<Result>::start(
+            docIDtoVerify.size(), workers, manager
+        );
+        
+        // cleanup
+        util::delPointerVector(workers);
+        
+        numVerified= batchEnd;
+        
+        if (!spatParams_.adaptive || numVerified >= spatialDepthEff)
+            break;
+        // unverified documents still have their first-stage scores
+        if (queryRes[numVerified].second < minScore)
+            break;
+        if (spatParams_.timeBudget > 0 && timing::toc(t0) >= spatParams_.timeBudget)
+            break;
+        if (latency::pastDeadline())
+            break;
+    }
     
-    // cleanup
-    util::delPointerVector(workers);
+    if (spatialDepth!=NULL)
+        *spatialDepth= numVerified;
     
     retriever::sortResults( queryRes, spatialDepthEff, toReturn );
     
@@ -143,7 +269,8 @@ spatialVerifV2::getMatchesCore(
         uint32_t docID2,
         std::vector<ellipse> &ellipses1,
         std::vector<ellipse> &ellipses2,
-        matchesType &putativeMatches) const{
+        matchesType &putativeMatches,
+        std::vector<double> *PMquality) const{
     
     ellipses1.clear();
     ellipses2.clear();
@@ -239,7 +366,8 @@ spatialVerifV2::getMatchesCore(
     getPutativeMatches(ue, uniqIndToInd,
                        *nonEmptyEntryInd, *entryInd,
                        elUnquant_,
-                       ellipses2, putativeMatches);
+                       ellipses2, putativeMatches,
+                       PMquality);
     
 }
 
@@ -296,7 +424,9 @@ spatialVerifV2::getMatches(
     
     std::vector<ellipse> ellipses1, ellipses2;
     matchesType putativeMatches;
-    getMatchesCore(queryObj, docID2, ellipses1, ellipses2, putativeMatches );
+    std::vector<double> PMquality;
+    getMatchesCore(queryObj, docID2, ellipses1, ellipses2, putativeMatches,
+                   spatParams_.guided ? &PMquality : NULL );
     
     std::vector< std::pair<uint32_t,uint32_t> > inlierInds;
     H.setIdentity();
@@ -313,7 +443,8 @@ spatialVerifV2::getMatches(
                       spatParams_.errorThr,
                       spatParams_.lowAreaChange, spatParams_.highAreaChange,
                       spatParams_.maxReest,
-                      &H, &inlierInds
+                      &H, &inlierInds,
+                      PMquality.empty() ? NULL : &PMquality
                     );
     
     convertMatchesToEllipses(ellipses1, ellipses2, inlierInds, matches);
@@ -350,7 +481,8 @@ spatialVerifV2::getPutativeMatches(
         std::vector< std::pair<uint32_t,uint32_t> > const &entryInd,
         ellipseUnquantizer const &elUnquant,
         std::vector<ellipse> &ellipses2,
-        matchesType &putativeMatches) {
+        matchesType &putativeMatches,
+        std::vector<double> *PMquality) {
     
     // careful about Ind meaning (it is actually indexing directly into uniqEntries.allEntries_
     // semiTODO matching weight (didn't really improve things for hamming, so should distinguish somehow between it and bow (weight doesn't exist in db entries?). However seems unnecessary as hamming works well without it
@@ -363,6 +495,8 @@ spatialVerifV2::getPutativeMatches(
     
     ellipses2.clear();
     putativeMatches.clear();
+    if (PMquality!=NULL)
+        PMquality->clear();
     // reserve memory with a rough guesstimate, 15% speedup for spatial query
     ellipses2.reserve( nonEmptyEntryInd.size() *5 );
     putativeMatches.reserve( nonEmptyEntryInd.size() *5 );
@@ -437,9 +571,12 @@ spatialVerifV2::getPutativeMatches(
                     weightThr= 0.0;
                 
                 for (int ind= uniqIndToInd[uniqInd]; ind < uniqIndToInd[uniqInd+1]; ++ind)
-                    if (weights[ (ind - uniqIndToInd[uniqInd]) * entry.id_size() + matchInd ] >= weightThr)
+                    if (weights[ (ind - uniqIndToInd[uniqInd]) * entry.id_size() + matchInd ] >= weightThr){
                         putativeMatches.push_back( std::make_pair(
                             static_cast<uint32_t>(ind), ellipses2.size()-1 ) );
+                        if (PMquality!=NULL)
+                            PMquality->push_back( weights[ (ind - uniqIndToInd[uniqInd]) * entry.id_size() + matchInd ] );
+                    }
             }
         }
     }
@@ -452,8 +589,41 @@ spatialVerifV2::spatManager::spatManager(
         std::vector<indScorePair> &queryRes,
         spatParams const &spatParamsObj,
         uint32_t spatialDepthEff,
-        std::map<uint32_t, homography> *Hs)
-        : queryRes_(&queryRes), spatParams_(&spatParamsObj), spatialDepthEff_(spatialDepthEff), Hs_(Hs) {
+        std::map<uint32_t, homography> *Hs,
+        uint32_t topK)
+        : queryRes_(&queryRes), spatParams_(&spatParamsObj), spatialDepthEff_(spatialDepthEff), Hs_(Hs), topK_(topK), kthScore_(0.0) {
+    
+    if (topK_==0)
+        return;
+    
+    std::vector<indScorePair> sorted(queryRes.begin(), queryRes.begin() + spatialDepthEff_);
+    std::sort(sorted.begin(), sorted.end());
+    docIDs_.reserve(spatialDepthEff_);
+    firstScores_.reserve(spatialDepthEff_);
+    for (uint32_t i= 0; i<spatialDepthEff_; ++i){
+        docIDs_.push_back(sorted[i].first);
+        firstScores_.push_back(sorted[i].second);
+    }
+    scores_= firstScores_;
+    
+    std::vector<double> temp(scores_);
+    std::nth_element(temp.begin(), temp.begin()+topK_-1, temp.end(), std::greater<double>());
+    kthScore_= temp[topK_-1];
+}
+
+
+
+bool
+spatialVerifV2::spatManager::canReachTopK(uint32_t docID, double maxSpatialScore) const {
+    
+    if (topK_==0)
+        return true;
+    
+    boost::mutex::scoped_lock lock(scoresLock_);
+    uint32_t i= std::lower_bound(docIDs_.begin(), docIDs_.end(), docID) - docIDs_.begin();
+    ASSERT(i<docIDs_.size() && docIDs_[i]==docID);
+    // scores only increase, so kthScore_ is a lower bound on the final topK-th score
+    return firstScores_[i] + maxSpatialScore >= kthScore_;
 }
 
 
@@ -470,6 +640,15 @@ spatialVerifV2::spatManager::operator() (uint32_t resInd, Result &result){
         queryRes_->at(i).second+= result.first.second.first;
         if (Hs_!=NULL)
             (*Hs_)[docID]= result.second;
+        
+        if (topK_!=0){
+            boost::mutex::scoped_lock lock(scoresLock_);
+            uint32_t j= std::lower_bound(docIDs_.begin(), docIDs_.end(), docID) - docIDs_.begin();
+            scores_[j]+= result.first.second.first;
+            std::vector<double> temp(scores_);
+            std::nth_element(temp.begin(), temp.begin()+topK_-1, temp.end(), std::greater<double>());
+            kthScore_= temp[topK_-1];
+        }
     }
     
 }
@@ -484,8 +663,9 @@ spatialVerifV2::spatWorker::spatWorker(
         std::vector<int> const &uniqIndToInd,
         spatParams const &spatParamsObj,
         ellipseUnquantizer const &elUnquant,
-        sameRandomUint32 const &sameRandomObj) :
-        ellipses1_(&ellipses1), ue_(&ue), daatIter_(&daatIter), daatLock_(&daatLock), uniqIndToInd_(&uniqIndToInd), spatParams_(&spatParamsObj), elUnquant_(&elUnquant), sameRandomObj_(&sameRandomObj){
+        sameRandomUint32 const &sameRandomObj,
+        spatManager const &manager) :
+        ellipses1_(&ellipses1), ue_(&ue), daatIter_(&daatIter), daatLock_(&daatLock), uniqIndToInd_(&uniqIndToInd), spatParams_(&spatParamsObj), elUnquant_(&elUnquant), sameRandomObj_(&sameRandomObj), manager_(&manager), trace_(latency::queryTrace::current()), deadline_(latency::currentDeadline()){
 }
 
 
@@ -493,11 +673,23 @@ spatialVerifV2::spatWorker::spatWorker(
 void
 spatialVerifV2::spatWorker::operator() (uint32_t resInd, Result &result) const {
     
+    latency::attach attach(trace_);
+    latency::deadline deadline(deadline_);
+    
+    // out of time: leave the rest unverified
+    if (latency::pastDeadline()){
+        result.first.second.first= 0;
+        result.first.second.second= 0;
+        return;
+    }
+    
     // iterate DAAT to get putative matches
     bool foundEntry= false;
     std::vector< std::pair<uint32_t,uint32_t> > const *entryInd= NULL;
     std::vector<uint32_t> const *nonEmptyEntryInd= NULL;
     
+    // includes waiting for the lock as that is what the DAAT costs the query
+    double const tDaat= latency::now();
     boost::mutex::scoped_lock daatLock(*daatLock_);
     
     while (!daatIter_->isEnd()){
@@ -511,6 +703,7 @@ spatialVerifV2::spatWorker::operator() (uint32_t resInd, Result &result) const {
     }
     
     if (!foundEntry){
+        latency::record(latency::daat, latency::now()-tDaat);
         result.first.second.first= 0;
         return;
     }
@@ -526,15 +719,30 @@ spatialVerifV2::spatWorker::operator() (uint32_t resInd, Result &result) const {
     uint32_t docID= daatIter_->getDocID();
     
     daatLock.unlock();
+    latency::record(latency::daat, latency::now()-tDaat);
     
     // form putative matches
     getPutativeMatches(*ue_, *uniqIndToInd_,
                        nonEmptyEntryIndC, entryIndC_,
                        *elUnquant_,
-                       ellipses2_, putativeMatches_);
+                       ellipses2_, putativeMatches_,
+                       spatParams_->guided ? &PMquality_ : NULL);
+    
+    result.first.first= docID;
+    
+    // skip if it provably can't be accepted (one-to-one matching bounds #inliers, and score as weights are 1)
+    // or can't make it into the returned results anyway; neither changes the ranking
+    uint32_t const maxNInliers= detRansac::getMaxNInliers(putativeMatches_);
+    if (maxNInliers < spatParams_->minInliers ||
+        !manager_->canReachTopK(docID, maxNInliers)){
+        result.first.second.first= 0;
+        result.first.second.second= 0;
+        return;
+    }
     
     // do matching
     uint32_t numInliers= 0;
+    latency::span span(latency::ransac);
     double score=
         detRansac::match(
                       *sameRandomObj_,
@@ -545,10 +753,10 @@ spatialVerifV2::spatWorker::operator() (uint32_t resInd, Result &result) const {
                       spatParams_->errorThr,
                       spatParams_->lowAreaChange, spatParams_->highAreaChange,
                       spatParams_->maxReest,
-                      &result.second, NULL
+                      &result.second, NULL,
+                      PMquality_.empty() ? NULL : &PMquality_
                     );
     
-    result.first.first= docID;
     result.first.second.first= score;
     result.first.second.second= numInliers;
 }
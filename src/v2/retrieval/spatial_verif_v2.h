@@ -16,6 +16,7 @@ No usage or redistribution is allowed without explicit permission.
 #define _SPATIAL_VERIF_V2_H
 
 #include <map>
+#include <set>
 
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -25,6 +26,7 @@ No usage or redistribution is allowed without explicit permission.
 #include "ellipse.h"
 #include "homography.h"
 #include "index_entry_util.h"
+#include "latency.h"
 #include "macros.h"
 #include "par_queue.h"
 #include "retriever_v2.h"
@@ -56,6 +58,9 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
         void
             queryExecute( rr::indexEntry &queryRep, std::vector<indScorePair> &queryRes, uint32_t toReturn= 0 ) const;
         
+        // spatialDepth (optional) is set to the number of verified documents (can be smaller than spatParams.spatialDepth if adaptive)
+        // ignoreDocs (optional) are neither verified nor returned (e.g. the caller already has their scores),
+        // the next documents in the first-stage ranking are verified instead
         void
             spatialQueryExecute( rr::indexEntry &queryRep,
                                  std::vector<indScorePair> &queryRes,
@@ -63,7 +68,26 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
                                  std::set<uint32_t> *ignoreDocs= NULL,
                                  uint32_t toReturn= 0,
                                  bool queryFirst= true,
-                                 bool forgetFirst= false) const;
+                                 bool forgetFirst= false,
+                                 uint32_t *spatialDepth= NULL) const;
+        
+        using retrieverV2::queryExecuteBatch;
+        
+        // posting lists of the union of query words are fetched once and shared between the queries,
+        // which are then executed in parallel
+        inline void
+            queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn= 0 ) const {
+                spatialQueryExecuteBatch( queryReps, queryRes, NULL, toReturn );
+            }
+        
+        bool
+            supportsBatch() const { return true; }
+        
+        void
+            spatialQueryExecuteBatch( std::vector<rr::indexEntry> &queryReps,
+                                      std::vector< std::vector<indScorePair> > &queryRes,
+                                      std::vector< std::map<uint32_t, homography> > *Hs= NULL,
+                                      uint32_t toReturn= 0 ) const;
         
         inline uint32_t
             numDocs() const {
@@ -76,18 +100,27 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
             spatialQuery( query const &queryObj,
                           std::vector<indScorePair> &queryRes,
                           std::map<uint32_t, homography> &Hs,
-                          uint32_t toReturn= 0 ) const {
+                          uint32_t toReturn= 0,
+                          uint32_t *spatialDepth= NULL ) const {
                 rr::indexEntry queryRep;
                 getQueryRep(queryObj, queryRep);
-                spatialQueryExecute( queryRep, queryRes, &Hs, NULL, toReturn, true );
+                spatialQueryExecute( queryRep, queryRes, &Hs, NULL, toReturn, true, false, spatialDepth );
             }
         
+        void
+            spatialQueryBatch( std::vector<query> const &queries,
+                               std::vector< std::vector<indScorePair> > &queryRes,
+                               std::vector< std::map<uint32_t, homography> > &Hs,
+                               uint32_t toReturn= 0 ) const;
+        
+        // PMquality (optional) is filled with match quality if available (see getPutativeMatches)
         void
             getMatchesCore(query const &queryObj,
                            uint32_t docID2,
                            std::vector<ellipse> &ellipses1,
                            std::vector<ellipse> &ellipses2,
-                           matchesType &putativeMatches) const;
+                           matchesType &putativeMatches,
+                           std::vector<double> *PMquality= NULL) const;
         
         inline void
             getMatches( query const &queryObj,
@@ -111,10 +144,26 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
         
         static uint32_t const maxPutativePerDBFeature_= 1; // 0 if no maximum
         
+        // spatialQueryExecute after the posting lists of the query (ue) have been fetched, tStart is when the query started
+        void
+            spatialQueryExecuteCore( rr::indexEntry &queryRep,
+                                     uniqEntries &ue,
+                                     std::vector<indScorePair> &queryRes,
+                                     std::map<uint32_t, homography> *Hs,
+                                     uint32_t spatialDepthEff,
+                                     uint32_t toReturn,
+                                     bool queryFirst,
+                                     bool forgetFirst,
+                                     double tStart,
+                                     uint32_t *spatialDepth,
+                                     std::set<uint32_t> const *ignoreDocs= NULL) const;
+        
         // create ellipses of the query
         void
             createEllipses(rr::indexEntry &queryRep, std::vector<ellipse> &ellipses) const;
         
+        // PMquality (optional) gets the matching weight of each putative match (e.g. from hamming),
+        // left empty if entries don't have weights
         static void
             getPutativeMatches(uniqEntries const &ue,
                                std::vector<int> const &uniqIndToInd,
@@ -122,7 +171,8 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
                                std::vector< std::pair<uint32_t,uint32_t> > const &entryInd,
                                ellipseUnquantizer const &elUnquant,
                                std::vector<ellipse> &ellipses2,
-                               matchesType &putativeMatches);
+                               matchesType &putativeMatches,
+                               std::vector<double> *PMquality= NULL);
         
         static void
             convertMatchesToEllipses(std::vector<ellipse> const &ellipses1,
@@ -130,18 +180,49 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
                                      matchesType const &matchesInds,
                                      std::vector< std::pair<ellipse,ellipse> > &matches );
         
+        class batchWorker : public queueWorker<bool> {
+            public:
+                batchWorker(spatialVerifV2 const &spatVerif,
+                            std::vector<rr::indexEntry> &queryReps,
+                            batchEntries const &entries,
+                            std::vector< std::vector<indScorePair> > &queryRes,
+                            std::vector< std::map<uint32_t, homography> > *Hs,
+                            uint32_t toReturn)
+                    : spatVerif_(&spatVerif), queryReps_(&queryReps), entries_(&entries), queryRes_(&queryRes), Hs_(Hs), toReturn_(toReturn) {}
+                void operator() (uint32_t jobID, bool &result) const;
+            private:
+                spatialVerifV2 const *spatVerif_;
+                std::vector<rr::indexEntry> *queryReps_;
+                batchEntries const *entries_;
+                std::vector< std::vector<indScorePair> > *queryRes_;
+                std::vector< std::map<uint32_t, homography> > *Hs_;
+                uint32_t const toReturn_;
+                DISALLOW_COPY_AND_ASSIGN(batchWorker)
+        };
+        
         class spatManager : public queueManager<Result> {
             public:
+                // topK: only the top topK results will be returned (0 if all), used for early exit
                 spatManager(std::vector<indScorePair> &queryRes,
                             spatParams const &spatParamsObj,
                             uint32_t spatialDepthEff,
-                            std::map<uint32_t, homography> *Hs= NULL);
+                            std::map<uint32_t, homography> *Hs= NULL,
+                            uint32_t topK= 0);
                 void operator() (uint32_t resInd, Result &result);
+                // false if docID's score even with maxSpatialScore added is below the current topK-th best,
+                // i.e. verifying it cannot change the returned results. Thread safe (called by workers)
+                bool canReachTopK(uint32_t docID, double maxSpatialScore) const;
             private:
                 std::vector<indScorePair> *queryRes_;
                 spatParams const *spatParams_;
                 uint32_t spatialDepthEff_;
                 std::map<uint32_t, homography> *Hs_;
+                uint32_t topK_;
+                // copy of the scores, sorted by docID, as queryRes_ is being changed while workers query it
+                std::vector<uint32_t> docIDs_;
+                std::vector<double> firstScores_, scores_;
+                double kthScore_;
+                mutable boost::mutex scoresLock_;
                 DISALLOW_COPY_AND_ASSIGN(spatManager)
         };
         
@@ -154,7 +235,8 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
                            std::vector<int> const &uniqIndToInd,
                            spatParams const &spatParamsObj,
                            ellipseUnquantizer const &elUnquant,
-                           sameRandomUint32 const &sameRandomObj);
+                           sameRandomUint32 const &sameRandomObj,
+                           spatManager const &manager);
                 void operator() (uint32_t resInd, Result &result) const;
             private:
                 std::vector<ellipse> const *ellipses1_;
@@ -165,10 +247,15 @@ class spatialVerifV2 : public retrieverV2, public spatialRetriever {
                 spatParams const *spatParams_;
                 ellipseUnquantizer const *elUnquant_;
                 sameRandomUint32 const *sameRandomObj_;
+                spatManager const *manager_;
+                // of the query being verified (workers are created by its thread)
+                latency::queryTrace *trace_;
+                double const deadline_;
                 
                 // to avoid reallocating RAM
                 mutable std::vector<ellipse> ellipses2_;
                 mutable matchesType putativeMatches_;
+                mutable std::vector<double> PMquality_;
                 mutable std::vector< std::pair<uint32_t,uint32_t> > entryIndC_;
                 
                 DISALLOW_COPY_AND_ASSIGN(spatWorker)
@@ -38,6 +38,7 @@ void printUsageAndExit(uint32_t rank){
     std::cout<<"e : Print some nodes and their edges\n";
     std::cout<<"s : Compute image graph by querying sequentially\n";
     std::cout<<"p : Compute image graph in parallel\n";
+    std::cout<<"r : Compute image graph in parallel, checkpointed (rerun to resume)\n";
     exit(1);
 }
 
@@ -53,8 +54,8 @@ int main(int argc, char* argv[]){
         printUsageAndExit(rank);
     
     char choice= argv[1][0];
-    if (!(choice=='e' || choice=='s' || choice=='p') ||
-        ((choice=='e' || choice=='s') && numProc>1) )
+    if (!(choice=='e' || choice=='s' || choice=='p' || choice=='r') ||
+        ((choice=='e' || choice=='s' || choice=='r') && numProc>1) )
         printUsageAndExit(rank);
     
     // file name
@@ -62,7 +63,7 @@ int main(int argc, char* argv[]){
     
     // create the image graph
     
-    if (choice=='s' || choice=='p') {
+    if (choice=='s' || choice=='p' || choice=='r') {
         
         // file names
         
@@ -95,10 +96,14 @@ int main(int argc, char* argv[]){
             // compute image graph sequential querying
             imGraph.computeSingle(
                 imageGraphFn, fidx.numIDs(), spatVerifHamm, 100, 10 );
-        else {
+        else if (choice=='p') {
             // compute image graph in parallel
             imGraph.computeParallel(
                 imageGraphFn, fidx.numIDs(), spatVerifHamm, 100, 10 );
+        } else {
+            // compute image graph in parallel batches, resuming if interrupted
+            imGraph.computeResumable(
+                imageGraphFn, fidx.numIDs(), spatVerifHamm, 100, 10 );
         }
     }
     
@@ -0,0 +1,649 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+// Micro-benchmarks of the kernels in the retrieval hot loops, on synthetic inputs of controllable size, so
+// that implementations (and machines) can be compared without building an index:
+//     tfidf_score      weighterV2::queryExecute, n postings in 200 query words, n/10 documents
+//     hamming_scan     decoding n 64-bit Hamming signatures and thresholding their distances to a query
+//     from_diff        indexEntryUtil::fromDiff of a posting list of n
+//     proto_decode     parsing a posting list of n as stored in the iidx (diffid, qx, qy, qel, signatures)
+//     ellipse_unquant  ellipseUnquantizer::unquantize of a posting list of n
+//     daat_advance     daat::advance through n postings in 200 query words, all documents
+//     daat_skip        the same but only for 200 documents (as in spatial verification, uses the skips)
+//     ransac           detRansac::match of n/10 putative matches, in image pairs of 200 (30% inliers)
+//     pq_adc           productQuant::getDistsSq of n codes (128-D, 16 x 256 centres)
+//     pq_fastscan      productQuant::getDistsSqFastScan of n codes (128-D, 32 x 16 centres)
+//     sort_results     retriever::sortResults of n scores
+// Each kernel is run once to warm up and then reps times; the report has the min and median ns per
+// element and the input bytes per element, so the GB/s show how far a kernel is from being memory bound.
+//
+// kernel_bench [n=1000000] [reps=5] [filter=""] [outFn=""]
+//
+// filter: only run the kernels whose name contains it; the report (JSON) goes to outFn or stdout.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+#include <google/protobuf/stubs/common.h>
+
+#include "bitcount.h"
+#include "char_streams.h"
+#include "daat.h"
+#include "det_ransac.h"
+#include "ellipse.h"
+#include "index_entry.pb.h"
+#include "index_entry_util.h"
+#include "latency.h"
+#include "macros.h"
+#include "opq_train.h"
+#include "product_quant.h"
+#include "retriever.h"
+#include "same_random.h"
+#include "spatial_defs.h"
+#include "uniq_entries.h"
+#include "util.h"
+#include "weighter_v2.h"
+
+
+
+static uint32_t const numQueryWords_= 200;
+static uint32_t const numPMPerPair_= 200;
+
+// results of the kernels are accumulated here so that the work can't be optimized away
+volatile double sink_= 0;
+
+
+
+inline double
+uniform01(boost::mt19937 &rng){
+    return rng() / 4294967296.0;
+}
+
+
+
+inline uint64_t
+random64(boost::mt19937 &rng){
+    uint64_t const hi= rng();
+    return (hi << 32) | rng();
+}
+
+
+
+// radius log-uniform in [4,64] pixels, ratio of axes log-uniform in [1,3], uniform orientation
+void
+randomEllipse(boost::mt19937 &rng, double &a, double &b, double &c){
+    double const radius= 4.0 * std::exp( uniform01(rng) * std::log(16.0) );
+    double const ratio= std::exp( uniform01(rng) * std::log(3.0) );
+    double const angle= (uniform01(rng) - 0.5) * M_PI;
+    double const i1= 1.0 / (radius*radius*ratio), i2= ratio / (radius*radius);
+    double const co= std::cos(angle), si= std::sin(angle);
+    a= co*co*i1 + si*si*i2;
+    b= co*si*(i1 - i2);
+    c= si*si*i1 + co*co*i2;
+}
+
+
+
+// sorted random docIDs (repeats are features of the same document)
+void
+randomIDs(boost::mt19937 &rng, uint32_t n, uint32_t numDocs, std::vector<uint32_t> &ids){
+    ids.resize(n);
+    for (uint32_t i= 0; i<n; ++i)
+        ids[i]= rng() % numDocs;
+    std::sort(ids.begin(), ids.end());
+}
+
+
+
+// one entry with the ids per query word, as after protoIndex::getUniqEntries
+void
+randomPostings(boost::mt19937 &rng, uint32_t numPostings, uint32_t numDocs, uniqEntries &ue){
+    ue.index_.resize(numQueryWords_);
+    ue.allEntries_.resize(numQueryWords_);
+    std::vector<uint32_t> ids;
+    for (uint32_t iWord= 0; iWord<numQueryWords_; ++iWord){
+        ue.index_[iWord]= iWord;
+        uint32_t const thisNum= numPostings/numQueryWords_ + (iWord < numPostings%numQueryWords_);
+        randomIDs(rng, thisNum, numDocs, ids);
+        ue.allEntries_[iWord].resize(1);
+        rr::indexEntry &entry= ue.allEntries_[iWord][0];
+        entry.mutable_id()->Reserve(thisNum);
+        for (uint32_t i= 0; i<thisNum; ++i)
+            entry.add_id(ids[i]);
+    }
+}
+
+
+
+class benchKernel {
+
+    public:
+
+        benchKernel(std::string const &name) : name_(name), numElements_(0), bytesPerElement_(0) {}
+
+        virtual ~benchKernel() {}
+
+        // restores the input if run modifies it, not timed
+        virtual void
+            prepare() {}
+
+        // returns a checksum of the result
+        virtual double
+            run() =0;
+
+        inline std::string const &
+            name() const { return name_; }
+
+        inline uint64_t
+            numElements() const { return numElements_; }
+
+        inline double
+            bytesPerElement() const { return bytesPerElement_; }
+
+    protected:
+        std::string const name_;
+        uint64_t numElements_;
+        double bytesPerElement_;
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(benchKernel)
+};
+
+
+
+class tfidfKernel : public benchKernel {
+
+    public:
+
+        tfidfKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("tfidf_score") {
+            uint32_t const numDocs= std::max(n/10, 1u);
+            randomPostings(rng, n, numDocs, ue_);
+            for (uint32_t iWord= 0; iWord<numQueryWords_; ++iWord){
+                queryRep_.add_id(iWord);
+                queryRep_.add_weight(1.0);
+            }
+            idf_.resize(numQueryWords_);
+            for (uint32_t iWord= 0; iWord<numQueryWords_; ++iWord)
+                idf_[iWord]= 1.0 + uniform01(rng);
+            docL2_.resize(numDocs, 1.0);
+            numElements_= n;
+            bytesPerElement_= sizeof(uint32_t);
+        }
+
+        double
+            run(){
+                precompUEIterator ueIter(ue_);
+                weighterV2::queryExecute(queryRep_, &ueIter, idf_, docL2_, scores_);
+                return scores_[0];
+            }
+
+    private:
+        uniqEntries ue_;
+        rr::indexEntry queryRep_;
+        std::vector<double> idf_, docL2_, scores_;
+};
+
+
+
+// the inner loop of hamming::queryExecute
+class hammingKernel : public benchKernel {
+
+    public:
+
+        hammingKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("hamming_scan"), stream_(charStream::charStreamCreate(64)) {
+            stream_->reserve(n);
+            for (uint32_t i= 0; i<n; ++i)
+                stream_->add( random64(rng) );
+            data_= stream_->getDataCopy();
+            query_= random64(rng);
+            numElements_= n;
+            bytesPerElement_= static_cast<double>(data_.length())/std::max(n, 1u);
+        }
+
+        ~hammingKernel(){ delete stream_; }
+
+        double
+            run(){
+                stream_->setDataCopy(data_);
+                sigs_.resize(stream_->getNum());
+                if (!sigs_.empty())
+                    stream_->decodeNext(sigs_.size(), &sigs_[0]);
+                uint32_t numClose= 0;
+                for (std::vector<uint64_t>::const_iterator it= sigs_.begin(); it!=sigs_.end(); ++it)
+                    numClose+= ( bitcount64(query_ ^ *it) <= 24 );
+                return numClose;
+            }
+
+    private:
+        charStream *stream_;
+        std::string data_;
+        uint64_t query_;
+        std::vector<uint64_t> sigs_;
+};
+
+
+
+class fromDiffKernel : public benchKernel {
+
+    public:
+
+        fromDiffKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("from_diff") {
+            std::vector<uint32_t> ids;
+            randomIDs(rng, n, std::max(n/10, 1u), ids);
+            for (uint32_t i= 0; i<n; ++i)
+                orig_.add_id(ids[i]);
+            indexEntryUtil::toDiff(orig_);
+            numElements_= n;
+            bytesPerElement_= sizeof(uint32_t);
+        }
+
+        void
+            prepare(){ entry_.CopyFrom(orig_); }
+
+        double
+            run(){
+                indexEntryUtil::fromDiff(entry_);
+                return entry_.id_size()>0 ? entry_.id(entry_.id_size()-1) : 0;
+            }
+
+    private:
+        rr::indexEntry orig_, entry_;
+};
+
+
+
+// a posting list in the format buildIndex writes (what protoIndex parses for every fetched entry)
+void
+randomStoredEntry(boost::mt19937 &rng, uint32_t n, rr::indexEntry &entry){
+    std::vector<uint32_t> ids;
+    randomIDs(rng, n, std::max(n/10, 1u), ids);
+    charStream *stream= charStream::charStreamCreate(64);
+    stream->reserve(n);
+    double a, b, c;
+    for (uint32_t i= 0; i<n; ++i){
+        entry.add_id(ids[i]);
+        entry.add_x( uniform01(rng)*1024 );
+        entry.add_y( uniform01(rng)*768 );
+        randomEllipse(rng, a, b, c);
+        entry.add_a(a); entry.add_b(b); entry.add_c(c);
+        stream->add( random64(rng) );
+    }
+    entry.set_data( stream->getDataCopy() );
+    delete stream;
+    indexEntryUtil::toDiff(entry);
+    indexEntryUtil::quantXY(entry);
+    indexEntryUtil::quantEllipse(entry);
+}
+
+
+
+class protoDecodeKernel : public benchKernel {
+
+    public:
+
+        protoDecodeKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("proto_decode") {
+            rr::indexEntry entry;
+            randomStoredEntry(rng, n, entry);
+            entry.SerializeToString(&serialized_);
+            numElements_= n;
+            bytesPerElement_= static_cast<double>(serialized_.length())/std::max(n, 1u);
+        }
+
+        double
+            run(){
+                entry_.ParseFromString(serialized_);
+                return entry_.diffid_size();
+            }
+
+    private:
+        std::string serialized_;
+        rr::indexEntry entry_;
+};
+
+
+
+class ellipseKernel : public benchKernel {
+
+    public:
+
+        ellipseKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("ellipse_unquant") {
+            double a, b, c;
+            for (uint32_t i= 0; i<n; ++i){
+                randomEllipse(rng, a, b, c);
+                orig_.add_a(a); orig_.add_b(b); orig_.add_c(c);
+            }
+            indexEntryUtil::quantEllipse(orig_);
+            numElements_= n;
+            bytesPerElement_= 3;
+        }
+
+        void
+            prepare(){ entry_.CopyFrom(orig_); }
+
+        double
+            run(){
+                elUnquant_.unquantize(entry_);
+                return entry_.a_size()>0 ? entry_.a(0) : 0;
+            }
+
+    private:
+        ellipseUnquantizer elUnquant_;
+        rr::indexEntry orig_, entry_;
+};
+
+
+
+class daatKernel : public benchKernel {
+
+    public:
+
+        daatKernel(uint32_t n, boost::mt19937 &rng, bool skip) : benchKernel(skip ? "daat_skip" : "daat_advance"), docIDs_(NULL) {
+            uint32_t const numDocs= std::max(n/10, 1u);
+            randomPostings(rng, n, numDocs, ue_);
+            if (skip){
+                std::vector<uint32_t> docIDs;
+                randomIDs(rng, 200, numDocs, docIDs);
+                docIDs.erase( std::unique(docIDs.begin(), docIDs.end()), docIDs.end() );
+                docIDs_= new std::vector<uint32_t>(docIDs);
+            }
+            numElements_= n;
+            bytesPerElement_= sizeof(uint32_t);
+        }
+
+        ~daatKernel(){
+            if (docIDs_!=NULL)
+                delete docIDs_;
+        }
+
+        double
+            run(){
+                precompUEIterator ueIter(ue_);
+                daat daatIter(&ueIter, docIDs_);
+                std::vector< std::pair<uint32_t,uint32_t> > const *entryInd;
+                std::vector<uint32_t> const *nonEmptyEntryInd;
+                uint32_t numMatches= 0;
+                while (!daatIter.isEnd()){
+                    daatIter.advance();
+                    if (daatIter.getMatches(entryInd, nonEmptyEntryInd))
+                        numMatches+= nonEmptyEntryInd->size();
+                }
+                return numMatches;
+            }
+
+    private:
+        uniqEntries ue_;
+        std::vector<uint32_t> const *docIDs_;
+};
+
+
+
+class ransacKernel : public benchKernel {
+
+    public:
+
+        ransacKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("ransac"), sameRandomObj_(10000) {
+
+            numPairs_= std::max(n/10/numPMPerPair_, 1u);
+            uint32_t const numDistinct= std::min(numPairs_, 64u);
+            ellipses1_.resize(numDistinct);
+            ellipses2_.resize(numDistinct);
+            double a, b, c;
+
+            for (uint32_t iPair= 0; iPair<numDistinct; ++iPair){
+                // the second image is the first scaled and translated, and noisy
+                double const scale= 0.7 + 0.7*uniform01(rng);
+                double const tx= (uniform01(rng)-0.5)*200, ty= (uniform01(rng)-0.5)*200;
+                for (uint32_t i= 0; i<numPMPerPair_; ++i){
+                    randomEllipse(rng, a, b, c);
+                    double const x= uniform01(rng)*1024, y= uniform01(rng)*768;
+                    ellipses1_[iPair].push_back( ellipse(x, y, a, b, c) );
+                    if (uniform01(rng) < 0.3){
+                        double const s2= scale*scale;
+                        ellipses2_[iPair].push_back( ellipse(
+                            scale*x + tx + (uniform01(rng)-0.5)*4,
+                            scale*y + ty + (uniform01(rng)-0.5)*4,
+                            a/s2, b/s2, c/s2 ) );
+                    } else {
+                        randomEllipse(rng, a, b, c);
+                        ellipses2_[iPair].push_back( ellipse(uniform01(rng)*1024, uniform01(rng)*768, a, b, c) );
+                    }
+                }
+            }
+
+            for (uint32_t i= 0; i<numPMPerPair_; ++i)
+                putativeMatches_.push_back( std::make_pair(i, i) );
+
+            numElements_= static_cast<uint64_t>(numPairs_)*numPMPerPair_;
+            bytesPerElement_= 2*sizeof(ellipse) + sizeof(std::pair<uint32_t,uint32_t>);
+        }
+
+        double
+            run(){
+                uint32_t totalInliers= 0, numInliers;
+                for (uint32_t iPair= 0; iPair<numPairs_; ++iPair){
+                    uint32_t const ind= iPair % ellipses1_.size();
+                    detRansac::match( sameRandomObj_, numInliers,
+                                      ellipses1_[ind], ellipses2_[ind],
+                                      putativeMatches_, NULL,
+                                      spatParams_def.errorThr,
+                                      spatParams_def.lowAreaChange, spatParams_def.highAreaChange,
+                                      spatParams_def.maxReest );
+                    totalInliers+= numInliers;
+                }
+                return totalInliers;
+            }
+
+    private:
+        sameRandomUint32 sameRandomObj_;
+        uint32_t numPairs_;
+        std::vector< std::vector<ellipse> > ellipses1_, ellipses2_;
+        matchesType putativeMatches_;
+};
+
+
+
+// random centres are written to temporary files as productQuant loads them from disk
+class pqKernel : public benchKernel {
+
+    public:
+
+        pqKernel(uint32_t n, boost::mt19937 &rng, bool fastScan) : benchKernel(fastScan ? "pq_fastscan" : "pq_adc"), fastScan_(fastScan) {
+
+            uint32_t const numDims= 128;
+            uint32_t const nSubQuant= fastScan ? 32 : 16, subQuantK= fastScan ? 16 : 256;
+            uint32_t const subDims= numDims/nSubQuant;
+
+            std::vector<float> centres(subQuantK*subDims);
+            for (uint32_t iSub= 0; iSub<nSubQuant; ++iSub){
+                for (uint32_t i= 0; i<centres.size(); ++i)
+                    centres[i]= uniform01(rng);
+                clstFns_.push_back( util::getTempFileName("", "kernel_bench_", ".e3bin") );
+                opqTrain::saveCentres( clstFns_.back(), &centres[0], subQuantK, subDims );
+            }
+            pq_= new productQuant(clstFns_);
+
+            charStream *stream= pq_->charStreamFactoryCreate();
+            stream->reserve(n*nSubQuant);
+            for (uint32_t i= 0; i<n*nSubQuant; ++i)
+                stream->add( rng() % subQuantK );
+            std::string const codes= stream->getDataCopy();
+            delete stream;
+            if (fastScan)
+                pq_->fastScanPack(codes, data_);
+            else
+                data_= codes;
+
+            vec_.resize(numDims);
+            for (uint32_t i= 0; i<numDims; ++i)
+                vec_[i]= uniform01(rng);
+            distsSq_.resize(n);
+
+            numElements_= n;
+            bytesPerElement_= static_cast<double>(data_.length())/std::max(n, 1u);
+        }
+
+        ~pqKernel(){
+            delete pq_;
+            for (uint32_t i= 0; i<clstFns_.size(); ++i)
+                remove(clstFns_[i].c_str());
+        }
+
+        double
+            run(){
+                if (distsSq_.empty())
+                    return 0;
+                if (fastScan_){
+                    pq_->getDistsSqFastScan(&vec_[0], data_, distsSq_.size(), &distsSq_[0]);
+                    return distsSq_[0];
+                }
+                float *distsSq;
+                pq_->getDistsSq(&vec_[0], data_, distsSq);
+                double const res= distsSq[0];
+                delete []distsSq;
+                return res;
+            }
+
+    private:
+        bool const fastScan_;
+        std::vector<std::string> clstFns_;
+        productQuant *pq_;
+        std::string data_;
+        std::vector<float> vec_, distsSq_;
+};
+
+
+
+class sortKernel : public benchKernel {
+
+    public:
+
+        sortKernel(uint32_t n, boost::mt19937 &rng) : benchKernel("sort_results") {
+            scores_.resize(n);
+            for (uint32_t i= 0; i<n; ++i)
+                scores_[i]= uniform01(rng);
+            numElements_= n;
+            bytesPerElement_= sizeof(double);
+        }
+
+        double
+            run(){
+                retriever::sortResults(scores_, queryRes_);
+                return queryRes_.empty() ? 0 : queryRes_[0].second;
+            }
+
+    private:
+        std::vector<double> scores_;
+        std::vector<indScorePair> queryRes_;
+};
+
+
+
+static char const *kernelNames_[]= {
+    "tfidf_score", "hamming_scan", "from_diff", "proto_decode", "ellipse_unquant",
+    "daat_advance", "daat_skip", "ransac", "pq_adc", "pq_fastscan", "sort_results" };
+static uint32_t const numKernels_= sizeof(kernelNames_)/sizeof(kernelNames_[0]);
+
+
+
+benchKernel*
+createKernel(std::string const &name, uint32_t n, boost::mt19937 &rng){
+    if (name=="tfidf_score")     return new tfidfKernel(n, rng);
+    if (name=="hamming_scan")    return new hammingKernel(n, rng);
+    if (name=="from_diff")       return new fromDiffKernel(n, rng);
+    if (name=="proto_decode")    return new protoDecodeKernel(n, rng);
+    if (name=="ellipse_unquant") return new ellipseKernel(n, rng);
+    if (name=="daat_advance")    return new daatKernel(n, rng, false);
+    if (name=="daat_skip")       return new daatKernel(n, rng, true);
+    if (name=="ransac")          return new ransacKernel(n, rng);
+    if (name=="pq_adc")          return new pqKernel(n, rng, false);
+    if (name=="pq_fastscan")     return new pqKernel(n, rng, true);
+    if (name=="sort_results")    return new sortKernel(n, rng);
+    ASSERT(0);
+    return NULL;
+}
+
+
+
+int main(int argc, char* argv[]){
+
+    uint32_t const n= (argc>1) ? atoi(argv[1]) : 1000000;
+    uint32_t const reps= std::max( (argc>2) ? atoi(argv[2]) : 5, 1 );
+    std::string const filter= (argc>3) ? argv[3] : "";
+    std::string const outFn= (argc>4) ? argv[4] : "";
+
+    std::ostringstream out;
+    out<<"{\n";
+    out<<"  \"n\": "<<n<<",\n";
+    out<<"  \"reps\": "<<reps<<",\n";
+    out<<"  \"kernels\": {";
+
+    bool first= true;
+    for (uint32_t iKernel= 0; iKernel<numKernels_; ++iKernel){
+
+        std::string const name= kernelNames_[iKernel];
+        if (name.find(filter)==std::string::npos)
+            continue;
+
+        // the same input for a kernel whichever others are run
+        boost::mt19937 rng(43 + iKernel);
+        benchKernel *kernel= createKernel(name, n, rng);
+
+        kernel->prepare();
+        sink_+= kernel->run();
+
+        std::vector<double> times(reps);
+        for (uint32_t iRep= 0; iRep<reps; ++iRep){
+            kernel->prepare();
+            double const t0= latency::now();
+            sink_+= kernel->run();
+            times[iRep]= latency::now() - t0;
+        }
+        std::sort(times.begin(), times.end());
+
+        double const numEl= std::max(kernel->numElements(), static_cast<uint64_t>(1));
+        double const minNs= times[0]*1e9/numEl;
+        double const medianNs= times[reps/2]*1e9/numEl;
+        double const bytes= kernel->bytesPerElement();
+
+        std::cerr<<(boost::format("kernel_bench: %-16s %10d el  %8.3f ns/el (median %8.3f)  %6.2f B/el  %7.3f GB/s\n")
+                    % name % kernel->numElements() % minNs % medianNs % bytes % (minNs>0 ? bytes/minNs : 0));
+
+        out<<(first ? "\n" : ",\n"); first= false;
+        out<<"    \""<<name<<"\": "
+           <<(boost::format("{\"numElements\": %d, \"bytesPerElement\": %.3f, \"minNsPerElement\": %.4f, \"medianNsPerElement\": %.4f, \"minGBps\": %.3f}")
+              % kernel->numElements() % bytes % minNs % medianNs % (minNs>0 ? bytes/minNs : 0));
+
+        delete kernel;
+    }
+    out<<"\n  }\n}\n";
+
+    if (outFn.length()>0){
+        std::ofstream f(outFn.c_str());
+        f<<out.str();
+    } else
+        std::cout<<out.str();
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
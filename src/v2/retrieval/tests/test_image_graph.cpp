@@ -0,0 +1,229 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/filesystem.hpp>
+
+#include "image_graph.h"
+#include "macros.h"
+#include "proto_db.h"
+#include "proto_db_file.h"
+#include "proto_index.h"
+#include "query.h"
+#include "spatial_verif_v2.h"
+#include "synthetic_index.h"
+#include "tfidf_v2.h"
+#include "util.h"
+
+
+
+// counts the queries which don't reuse verified pairs (see imageGraph::computeResumable),
+// and if exitAfter>0 stops the process abruptly after that many, as if it were killed
+class killedSpatialVerif : public spatialVerifV2 {
+    
+    public:
+        
+        killedSpatialVerif( retrieverFromIter const &firstRetriever, protoIndex const *iidx, protoIndex const *fidx,
+                            spatParams spatParamsObj, uint32_t exitAfter= 0 )
+            : spatialVerifV2(firstRetriever, iidx, fidx, true, NULL, NULL, NULL, spatParamsObj),
+              exitAfter_(exitAfter), numQueries_(0) {}
+        
+        using spatialVerifV2::queryExecute;
+        
+        void
+            queryExecute( rr::indexEntry &queryRep, std::vector<indScorePair> &queryRes, uint32_t toReturn= 0 ) const {
+                if (++numQueries_ == exitAfter_)
+                    _exit(0);
+                spatialVerifV2::queryExecute(queryRep, queryRes, toReturn);
+            }
+        
+        uint32_t
+            numQueries() const { return numQueries_; }
+    
+    private:
+        uint32_t const exitAfter_;
+        mutable boost::atomic<uint32_t> numQueries_;
+};
+
+
+
+// documents in ignoreDocs are neither verified nor returned, the next ones in the first-stage ranking are verified instead
+void
+testIgnoreDocs( tfidfV2 const &tfidfObj, spatialVerifV2 const &spatVerif, uint32_t spatialDepth, uint32_t numDocs ){
+    
+    std::cout<<"ignoreDocs: \t"; std::cout.flush();
+    
+    uint32_t numTested= 0;
+    
+    for (uint32_t docID= 0; docID<numDocs; docID+= 7){
+        
+        rr::indexEntry queryRep;
+        spatVerif.getQueryRep( query(docID, true), queryRep );
+        
+        std::vector<indScorePair> firstRes;
+        static_cast<retriever const &>(tfidfObj).queryExecute( query(docID, true), firstRes );
+        
+        std::vector<indScorePair> res0, res1;
+        std::map<uint32_t, homography> Hs0, Hs1;
+        uint32_t depth0, depth1;
+        rr::indexEntry queryRep0(queryRep);
+        spatVerif.spatialQueryExecute( queryRep0, res0, &Hs0, NULL, 0, true, false, &depth0 );
+        ASSERT( depth0==spatialDepth );
+        
+        // ignore the verified ones, apart from the query itself
+        std::set<uint32_t> ignoreDocs;
+        for (std::map<uint32_t, homography>::const_iterator it= Hs0.begin(); it!=Hs0.end(); ++it)
+            if (it->first!=docID)
+                ignoreDocs.insert(it->first);
+        if (ignoreDocs.empty())
+            continue;
+        ++numTested;
+        
+        spatVerif.spatialQueryExecute( queryRep, res1, &Hs1, &ignoreDocs, 0, true, false, &depth1 );
+        
+        ASSERT( depth1==spatialDepth );
+        ASSERT( res1.size() + ignoreDocs.size() == res0.size() );
+        for (uint32_t i= 0; i<res1.size(); ++i)
+            ASSERT( ignoreDocs.count(res1[i].first)==0 );
+        
+        // only the top of the first-stage ranking, without ignoreDocs, is verified
+        std::set<uint32_t> canVerify;
+        for (uint32_t i= 0; i<firstRes.size() && canVerify.size()<spatialDepth; ++i)
+            if (ignoreDocs.count(firstRes[i].first)==0)
+                canVerify.insert(firstRes[i].first);
+        for (std::map<uint32_t, homography>::const_iterator it= Hs1.begin(); it!=Hs1.end(); ++it)
+            ASSERT( canVerify.count(it->first)==1 );
+    }
+    
+    ASSERT( numTested>0 );
+    std::cout<<"OK ("<<numTested<<" queries)\n";
+}
+
+
+
+// graph computed by an interrupted and then resumed computeResumable is the same as the one computed in one go
+void
+testResume( tfidfV2 const &tfidfObj, protoIndex const &iidx, protoIndex const &fidx, spatParams const &spatParamsObj,
+            std::string const &tempPrefix, uint32_t numDocs ){
+    
+    std::cout<<"computeResumable: \t"; std::cout.flush();
+    
+    uint32_t const batchSize= 8, numThreads= 3;
+    double const scoreThr= 2.0;
+    
+    std::string const singleFn= tempPrefix + "_single.v2bin";
+    uint32_t numQueries;
+    {
+        killedSpatialVerif spatVerif(tfidfObj, &iidx, &fidx, spatParamsObj);
+        imageGraph imGraph;
+        imGraph.computeResumable(singleFn, numDocs, spatVerif, 0, scoreThr, batchSize, numThreads);
+        numQueries= spatVerif.numQueries();
+    }
+    // some documents were queried reusing the pairs, so with ignoreDocs
+    ASSERT( numQueries>0 && numQueries<numDocs );
+    imageGraph single(singleFn);
+    ASSERT( single.graph_.size()>0 );
+    
+    std::string const resumedFn= tempPrefix + "_resumed.v2bin";
+    
+    // interrupted half way
+    pid_t const pid= fork();
+    ASSERT( pid>=0 );
+    if (pid==0){
+        killedSpatialVerif spatVerif(tfidfObj, &iidx, &fidx, spatParamsObj, numQueries/2);
+        imageGraph imGraph;
+        imGraph.computeResumable(resumedFn, numDocs, spatVerif, 0, scoreThr, batchSize, numThreads);
+        // shouldn't get here
+        _exit(1);
+    }
+    int status;
+    ASSERT( waitpid(pid, &status, 0)==pid );
+    ASSERT( WIFEXITED(status) && WEXITSTATUS(status)==0 );
+    ASSERT( !boost::filesystem::exists(resumedFn) );
+    ASSERT( boost::filesystem::exists(resumedFn + ".status") );
+    
+    // resume
+    {
+        killedSpatialVerif spatVerif(tfidfObj, &iidx, &fidx, spatParamsObj);
+        imageGraph imGraph;
+        imGraph.computeResumable(resumedFn, numDocs, spatVerif, 0, scoreThr, batchSize, numThreads);
+        // the finished batches weren't redone
+        ASSERT( spatVerif.numQueries() < numQueries );
+    }
+    ASSERT( !boost::filesystem::exists(resumedFn + ".status") );
+    imageGraph resumed(resumedFn);
+    ASSERT( resumed.graph_==single.graph_ );
+    
+    uint32_t numEdges= 0;
+    for (imageGraph::imageGraphType::const_iterator it= single.graph_.begin(); it!=single.graph_.end(); ++it)
+        numEdges+= it->second.size();
+    std::cout<<"OK ("<<numEdges<<" edges)\n";
+    
+    boost::filesystem::remove(singleFn);
+    boost::filesystem::remove(resumedFn);
+}
+
+
+
+int main(){
+    
+    std::string const tempPrefix= util::getTempFileName("", "test_image_graph_");
+    std::string const dsetFn= tempPrefix + "_dset.v2bin";
+    std::string const iidxFn= tempPrefix + "_iidx.v2bin";
+    std::string const fidxFn= tempPrefix + "_fidx.v2bin";
+    
+    // groups of 5 images of the same scene, so there is something to verify
+    uint32_t const numDocs= 60;
+    syntheticParams params(numDocs, 2000, 200);
+    params.dupFraction= 0.5;
+    buildIndex::buildSynthetic(params, dsetFn, iidxFn, fidxFn, "", 2);
+    
+    {
+        protoDbFile dbFidx_file(fidxFn);
+        protoDbInRam dbFidx(dbFidx_file, false);
+        protoIndex fidx(dbFidx, false);
+        
+        protoDbFile dbIidx_file(iidxFn);
+        protoDbInRam dbIidx(dbIidx_file, false);
+        protoIndex iidx(dbIidx, false);
+        
+        tfidfV2 tfidfObj(&iidx, &fidx);
+        
+        uint32_t const spatialDepth= 12;
+        spatParams spatParamsObj(spatialDepth);
+        spatialVerifV2 spatVerif(tfidfObj, &iidx, &fidx, true, NULL, NULL, NULL, spatParamsObj);
+        
+        testIgnoreDocs(tfidfObj, spatVerif, spatialDepth, numDocs);
+        testResume(tfidfObj, iidx, fidx, spatParamsObj, tempPrefix, numDocs);
+    }
+    
+    boost::filesystem::remove(tempPrefix);
+    boost::filesystem::remove(dsetFn);
+    boost::filesystem::remove(iidxFn);
+    boost::filesystem::remove(fidxFn);
+    
+    std::cout<<"\nAll OK\n";
+    
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+==== Author:
+
+Relja Arandjelovic (relja@robots.ox.ac.uk)
+Visual Geometry Group,
+Department of Engineering Science
+University of Oxford
+
+==== Copyright:
+
+The library belongs to Relja Arandjelovic and the University of Oxford.
+No usage or redistribution is allowed without explicit permission.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "index_entry.pb.h"
+#include "macros.h"
+#include "near_dup.h"
+#include "proto_db.h"
+#include "proto_index.h"
+#include "query.h"
+#include "same_random.h"
+#include "util.h"
+
+
+
+// fidx in RAM: one entry with the words of each document
+class protoDbWords : public protoDb {
+
+    public:
+
+        protoDbWords( std::vector< std::vector<uint32_t> > const &words ) : data_(words.size()) {
+            for (uint32_t docID= 0; docID<words.size(); ++docID){
+                rr::indexEntry entry;
+                for (uint32_t i= 0; i<words[docID].size(); ++i)
+                    entry.add_id(words[docID][i]);
+                data_[docID].resize(1);
+                entry.SerializeToString(&data_[docID][0]);
+            }
+        }
+
+        uint32_t
+            numIDs() const { return data_.size(); }
+
+        void
+            getData( uint32_t ID, std::vector<std::string> &data ) const { data= data_[ID]; }
+
+    private:
+        std::vector< std::vector<std::string> > data_;
+        DISALLOW_COPY_AND_ASSIGN(protoDbWords)
+};
+
+
+
+// "confirms" the pairs with an even docID2, so that what gets through is known
+class evenConfirmer : public nearDupConfirmer {
+
+    public:
+
+        evenConfirmer() : nearDupConfirmer(10) {}
+
+        uint32_t
+            numMatches( query const &queryObj, uint32_t docID2 ) const {
+                return (docID2%2==0) ? 20 : 1;
+            }
+};
+
+
+
+void
+randomWords( sameRandomStreamUint32 &randStream, uint32_t n, std::vector<uint32_t> &words ){
+    words.clear();
+    for (uint32_t i= 0; i<n; ++i)
+        words.push_back( randStream.getNext0ToN(1000000) );
+}
+
+
+
+int main(){
+
+    sameRandomUint32 rand(1000000, 43);
+    sameRandomStreamUint32 randStream(rand);
+
+    // random documents (no near duplicates among them) with planted groups:
+    //   A: identical word sets (also with repeated words and in a different order)
+    //   B: a pair with 90% of the words in common
+    //   C: more identical documents than maxBucketSize
+    //   small: identical but with fewer than minWords words, so ignored
+    uint32_t const numDocs= 400, numWords= 200;
+    std::vector< std::vector<uint32_t> > words(numDocs);
+    for (uint32_t docID= 0; docID<numDocs; ++docID)
+        randomWords(randStream, numWords, words[docID]);
+
+    std::vector<uint32_t> groupA, groupC;
+    groupA.push_back(10); groupA.push_back(50); groupA.push_back(120);
+    for (uint32_t i= 1; i<groupA.size(); ++i){
+        words[groupA[i]].assign( words[groupA[0]].rbegin(), words[groupA[0]].rend() );
+        words[groupA[i]].push_back( words[groupA[0]][i] );
+    }
+
+    uint32_t const B1= 20, B2= 21;
+    words[B2]= words[B1];
+    for (uint32_t i= 0; i<numWords/10; ++i)
+        words[B2][i]= 1000000 + i;
+
+    for (uint32_t docID= 200; docID<350; ++docID){
+        groupC.push_back(docID);
+        words[docID]= words[groupC[0]];
+    }
+
+    uint32_t const small1= 30, small2= 31;
+    randomWords(randStream, 5, words[small1]);
+    words[small2]= words[small1];
+
+    protoDbWords db(words);
+    protoIndex fidx(db, false);
+
+    nearDupParams params;
+    ASSERT( groupC.size() > params.maxBucketSize );
+
+    // ------- all pairs, with the maxBucketSize limit
+
+    std::cout<<"getAllPairs, maxBucketSize= "<<params.maxBucketSize<<": \t"; std::cout.flush();
+    nearDuplicates nearDup(fidx, numDocs, params, 3);
+    std::vector<nearDupPair> pairs;
+    nearDup.getAllPairs(pairs, NULL, 3);
+
+    std::set< std::pair<uint32_t, uint32_t> > expected;
+    for (uint32_t i= 0; i<groupA.size(); ++i)
+        for (uint32_t j= i+1; j<groupA.size(); ++j)
+            expected.insert( std::make_pair(groupA[i], groupA[j]) );
+    expected.insert( std::make_pair(B1, B2) );
+    // the bucket of C is too big, so only the pairs with its first document
+    for (uint32_t i= 1; i<groupC.size(); ++i)
+        expected.insert( std::make_pair(groupC[0], groupC[i]) );
+
+    ASSERT( pairs.size()==expected.size() );
+    std::set< std::pair<uint32_t, uint32_t> >::const_iterator itE= expected.begin();
+    for (uint32_t i= 0; i<pairs.size(); ++i, ++itE){
+        // sorted, and the same as expected
+        ASSERT( pairs[i].docID1==itE->first && pairs[i].docID2==itE->second );
+        ASSERT( pairs[i].numMatches==0 );
+        if (pairs[i].docID1==B1){
+            ASSERT( pairs[i].jaccard>=params.jaccardThr && pairs[i].jaccard<1.0f );
+        } else {
+            ASSERT( pairs[i].jaccard==1.0f );
+        }
+    }
+    std::cout<<"OK ("<<pairs.size()<<" pairs)\n";
+
+    // ------- clusters
+
+    std::cout<<"getClusters: \t"; std::cout.flush();
+    std::vector< std::vector<uint32_t> > clusters;
+    nearDuplicates::getClusters(pairs, clusters);
+    // in decreasing order of size, C is complete even though only the pairs with its first document were found
+    ASSERT( clusters.size()==3 );
+    ASSERT( clusters[0]==groupC );
+    ASSERT( clusters[1]==groupA );
+    ASSERT( clusters[2].size()==2 && clusters[2][0]==B1 && clusters[2][1]==B2 );
+    std::cout<<"OK\n";
+
+    // ------- all pairs without the limit
+
+    std::cout<<"getAllPairs, no limit: \t"; std::cout.flush();
+    nearDupParams paramsNoLimit;
+    paramsNoLimit.maxBucketSize= numDocs;
+    nearDuplicates nearDupNoLimit(fidx, numDocs, paramsNoLimit, 3);
+    std::vector<nearDupPair> pairsNoLimit;
+    nearDupNoLimit.getAllPairs(pairsNoLimit, NULL, 3);
+    ASSERT( pairsNoLimit.size() == groupA.size()*(groupA.size()-1)/2 + 1 + groupC.size()*(groupC.size()-1)/2 );
+    std::vector< std::vector<uint32_t> > clustersNoLimit;
+    nearDuplicates::getClusters(pairsNoLimit, clustersNoLimit);
+    ASSERT( clustersNoLimit==clusters );
+    std::cout<<"OK ("<<pairsNoLimit.size()<<" pairs)\n";
+
+    // ------- confirmation
+
+    std::cout<<"getAllPairs, confirmed: \t"; std::cout.flush();
+    evenConfirmer confirmer;
+    std::vector<nearDupPair> pairsConfirmed;
+    nearDup.getAllPairs(pairsConfirmed, &confirmer, 3);
+    uint32_t iConfirmed= 0;
+    for (uint32_t i= 0; i<pairs.size(); ++i)
+        if (pairs[i].docID2%2==0){
+            ASSERT( iConfirmed<pairsConfirmed.size() );
+            ASSERT( pairsConfirmed[iConfirmed].docID1==pairs[i].docID1 && pairsConfirmed[iConfirmed].docID2==pairs[i].docID2 );
+            ASSERT( pairsConfirmed[iConfirmed].numMatches==20 );
+            ++iConfirmed;
+        }
+    ASSERT( iConfirmed==pairsConfirmed.size() && iConfirmed>0 );
+    std::cout<<"OK ("<<pairsConfirmed.size()<<" pairs)\n";
+
+    // ------- duplicates of a query
+
+    std::cout<<"getDuplicates: \t"; std::cout.flush();
+    std::vector<nearDupPair> dups;
+
+    nearDup.getDuplicates( query(groupA[1], true), dups );
+    ASSERT( dups.size()==2 );
+    // equal Jaccard so by docID
+    ASSERT( dups[0].docID1==groupA[1] && dups[0].docID2==groupA[0] && dups[0].jaccard==1.0f );
+    ASSERT( dups[1].docID1==groupA[1] && dups[1].docID2==groupA[2] && dups[1].jaccard==1.0f );
+
+    nearDup.getDuplicates( query(B1, true), dups );
+    ASSERT( dups.size()==1 && dups[0].docID2==B2 );
+
+    // the maxBucketSize limit is only for getAllPairs
+    nearDup.getDuplicates( query(groupC[5], true), dups );
+    ASSERT( dups.size()==groupC.size()-1 );
+    for (uint32_t i= 0, iC= 0; i<dups.size(); ++i, ++iC){
+        if (groupC[iC]==groupC[5]) ++iC;
+        ASSERT( dups[i].docID2==groupC[iC] );
+    }
+
+    nearDup.getDuplicates( query(groupC[5], true), dups, &confirmer );
+    ASSERT( groupC[5]%2==1 && dups.size()==groupC.size()/2 );
+    for (uint32_t i= 0; i<dups.size(); ++i)
+        ASSERT( dups[i].docID2%2==0 && dups[i].numMatches==20 );
+
+    nearDup.getDuplicates( query(0, true), dups );
+    ASSERT( dups.empty() );
+    nearDup.getDuplicates( query(small1, true), dups );
+    ASSERT( dups.empty() );
+
+    // external, from the query's words as written by processImage
+    std::string const compDataFn= util::getTempFileName();
+    {
+        rr::indexEntry queryRep;
+        for (uint32_t i= 0; i<words[B1].size(); ++i)
+            queryRep.add_id(words[B1][i]);
+        std::ofstream out(compDataFn.c_str(), std::ios::binary);
+        queryRep.SerializeToOstream(&out);
+    }
+    nearDup.getDuplicates( query(0, false, compDataFn), dups );
+    boost::filesystem::remove(compDataFn);
+    ASSERT( dups.size()==2 );
+    ASSERT( dups[0].docID1==0 && dups[0].docID2==B1 && dups[0].jaccard==1.0f );
+    ASSERT( dups[1].docID2==B2 );
+    std::cout<<"OK\n";
+
+    std::cout<<"\nAll OK\n";
+
+    google::protobuf::ShutdownProtobufLibrary();
+    return 0;
+}
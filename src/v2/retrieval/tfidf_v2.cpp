@@ -123,6 +123,26 @@ tfidfV2::queryExecute( rr::indexEntry &queryRep, ueIterator *ueIter, std::vector
 
 
 
+void
+tfidfV2::queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn ) const {
+    
+    // weight query BoWs with idf
+    for (uint32_t i= 0; i<queryReps.size(); ++i)
+        weight(queryReps[i]);
+    
+    batchEntries entries;
+    iidx_->getBatchEntries(queryReps, entries);
+    
+    std::vector< std::vector<double> > scores;
+    weighterV2::queryExecuteBatch(queryReps, entries, idf_, docL2_, scores);
+    
+    queryRes.resize( queryReps.size() );
+    for (uint32_t i= 0; i<queryReps.size(); ++i)
+        retriever::sortResults( scores[i], queryRes[i], toReturn );
+}
+
+
+
 void
 tfidfV2::weightStatic(rr::indexEntry &entry, double *weight, std::vector<double> const *idf) {
     
@@ -46,6 +46,12 @@ class tfidfV2 : public retrieverFromIter {
         void
             queryExecute( rr::indexEntry &queryRep, ueIterator *ueIter, std::vector<double> &scores ) const;
         
+        using retrieverFromIter::queryExecuteBatch;
+        
+        // single pass over each shared posting list for all queries (weighterV2::queryExecuteBatch)
+        void
+            queryExecuteBatch( std::vector<rr::indexEntry> &queryReps, std::vector< std::vector<indScorePair> > &queryRes, uint32_t toReturn= 0 ) const;
+        
         inline uint32_t
             numDocs() const {
                 return numDocs_;
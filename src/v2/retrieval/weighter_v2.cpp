@@ -16,6 +16,10 @@ No usage or redistribution is allowed without explicit permission.
 
 #include <math.h>
 
+#include <algorithm>
+
+#include "latency.h"
+
 
 
 void
@@ -37,6 +41,10 @@ weighterV2::queryExecute(
     
     for (int iQueryWord= 0; iQueryWord < queryRep.id_size();){
         
+        // out of time: the scores are from the words so far
+        if (latency::pastDeadline())
+            break;
+        
         wordID= queryRep.id(iQueryWord);
         queryW= 0.0;
         
@@ -109,6 +117,144 @@ weighterV2::queryExecute(
 
 
 
+void
+weighterV2::queryExecuteBatch(
+        std::vector<rr::indexEntry> const &queryReps,
+        batchEntries const &entries,
+        std::vector<double> const &idf,
+        std::vector<double> const &docL2,
+        std::vector< std::vector<double> > &scores,
+        double defaultScore ){
+    
+    uint32_t const numQ= queryReps.size();
+    
+    scores.resize(numQ);
+    std::vector<double> queryL2(numQ, 0.0);
+    
+    // (wordID, (iQuery, widf)) for all unique words of all queries
+    std::vector< std::pair<uint32_t, std::pair<uint32_t, double> > > words;
+    
+    for (uint32_t iQuery= 0; iQuery<numQ; ++iQuery){
+        
+        rr::indexEntry const &queryRep= queryReps[iQuery];
+        ASSERT(queryRep.id_size()==queryRep.weight_size());
+        
+        scores[iQuery].clear();
+        scores[iQuery].resize( docL2.size(), 0.0 );
+        
+        for (int iQueryWord= 0; iQueryWord < queryRep.id_size();){
+            
+            uint32_t wordID= queryRep.id(iQueryWord);
+            double queryW= 0.0;
+            bool keep= false;
+            
+            for (; iQueryWord < queryRep.id_size() && queryRep.id(iQueryWord)==wordID;
+                   ++iQueryWord){
+                queryW+= queryRep.weight(iQueryWord);
+                keep= keep || queryRep.keep_size()==0 || queryRep.keep(iQueryWord);
+            }
+            
+            queryL2[iQuery]+= queryW * queryW;
+            if (keep)
+                words.push_back( std::make_pair(wordID, std::make_pair(iQuery, idf[wordID] * queryW)) );
+        }
+    }
+    
+    // words in increasing order, so the scores are accumulated in the same order as in queryExecute
+    std::sort(words.begin(), words.end());
+    
+    std::vector<double*> wordScores;
+    std::vector<double> widfs;
+    
+    for (uint32_t iWord= 0; iWord < words.size();){
+        
+        uint32_t const wordID= words[iWord].first;
+        
+        // all queries which contain this word
+        wordScores.clear();
+        widfs.clear();
+        for (; iWord < words.size() && words[iWord].first==wordID; ++iWord){
+            wordScores.push_back( &scores[ words[iWord].second.first ][0] );
+            widfs.push_back( words[iWord].second.second );
+        }
+        uint32_t const numWQ= wordScores.size();
+        
+        std::vector<rr::indexEntry> const *wordEntries= entries.getEntries(wordID);
+        ASSERT(wordEntries!=NULL);
+        
+        for (uint32_t iEntry= 0; iEntry<wordEntries->size(); ++iEntry){
+            rr::indexEntry const &entry= wordEntries->at(iEntry);
+            uint32_t const *itID= entry.id().data();
+            uint32_t const *endID= itID + entry.id_size();
+            
+            if (entry.weight_size()!=0) {
+                
+                ASSERT( entry.id_size() == entry.weight_size() );
+                float const *itW= entry.weight().data();
+                for (; itID!=endID; ++itW, ++itID)
+                    for (uint32_t iWQ= 0; iWQ<numWQ; ++iWQ)
+                        wordScores[iWQ][ *itID ]+= *itW * widfs[iWQ];
+                
+            } else if (entry.count_size()!=0) {
+                
+                ASSERT( entry.id_size() == entry.count_size() );
+                unsigned const *itC= entry.count().data();
+                for (; itID!=endID; ++itC, ++itID)
+                    for (uint32_t iWQ= 0; iWQ<numWQ; ++iWQ)
+                        wordScores[iWQ][ *itID ]+= static_cast<double>(*itC) * widfs[iWQ];
+                
+            } else {
+                
+                for (; itID!=endID; ++itID)
+                    for (uint32_t iWQ= 0; iWQ<numWQ; ++iWQ)
+                        wordScores[iWQ][ *itID ]+= widfs[iWQ];
+                
+            }
+        }
+    }
+    
+    for (uint32_t iQuery= 0; iQuery<numQ; ++iQuery){
+        
+        double queryL2sqrt= sqrt(queryL2[iQuery]);
+        if (queryL2sqrt <= 1e-7)
+            queryL2sqrt= 1.0;
+        double defaultScoreByNorm= defaultScore / queryL2sqrt;
+        
+        std::vector<double>::const_iterator docL2Iter= docL2.begin();
+        for (std::vector<double>::iterator itS= scores[iQuery].begin(); itS!=scores[iQuery].end(); ++itS, ++docL2Iter)
+            (*itS)= (*itS) / ( queryL2sqrt * (*docL2Iter) ) + defaultScoreByNorm;
+    }
+    
+}
+
+
+
+// max over the moving sums (of averageW consecutive scales) of the scale histogram
+static inline float
+wgcMaxMovingSum( float const *ssIter, uint16_t numScales, uint8_t averageW ){
+    
+    float const *ssFirst= ssIter;
+    float const *ssEnd= ssIter + numScales;
+    float sum= 0;
+    
+    // first sum
+    float const *ssFirstEnd= ssIter + averageW;
+    for (; ssIter!=ssFirstEnd; ++ssIter)
+        sum+= *ssIter;
+    float maxSum= sum;
+    
+    // other sums
+    for(; ssIter!=ssEnd; ++ssIter, ++ssFirst){
+        sum+= *ssIter - *ssFirst;
+        if (sum > maxSum)
+            maxSum= sum;
+    }
+    
+    return maxSum;
+}
+
+
+
 void
 weighterV2::queryExecuteWGC(
         rr::indexEntry const &queryRep,
@@ -173,30 +319,104 @@ weighterV2::queryExecuteWGC(
     scores.resize( docL2.size(), 0.0 );
     
     std::vector<double>::const_iterator docL2Iter= docL2.begin();
-    std::vector<float>::const_iterator ssIter= scoresScale.begin();
+    float const *ssIter= scoresScale.empty() ? NULL : &scoresScale[0];
     uint8_t averageW= static_cast<uint8_t>( std::max(std::ceil(static_cast<double>(numScales)/16), 1.0) );
     
     
-    for (std::vector<double>::iterator itS= scores.begin(); itS!=scores.end(); ++itS, ++docL2Iter){
+    for (std::vector<double>::iterator itS= scores.begin(); itS!=scores.end(); ++itS, ++docL2Iter, ssIter+= numScales){
         // moving average
-        std::vector<float>::const_iterator ssFirst= ssIter;
-        std::vector<float>::const_iterator ssEnd= ssIter + numScales;
-        float sum= 0;
-        
-        // first sum
-        std::vector<float>::const_iterator ssFirstEnd= ssIter + averageW;
-        for (; ssIter!=ssFirstEnd; ++ssIter)
-            sum+= *ssIter;
-        *itS= sum;
-        
-        // other sums
-        for(; ssIter!=ssEnd; ++ssIter, ++ssFirst){
-            sum+= *ssIter - *ssFirst;
-            if (sum > *itS)
-                *itS= sum;
+        *itS= wgcMaxMovingSum(ssIter, numScales, averageW);
+        (*itS)= (*itS)/averageW / ( queryL2sqrt * (*docL2Iter) ) + defaultScoreByNorm;
+    }
+    
+}
+
+
+
+void
+weighterV2::queryExecuteWGCSparse(
+        rr::indexEntry const &queryRep,
+        ueIterator *ueIter,
+        std::vector<double> const &idf,
+        std::vector<double> const &docL2,
+        std::vector<double> &scores,
+        uint16_t numScales,
+        double defaultScore ){
+    
+    ASSERT(queryRep.id_size()==queryRep.weight_size());
+    ASSERT(queryRep.has_qel_scale());
+    std::string const &queryScaleStr= queryRep.qel_scale();
+    ASSERT(static_cast<uint32_t>(queryRep.id_size())==queryScaleStr.length());
+    unsigned char const *itQueryScale= reinterpret_cast<unsigned char const*>(queryScaleStr.c_str());
+    
+    // docSlot[docID] is the index of the document's histogram in the arena
+    uint32_t const noSlot= ~static_cast<uint32_t>(0);
+    std::vector<uint32_t> docSlot( docL2.size(), noSlot );
+    std::vector<uint32_t> touched;
+    std::vector<float> arena;
+    
+    uint16_t scaleStep= std::ceil(static_cast<double>(255*2) / numScales);
+    
+    double queryL2= 0.0, queryW= 0.0, widf;
+    uint32_t wordID;
+    
+    for (int iQueryWord= 0; iQueryWord < queryRep.id_size(); ++iQueryWord, ++itQueryScale, ueIter->increment()){
+        
+        wordID= queryRep.id(iQueryWord);
+        queryW= queryRep.weight(iQueryWord);
+        uint16_t queryScale= static_cast<uint16_t>(*itQueryScale) + 255;
+        
+        widf= idf[wordID] * queryW;
+        queryL2+= queryW * queryW;
+        
+        ASSERT( static_cast<uint32_t>(iQueryWord) == ueIter->getInd() );
+        std::vector<rr::indexEntry> *entries= ueIter->getEntries();
+        
+        for (uint32_t iEntry= 0; iEntry<entries->size(); ++iEntry){
+            rr::indexEntry const &entry= entries->at(iEntry);
+            uint32_t const *itID= entry.id().data();
+            uint32_t const *endID= itID + entry.id_size();
+            
+            ASSERT(entry.has_qel_scale());
+            std::string const &entryScaleStr= entry.qel_scale();
+            ASSERT(static_cast<uint32_t>(entry.id_size())==entryScaleStr.length());
+            unsigned char const *itEntryScale= reinterpret_cast<unsigned char const*>(entryScaleStr.c_str());
+            
+            ASSERT(entry.weight_size()==0 && entry.count_size()==0); // TODO
+            
+            for (; itID!=endID; ++itID, ++itEntryScale){
+                uint32_t &slot= docSlot[*itID];
+                if (slot==noSlot){
+                    slot= touched.size();
+                    touched.push_back(*itID);
+                    arena.resize( arena.size() + numScales, 0.0f );
+                }
+                // same additions in the same order as queryExecuteWGC, so the sums are identical
+                arena[ static_cast<uint64_t>(slot) * numScales + (queryScale - *itEntryScale)/scaleStep ]+= widf;
+            }
         }
         
+    }
+    
+    double queryL2sqrt= sqrt(queryL2);
+    if (queryL2sqrt <= 1e-7)
+        queryL2sqrt= 1.0;
+    double defaultScoreByNorm= defaultScore / queryL2sqrt;
+    
+    uint8_t averageW= static_cast<uint8_t>( std::max(std::ceil(static_cast<double>(numScales)/16), 1.0) );
+    
+    // documents which are not hit have an all-zero histogram
+    scores.clear();
+    scores.resize( docL2.size(), 0.0 );
+    
+    std::vector<double>::const_iterator docL2Iter= docL2.begin();
+    for (std::vector<double>::iterator itS= scores.begin(); itS!=scores.end(); ++itS, ++docL2Iter)
         (*itS)= (*itS)/averageW / ( queryL2sqrt * (*docL2Iter) ) + defaultScoreByNorm;
+    
+    for (uint32_t iSlot= 0; iSlot<touched.size(); ++iSlot){
+        uint32_t const docID= touched[iSlot];
+        double maxSum= wgcMaxMovingSum(&arena[static_cast<uint64_t>(iSlot) * numScales], numScales, averageW);
+        scores[docID]= maxSum/averageW / ( queryL2sqrt * docL2[docID] ) + defaultScoreByNorm;
     }
     
 }
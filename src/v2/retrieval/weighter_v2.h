@@ -34,6 +34,16 @@ void
                   std::vector<double> &scores,
                   double defaultScore= 0.0 );
 
+// scores all queries in a single pass over each posting list of entries (see protoIndex::getBatchEntries),
+// scores[i] is the same as queryExecute for queryReps[i]
+void
+    queryExecuteBatch( std::vector<rr::indexEntry> const &queryReps,
+                       batchEntries const &entries,
+                       std::vector<double> const &idf,
+                       std::vector<double> const &docL2,
+                       std::vector< std::vector<double> > &scores,
+                       double defaultScore= 0.0 );
+
 // queryRep.id should be sorted for efficiency
 void
     queryExecuteWGC( rr::indexEntry const &queryRep,
@@ -44,6 +54,17 @@ void
                      uint16_t numScales,
                      double defaultScore= 0.0 );
 
+// same output as queryExecuteWGC but scale histograms only exist for documents hit by the postings
+// (kept in an arena, in order of the first hit), so memory is numScales floats per hit document instead of per document
+void
+    queryExecuteWGCSparse( rr::indexEntry const &queryRep,
+                           ueIterator *ueIter,
+                           std::vector<double> const &idf,
+                           std::vector<double> const &docL2,
+                           std::vector<double> &scores,
+                           uint16_t numScales,
+                           double defaultScore= 0.0 );
+
 };
 
 
@@ -25,7 +25,7 @@ No usage or redistribution is allowed without explicit permission.
 
 
 
-wgc::wgc( protoIndex const &iidx, protoIndex const *fidx, std::string wgcFn ) : retrieverFromIter(&iidx, fidx, false, true), iidx_(&iidx) {
+wgc::wgc( protoIndex const &iidx, protoIndex const *fidx, std::string wgcFn, bool sparseHist ) : retrieverFromIter(&iidx, fidx, false, true), iidx_(&iidx), sparseHist_(sparseHist) {
     
     if ( wgcFn.length()>0 && boost::filesystem::exists( wgcFn ) ){
         
@@ -63,7 +63,10 @@ wgc::queryExecute( rr::indexEntry &queryRep, ueIterator *ueIter, std::vector<dou
     tfidfV2::weightStatic(queryRep, NULL, &idf_);
     
     // query
-    weighterV2::queryExecuteWGC(queryRep, ueIter, idf_, docL2_, scores, 128);
+    if (sparseHist_)
+        weighterV2::queryExecuteWGCSparse(queryRep, ueIter, idf_, docL2_, scores, 128);
+    else
+        weighterV2::queryExecuteWGC(queryRep, ueIter, idf_, docL2_, scores, 128);
     
 }
 
@@ -27,7 +27,9 @@ class wgc : public retrieverFromIter {
     
     public:
         
-        wgc( protoIndex const &iidx, protoIndex const *fidx= NULL, std::string wgcFn= "" );
+        // sparseHist: scale histograms only for documents hit by the query (weighterV2::queryExecuteWGCSparse),
+        // otherwise for all documents; the scores are identical
+        wgc( protoIndex const &iidx, protoIndex const *fidx= NULL, std::string wgcFn= "", bool sparseHist= true );
         
         void
             queryExecute( rr::indexEntry &queryRep, ueIterator *ueIter, std::vector<indScorePair> &queryRes, uint32_t toReturn= 0 ) const;
@@ -53,6 +55,7 @@ class wgc : public retrieverFromIter {
         protoIndex const *iidx_;
         std::vector<double> idf_, docL2_;
         uint32_t numDocs_;
+        bool const sparseHist_;
     
     private:
         DISALLOW_COPY_AND_ASSIGN(wgc)